@@ -0,0 +1,120 @@
+/**
+ * @file    ar013x_context.c
+ * @brief   AR013x CMOS Digital Image Sensor context alternation.
+ *
+ * The pattern is laid over the sensor frame count, frame n gets
+ * pattern[n % length]. The context bit is latched at the start of a frame
+ * like the grouped parameter hold, so after each frame the switch is made
+ * for the frame the settings batches would be first exposed on, see
+ * ar013x_hold.c. That takes a frame count read and, when the context
+ * changes, one register write.
+ *
+ * The frame count wraps at 65536, where patterns with a length that isn't a
+ * power of 2 skip a step.
+ *
+ * @addtogroup AR013x
+ */
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/workqueue.h>
+
+#include "ar013x_context.h"
+#include "ar013x_hold.h"
+#include "ar013x_regs.h"
+#include "cam_i2c.h"
+
+/** context select bit of the digital test register */
+#define CONTEXT_B_BIT 0x2000
+
+/**
+ * The pattern, one bit per frame that is set for B in the low 16 bits and
+ * its length above them. Updated as a whole, so it is read without a lock.
+ */
+static u32 pattern;
+
+#define PATTERN_LEN(p)       ((p) >> 16)
+#define PATTERN_CONTEXT(p, n) (((p) >> ((n) % PATTERN_LEN(p))) & 1)
+
+static void context_switch(struct work_struct *work)
+{
+    u32 p = READ_ONCE(pattern);
+    u16 frame_count, next;
+    int r;
+
+    if (!PATTERN_LEN(p))
+        return;
+
+    // the frame count is of the frame being read out, or of the next one
+    r = read_cam_reg(AR013X_AD_FRAME_COUNT, &frame_count);
+    if (r == 0) {
+        next = frame_count + 1 + ar013x_hold_latency();
+        r = update_cam_reg(AR013X_AD_DIGITAL_TEST, CONTEXT_B_BIT,
+                           PATTERN_CONTEXT(p, next) ? CONTEXT_B_BIT : 0);
+    }
+    if (r != 0)
+        printk_ratelimited(KERN_ERR "prucam: context switch failed: %d\n", r);
+}
+
+static DECLARE_WORK(context_work, context_switch);
+
+int ar013x_context_set_pattern(const char *buf, size_t len)
+{
+    u32 p = 0;
+
+    if (len > AR013X_CONTEXT_PATTERN_MAX)
+        return -EINVAL;
+
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == 'B')
+            p |= 1 << i;
+        else if (buf[i] != 'A')
+            return -EINVAL;
+    }
+
+    WRITE_ONCE(pattern, p | len << 16);
+
+    return 0;
+}
+
+int ar013x_context_pattern(char *buf)
+{
+    u32 p = READ_ONCE(pattern);
+    int len = PATTERN_LEN(p);
+
+    for (int i = 0; i < len; i++)
+        buf[i] = PATTERN_CONTEXT(p, i) ? 'B' : 'A';
+    buf[len] = '\0';
+
+    return len;
+}
+
+bool ar013x_context_active(void)
+{
+    return PATTERN_LEN(READ_ONCE(pattern)) != 0;
+}
+
+void ar013x_context_frame_done(void)
+{
+    // the switch goes over i2c, which can't be done from the interrupt
+    if (PATTERN_LEN(READ_ONCE(pattern)))
+        schedule_work(&context_work);
+}
+
+int ar013x_context_of(u16 frame_count, u16 *context)
+{
+    u32 p = READ_ONCE(pattern);
+
+    if (!PATTERN_LEN(p))
+        return -ENODATA;
+
+    *context = PATTERN_CONTEXT(p, frame_count);
+
+    return 0;
+}
+
+void ar013x_context_stop(void)
+{
+    WRITE_ONCE(pattern, 0);
+    cancel_work_sync(&context_work);
+}
@@ -0,0 +1,70 @@
+/**
+ * @file    ar013x_context.h
+ * @brief   AR013x CMOS Digital Image Sensor context alternation.
+ *
+ * The sensor has two full sets of context registers, A and B, and switches
+ * between them with one bit. With a context pattern set, the driver flips
+ * that bit after every frame, so a stream alternates between the two sets of
+ * settings at the full frame rate, e.g. short and long exposures with the
+ * pattern "AB".
+ *
+ * While it alternates, the sensor could be in either context when a control
+ * is set, so the context and the controls of one context fail with -EBUSY on
+ * their own. A batch, PRUCAM_IOC_S_CONTROLS or the settings attribute, sets
+ * them after a PRUCAM_CID_CONTEXT that picks the context they go to without
+ * switching the sensor, e.g. context=0, coarse_time=100, context=1,
+ * coarse_time=800.
+ *
+ * @addtogroup AR013x
+ */
+
+#ifndef AR013X_CONTEXT_H
+#define AR013X_CONTEXT_H
+
+#include <linux/types.h>
+
+/** longest context pattern */
+#define AR013X_CONTEXT_PATTERN_MAX 16
+
+/**
+ * @brief Sets the context pattern, or stops alternating.
+ * @param buf A and B for the contexts of consecutive frames, repeated.
+ * Empty stops the alternation, and leaves the sensor in the context it is in.
+ * @param len The length of the pattern, at most AR013X_CONTEXT_PATTERN_MAX
+ * @return 0 on success or -EINVAL for a bad pattern.
+ */
+int ar013x_context_set_pattern(const char *buf, size_t len);
+
+/**
+ * @brief Gets the context pattern.
+ * @param buf Set to the pattern, with a terminating null, empty when not
+ * alternating. At least AR013X_CONTEXT_PATTERN_MAX + 1 bytes.
+ * @return The length of the pattern.
+ */
+int ar013x_context_pattern(char *buf);
+
+/**
+ * @brief Tells whether a context pattern is set.
+ */
+bool ar013x_context_active(void);
+
+/**
+ * @brief Called for every frame the PRUs finish, from the interrupt. Switches
+ * the sensor to the context of a later frame when alternating.
+ */
+void ar013x_context_frame_done(void);
+
+/**
+ * @brief Gets the context the pattern gives a frame.
+ * @param frame_count The sensor frame count of the frame
+ * @param context Set to 0 for A or 1 for B
+ * @return 0 on success or -ENODATA when not alternating.
+ */
+int ar013x_context_of(u16 frame_count, u16 *context);
+
+/**
+ * @brief Stops alternating and waits for a switch in progress.
+ */
+void ar013x_context_stop(void);
+
+#endif /* AR013X_CONTEXT_H */
@@ -0,0 +1,512 @@
+/**
+ * @file    ar013x_controls.c
+ * @brief   AR013x CMOS Digital Image Sensor controls, by PRUCAM_CID_* id.
+ *
+ * Every control is a field of a register, or of one register per context.
+ * The sizes are the exception, they are stored as the end of the window and
+ * counted from its start.
+ *
+ * @addtogroup AR013x
+ */
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+
+#include "ar013x_context.h"
+#include "ar013x_controls.h"
+#include "ar013x_hold.h"
+#include "ar013x_regs.h"
+#include "cam_i2c.h"
+
+/** context select bit of the digital test register */
+#define CONTEXT_B_BIT 0x2000
+
+/** no context picked yet, in a batch set while the contexts alternate */
+#define NO_CONTEXT -1
+
+/** @brief Where a control is in the sensor registers */
+struct ar013x_control {
+    /** register of context A, or of both contexts */
+    u16 reg;
+    /** register of context B, 0 when the control is the same for both */
+    u16 reg_cb;
+    /** bits of the register the value is in, 0 for all of them */
+    u16 mask;
+    u16 mask_cb;
+    /** for a size, the register the window starts at, reg is where it ends */
+    u16 start;
+    u16 start_cb;
+    /** largest value, or for a size the largest end of the window */
+    s32 max;
+};
+
+static const struct ar013x_control controls_table[PRUCAM_CID_COUNT] = {
+    // context registers
+    [PRUCAM_CID_CONTEXT] = {
+        .reg = AR013X_AD_DIGITAL_TEST, .mask = CONTEXT_B_BIT, .max = 1,
+    },
+    [PRUCAM_CID_X_SIZE] = {
+        .reg = AR013X_AD_X_ADDR_END, .reg_cb = AR013X_AD_X_ADDR_END_CB,
+        .start = AR013X_AD_X_ADDR_START,
+        .start_cb = AR013X_AD_X_ADDR_START_CB, .max = 0x07FE,
+    },
+    [PRUCAM_CID_Y_SIZE] = {
+        .reg = AR013X_AD_Y_ADDR_END, .reg_cb = AR013X_AD_Y_ADDR_END_CB,
+        .start = AR013X_AD_Y_ADDR_START,
+        .start_cb = AR013X_AD_Y_ADDR_START_CB, .max = 0x03FE,
+    },
+    [PRUCAM_CID_COARSE_TIME] = {
+        .reg = AR013X_AD_COARSE_INTEGRATION_TIME,
+        .reg_cb = AR013X_AD_COARSE_INTEGRATION_TIME_CB, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_FINE_TIME] = {
+        .reg = AR013X_AD_FINE_INTERGRATION_TIME,
+        .reg_cb = AR013X_AD_FINE_INTERGRATION_TIME_CB, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_Y_ODD_INC] = {
+        .reg = AR013X_AD_Y_ODD_INC, .reg_cb = AR013X_AD_Y_ODD_INC_CB,
+        .mask = 0x007F, .mask_cb = 0x007F, .max = 0x7E,
+    },
+    [PRUCAM_CID_GREEN1_GAIN] = {
+        .reg = AR013X_AD_GREEN1_GAIN, .reg_cb = AR013X_AD_GREEN1_GAIN_CB,
+        .mask = 0x00FF, .mask_cb = 0x00FF, .max = 0xFE,
+    },
+    [PRUCAM_CID_BLUE_GAIN] = {
+        .reg = AR013X_AD_BLUE_GAIN, .reg_cb = AR013X_AD_BLUE_GAIN_CB,
+        .mask = 0x00FF, .mask_cb = 0x00FF, .max = 0xFE,
+    },
+    [PRUCAM_CID_RED_GAIN] = {
+        .reg = AR013X_AD_RED_GAIN, .reg_cb = AR013X_AD_RED_GAIN_CB,
+        .mask = 0x00FF, .mask_cb = 0x00FF, .max = 0xFE,
+    },
+    [PRUCAM_CID_GREEN2_GAIN] = {
+        .reg = AR013X_AD_GREEN2_GAIN, .reg_cb = AR013X_AD_GREEN2_GAIN_CB,
+        .mask = 0x00FF, .mask_cb = 0x00FF, .max = 0xFE,
+    },
+    [PRUCAM_CID_GLOBAL_GAIN] = {
+        .reg = AR013X_AD_GLOBAL_GAIN, .reg_cb = AR013X_AD_GLOBAL_GAIN_CB,
+        .mask = 0x00FF, .mask_cb = 0x00FF, .max = 0xFE,
+    },
+    [PRUCAM_CID_ANALOG_GAIN] = { // context A is bits [5:4] & B is [9:8]
+        .reg = AR013X_AD_DIGITAL_TEST, .reg_cb = AR013X_AD_DIGITAL_TEST,
+        .mask = 0x0030, .mask_cb = 0x0300, .max = 0x3,
+    },
+    [PRUCAM_CID_FRAME_LEN_LINES] = {
+        .reg = AR013X_AD_FRAME_LEN_LINES,
+        .reg_cb = AR013X_AD_FRAME_LEN_LINES_CB, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_DIGITAL_BINNING] = { // context A is bits [1:0] & B is [5:4]
+        .reg = AR013X_AD_DIGITAL_BINNING, .reg_cb = AR013X_AD_DIGITAL_BINNING,
+        .mask = 0x0003, .mask_cb = 0x0030, .max = 0x3,
+    },
+
+    // auto exposure
+    [PRUCAM_CID_AE_ENABLE] = {
+        .reg = AR013X_AD_AE_CTRL_REG, .mask = 0x0001, .max = 1,
+    },
+    [PRUCAM_CID_AE_AG_EN] = {
+        .reg = AR013X_AD_AE_CTRL_REG, .mask = 0x0002, .max = 1,
+    },
+    [PRUCAM_CID_AE_DG_EN] = {
+        .reg = AR013X_AD_AE_CTRL_REG, .mask = 0x0010, .max = 1,
+    },
+    [PRUCAM_CID_AE_MIN_ANA_GAIN] = {
+        .reg = AR013X_AD_AE_CTRL_REG, .mask = 0x0060, .max = 0x3,
+    },
+    [PRUCAM_CID_AE_ROI_X_START_OFFSET] = {
+        .reg = AR013X_AD_AE_ROI_X_START_OFFSET, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_ROI_Y_START_OFFSET] = {
+        .reg = AR013X_AD_AE_ROI_Y_START_OFFSET, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_ROI_X_SIZE] = {
+        .reg = AR013X_AD_AE_ROI_X_SIZE, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_ROI_Y_SIZE] = {
+        .reg = AR013X_AD_AE_ROI_Y_SIZE, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_LUMA_TARGET] = {
+        .reg = AR013X_AD_AE_LUMA_TARGET_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_MIN_EV_STEP] = {
+        .reg = AR013X_AD_AE_MIN_EV_STEP_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_MAX_EV_STEP] = {
+        .reg = AR013X_AD_AE_MAX_EV_STEP_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_DAMP_OFFSET] = {
+        .reg = AR013X_AD_AE_DAMP_OFFSET_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_DAMP_GAIN] = {
+        .reg = AR013X_AD_AE_DAMP_GAIN_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_DAMP_MAX] = {
+        .reg = AR013X_AD_AE_DAMP_MAX_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_MIN_EXPOSURE] = {
+        .reg = AR013X_AD_AE_MIN_EXPOSURE_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_MAX_EXPOSURE] = {
+        .reg = AR013X_AD_AE_MAX_EXPOSURE_REG, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_AG_EXPOSURE_HI] = {
+        .reg = AR013X_AD_AE_AG_EXPOSURE_HI, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_AG_EXPOSURE_LO] = {
+        .reg = AR013X_AD_AE_AG_EXPOSURE_LO, .max = 0xFFFF,
+    },
+    [PRUCAM_CID_AE_DARK_CUR_THRESH] = {
+        .reg = AR013X_AD_AE_DARK_CUR_THRESH_REG, .max = 0xFFFF,
+    },
+};
+
+/**
+ * The controls are claimed, see ar013x_controls_claim(). Sets other than the
+ * claimer's hold claim_mutex while they check it and write, so a set that
+ * started before the claim is done before it returns.
+ */
+static bool claimed;
+static DEFINE_MUTEX(claim_mutex);
+
+/** @brief Reads which context the sensor is in, 0 for A and 1 for B */
+static int current_context(int *context)
+{
+    u16 value;
+    int r;
+
+    r = read_cam_reg(AR013X_AD_DIGITAL_TEST, &value);
+    if (r == 0)
+        *context = value & CONTEXT_B_BIT ? 1 : 0;
+
+    return r;
+}
+
+/**
+ * @brief Gets the context a batch starts in. While a context pattern
+ * alternates them, it has none until a PRUCAM_CID_CONTEXT picks one.
+ */
+static int batch_context(int *context)
+{
+    if (ar013x_context_active()) {
+        *context = NO_CONTEXT;
+        return 0;
+    }
+
+    return current_context(context);
+}
+
+/**
+ * @brief Tells whether a control is set in one context, or is the context,
+ * so it can't be set on its own while the contexts alternate.
+ */
+static bool context_control(u32 id)
+{
+    return id == PRUCAM_CID_CONTEXT ||
+           (id < PRUCAM_CID_COUNT && controls_table[id].reg_cb);
+}
+
+/**
+ * @brief Gets the register, mask and start register of a control in a
+ * context.
+ */
+static void control_regs(const struct ar013x_control *c, int context,
+                         u16 *reg, u16 *mask, u16 *start)
+{
+    if (context && c->reg_cb) {
+        *reg   = c->reg_cb;
+        *mask  = c->mask_cb;
+        *start = c->start_cb;
+    } else {
+        *reg   = c->reg;
+        *mask  = c->mask;
+        *start = c->start;
+    }
+}
+
+/** @brief Reads a control in a context */
+static int control_read(u32 id, int context, s32 *value)
+{
+    const struct ar013x_control *c;
+    u16 reg, mask, start, reg_value, start_value;
+    int r;
+
+    if (id >= PRUCAM_CID_COUNT)
+        return -EINVAL;
+
+    c = &controls_table[id];
+    control_regs(c, context, &reg, &mask, &start);
+
+    r = read_cam_reg(reg, &reg_value);
+    if (r != 0)
+        return r;
+
+    if (start) {
+        r = read_cam_reg(start, &start_value);
+        if (r != 0)
+            return r;
+        *value = reg_value - start_value + 1;
+    } else if (mask) {
+        *value = (reg_value & mask) >> __ffs(mask);
+    } else {
+        *value = reg_value;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Checks the value of a control and works out the register write that
+ * sets it.
+ * @param control The id and value
+ * @param context The context the control is set in
+ * @param reg Set to the register to write
+ * @param mask Set to the bits of it to write, 0 for all of them
+ * @param value Set to the value to write, already shifted into mask
+ * @return 0 on success or negative errno value on failure.
+ */
+static int control_write(const struct prucam_control *control, int context,
+                         u16 *reg, u16 *mask, u16 *value)
+{
+    const struct ar013x_control *c;
+    u16 start, start_value;
+    int r;
+
+    if (control->id >= PRUCAM_CID_COUNT)
+        return -EINVAL;
+
+    c = &controls_table[control->id];
+    control_regs(c, context, reg, mask, &start);
+
+    if (start) {
+        // the size is counted from the start of the window
+        if (control->value < 1 || control->value > c->max + 1)
+            return -EINVAL;
+
+        r = read_cam_reg(start, &start_value);
+        if (r != 0)
+            return r;
+
+        if (start_value + control->value - 1 > c->max)
+            return -EINVAL;
+
+        *value = start_value + control->value - 1;
+        return 0;
+    }
+
+    if (control->value < 0 || control->value > c->max)
+        return -EINVAL;
+
+    *value = *mask ? control->value << __ffs(*mask) : control->value;
+
+    return 0;
+}
+
+/** @brief Checks and writes a control in a context */
+static int control_set(const struct prucam_control *control, int context)
+{
+    u16 reg, mask, value;
+    int r;
+
+    r = control_write(control, context, &reg, &mask, &value);
+    if (r != 0)
+        return r;
+
+    // digital binning must be off while the sensor runs auto exposure
+    if (control->id == PRUCAM_CID_AE_ENABLE) {
+        r = write_cam_reg(AR013X_AD_DIGITAL_BINNING, 0);
+        if (r != 0)
+            return r;
+    }
+
+    if (mask)
+        return update_cam_reg(reg, mask, value);
+
+    return write_cam_reg(reg, value);
+}
+
+int ar013x_control_get(u32 id, s32 *value)
+{
+    int context, r;
+
+    r = current_context(&context);
+    if (r != 0)
+        return r;
+
+    return control_read(id, context, value);
+}
+
+int ar013x_control_set(u32 id, s32 value)
+{
+    struct prucam_control control = {.id = id, .value = value};
+    int context, r;
+
+    mutex_lock(&claim_mutex);
+
+    // the sensor could be in either context, see ar013x_context.h
+    if (claimed || (ar013x_context_active() && context_control(id)))
+        r = -EBUSY;
+    else
+        r = current_context(&context);
+    if (r == 0)
+        r = control_set(&control, context);
+
+    mutex_unlock(&claim_mutex);
+
+    return r;
+}
+
+int ar013x_controls_get(struct prucam_control *controls, u32 count,
+                        u32 *error_idx)
+{
+    int context, r;
+    u32 i;
+
+    *error_idx = count;
+
+    r = current_context(&context);
+    if (r != 0)
+        return r;
+
+    for (i = 0; i < count; i++) {
+        r = control_read(controls[i].id, context, &controls[i].value);
+        if (r != 0) {
+            *error_idx = i;
+            return r;
+        }
+    }
+
+    return 0;
+}
+
+/** @brief Checks controls set in order from a context */
+static int controls_check(const struct prucam_control *controls, u32 count,
+                          int context, u32 *error_idx)
+{
+    u16 reg, mask, value;
+    int r;
+    u32 i;
+
+    // follow the context switches in the batch
+    for (i = 0; i < count; i++) {
+        if (context == NO_CONTEXT && controls[i].id != PRUCAM_CID_CONTEXT &&
+            context_control(controls[i].id)) {
+            *error_idx = i;
+            return -EBUSY;
+        }
+
+        r = control_write(&controls[i], context, &reg, &mask, &value);
+        if (r != 0) {
+            *error_idx = i;
+            return r;
+        }
+
+        if (controls[i].id == PRUCAM_CID_CONTEXT)
+            context = controls[i].value;
+    }
+
+    *error_idx = count;
+
+    return 0;
+}
+
+int ar013x_controls_check(const struct prucam_control *controls, u32 count,
+                          u32 *error_idx)
+{
+    int context, r;
+
+    *error_idx = count;
+
+    r = batch_context(&context);
+    if (r != 0)
+        return r;
+
+    return controls_check(controls, count, context, error_idx);
+}
+
+int ar013x_controls_set_claimed(const struct prucam_control *controls,
+                                u32 count, u32 *error_idx, u32 *batch)
+{
+    int context, start_context, r;
+    u32 i;
+
+    *error_idx = count;
+
+    r = batch_context(&start_context);
+    if (r != 0)
+        return r;
+
+    // check them all before the sensor sees any of them
+    r = controls_check(controls, count, start_context, error_idx);
+    if (r != 0)
+        return r;
+
+    // all of them take effect on the same frame
+    r = ar013x_hold_begin();
+    context = start_context;
+    for (i = 0; r == 0 && i < count; i++) {
+        *error_idx = i;
+
+        // while alternating, a context only picks where the rest go
+        if (controls[i].id != PRUCAM_CID_CONTEXT ||
+            start_context != NO_CONTEXT)
+            r = control_set(&controls[i], context);
+
+        if (controls[i].id == PRUCAM_CID_CONTEXT)
+            context = controls[i].value;
+    }
+
+    if (r == 0)
+        *error_idx = count;
+
+    if (ar013x_hold_end(batch) < 0 && r == 0)
+        r = -EIO;
+
+    return r;
+}
+
+int ar013x_controls_set(const struct prucam_control *controls, u32 count,
+                        u32 *error_idx, u32 *batch)
+{
+    int r;
+
+    mutex_lock(&claim_mutex);
+
+    if (claimed) {
+        *error_idx = count;
+        r = -EBUSY;
+    } else {
+        r = ar013x_controls_set_claimed(controls, count, error_idx, batch);
+    }
+
+    mutex_unlock(&claim_mutex);
+
+    return r;
+}
+
+int ar013x_controls_claim(void)
+{
+    s32 ae;
+    int r;
+
+    mutex_lock(&claim_mutex);
+
+    // the sensor's auto exposure owns the integration time and gains
+    r = claimed ? -EBUSY : control_read(PRUCAM_CID_AE_ENABLE, 0, &ae);
+    if (r == 0 && ae)
+        r = -EBUSY;
+    if (r == 0)
+        claimed = true;
+
+    mutex_unlock(&claim_mutex);
+
+    return r;
+}
+
+void ar013x_controls_release(void)
+{
+    mutex_lock(&claim_mutex);
+    claimed = false;
+    mutex_unlock(&claim_mutex);
+}
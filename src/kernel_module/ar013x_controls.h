@@ -0,0 +1,105 @@
+/**
+ * @file    ar013x_controls.h
+ * @brief   AR013x CMOS Digital Image Sensor controls, by PRUCAM_CID_* id.
+ *
+ * The same settings as the context_settings and auto_exposure_settings
+ * attributes, for getting and setting many of them at once.
+ *
+ * @addtogroup AR013x
+ */
+
+#ifndef AR013X_CONTROLS_H
+#define AR013X_CONTROLS_H
+
+#include <linux/device.h>
+#include <linux/types.h>
+
+#include "prucam_uapi.h"
+
+/** @brief The sysfs attribute of a control, see ar013x_sysfs.h */
+struct ar013x_control_attr {
+    struct device_attribute attr;
+    /** PRUCAM_CID_* */
+    u32 id;
+};
+
+/**
+ * @brief Gets a control in the current context.
+ * @param id PRUCAM_CID_*
+ * @param value The value
+ * @return 0 on success or negative errno value on failure.
+ */
+int ar013x_control_get(u32 id, s32 *value);
+
+/**
+ * @brief Sets a control in the current context, on its own and not as a
+ * settings batch.
+ * @param id PRUCAM_CID_*
+ * @param value The value
+ * @return 0 on success, -EINVAL when the value is out of range, -EBUSY while
+ * the controls are claimed, or for the context and the context controls
+ * while the contexts alternate, or negative errno value on failure.
+ */
+int ar013x_control_set(u32 id, s32 value);
+
+/**
+ * @brief Gets the values of controls.
+ * @param controls The ids to get, their values are set
+ * @param count The number of controls
+ * @param error_idx Set to the index of the control that failed, or to count
+ * @return 0 on success or negative errno value on failure.
+ */
+int ar013x_controls_get(struct prucam_control *controls, u32 count,
+                        u32 *error_idx);
+
+/**
+ * @brief Checks controls like ar013x_controls_set() does, without setting
+ * them.
+ * @param controls The ids and values to check
+ * @param count The number of controls
+ * @param error_idx Set to the index of the control that failed, or to count
+ * @return 0 on success, -EINVAL when one is unknown or out of range or
+ * negative errno value on failure.
+ */
+int ar013x_controls_check(const struct prucam_control *controls, u32 count,
+                          u32 *error_idx);
+
+/**
+ * @brief Sets controls in order, as one settings batch. All of them are
+ * checked first, so nothing is written when one is unknown or out of range.
+ * While the contexts alternate, a PRUCAM_CID_CONTEXT picks the context of the
+ * controls after it without switching the sensor, and a context control
+ * before any fails with -EBUSY, see ar013x_context.h.
+ * @param controls The ids and values to set
+ * @param count The number of controls
+ * @param error_idx Set to the index of the control that failed, or to count
+ * @param batch Set to the number of the settings batch, see ar013x_hold.h
+ * @return 0 on success, -EBUSY while the controls are claimed or negative
+ * errno value on failure.
+ */
+int ar013x_controls_set(const struct prucam_control *controls, u32 count,
+                        u32 *error_idx, u32 *batch);
+
+/**
+ * @brief Sets controls like ar013x_controls_set(), for the caller that has
+ * claimed them.
+ */
+int ar013x_controls_set_claimed(const struct prucam_control *controls,
+                                u32 count, u32 *error_idx, u32 *batch);
+
+/**
+ * @brief Claims the controls, e.g. for an exposure bracket. Until
+ * ar013x_controls_release(), every other set fails with -EBUSY, from the
+ * attributes, the settings attribute or PRUCAM_IOC_S_CONTROLS, and the
+ * claimer sets them with ar013x_controls_set_claimed().
+ * @return 0 on success, -EBUSY when they are claimed already or the sensor's
+ * auto exposure is on, or negative errno value on failure.
+ */
+int ar013x_controls_claim(void);
+
+/**
+ * @brief Releases the controls claimed by ar013x_controls_claim().
+ */
+void ar013x_controls_release(void);
+
+#endif /* AR013X_CONTROLS_H */
@@ -0,0 +1,171 @@
+/**
+ * @file    ar013x_embedded.c
+ * @brief   AR013x CMOS Digital Image Sensor embedded data decoding.
+ *
+ * With AR013X_AD_EMBEDDED_DATA_CTRL enabled, the sensor outputs 2 rows of
+ * register values before the image in the SMIA embedded data format: a start
+ * code, then tag/value byte pairs. The tags load the high and low byte of the
+ * register address or carry one data byte, after which the address
+ * increments. The tags and values are 8 bits in the top of the pixel word, the
+ * same 8 bits the PRUs capture.
+ *
+ * @addtogroup AR013x
+ */
+
+#include <linux/kernel.h>
+
+#include "ar013x_embedded.h"
+#include "ar013x_regs.h"
+
+#define EMB_CODE_START   0x0A
+#define EMB_TAG_ADDR_MSB 0xAA
+#define EMB_TAG_ADDR_LSB 0xA5
+#define EMB_TAG_DATA     0x5A
+#define EMB_TAG_NULL     0x55
+#define EMB_CODE_END     0x07
+
+/** @brief Registers picked out of the embedded data */
+enum {
+    EMB_FRAME_COUNT,
+    EMB_COARSE_TIME,
+    EMB_FINE_TIME,
+    EMB_COARSE_TIME_CB,
+    EMB_FINE_TIME_CB,
+    EMB_GLOBAL_GAIN,
+    EMB_GLOBAL_GAIN_CB,
+    EMB_DIGITAL_TEST,
+    EMB_AE_CURRENT_GAINS,
+    EMB_AE_MEAN,
+    EMB_NUM_REGS,
+};
+
+static const u16 emb_regs[EMB_NUM_REGS] = {
+    [EMB_FRAME_COUNT]      = AR013X_AD_FRAME_COUNT,
+    [EMB_COARSE_TIME]      = AR013X_AD_COARSE_INTEGRATION_TIME,
+    [EMB_FINE_TIME]        = AR013X_AD_FINE_INTERGRATION_TIME,
+    [EMB_COARSE_TIME_CB]   = AR013X_AD_COARSE_INTEGRATION_TIME_CB,
+    [EMB_FINE_TIME_CB]     = AR013X_AD_FINE_INTERGRATION_TIME_CB,
+    [EMB_GLOBAL_GAIN]      = AR013X_AD_GLOBAL_GAIN,
+    [EMB_GLOBAL_GAIN_CB]   = AR013X_AD_GLOBAL_GAIN_CB,
+    [EMB_DIGITAL_TEST]     = AR013X_AD_DIGITAL_TEST,
+    [EMB_AE_CURRENT_GAINS] = AR013X_AD_AE_CURRENT_GAINS,
+    [EMB_AE_MEAN]          = AR013X_AD_AE_MEAN_L,
+};
+
+/** @brief State carried across the embedded rows while decoding */
+typedef struct {
+    /** byte address the next data byte is for */
+    u16 addr;
+    /** the high byte of the register being assembled */
+    u8 msb;
+    /** true if msb holds the high byte for addr */
+    bool have_msb;
+    /** number of registers decoded */
+    int count;
+    /** values of the registers in emb_regs */
+    u16 vals[EMB_NUM_REGS];
+    /** bit mask of the emb_regs found */
+    u32 found;
+} emb_state_t;
+
+static void emb_save_reg(emb_state_t *st, u16 reg, u16 val)
+{
+    st->count++;
+
+    for (int i = 0; i < EMB_NUM_REGS; i++) {
+        if (emb_regs[i] == reg) {
+            st->vals[i] = val;
+            st->found |= BIT(i);
+            return;
+        }
+    }
+}
+
+static void emb_decode_row(emb_state_t *st, const u8 *row, int cols)
+{
+    // not embedded data (e.g. it is disabled on the sensor)
+    if (cols < 1 || row[0] != EMB_CODE_START)
+        return;
+
+    for (int i = 1; i + 1 < cols; i += 2) {
+        u8 tag = row[i], byte = row[i + 1];
+
+        switch (tag) {
+        case EMB_TAG_ADDR_MSB:
+            st->addr     = (st->addr & 0x00FF) | (byte << 8);
+            st->have_msb = false;
+            break;
+        case EMB_TAG_ADDR_LSB:
+            st->addr     = (st->addr & 0xFF00) | byte;
+            st->have_msb = false;
+            break;
+        case EMB_TAG_DATA:
+            // registers are 16 bits, big endian, at even addresses
+            if ((st->addr & 1) == 0) {
+                st->msb      = byte;
+                st->have_msb = true;
+            } else if (st->have_msb) {
+                emb_save_reg(st, st->addr - 1, (st->msb << 8) | byte);
+                st->have_msb = false;
+            }
+            st->addr++;
+            break;
+        case EMB_TAG_NULL:
+            break;
+        case EMB_CODE_END:
+        default:
+            return;
+        }
+    }
+}
+
+int ar013x_decode_embedded(const u8 *rows, int nrows, int cols,
+                           struct prucam_frame_info *info)
+{
+    emb_state_t st = {0};
+    int ctx_b;
+
+    for (int i = 0; i < nrows; i++)
+        emb_decode_row(&st, &rows[i * cols], cols);
+
+    info->embedded_valid = 0;
+
+#define EMB_COPY(field, idx, flag)               \
+    do {                                         \
+        if (st.found & BIT(idx)) {               \
+            info->field = st.vals[idx];          \
+            info->embedded_valid |= (flag);      \
+        }                                        \
+    } while (0)
+
+    EMB_COPY(frame_count, EMB_FRAME_COUNT, PRUCAM_EMB_FRAME_COUNT);
+    EMB_COPY(ae_current_gains, EMB_AE_CURRENT_GAINS,
+             PRUCAM_EMB_AE_CURRENT_GAINS);
+    EMB_COPY(ae_mean, EMB_AE_MEAN, PRUCAM_EMB_AE_MEAN);
+
+    // the rest depend on the context, which is bit 13 of digital_test
+    if (!(st.found & BIT(EMB_DIGITAL_TEST)))
+        return st.count;
+
+    ctx_b = (st.vals[EMB_DIGITAL_TEST] >> 13) & 0x1;
+    info->context = ctx_b;
+    info->embedded_valid |= PRUCAM_EMB_CONTEXT;
+
+    // Context A analog gain is bits [5:4] & Context B is bits [9:8]
+    info->analog_gain = (st.vals[EMB_DIGITAL_TEST] >> (ctx_b ? 8 : 4)) & 0x3;
+    info->embedded_valid |= PRUCAM_EMB_ANALOG_GAIN;
+
+    if (ctx_b) {
+        EMB_COPY(coarse_time, EMB_COARSE_TIME_CB, PRUCAM_EMB_COARSE_TIME);
+        EMB_COPY(fine_time, EMB_FINE_TIME_CB, PRUCAM_EMB_FINE_TIME);
+        EMB_COPY(global_gain, EMB_GLOBAL_GAIN_CB, PRUCAM_EMB_GLOBAL_GAIN);
+    } else {
+        EMB_COPY(coarse_time, EMB_COARSE_TIME, PRUCAM_EMB_COARSE_TIME);
+        EMB_COPY(fine_time, EMB_FINE_TIME, PRUCAM_EMB_FINE_TIME);
+        EMB_COPY(global_gain, EMB_GLOBAL_GAIN, PRUCAM_EMB_GLOBAL_GAIN);
+    }
+
+#undef EMB_COPY
+
+    return st.count;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file    ar013x_embedded.h
+ * @brief   AR013x CMOS Digital Image Sensor embedded data decoding.
+ *
+ * @addtogroup AR013x
+ */
+
+#ifndef AR013X_EMBEDDED_H
+#define AR013X_EMBEDDED_H
+
+#include <linux/types.h>
+
+#include "prucam_uapi.h"
+
+/**
+ * @brief Decodes the embedded register rows the sensor outputs before the
+ * image and fills in the embedded fields of the frame info.
+ * @param rows The top embedded rows as captured, one after the other
+ * @param nrows Number of rows
+ * @param cols Number of bytes in each row
+ * @param info The frame info to fill in. Only embedded_valid and the fields it
+ * flags are written.
+ * @return Number of registers decoded.
+ */
+int ar013x_decode_embedded(const u8 *rows, int nrows, int cols,
+                           struct prucam_frame_info *info);
+
+#endif /* AR013X_EMBEDDED_H */
@@ -0,0 +1,101 @@
+/**
+ * @file    ar013x_hold.c
+ * @brief   AR013x CMOS Digital Image Sensor grouped parameter hold.
+ *
+ * The sensor latches the held registers at the start of the next frame. The
+ * frame count read right after the release is that of the frame being read
+ * out, or of the one after it when a frame started in between, so the batch
+ * is latched by frame count + 1 at the latest. The rows of the frame it is
+ * latched on start integrating before the frame does, so it is first exposed
+ * hold_latency frames later.
+ *
+ * @addtogroup AR013x
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+#include "ar013x_hold.h"
+#include "ar013x_regs.h"
+#include "cam_i2c.h"
+
+/** batches remembered, older ones are only needed for frames read late */
+#define HOLD_BATCHES 8
+
+static unsigned int hold_latency = 1;
+module_param(hold_latency, uint, 0644);
+MODULE_PARM_DESC(hold_latency,
+                 "Frames from the one a settings batch is latched on to the "
+                 "first one exposed with it (default: 1)");
+
+/** the first frame count of each of the last batches, by batch number */
+static u16 batch_frames[HOLD_BATCHES];
+static u32 last_batch;
+static DEFINE_SPINLOCK(batch_lock);
+
+/** held from ar013x_hold_begin() to ar013x_hold_end() */
+static DEFINE_MUTEX(hold_mutex);
+
+int ar013x_hold_begin(void)
+{
+    mutex_lock(&hold_mutex);
+
+    return write_cam_reg(AR013X_AD_GROUPED_PARAMETER_HOLD, 0x0001);
+}
+
+int ar013x_hold_end(u32 *batch)
+{
+    u16 frame_count = 0;
+    int r;
+
+    r = write_cam_reg(AR013X_AD_GROUPED_PARAMETER_HOLD, 0x0000);
+    if (r == 0)
+        r = read_cam_reg(AR013X_AD_FRAME_COUNT, &frame_count);
+
+    // the batch may be partly written, so it counts even after an error
+    spin_lock(&batch_lock);
+    last_batch++;
+    batch_frames[last_batch % HOLD_BATCHES] = frame_count + 1 + hold_latency;
+    if (batch)
+        *batch = last_batch;
+    spin_unlock(&batch_lock);
+
+    mutex_unlock(&hold_mutex);
+
+    return r;
+}
+
+u32 ar013x_hold_batch(void)
+{
+    u32 batch;
+
+    spin_lock(&batch_lock);
+    batch = last_batch;
+    spin_unlock(&batch_lock);
+
+    return batch;
+}
+
+u32 ar013x_hold_batch_of(u16 frame_count)
+{
+    u32 batch, oldest;
+
+    spin_lock(&batch_lock);
+    oldest = last_batch >= HOLD_BATCHES ? last_batch - HOLD_BATCHES + 1 : 1;
+    for (batch = last_batch; batch >= oldest; batch--) {
+        // the frame count wraps, compare the distance
+        if ((s16)(frame_count - batch_frames[batch % HOLD_BATCHES]) >= 0)
+            break;
+    }
+    spin_unlock(&batch_lock);
+
+    // a frame older than every batch remembered gets the one before them
+    return batch >= oldest ? batch : oldest - 1;
+}
+
+unsigned int ar013x_hold_latency(void)
+{
+    return READ_ONCE(hold_latency);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file    ar013x_hold.h
+ * @brief   AR013x CMOS Digital Image Sensor grouped parameter hold.
+ *
+ * The registers written between ar013x_hold_begin() and ar013x_hold_end()
+ * take effect together, at the start of the first frame after the hold is
+ * released. Each hold is a settings batch, numbered from 1, and a frame can
+ * be matched to the last batch it was exposed with from its sensor frame
+ * count.
+ *
+ * @addtogroup AR013x
+ */
+
+#ifndef AR013X_HOLD_H
+#define AR013X_HOLD_H
+
+#include <linux/types.h>
+
+/**
+ * @brief Holds the sensor's register updates. Must be followed by
+ * ar013x_hold_end(), even when it fails, and serialises the batches.
+ * @return 0 on success or negative errno value on failure.
+ */
+int ar013x_hold_begin(void);
+
+/**
+ * @brief Releases the register updates held since ar013x_hold_begin(), and
+ * records the frame the batch is first exposed on.
+ * @param batch Set to the number of the batch
+ * @return 0 on success or negative errno value on failure.
+ */
+int ar013x_hold_end(u32 *batch);
+
+/**
+ * @brief Gets the number of the last batch, 0 before the first.
+ */
+u32 ar013x_hold_batch(void);
+
+/**
+ * @brief Gets the last batch a frame was exposed with.
+ * @param frame_count The sensor frame count of the frame, as in its embedded
+ * rows
+ * @return The batch number, 0 for the startup settings.
+ */
+u32 ar013x_hold_batch_of(u16 frame_count);
+
+/**
+ * @brief Gets the frames from the one a batch is latched on to the first one
+ * exposed with it, the hold_latency param.
+ */
+unsigned int ar013x_hold_latency(void);
+
+#endif /* AR013X_HOLD_H */
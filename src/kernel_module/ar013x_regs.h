@@ -26,6 +26,7 @@
 #define AR013X_AD_FINE_INTERGRATION_TIME_CB  0x3018U
 #define AR013X_AD_RESET_REGISTER             0x301AU
 #define AR013X_AD_DATA_PEDESTAL              0x301EU
+#define AR013X_AD_GROUPED_PARAMETER_HOLD     0x3022U
 #define AR013X_AD_GPI_STATUS                 0x3026U
 #define AR013X_AD_ROW_SPEED                  0x3028U
 #define AR013X_AD_VT_PIX_CLK_DIV             0x302AU
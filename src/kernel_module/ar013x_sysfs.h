@@ -10,150 +10,65 @@
 
 #include <linux/sysfs.h>
 
-#define CONTEXT_A 0
-#define CONTEXT_B 1
-
-#define ENABLE  0
-#define DISABLE 1
+#include "ar013x_controls.h"
 
 // ---------------------------------------------------------------------------
-// Context registers
-
-/**
- * @brief Gets the size of the images.
- * @return length of attribute on success or negative errno value on failure.
- */
-ssize_t ar013x_img_size_show(struct device *dev, struct device_attribute *attr,
-                             char *buf);
-
-/**
- * @brief Sets the size of the image
- * @return Attribute's count on success or negative errno value on failure.
- */
-ssize_t ar013x_img_size_store(struct device *dev, struct device_attribute *attr,
-                              const char *buf, size_t count);
-
-/**
- * @brief Gets all the color gains (green1, red, blue, green2, & gobal gains)
- * @return length of attribute on success or negative errno value on failure.
- */
-ssize_t ar013x_color_gain_show(struct device *dev,
-                               struct device_attribute *attr, char *buf);
-
-/**
- * @brief Sets all the color gains (green1, red, blue, green2, & gobal gains)
- * @return Attribute's count on success or negative errno value on failure.
- */
-ssize_t ar013x_color_gain_store(struct device *dev,
-                                struct device_attribute *attr, const char *buf,
-                                size_t count);
-
-/**
- * @brief Gets the bit fields in the digital_test register (contain the context
- * selector and analog gain)
- * @return length of attribute on success or negative errno value on failure.
- */
-ssize_t ar013x_digital_test_show(struct device *dev,
-                                 struct device_attribute *attr, char *buf);
-
-/**
- * @brief Sets the bit fields in the digital_test register (contain the context
- * selector and analog gain)
- * @return Attribute's count on success or negative errno value on failure.
- */
-ssize_t ar013x_digital_test_store(struct device *dev,
-                                  struct device_attribute *attr,
-                                  const char *buf, size_t count);
-
-/**
- * @brief Gets y odd inc values
- * @return length of attribute on success or negative errno value on failure.
- */
-ssize_t ar013x_y_odd_show(struct device *dev, struct device_attribute *attr,
-                          char *buf);
-
-/**
- * @brief Sets y odd inc values
- * @return Attribute's count on success or negative errno value on failure.
- */
-ssize_t ar013x_y_odd_store(struct device *dev, struct device_attribute *attr,
-                           const char *buf, size_t count);
+// Context and auto exposure controls
 
 /**
- * @brief Gets the digital binning values
+ * @brief Gets a control, see ar013x_controls.h. The context ones are those of
+ * the current context.
  * @return length of attribute on success or negative errno value on failure.
  */
-ssize_t ar013x_digital_binning_show(struct device *dev,
-                                    struct device_attribute *attr, char *buf);
-
-/**
- * @brief Sets the digital binning values
- * @return Attribute's count on success or negative errno value on failure.
- */
-ssize_t ar013x_digital_binning_store(struct device *dev,
-                                     struct device_attribute *attr,
-                                     const char *buf, size_t count);
-
-/**
- * @brief Gets general registers with no bit masking (all 16 bits of the
- * register are used)
- * @return length of attribute on success or negative errno value on failure.
- */
-ssize_t ar013x_general_show(struct device *dev, struct device_attribute *attr,
+ssize_t ar013x_control_show(struct device *dev, struct device_attribute *attr,
                             char *buf);
 
 /**
- * @brief Sets general registers with no bit masking (all 16 bits of the
- * register are used)
+ * @brief Sets a control, see ar013x_controls.h. The context ones are those of
+ * the current context.
  * @return Attribute's count on success or negative errno value on failure.
  */
-ssize_t ar013x_general_store(struct device *dev, struct device_attribute *attr,
+ssize_t ar013x_control_store(struct device *dev, struct device_attribute *attr,
                              const char *buf, size_t count);
 
-DEVICE_ATTR(context, S_IRUGO | S_IWUSR, ar013x_digital_test_show,
-            ar013x_digital_test_store);
-DEVICE_ATTR(x_size, S_IRUGO | S_IWUSR, ar013x_img_size_show,
-            ar013x_img_size_store);
-DEVICE_ATTR(y_size, S_IRUGO | S_IWUSR, ar013x_img_size_show,
-            ar013x_img_size_store);
-DEVICE_ATTR(coarse_time, S_IRUGO | S_IWUSR, ar013x_general_show,
-            ar013x_general_store);
-DEVICE_ATTR(fine_time, S_IRUGO | S_IWUSR, ar013x_general_show,
-            ar013x_general_store);
-DEVICE_ATTR(y_odd_inc, S_IRUGO | S_IWUSR, ar013x_y_odd_show,
-            ar013x_y_odd_store);
-DEVICE_ATTR(green1_gain, S_IRUGO | S_IWUSR, ar013x_color_gain_show,
-            ar013x_color_gain_store);
-DEVICE_ATTR(blue_gain, S_IRUGO | S_IWUSR, ar013x_color_gain_show,
-            ar013x_color_gain_store);
-DEVICE_ATTR(red_gain, S_IRUGO | S_IWUSR, ar013x_color_gain_show,
-            ar013x_color_gain_store);
-DEVICE_ATTR(green2_gain, S_IRUGO | S_IWUSR, ar013x_color_gain_show,
-            ar013x_color_gain_store);
-DEVICE_ATTR(global_gain, S_IRUGO | S_IWUSR, ar013x_color_gain_show,
-            ar013x_color_gain_store);
-DEVICE_ATTR(analog_gain, S_IRUGO | S_IWUSR, ar013x_digital_test_show,
-            ar013x_digital_test_store);
-DEVICE_ATTR(frame_len_lines, S_IRUGO | S_IWUSR, ar013x_general_show,
-            ar013x_general_store);
-DEVICE_ATTR(digital_binning, S_IRUGO | S_IWUSR, ar013x_digital_binning_show,
-            ar013x_digital_binning_store);
+/** @brief Defines dev_attr_<name>, the attribute of control id */
+#define CONTROL_ATTR(_name, _id)                                               \
+    struct ar013x_control_attr dev_attr_##_name = {                            \
+        .attr = __ATTR(_name, S_IRUGO | S_IWUSR, ar013x_control_show,          \
+                       ar013x_control_store),                                  \
+        .id   = _id,                                                           \
+    }
+
+CONTROL_ATTR(context, PRUCAM_CID_CONTEXT);
+CONTROL_ATTR(x_size, PRUCAM_CID_X_SIZE);
+CONTROL_ATTR(y_size, PRUCAM_CID_Y_SIZE);
+CONTROL_ATTR(coarse_time, PRUCAM_CID_COARSE_TIME);
+CONTROL_ATTR(fine_time, PRUCAM_CID_FINE_TIME);
+CONTROL_ATTR(y_odd_inc, PRUCAM_CID_Y_ODD_INC);
+CONTROL_ATTR(green1_gain, PRUCAM_CID_GREEN1_GAIN);
+CONTROL_ATTR(blue_gain, PRUCAM_CID_BLUE_GAIN);
+CONTROL_ATTR(red_gain, PRUCAM_CID_RED_GAIN);
+CONTROL_ATTR(green2_gain, PRUCAM_CID_GREEN2_GAIN);
+CONTROL_ATTR(global_gain, PRUCAM_CID_GLOBAL_GAIN);
+CONTROL_ATTR(analog_gain, PRUCAM_CID_ANALOG_GAIN);
+CONTROL_ATTR(frame_len_lines, PRUCAM_CID_FRAME_LEN_LINES);
+CONTROL_ATTR(digital_binning, PRUCAM_CID_DIGITAL_BINNING);
 
 struct attribute *ar013x_context_attrs[] = {
-    &dev_attr_context.attr,
-    &dev_attr_x_size.attr,
-    &dev_attr_y_size.attr,
-    &dev_attr_coarse_time.attr,
-    &dev_attr_fine_time.attr,
-    &dev_attr_y_odd_inc.attr,
-    &dev_attr_green1_gain.attr,
-    &dev_attr_blue_gain.attr,
-    &dev_attr_red_gain.attr,
-    &dev_attr_green2_gain.attr,
-    &dev_attr_global_gain.attr,
-    &dev_attr_analog_gain.attr,
-    &dev_attr_frame_len_lines.attr,
-    &dev_attr_digital_binning.attr,
+    &dev_attr_context.attr.attr,
+    &dev_attr_x_size.attr.attr,
+    &dev_attr_y_size.attr.attr,
+    &dev_attr_coarse_time.attr.attr,
+    &dev_attr_fine_time.attr.attr,
+    &dev_attr_y_odd_inc.attr.attr,
+    &dev_attr_green1_gain.attr.attr,
+    &dev_attr_blue_gain.attr.attr,
+    &dev_attr_red_gain.attr.attr,
+    &dev_attr_green2_gain.attr.attr,
+    &dev_attr_global_gain.attr.attr,
+    &dev_attr_analog_gain.attr.attr,
+    &dev_attr_frame_len_lines.attr.attr,
+    &dev_attr_digital_binning.attr.attr,
     NULL,
 };
 
@@ -162,110 +77,121 @@ struct attribute_group ar013x_context_group = {
     .attrs = ar013x_context_attrs,
 };
 
+CONTROL_ATTR(ae_enable, PRUCAM_CID_AE_ENABLE);
+CONTROL_ATTR(ae_ag_en, PRUCAM_CID_AE_AG_EN);
+CONTROL_ATTR(ae_dg_en, PRUCAM_CID_AE_DG_EN);
+CONTROL_ATTR(ae_min_ana_gain, PRUCAM_CID_AE_MIN_ANA_GAIN);
+CONTROL_ATTR(ae_roi_x_start_offset, PRUCAM_CID_AE_ROI_X_START_OFFSET);
+CONTROL_ATTR(ae_roi_y_start_offset, PRUCAM_CID_AE_ROI_Y_START_OFFSET);
+CONTROL_ATTR(ae_roi_x_size, PRUCAM_CID_AE_ROI_X_SIZE);
+CONTROL_ATTR(ae_roi_y_size, PRUCAM_CID_AE_ROI_Y_SIZE);
+CONTROL_ATTR(ae_luma_target, PRUCAM_CID_AE_LUMA_TARGET);
+CONTROL_ATTR(ae_min_ev_step, PRUCAM_CID_AE_MIN_EV_STEP);
+CONTROL_ATTR(ae_max_ev_step, PRUCAM_CID_AE_MAX_EV_STEP);
+CONTROL_ATTR(ae_damp_offset, PRUCAM_CID_AE_DAMP_OFFSET);
+CONTROL_ATTR(ae_damp_gain, PRUCAM_CID_AE_DAMP_GAIN);
+CONTROL_ATTR(ae_damp_max, PRUCAM_CID_AE_DAMP_MAX);
+CONTROL_ATTR(ae_max_exposure, PRUCAM_CID_AE_MAX_EXPOSURE);
+CONTROL_ATTR(ae_min_exposure, PRUCAM_CID_AE_MIN_EXPOSURE);
+CONTROL_ATTR(ae_ag_exposure_hi, PRUCAM_CID_AE_AG_EXPOSURE_HI);
+CONTROL_ATTR(ae_ag_exposure_lo, PRUCAM_CID_AE_AG_EXPOSURE_LO);
+CONTROL_ATTR(ae_dark_cur_thresh, PRUCAM_CID_AE_DARK_CUR_THRESH);
+
+struct attribute *ar013x_auto_exposure_attrs[] = {
+    &dev_attr_ae_enable.attr.attr,
+    &dev_attr_ae_ag_en.attr.attr,
+    &dev_attr_ae_dg_en.attr.attr,
+    &dev_attr_ae_min_ana_gain.attr.attr,
+    &dev_attr_ae_roi_x_start_offset.attr.attr,
+    &dev_attr_ae_roi_y_start_offset.attr.attr,
+    &dev_attr_ae_roi_x_size.attr.attr,
+    &dev_attr_ae_roi_y_size.attr.attr,
+    &dev_attr_ae_luma_target.attr.attr,
+    &dev_attr_ae_min_ev_step.attr.attr,
+    &dev_attr_ae_max_ev_step.attr.attr,
+    &dev_attr_ae_damp_offset.attr.attr,
+    &dev_attr_ae_damp_gain.attr.attr,
+    &dev_attr_ae_damp_max.attr.attr,
+    &dev_attr_ae_max_exposure.attr.attr,
+    &dev_attr_ae_min_exposure.attr.attr,
+    &dev_attr_ae_ag_exposure_hi.attr.attr,
+    &dev_attr_ae_ag_exposure_lo.attr.attr,
+    &dev_attr_ae_dark_cur_thresh.attr.attr,
+    NULL,
+};
+
+struct attribute_group ar013x_auto_exposure_group = {
+    .name  = "auto_exposure_settings",
+    .attrs = ar013x_auto_exposure_attrs,
+};
+
 // ---------------------------------------------------------------------------
-// Auto exposure
+// Settings
 
 /**
- * @brief Gets the value from the auto exposure register.
+ * @brief Gets every context and auto exposure attribute as name=value lines,
+ * mostly from the register cache.
  * @return length of attribute on success or negative errno value on failure.
  */
-ssize_t ar013x_auto_exposure_show(struct device *dev,
-                                  struct device_attribute *attr, char *buf);
+ssize_t ar013x_settings_show(struct device *dev, struct device_attribute *attr,
+                             char *buf);
 
 /**
- * @brief Sets the auto exposure register.
+ * @brief Sets any of the context and auto exposure attributes from
+ * name=value lines, as a batch that takes effect on one frame. Every line,
+ * and the range of its value, is checked before any is written, see
+ * ar013x_controls_set(). At most PRUCAM_CONTROLS_MAX lines.
  * @return Attribute's count on success or negative errno value on failure.
  */
-ssize_t ar013x_auto_exposure_store(struct device *dev,
-                                   struct device_attribute *attr,
-                                   const char *buf, size_t count);
+ssize_t ar013x_settings_store(struct device *dev, struct device_attribute *attr,
+                              const char *buf, size_t count);
 
 /**
- * @brief Gets the value from any of the auto exposure registers.
+ * @brief Gets the number of the last settings batch, frames exposed with it
+ * have it in prucam_frame_info.settings.
  * @return length of attribute on success or negative errno value on failure.
  */
-ssize_t ar013x_ae_general_show(struct device *dev,
-                               struct device_attribute *attr, char *buf);
+ssize_t ar013x_settings_batch_show(struct device *dev,
+                                   struct device_attribute *attr, char *buf);
 
 /**
- * @brief Sets any of the auto exposure registers.
+ * @brief Gets the context pattern, see ar013x_context.h.
+ * @return length of attribute on success or negative errno value on failure.
+ */
+ssize_t ar013x_context_pattern_show(struct device *dev,
+                                    struct device_attribute *attr, char *buf);
+
+/**
+ * @brief Sets the context pattern, e.g. AB to alternate the contexts frame by
+ * frame, or nothing to stop.
  * @return Attribute's count on success or negative errno value on failure.
  */
-ssize_t ar013x_ae_general_store(struct device *dev,
-                                struct device_attribute *attr, const char *buf,
-                                size_t count);
+ssize_t ar013x_context_pattern_store(struct device *dev,
+                                     struct device_attribute *attr,
+                                     const char *buf, size_t count);
 
-DEVICE_ATTR(ae_enable, S_IRUGO | S_IWUSR, ar013x_auto_exposure_show,
-            ar013x_auto_exposure_store);
-DEVICE_ATTR(ae_ag_en, S_IRUGO | S_IWUSR, ar013x_auto_exposure_show,
-            ar013x_auto_exposure_store);
-DEVICE_ATTR(ae_dg_en, S_IRUGO | S_IWUSR, ar013x_auto_exposure_show,
-            ar013x_auto_exposure_store);
-DEVICE_ATTR(ae_min_ana_gain, S_IRUGO | S_IWUSR, ar013x_auto_exposure_show,
-            ar013x_auto_exposure_store);
-DEVICE_ATTR(ae_roi_x_start_offset, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_roi_y_start_offset, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_roi_x_size, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_roi_y_size, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_luma_target, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_min_ev_step, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_max_ev_step, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_damp_offset, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_damp_gain, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_damp_max, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_max_exposure, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_min_exposure, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_ag_exposure_hi, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_ag_exposure_lo, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
-DEVICE_ATTR(ae_dark_cur_thresh, S_IRUGO | S_IWUSR, ar013x_ae_general_show,
-            ar013x_ae_general_store);
+DEVICE_ATTR(settings, S_IRUGO | S_IWUSR, ar013x_settings_show,
+            ar013x_settings_store);
+DEVICE_ATTR(settings_batch, S_IRUGO, ar013x_settings_batch_show, NULL);
+DEVICE_ATTR(context_pattern, S_IRUGO | S_IWUSR, ar013x_context_pattern_show,
+            ar013x_context_pattern_store);
 
-struct attribute *ar013x_auto_exposure_attrs[] = {
-    &dev_attr_ae_enable.attr,
-    &dev_attr_ae_ag_en.attr,
-    &dev_attr_ae_dg_en.attr,
-    &dev_attr_ae_min_ana_gain.attr,
-    &dev_attr_ae_roi_x_start_offset.attr,
-    &dev_attr_ae_roi_y_start_offset.attr,
-    &dev_attr_ae_roi_x_size.attr,
-    &dev_attr_ae_roi_y_size.attr,
-    &dev_attr_ae_luma_target.attr,
-    &dev_attr_ae_min_ev_step.attr,
-    &dev_attr_ae_max_ev_step.attr,
-    &dev_attr_ae_damp_offset.attr,
-    &dev_attr_ae_damp_gain.attr,
-    &dev_attr_ae_damp_max.attr,
-    &dev_attr_ae_max_exposure.attr,
-    &dev_attr_ae_min_exposure.attr,
-    &dev_attr_ae_ag_exposure_hi.attr,
-    &dev_attr_ae_ag_exposure_lo.attr,
-    &dev_attr_ae_dark_cur_thresh.attr,
+struct attribute *ar013x_settings_attrs[] = {
+    &dev_attr_settings.attr,
+    &dev_attr_settings_batch.attr,
+    &dev_attr_context_pattern.attr,
     NULL,
 };
 
-struct attribute_group ar013x_auto_exposure_group = {
-    .name  = "auto_exposure_settings",
-    .attrs = ar013x_auto_exposure_attrs,
+struct attribute_group ar013x_settings_group = {
+    .attrs = ar013x_settings_attrs,
 };
 
 // ---------------------------------------------------------------------------
 // groups
 
 const struct attribute_group *ar013x_groups[]
-    = {&ar013x_context_group, &ar013x_auto_exposure_group, NULL};
+    = {&ar013x_context_group, &ar013x_auto_exposure_group,
+       &ar013x_settings_group, NULL};
 
 #endif /* AR013X_SYSFS_H */
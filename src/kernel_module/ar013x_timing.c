@@ -0,0 +1,163 @@
+/**
+ * @file    ar013x_timing.c
+ * @brief   AR013x CMOS Digital Image Sensor frame timing.
+ *
+ * The pixel clock is
+ *
+ *     extclk * pll_multiplier / (pre_pll_clk_div * vt_sys_clk_div *
+ *                                vt_pix_clk_div)
+ *
+ * and a frame takes frame_length_lines * line_length_pck pixel clocks. The
+ * sensor stretches the frame when the integration time doesn't fit in it, so
+ * the frame is at least coarse_integration_time + 1 lines long.
+ *
+ * A frame in flight can still have the settings from before the last write,
+ * until hold_latency + 1 frames are done after it, so the longest period of
+ * those settings is kept as well until then. While the contexts alternate,
+ * the period is the longest of the two contexts.
+ *
+ * @addtogroup AR013x
+ */
+
+#include <linux/atomic.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+
+#include "ar013x_context.h"
+#include "ar013x_hold.h"
+#include "ar013x_regs.h"
+#include "ar013x_timing.h"
+#include "cam_i2c.h"
+
+static unsigned int extclk = 27000000;
+module_param(extclk, uint, 0444);
+MODULE_PARM_DESC(extclk, "Sensor EXTCLK input frequency in Hz "
+                         "(default: 27000000)");
+
+/**
+ * Bumped on every register write. A period computed while a write raced with
+ * it is not cached, so the cache never holds a period from old settings.
+ */
+static atomic_t timing_gen = ATOMIC_INIT(0);
+static int cached_gen      = -1;
+static u32 cached_period_us;
+/** the cached period is the longest of both contexts */
+static bool cached_both;
+/** longest period of the settings from before the last write */
+static u32 old_period_us;
+static DEFINE_MUTEX(timing_lock);
+
+/** frames done since the last register write */
+static atomic_t frames_since_write = ATOMIC_INIT(0);
+
+void ar013x_timing_invalidate(void)
+{
+    atomic_inc(&timing_gen);
+    atomic_set(&frames_since_write, 0);
+}
+
+void ar013x_timing_frame_done(void)
+{
+    atomic_inc(&frames_since_write);
+}
+
+/** @brief Reads the lines of a frame in a context, 0 for A and 1 for B */
+static int read_frame_lines(int context, u32 *lines)
+{
+    u16 frame_len, coarse;
+    int r;
+
+    r = read_cam_reg(context ? AR013X_AD_FRAME_LEN_LINES_CB
+                             : AR013X_AD_FRAME_LEN_LINES, &frame_len);
+    if (r != 0)
+        return r;
+    r = read_cam_reg(context ? AR013X_AD_COARSE_INTEGRATION_TIME_CB
+                             : AR013X_AD_COARSE_INTEGRATION_TIME, &coarse);
+    if (r != 0)
+        return r;
+
+    *lines = max_t(u32, frame_len, (u32)coarse + 1);
+    return 0;
+}
+
+static int read_frame_period_us(bool both, u32 *period_us)
+{
+    u16 test, line_len, pre_div, mult, sys_div, pix_div;
+    u64 pixclk, period;
+    u32 lines, lines_b;
+    int r;
+
+    if (both) {
+        if ((r = read_frame_lines(0, &lines)) != 0)
+            return r;
+        if ((r = read_frame_lines(1, &lines_b)) != 0)
+            return r;
+        lines = max_t(u32, lines, lines_b);
+    } else {
+        // the context the sensor is streaming with is bit 13
+        if ((r = read_cam_reg(AR013X_AD_DIGITAL_TEST, &test)) != 0)
+            return r;
+        if ((r = read_frame_lines(test & 0x2000 ? 1 : 0, &lines)) != 0)
+            return r;
+    }
+
+    if ((r = read_cam_reg(AR013X_AD_LINE_LENGTH_PCK, &line_len)) != 0)
+        return r;
+    if ((r = read_cam_reg(AR013X_AD_PRE_PLL_CLK_DIV, &pre_div)) != 0)
+        return r;
+    if ((r = read_cam_reg(AR013X_AD_PLL_MULTIPLIER, &mult)) != 0)
+        return r;
+    if ((r = read_cam_reg(AR013X_AD_VT_SYS_CLK_DIV, &sys_div)) != 0)
+        return r;
+    if ((r = read_cam_reg(AR013X_AD_VT_PIX_CLK_DIV, &pix_div)) != 0)
+        return r;
+
+    if (pre_div == 0 || sys_div == 0 || pix_div == 0)
+        return -EINVAL;
+
+    pixclk = div_u64((u64)extclk * mult, (u32)pre_div * sys_div * pix_div);
+    if (pixclk == 0)
+        return -EINVAL;
+
+    period = div64_u64((u64)lines * line_len * USEC_PER_SEC, pixclk);
+
+    *period_us = (u32)min_t(u64, period, U32_MAX);
+    return 0;
+}
+
+int ar013x_frame_period_us(u32 *period_us)
+{
+    bool both = ar013x_context_active();
+    bool in_flight;
+    u32 period;
+    int gen, r = 0;
+
+    mutex_lock(&timing_lock);
+
+    in_flight = atomic_read(&frames_since_write) <= ar013x_hold_latency() + 1;
+    if (!in_flight)
+        old_period_us = 0;
+
+    gen = atomic_read(&timing_gen);
+    if (gen != cached_gen || both != cached_both) {
+        r = read_frame_period_us(both, &period);
+        if (r == 0) {
+            // the settings it was computed from may still be in flight
+            if (cached_gen >= 0 && in_flight)
+                old_period_us = max_t(u32, old_period_us, cached_period_us);
+            cached_period_us = period;
+            cached_both      = both;
+        }
+        // only cache it if no register was written while reading them
+        if (r == 0 && atomic_read(&timing_gen) == gen)
+            cached_gen = gen;
+    }
+    if (r == 0)
+        *period_us = max_t(u32, cached_period_us, old_period_us);
+
+    mutex_unlock(&timing_lock);
+
+    return r;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file    ar013x_timing.h
+ * @brief   AR013x CMOS Digital Image Sensor frame timing.
+ *
+ * @addtogroup AR013x
+ */
+
+#ifndef AR013X_TIMING_H
+#define AR013X_TIMING_H
+
+#include <linux/types.h>
+
+/**
+ * @brief Gets the longest time between frames the frames in flight can have.
+ *
+ * Computed from the frame and line length, the PLL dividers and the
+ * integration time of the active context, or of both contexts while they
+ * alternate. Until hold_latency + 1 frames are done after a register write,
+ * it is at least the period from before the write. The registers are only
+ * read again after a write to the sensor, see ar013x_timing_invalidate().
+ *
+ * @param period_us The frame period in microseconds.
+ * @return 0 on success or negative errno value on failure.
+ */
+int ar013x_frame_period_us(u32 *period_us);
+
+/**
+ * @brief Drops the cached frame period, called whenever a sensor register is
+ * written.
+ */
+void ar013x_timing_invalidate(void);
+
+/**
+ * @brief Counts a frame done, for how long the settings from before a write
+ * can be in flight. Called from the interrupt.
+ */
+void ar013x_timing_frame_done(void);
+
+#endif /* AR013X_TIMING_H */
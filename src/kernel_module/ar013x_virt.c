@@ -0,0 +1,118 @@
+/**
+ * @file    ar013x_virt.c
+ * @brief   Simulated AR013x CMOS Digital Image Sensor registers.
+ *
+ * @addtogroup AR013x
+ */
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "ar013x_regs.h"
+#include "ar013x_virt.h"
+
+/** the sensor's 16 bit registers are at even addresses from 0x3000 */
+#define VIRT_REG_FIRST 0x3000U
+#define VIRT_REG_LAST  0x3FFEU
+#define VIRT_REG_INDEX(reg) (((reg) - VIRT_REG_FIRST) / 2)
+
+static unsigned short virt_chip_version = 0x2402;
+module_param(virt_chip_version, ushort, 0444);
+MODULE_PARM_DESC(virt_chip_version,
+                 "Chip version the simulated sensor reports, 0x2402 for an "
+                 "AR0130 or 0x2406 for an AR0134 (default: 0x2402)");
+
+static u16 regs[VIRT_REG_INDEX(VIRT_REG_LAST) + 1];
+static DEFINE_SPINLOCK(regs_lock);
+
+/**
+ * Power on values of the registers the driver reads before writing, the
+ * frame timing comes out at about 30 fps with a 27MHz EXTCLK.
+ */
+static const struct {
+    u16 reg;
+    u16 val;
+} reset_regs[] = {
+    {AR013X_AD_Y_ADDR_END, 0x03BF},
+    {AR013X_AD_X_ADDR_END, 0x04FF},
+    {AR013X_AD_FRAME_LEN_LINES, 0x03DE},
+    {AR013X_AD_COARSE_INTEGRATION_TIME, 0x00C0},
+    {AR013X_AD_LINE_LENGTH_PCK, 0x0672},
+    {AR013X_AD_PRE_PLL_CLK_DIV, 0x000A},
+    {AR013X_AD_PLL_MULTIPLIER, 0x00CB},
+    {AR013X_AD_VT_SYS_CLK_DIV, 0x0004},
+    {AR013X_AD_VT_PIX_CLK_DIV, 0x0003},
+    {AR013X_AD_Y_ADDR_END_CB, 0x03BF},
+    {AR013X_AD_X_ADDR_END_CB, 0x04FF},
+    {AR013X_AD_FRAME_LEN_LINES_CB, 0x03DE},
+    {AR013X_AD_COARSE_INTEGRATION_TIME_CB, 0x00C0},
+};
+
+static bool valid_reg(u16 reg)
+{
+    return reg >= VIRT_REG_FIRST && reg <= VIRT_REG_LAST && !(reg & 1);
+}
+
+/** the green1 gain of a context's global gain, which it reads back as */
+static u16 green1_gain_of(u16 reg)
+{
+    return reg == AR013X_AD_GLOBAL_GAIN ? AR013X_AD_GREEN1_GAIN
+                                        : AR013X_AD_GREEN1_GAIN_CB;
+}
+
+void ar013x_virt_init(void)
+{
+    spin_lock(&regs_lock);
+    memset(regs, 0, sizeof(regs));
+    for (int i = 0; i < ARRAY_SIZE(reset_regs); i++)
+        regs[VIRT_REG_INDEX(reset_regs[i].reg)] = reset_regs[i].val;
+    regs[VIRT_REG_INDEX(AR013X_AD_CHIP_VERSION_REG)] = virt_chip_version;
+    spin_unlock(&regs_lock);
+}
+
+int ar013x_virt_read(u16 reg, u16 *val)
+{
+    if (!val)
+        return -EINVAL;
+    if (!valid_reg(reg))
+        return -EREMOTEIO;
+
+    if (reg == AR013X_AD_GLOBAL_GAIN || reg == AR013X_AD_GLOBAL_GAIN_CB)
+        reg = green1_gain_of(reg);
+
+    spin_lock(&regs_lock);
+    *val = regs[VIRT_REG_INDEX(reg)];
+    spin_unlock(&regs_lock);
+
+    return 0;
+}
+
+int ar013x_virt_write(u16 reg, u16 val)
+{
+    if (!valid_reg(reg))
+        return -EREMOTEIO;
+
+    // read only
+    if (reg == AR013X_AD_CHIP_VERSION_REG)
+        return 0;
+
+    spin_lock(&regs_lock);
+    regs[VIRT_REG_INDEX(reg)] = val;
+    // a global gain is written to the four colour gains of its context
+    if (reg == AR013X_AD_GLOBAL_GAIN || reg == AR013X_AD_GLOBAL_GAIN_CB)
+        for (u16 r = green1_gain_of(reg); r < reg; r += 2)
+            regs[VIRT_REG_INDEX(r)] = val;
+    spin_unlock(&regs_lock);
+
+    return 0;
+}
+
+void ar013x_virt_frames(u32 frames)
+{
+    spin_lock(&regs_lock);
+    regs[VIRT_REG_INDEX(AR013X_AD_FRAME_COUNT)] += frames;
+    spin_unlock(&regs_lock);
+}
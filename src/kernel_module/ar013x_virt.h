@@ -0,0 +1,48 @@
+/**
+ * @file    ar013x_virt.h
+ * @brief   Simulated AR013x CMOS Digital Image Sensor registers.
+ *
+ * A register file behind read_cam_reg()/write_cam_reg() when the driver runs
+ * without the camera board. Registers hold what was last written to them,
+ * the sensor doesn't act on any of them. Only the frame count changes, as
+ * the simulated PRUs see frames.
+ *
+ * @addtogroup AR013x
+ */
+
+#ifndef AR013X_VIRT_H
+#define AR013X_VIRT_H
+
+#include <linux/types.h>
+
+/**
+ * @brief Resets the registers to their power on values.
+ */
+void ar013x_virt_init(void);
+
+/**
+ * @brief Reads a simulated register.
+ * @param reg The register to read from
+ * @param val A pointer to read the value to
+ * @return 0 on success or -EREMOTEIO for a register the sensor doesn't have,
+ * like an i2c NAK.
+ */
+int ar013x_virt_read(u16 reg, u16 *val);
+
+/**
+ * @brief Writes a simulated register.
+ * @param reg The register to write to
+ * @param val The value to write
+ * @return 0 on success or -EREMOTEIO for a register the sensor doesn't have,
+ * like an i2c NAK.
+ */
+int ar013x_virt_write(u16 reg, u16 val);
+
+/**
+ * @brief Counts frames the simulated sensor put out in its frame count
+ * register, the one thing it does on its own.
+ * @param frames The frames since the last call
+ */
+void ar013x_virt_frames(u32 frames);
+
+#endif /* AR013X_VIRT_H */
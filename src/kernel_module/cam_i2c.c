@@ -1,54 +1,456 @@
 #include <linux/delay.h>
 #include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/regmap.h>
+#include <linux/spinlock.h>
 #include <linux/version.h>
 
+#include "ar013x_regs.h"
+#include "ar013x_timing.h"
+#include "ar013x_virt.h"
 #include "cam_i2c.h"
 
+/* where the sensor is when neither the device tree nor the params say */
+#define CAM_I2C_BUS  2
 #define CAM_I2C_ADDR 0x10
 
+static int i2c_bus = -1;
+module_param(i2c_bus, int, 0444);
+MODULE_PARM_DESC(i2c_bus,
+                 "I2C adapter number of the sensor, overrides the device "
+                 "tree's psas,i2c-bus (default: psas,i2c-bus or 2)");
+
+static int i2c_addr = -1;
+module_param(i2c_addr, int, 0444);
+MODULE_PARM_DESC(i2c_addr,
+                 "7 bit I2C address of the sensor, overrides the device "
+                 "tree's psas,i2c-addr (default: psas,i2c-addr or 0x10)");
+
+static unsigned int i2c_burst = CAM_I2C_BURST_MAX;
+module_param(i2c_burst, uint, 0644);
+MODULE_PARM_DESC(i2c_burst,
+                 "Most registers init_camera_regs() writes in one I2C "
+                 "transfer, 1 writes them one at a time (default: 32)");
+
 /** The i2c adapter */
 static struct i2c_adapter *i2c_adap;
 /** Used to interact with the image sensor's i2c slave address */
 static struct i2c_client *client;
-/** @breif Represents the address of the AR013X image sensor */
-static const struct i2c_board_info ar013x_i2c_info = {
-    I2C_BOARD_INFO("AR013X", CAM_I2C_ADDR),
+/** Registers are the simulated ones in ar013x_virt.c instead of the sensor's */
+static bool i2c_virt;
+
+/** The sensor's registers, through the register cache */
+static struct regmap *regmap;
+/**
+ * Held around every register access. read_cam_regs() turns the cache bypass
+ * and cache only modes of the whole regmap on and off, so nothing else may
+ * touch it meanwhile.
+ */
+static DEFINE_MUTEX(regs_mutex);
+/**
+ * The sensor's auto exposure is on, so it changes the integration time and
+ * gains itself
+ */
+static bool ae_on;
+
+/** register traffic, see cam_i2c_get_stats() */
+static struct cam_i2c_stats stats;
+static DEFINE_SPINLOCK(stats_lock);
+
+static void count_transfer(bool write, int ret, int regs, u64 start_ns)
+{
+    u64 ns = ktime_get_ns() - start_ns;
+
+    spin_lock(&stats_lock);
+    if (write) {
+        stats.writes++;
+    } else {
+        stats.reads++;
+        stats.bus_reg_reads += regs;
+    }
+    if (ret < 0)
+        stats.errors++;
+    stats.total_ns += ns;
+    if (ns > stats.max_ns)
+        stats.max_ns = ns;
+    spin_unlock(&stats_lock);
+}
+
+/**
+ * The sensor moves to the next register after each one of a burst, except
+ * for the sequencer data port, which takes all of them.
+ */
+static u16 next_reg(u16 reg)
+{
+    return reg == AR013X_AD_SEQ_DATA_PORT ? reg : reg + 2;
+}
+
+// ---------------------------------------------------------------------------
+// regmap bus, the I2C transfers themselves
+
+/** @brief Writes the register address and values in data in one transfer */
+static int cam_regmap_write(void *context, const void *data, size_t count)
+{
+    const u8 *buf = data;
+    u16 reg = (buf[0] << 8) | buf[1];
+    u64 start_ns;
+    int ret;
+
+    if (count < 4 || count % 2)
+        return -EINVAL;
+
+    start_ns = ktime_get_ns();
+    if (i2c_virt) {
+        ret = 0;
+        for (size_t i = 2; i < count && ret == 0; i += 2, reg = next_reg(reg))
+            ret = ar013x_virt_write(reg, (buf[i] << 8) | buf[i + 1]);
+        count_transfer(true, ret, 0, start_ns);
+        return ret;
+    }
+
+    ret = i2c_master_send(client, data, count);
+    if (ret >= 0 && ret != count)
+        ret = -EBADMSG;
+    count_transfer(true, ret, 0, start_ns);
+    if (ret == -EBADMSG) {
+        printk(KERN_INFO "No data was written for reg %x", reg);
+        return ret;
+    } else if (ret < 0) {
+        printk(KERN_INFO "I2C write for reg %x failed with %d", reg, ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+/** @brief Reads val_size bytes of registers from the one in reg_buf */
+static int cam_regmap_read(void *context, const void *reg_buf,
+                           size_t reg_size, void *val_buf, size_t val_size)
+{
+    const u8 *r = reg_buf;
+    u8 *vals = val_buf;
+    u16 reg = (r[0] << 8) | r[1];
+    u16 val;
+    u64 start_ns;
+    int ret;
+
+    if (reg_size != 2 || val_size < 2 || val_size % 2)
+        return -EINVAL;
+
+    start_ns = ktime_get_ns();
+    if (i2c_virt) {
+        ret = 0;
+        for (size_t i = 0; i < val_size && ret == 0;
+             i += 2, reg = next_reg(reg)) {
+            ret = ar013x_virt_read(reg, &val);
+            vals[i]     = val >> 8;
+            vals[i + 1] = val;
+        }
+        count_transfer(false, ret, val_size / 2, start_ns);
+        return ret;
+    }
+
+    // construct the i2c message that:
+    // - writes a 16 bit register (to be read)
+    // - reads back the 16 bit contents of that register and the ones after
+    //   it, big endian like the register address
+    //
+    // This is to be used with i2c_transfer() and not i2c_master_recv()
+    // because i2c_master_recv does not support reading 16 bit registers
+    struct i2c_msg msg[] = {
+        // Write the 16bit reg. I2C_M_REV_DIR_ADDR is for the need to trick
+        // the i2c driver to think its receiving while it does a write.
+        {
+            .addr  = client->addr,
+            .flags = I2C_M_REV_DIR_ADDR,
+            .len   = 2,
+            .buf   = (char *)reg_buf
+        },
+        // Receive the 16bit values. The I2C_M_RD is for receiving
+        {
+            .addr = client->addr,
+            .flags = I2C_M_RD,
+            .len = val_size,
+            .buf = val_buf
+        },
+    };
+
+    // start the i2c tranfers and check the return val
+    ret = i2c_transfer(i2c_adap, msg, 2);
+    count_transfer(false, ret == 2 ? 0 : -EIO, val_size / 2, start_ns);
+    if (ret < 0) {
+        printk(KERN_ERR "I2C read at reg %x failed with error code %d\n", reg,
+               ret);
+        return ret;
+    } else if (ret != 2) {
+        // make sure both messages went through
+        printk(KERN_ERR
+               "I2C read at reg %x read incorrect number of bytes %d\n",
+               reg, ret);
+        return -EBADMSG;
+    }
+
+    return 0;
+}
+
+static const struct regmap_bus cam_regmap_bus = {
+    .write                      = cam_regmap_write,
+    .read                       = cam_regmap_read,
+    .reg_format_endian_default  = REGMAP_ENDIAN_BIG,
+    .val_format_endian_default  = REGMAP_ENDIAN_BIG,
+    .max_raw_read               = 2 * CAM_I2C_BURST_MAX,
+    .max_raw_write              = 2 * CAM_I2C_BURST_MAX,
 };
 
-int init_cam_i2c(void)
+/**
+ * @brief The registers the sensor changes itself, which can't be cached. The
+ * integration time and gains are the auto exposure's while it is on, and its
+ * digital gain goes through the global gain to the colour gains.
+ */
+static bool cam_volatile_reg(struct device *dev, unsigned int reg)
 {
-    int ret = 0;
+    switch (reg) {
+    case AR013X_AD_RESET_REGISTER:
+    case AR013X_AD_GPI_STATUS:
+    case AR013X_AD_FRAME_COUNT:
+    case AR013X_AD_FRAME_STATUS:
+    case AR013X_AD_SEQ_DATA_PORT:
+    case AR013X_AD_SEQ_CTRL_PORT:
+    case AR013X_AD_FRAME_EXPOSURE:
+    case AR013X_AD_TEMPSENS_DATA:
+    case AR013X_AD_AE_CURRENT_GAINS:
+    case AR013X_AD_AE_MEAN_L:
+    case AR013X_AD_AE_COARSE_INTEGRATION_TIME:
+    case AR013X_AD_DELTA_DK_LEVEL:
+    case AR013X_AD_HIPSI_CRC_0:
+    case AR013X_AD_HIPSI_CRC_1:
+    case AR013X_AD_HIPSI_CRC_2:
+    case AR013X_AD_HIPSI_CRC_3:
+    case AR013X_AD_STAT_CRC_3:
+    case AR013X_AD_I2C_WRT_CHECKSUM:
+        return true;
+    case AR013X_AD_COARSE_INTEGRATION_TIME:
+    case AR013X_AD_COARSE_INTEGRATION_TIME_CB:
+    case AR013X_AD_GREEN1_GAIN ... AR013X_AD_GLOBAL_GAIN:
+    case AR013X_AD_GREEN1_GAIN_CB ... AR013X_AD_GLOBAL_GAIN_CB:
+    case AR013X_AD_DIGITAL_TEST:
+        return ae_on;
+    default:
+        return false;
+    }
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+/** @brief The sequencer data port takes a whole burst */
+static bool cam_noinc_reg(struct device *dev, unsigned int reg)
+{
+    return reg == AR013X_AD_SEQ_DATA_PORT;
+}
+#endif
+
+static const struct regmap_config cam_regmap_config = {
+    .name         = "ar013x",
+    .reg_bits     = 16,
+    .reg_stride   = 2,
+    .val_bits     = 16,
+    .max_register = 0x3FFE,
+    .volatile_reg = cam_volatile_reg,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+    .writeable_noinc_reg = cam_noinc_reg,
+#endif
+    .cache_type   = REGCACHE_RBTREE,
+};
+
+/**
+ * @brief Keeps the cache in step with a register the driver wrote. A soft
+ * reset puts every register back to its default, and the registers auto
+ * exposure owns were not cached while it was on. Writing a global gain sets
+ * the four colour gains of its context, and it reads back as green1's.
+ */
+static void cam_reg_written(u16 reg, u16 val)
+{
+    if (reg == AR013X_AD_RESET_REGISTER && (val & 0x0001)) {
+        regcache_drop_region(regmap, 0x3000, 0x3FFE);
+        ae_on = false;
+    } else if (reg == AR013X_AD_AE_CTRL_REG && ae_on != (val & 0x0001)) {
+        ae_on = val & 0x0001;
+        regcache_drop_region(regmap, AR013X_AD_COARSE_INTEGRATION_TIME,
+                             AR013X_AD_COARSE_INTEGRATION_TIME);
+        regcache_drop_region(regmap, AR013X_AD_COARSE_INTEGRATION_TIME_CB,
+                             AR013X_AD_COARSE_INTEGRATION_TIME_CB);
+        regcache_drop_region(regmap, AR013X_AD_GREEN1_GAIN,
+                             AR013X_AD_GLOBAL_GAIN);
+        regcache_drop_region(regmap, AR013X_AD_GREEN1_GAIN_CB,
+                             AR013X_AD_GLOBAL_GAIN_CB);
+        regcache_drop_region(regmap, AR013X_AD_DIGITAL_TEST,
+                             AR013X_AD_DIGITAL_TEST);
+    } else if (reg == AR013X_AD_GLOBAL_GAIN || reg == AR013X_AD_GREEN1_GAIN) {
+        regcache_drop_region(regmap, AR013X_AD_GREEN1_GAIN,
+                             AR013X_AD_GLOBAL_GAIN);
+    } else if (reg == AR013X_AD_GLOBAL_GAIN_CB ||
+               reg == AR013X_AD_GREEN1_GAIN_CB) {
+        regcache_drop_region(regmap, AR013X_AD_GREEN1_GAIN_CB,
+                             AR013X_AD_GLOBAL_GAIN_CB);
+    }
+}
+
+static int init_regmap(struct device *dev)
+{
+    regmap = regmap_init(dev, &cam_regmap_bus, NULL, &cam_regmap_config);
+    if (IS_ERR(regmap)) {
+        int r = PTR_ERR(regmap);
+
+        printk(KERN_ERR "prucam: register map failed: %d\n", r);
+        regmap = NULL;
+        return r;
+    }
+
+    return 0;
+}
+
+int init_cam_i2c(struct device *dev, bool virt)
+{
+    struct i2c_board_info info = {
+        I2C_BOARD_INFO("AR013X", CAM_I2C_ADDR),
+    };
+    u32 bus = CAM_I2C_BUS;
+    u32 addr = CAM_I2C_ADDR;
+    int r;
+
+    i2c_virt = virt;
+    ae_on = false;
+    if (virt) {
+        ar013x_virt_init();
+        return init_regmap(dev);
+    }
+
+    // the device tree says where the sensor is, the params override it
+    of_property_read_u32(dev->of_node, "psas,i2c-bus", &bus);
+    of_property_read_u32(dev->of_node, "psas,i2c-addr", &addr);
+    if (i2c_bus >= 0)
+        bus = i2c_bus;
+    if (i2c_addr >= 0)
+        addr = i2c_addr;
 
-    i2c_adap = i2c_get_adapter(2);
+    if (addr > 0x7F) {
+        printk(KERN_ERR "prucam: invalid i2c address 0x%x\n", addr);
+        return -EINVAL;
+    }
+    info.addr = addr;
+
+    i2c_adap = i2c_get_adapter(bus);
+    if (!i2c_adap) {
+        printk(KERN_ERR "prucam: no i2c adapter %u\n", bus);
+        return -ENODEV;
+    }
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5,2,6)
-    client = i2c_new_device(i2c_adap, &ar013x_i2c_info);
+    client = i2c_new_device(i2c_adap, &info);
 #else
-    client = i2c_new_client_device(i2c_adap, &ar013x_i2c_info);
+    client = i2c_new_client_device(i2c_adap, &info);
 #endif
 
-    if (!client) {
+    if (IS_ERR_OR_NULL(client)) {
         printk(KERN_ERR "i2c register failed\n");
-        ret = -ENXIO;
+        i2c_put_adapter(i2c_adap);
+        client = NULL;
+        return -ENXIO;
     }
 
-    return ret;
+    r = init_regmap(dev);
+    if (r < 0) {
+        i2c_unregister_device(client);
+        i2c_put_adapter(i2c_adap);
+        client = NULL;
+        return r;
+    }
+
+    printk(KERN_INFO "prucam: sensor on i2c-%u at 0x%02x\n", bus, addr);
+    return 0;
 }
 
 int end_cam_i2c(void)
 {
+    regmap_exit(regmap);
+    regmap = NULL;
+
+    if (i2c_virt)
+        return 0;
+
     i2c_unregister_device(client);
+    i2c_put_adapter(i2c_adap);
+    client = NULL;
+    i2c_adap = NULL;
     return 0;
 }
 
+void cam_i2c_get_stats(struct cam_i2c_stats *out)
+{
+    spin_lock(&stats_lock);
+    *out = stats;
+    spin_unlock(&stats_lock);
+}
+
+void cam_i2c_reset_stats(void)
+{
+    spin_lock(&stats_lock);
+    stats.reads         = 0;
+    stats.writes        = 0;
+    stats.reg_reads     = 0;
+    stats.bus_reg_reads = 0;
+    stats.errors        = 0;
+    stats.total_ns      = 0;
+    stats.max_ns        = 0;
+    spin_unlock(&stats_lock);
+}
+
+/**
+ * The registers of the controls, see ar013x_controls.c. regmap reads a range
+ * that isn't all volatile one register per transfer until it is cached, so
+ * init_camera_regs() reads them into the cache a burst each.
+ */
+static const struct {
+    u16 first;
+    u16 count;
+} control_ranges[] = {
+    {AR013X_AD_Y_ADDR_START, 25},          // to DIGITAL_BINNING
+    {AR013X_AD_GREEN1_GAIN, 5},            // to GLOBAL_GAIN
+    {AR013X_AD_X_ADDR_START_CB, 30},       // to GLOBAL_GAIN_CB
+    {AR013X_AD_AE_CTRL_REG, 19},           // to AE_DARK_CUR_THRESH_REG
+    {AR013X_AD_AE_ROI_X_START_OFFSET, 21}, // to AE_AG_EXPOSURE_LO
+};
+
+/** @return how many registers from regs[0] one burst can write */
+static int burst_len(const camera_regs_t *regs, int max)
+{
+    int n = 1;
+
+    // delays and the end of the table have reg 0 and end the burst too
+    while (n < max && regs[n].reg != 0
+           && regs[n].reg == next_reg(regs[n - 1].reg))
+        n++;
+
+    return n;
+}
+
 int init_camera_regs(camera_regs_t *regs)
 {
-    int ret;
+    int ret, n, max;
+    u16 vals[CAM_I2C_BURST_MAX];
+    u32 writes = 0, transfers = 0, reads = 0;
+    u64 delay_ns = 0;
+    u64 start_ns, delay_start_ns;
 
     if (!regs)
         return 0; // nothing todo
 
-    for (int i = 0;; i++) {
+    max = clamp_t(int, i2c_burst, 1, CAM_I2C_BURST_MAX);
+    start_ns = ktime_get_ns();
+
+    for (int i = 0;; i += n) {
         // last entry in the array will be empty
         if (regs[i].reg == 0 && regs[i].val == 0)
             break;
@@ -57,98 +459,185 @@ int init_camera_regs(camera_regs_t *regs)
         if (regs[i].reg == 0) {
             // delay is more wasteful than sleep, but the resultant traffic is
             // cleaner. TODO Come back to this.
+            delay_start_ns = ktime_get_ns();
             mdelay(regs[i].val); // msleep(reg.val);
+            delay_ns += ktime_get_ns() - delay_start_ns;
+            n = 1;
             continue;
         }
 
-        ret = write_cam_reg(regs[i].reg, regs[i].val);
+        // consecutive registers, or sequencer data, go in one transfer
+        n = burst_len(&regs[i], max);
+        for (int j = 0; j < n; j++)
+            vals[j] = regs[i + j].val;
+
+        ret = write_cam_regs(regs[i].reg, vals, n);
+        writes += n;
+        transfers++;
         if (ret < 0) {
-            printk(KERN_ERR "i2c write reg: %04x val: %04x returned: %d\n",
-                   regs[i].reg, regs[i].val, ret);
+            printk(KERN_ERR "i2c write reg: %04x val: %04x (%d regs) "
+                   "returned: %d\n", regs[i].reg, regs[i].val, n, ret);
             // return ret;
         }
         // mdelay(1);
     }
 
+    // the registers the table didn't set are only the sensor's defaults,
+    // which the cache doesn't have yet
+    for (int i = 0; i < ARRAY_SIZE(control_ranges); i++) {
+        ret = read_cam_regs(control_ranges[i].first, vals,
+                            control_ranges[i].count);
+        if (ret < 0) {
+            printk(KERN_ERR "i2c read regs: %04x (%d regs) returned: %d\n",
+                   control_ranges[i].first, control_ranges[i].count, ret);
+            continue;
+        }
+        reads++;
+    }
+
+    spin_lock(&stats_lock);
+    stats.init_writes    = writes;
+    stats.init_transfers = transfers;
+    stats.init_reads     = reads;
+    stats.init_ns        = ktime_get_ns() - start_ns;
+    stats.init_delay_ns  = delay_ns;
+    spin_unlock(&stats_lock);
+
     return 0;
 }
 
+
+int write_cam_regs(u16 reg, const u16 *vals, int count)
+{
+    int ret = 0;
+
+    if (!vals || count < 1 || count > CAM_I2C_BURST_MAX)
+        return -EINVAL;
+
+    mutex_lock(&regs_mutex);
+
+    // the write may change the frame timing, even a failed one
+    ar013x_timing_invalidate();
+
+    if (reg == AR013X_AD_SEQ_DATA_PORT) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+        // noinc writes are raw, so the values go big endian
+        __be16 vals_be[CAM_I2C_BURST_MAX];
+
+        for (int i = 0; i < count; i++)
+            vals_be[i] = cpu_to_be16(vals[i]);
+        ret = regmap_noinc_write(regmap, reg, vals_be, 2 * count);
+#else
+        for (int i = 0; i < count && ret == 0; i++)
+            ret = regmap_write(regmap, reg, vals[i]);
+#endif
+        goto out;
+    }
+
+    // the cache takes the values and the bus gets them in one transfer
+    ret = regmap_bulk_write(regmap, reg, vals, count);
+    if (ret < 0)
+        goto out;
+
+    for (int i = 0; i < count; i++, reg += 2)
+        cam_reg_written(reg, vals[i]);
+
+out:
+    mutex_unlock(&regs_mutex);
+    return ret;
+}
+
 int write_cam_reg(uint16_t reg, uint16_t val)
 {
+    return write_cam_regs(reg, &val, 1);
+}
+
+int update_cam_reg(u16 reg, u16 mask, u16 val)
+{
+    unsigned int new;
     int ret;
 
-    // unpack 16 bit values in buffer of bytes
-    char buf[4] = {
-        reg >> 8,
-        reg,
-        val >> 8,
-        val,
-    };
+    mutex_lock(&regs_mutex);
 
-    ret = i2c_master_send(client, buf, 4);
-    if (ret < 0) {
-        printk(KERN_INFO "I2C write for reg %x failed with %d", reg, ret);
-    } else if (ret == 0) {
-        printk(KERN_INFO "No data was written for reg %x", reg);
-        return -EBADMSG;
+    ar013x_timing_invalidate();
+
+    // only written when the bits change, and read from the cache
+    ret = regmap_update_bits(regmap, reg, mask, val);
+    if (ret < 0)
+        goto out;
+
+    // the cached value, the register isn't volatile
+    if (reg == AR013X_AD_AE_CTRL_REG) {
+        if ((ret = regmap_read(regmap, reg, &new)) < 0)
+            goto out;
+        cam_reg_written(reg, new);
+    } else if (reg != AR013X_AD_RESET_REGISTER) {
+        // only the gains are left that care, and not about the value
+        cam_reg_written(reg, val);
     }
 
-    return 0;
+out:
+    mutex_unlock(&regs_mutex);
+    return ret;
 }
 
-int read_cam_reg(uint16_t reg, uint16_t *val)
+int read_cam_regs(u16 reg, u16 *vals, int count)
 {
+    __be16 vals_be[CAM_I2C_BURST_MAX];
     int ret;
 
     // safety first
-    if (!val)
+    if (!vals || count < 1 || count > CAM_I2C_BURST_MAX)
         return -EINVAL;
 
-    // I2C send the little byte first, which is sorta big-endian compared
-    // to the little endian uint16 arguments. Convert these values to BE
-    __be16 reg_be = cpu_to_be16(reg);
-    __be16 val_be = 0;
+    spin_lock(&stats_lock);
+    stats.reg_reads += count;
+    spin_unlock(&stats_lock);
 
-    // construct the i2c message that:
-    // - writes a 16 bit register (to be read)
-    // - reads back the 16 bit contents of that register
-    //
-    // This is to be used with i2c_transfer() and not i2c_master_recv()
-    // because i2c_master_recv does not support reading 16 bit registers
-    struct i2c_msg msg[] = {
-        // Write the 16bit reg. I2C_M_REV_DIR_ADDR is for the need to trick
-        // the i2c driver to think its receiving while it does a write.
-        {
-            .addr  = CAM_I2C_ADDR,
-            .flags = I2C_M_REV_DIR_ADDR,
-            .len   = 2,
-            .buf   = (char *)&reg_be
-        },
-        // Receive the 16bit value. The I2C_M_RD is for receiving
-        {
-            .addr = CAM_I2C_ADDR,
-            .flags = I2C_M_RD,
-            .len = 2,
-            .buf = (char *)&val_be
-        },
-    };
+    // the modes are of the whole regmap, a write meanwhile would only reach
+    // the sensor or only the cache
+    mutex_lock(&regs_mutex);
 
-    // start the i2c tranfers and check the return val
-    ret = i2c_transfer(i2c_adap, msg, 2);
-    if (ret < 0) {
-        printk(KERN_ERR "I2C read at reg %x failed with error code %d\n", reg,
-               ret);
-        return ret;
-    } else if (ret != 2) {
-        // make sure 2 bytes we read
-        printk(KERN_ERR
-               "I2C read at reg %x read incorrect number of bytes %d\n",
-               reg, ret);
-        return -EBADMSG;
+    // past the cache, or regmap reads the registers it has no value for
+    // one at a time
+    regcache_cache_bypass(regmap, true);
+    ret = regmap_raw_read(regmap, reg, vals_be, 2 * count);
+    regcache_cache_bypass(regmap, false);
+    if (ret < 0)
+        goto out;
+
+    for (int i = 0; i < count; i++)
+        vals[i] = be16_to_cpu(vals_be[i]);
+
+    // the values go in the cache only, the sensor has them
+    regcache_cache_only(regmap, true);
+    for (int i = 0; i < count && reg != AR013X_AD_SEQ_DATA_PORT; i++) {
+        if (!cam_volatile_reg(NULL, reg + 2 * i))
+            regmap_write(regmap, reg + 2 * i, vals[i]);
     }
+    regcache_cache_only(regmap, false);
+
+out:
+    mutex_unlock(&regs_mutex);
+    return ret;
+}
 
-    // convert the BE value we read to LE and save to argument pointer
-    *val = be16_to_cpu(val_be);
+int read_cam_reg(uint16_t reg, uint16_t *val)
+{
+    unsigned int v;
+    int ret;
+
+    spin_lock(&stats_lock);
+    stats.reg_reads++;
+    spin_unlock(&stats_lock);
+
+    // a volatile register can't be read in read_cam_regs()' cache only window
+    mutex_lock(&regs_mutex);
+    ret = regmap_read(regmap, reg, &v);
+    mutex_unlock(&regs_mutex);
+    if (ret < 0)
+        return ret;
 
+    *val = v;
     return 0;
 }
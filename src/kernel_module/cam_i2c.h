@@ -3,6 +3,9 @@
 
 #include <linux/i2c.h>
 
+/** the most registers write_cam_regs() or read_cam_regs() do in a transfer */
+#define CAM_I2C_BURST_MAX 32
+
 typedef struct {
     /** the register number */
     u16 reg;
@@ -10,11 +13,51 @@ typedef struct {
     u16 val;
 } camera_regs_t;
 
+/** @brief Register traffic to the sensor, for finding the slow paths */
+struct cam_i2c_stats {
+    /** I2C register reads, a burst is one */
+    u32 reads;
+    /** I2C register writes, a burst is one */
+    u32 writes;
+    /** registers read_cam_reg() and read_cam_regs() were asked for */
+    u32 reg_reads;
+    /** registers read over I2C, the rest of reg_reads came from the cache */
+    u32 bus_reg_reads;
+    /** reads and writes that failed */
+    u32 errors;
+    /** time spent in reads and writes */
+    u64 total_ns;
+    /** longest read or write */
+    u64 max_ns;
+    /** register writes of the last init_camera_regs() */
+    u32 init_writes;
+    /** I2C transfers the last init_camera_regs() wrote them in */
+    u32 init_transfers;
+    /** I2C transfers the last init_camera_regs() read the controls into the
+     * cache in */
+    u32 init_reads;
+    /** time the last init_camera_regs() took, delays included */
+    u64 init_ns;
+    /** time the last init_camera_regs() spent in the delays of its table */
+    u64 init_delay_ns;
+};
+
 /**
  * @breif Initialize the camera registers
+ *
+ * The registers go through a regmap with a register cache. Reads of the
+ * registers only the driver changes come from the cache, the ones the sensor
+ * changes itself are volatile and always read over I2C.
+ *
+ * The sensor is at the psas,i2c-bus adapter and psas,i2c-addr address of the
+ * device tree node, unless the i2c_bus and i2c_addr module params are set.
+ *
+ * @param dev The prucam device
+ * @param virt Use the simulated registers in ar013x_virt.c instead of the
+ * sensor
  * @return 0 on success or non-zero on error
  */
-int init_cam_i2c(void);
+int init_cam_i2c(struct device *dev, bool virt);
 
 /**
  * @breif Initialize the camera registers
@@ -24,10 +67,25 @@ int end_cam_i2c(void);
 
 /**
  * @breif Initialize the camera registers
+ *
+ * Runs of consecutive registers, and of writes to the sequencer data port,
+ * are written in bursts of up to i2c_burst registers.
+ *
  * @return 0 on success and negative errno value on error
  */
 int init_camera_regs(camera_regs_t *regs);
 
+/**
+ * @brief Writes registers in one I2C transfer. The sensor moves to the next
+ * register after each value, except for the sequencer data port, which takes
+ * all of them.
+ * @param reg The first register to write to
+ * @param vals The values to write
+ * @param count The number of values, at most CAM_I2C_BURST_MAX
+ * @return 0 on success and negative errno value on error
+ */
+int write_cam_regs(u16 reg, const u16 *vals, int count);
+
 /**
  * @breif Writes the 16bit value from a 16bit camera register
  * @param reg The Register to write to
@@ -36,6 +94,17 @@ int init_camera_regs(camera_regs_t *regs);
  */
 int write_cam_reg(u16 reg, u16 val);
 
+/**
+ * @brief Changes some bits of a 16bit camera register. The current value
+ * comes from the cache when it can, and the register is only written when
+ * the bits change.
+ * @param reg The Register to change
+ * @param mask The bits to change
+ * @param val The new value of the bits in mask
+ * @return 0 on success and negative errno value on error
+ */
+int update_cam_reg(u16 reg, u16 mask, u16 val);
+
 /**
  * @breif Reads a 16bit value from a 16bit camera register
  * @param reg The Register to read from
@@ -44,4 +113,29 @@ int write_cam_reg(u16 reg, u16 val);
  */
 int read_cam_reg(u16 reg, u16 *val);
 
+/**
+ * @brief Reads registers from the sensor in one I2C transfer, and puts the
+ * ones that aren't volatile in the cache. The sensor moves to the next
+ * register after each value, except for the sequencer data port. The other
+ * register accesses wait for it, as it changes the modes of the whole cache.
+ * @param reg The first register to read from
+ * @param vals The values read
+ * @param count The number of values, at most CAM_I2C_BURST_MAX
+ * @return 0 on success and negative errno value on error
+ */
+int read_cam_regs(u16 reg, u16 *vals, int count);
+
+/**
+ * @brief Gets the register traffic counted since the last
+ * cam_i2c_reset_stats()
+ * @param stats The counters
+ */
+void cam_i2c_get_stats(struct cam_i2c_stats *stats);
+
+/**
+ * @brief Zeroes the read, write and error counters, the figures of the last
+ * init_camera_regs() are kept.
+ */
+void cam_i2c_reset_stats(void);
+
 #endif
@@ -0,0 +1,57 @@
+/**
+ * @file    prucam_backend.h
+ * @brief   The PRUs prucam_main.c captures with, real or simulated.
+ *
+ * A backend provides the control block and something that runs the PRU side
+ * of it, see prucam_shared.h. It calls prucam_frame_done() where the PRU1
+ * interrupt would come, so the capture path above it is the same for all of
+ * them.
+ */
+
+#ifndef PRUCAM_BACKEND_H
+#define PRUCAM_BACKEND_H
+
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
+#include <linux/types.h>
+
+/** @brief A capture backend */
+struct prucam_backend {
+    /** name for the log */
+    const char *name;
+    /**
+     * Gets the backend's resources.
+     * @param pdev The prucam platform device.
+     * @param ctrl Set to the base of the control block.
+     * @return 0 on success or negative errno value on failure.
+     */
+    int (*init)(struct platform_device *pdev, void __iomem **ctrl);
+    /** Frees what init got, the PRUs must be shut down. */
+    void (*end)(void);
+    /**
+     * Boots the PRUs, the control block must be initialized.
+     * @param buf_va Virtual address of the frame buffers.
+     * @param buf_pa Physical address of the frame buffers.
+     * @param buf_size Size of the frame buffers.
+     * @return 0 on success or negative errno value on failure.
+     */
+    int (*boot)(void *buf_va, dma_addr_t buf_pa, size_t buf_size);
+    /** Stops the PRUs wherever they are. */
+    void (*shutdown)(void);
+};
+
+#ifdef PRUCAM_PRU
+/** the PRU-ICSS and the AR013x on the camera board, prucam_pru.c */
+extern const struct prucam_backend prucam_pru_backend;
+#endif
+
+/** simulated PRUs and sensor, prucam_virt.c */
+extern const struct prucam_backend prucam_virt_backend;
+
+/**
+ * @brief Handles a frame the PRUs finished, called from the PRU1 interrupt
+ * or the simulated PRUs. Defined in prucam_main.c.
+ */
+void prucam_frame_done(void);
+
+#endif /* PRUCAM_BACKEND_H */
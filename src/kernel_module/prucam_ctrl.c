@@ -0,0 +1,187 @@
+/**
+ * @file    prucam_ctrl.c
+ * @brief   Kernel side of the control block shared with the PRUs.
+ *
+ * The kernel writes the header and the command ring head, PRU1 writes the
+ * ring tail and the status, see prucam_shared.h.
+ */
+
+#include <linux/build_bug.h>
+#include <linux/delay.h>
+#include <linux/errno.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+
+#include "prucam_ctrl.h"
+
+/** base of the control block, the base of the PRU shared RAM */
+static void __iomem *ctrl_base;
+/** number of commands sent */
+static u32 cmd_head;
+/** value of cmd_errors at the last sync */
+static u32 cmd_errors_seen;
+
+#define CTRL_ADDR(field) (ctrl_base + offsetof(struct prucam_ctrl, field))
+
+static const char *const ctrl_state_names[] = {
+    [PRUCAM_STATE_WAIT_INIT] = "wait_init",
+    [PRUCAM_STATE_IDLE]      = "idle",
+    [PRUCAM_STATE_CAPTURING] = "capturing",
+    [PRUCAM_STATE_STREAMING] = "streaming",
+};
+
+static const char *const pru0_state_names[] = {
+    [0]                        = "boot",
+    [PRUCAM_PRU0_WAIT_TRIGGER] = "wait_trigger",
+    [PRUCAM_PRU0_WAIT_VSYNC]   = "wait_vsync",
+    [PRUCAM_PRU0_WAIT_HSYNC]   = "wait_hsync",
+    [PRUCAM_PRU0_FRAME_DONE]   = "frame_done",
+};
+
+static const char *const pru1_state_names[] = {
+    [0]                             = "boot",
+    [PRUCAM_PRU1_WAIT_CMD]          = "wait_cmd",
+    [PRUCAM_PRU1_WAIT_CHUNK]        = "wait_chunk",
+    [PRUCAM_PRU1_WAIT_FRAME_STATUS] = "wait_frame_status",
+};
+
+const char *prucam_ctrl_state_name(u32 state)
+{
+    if (state >= ARRAY_SIZE(ctrl_state_names))
+        return "unknown";
+    return ctrl_state_names[state];
+}
+
+const char *prucam_pru_state_name(int pru, u32 state)
+{
+    if (pru == 0 && state < ARRAY_SIZE(pru0_state_names))
+        return pru0_state_names[state];
+    if (pru == 1 && state < ARRAY_SIZE(pru1_state_names))
+        return pru1_state_names[state];
+    return "unknown";
+}
+
+u32 prucam_ctrl_readl(size_t offset)
+{
+    return readl(ctrl_base + offset);
+}
+
+void prucam_ctrl_init(void __iomem *base)
+{
+    // the PRU assembly uses these offsets directly
+    BUILD_BUG_ON(offsetof(struct prucam_ctrl, rows) !=
+                 PRUCAM_CTRL_GEOMETRY_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_ctrl, options) !=
+                 PRUCAM_CTRL_OPTIONS_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_ctrl, frame_errors) !=
+                 PRUCAM_CTRL_FRAME_STATUS_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_ctrl, pru[0]) !=
+                 PRUCAM_CTRL_PRU0_STATUS_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_ctrl, pru[1]) !=
+                 PRUCAM_CTRL_PRU1_STATUS_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_pru_status, state) !=
+                 PRUCAM_STATUS_STATE_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_pru_status, frames) !=
+                 PRUCAM_STATUS_FRAMES_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_pru_status, lines) !=
+                 PRUCAM_STATUS_LINES_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_pru_status, chunks) !=
+                 PRUCAM_STATUS_CHUNKS_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_pru_status, cycles_max) !=
+                 PRUCAM_STATUS_CYCLES_MAX_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_frame_hist, saturated) !=
+                 PRUCAM_HIST_SATURATED_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_frame_hist, black) !=
+                 PRUCAM_HIST_BLACK_OFFSET);
+    BUILD_BUG_ON(offsetof(struct prucam_frame_hist, bins) !=
+                 PRUCAM_HIST_BINS_OFFSET);
+
+    ctrl_base       = base;
+    cmd_head        = 0;
+    cmd_errors_seen = 0;
+
+    // invalidate first, then clear the ring and status and write the magic
+    // last so the PRUs never see a half initialized block
+    writel(0, CTRL_ADDR(magic));
+    memset_io(ctrl_base + sizeof(u32), 0,
+              sizeof(struct prucam_ctrl) - sizeof(u32));
+    writel(PRUCAM_CTRL_VERSION, CTRL_ADDR(version));
+    writel(sizeof(struct prucam_ctrl), CTRL_ADDR(size));
+    writel(PRUCAM_CTRL_MAGIC, CTRL_ADDR(magic));
+}
+
+void prucam_ctrl_end(void)
+{
+    if (ctrl_base)
+        writel(0, CTRL_ADDR(magic));
+}
+
+int prucam_ctrl_wait_ready(unsigned int timeout_ms)
+{
+    unsigned long timeout = jiffies + msecs_to_jiffies(timeout_ms);
+
+    while (readl(CTRL_ADDR(state)) == PRUCAM_STATE_WAIT_INIT) {
+        if (time_after(jiffies, timeout)) {
+            printk(KERN_ERR "prucam: PRU firmware did not accept control "
+                   "block version %u\n", PRUCAM_CTRL_VERSION);
+            return -ETIMEDOUT;
+        }
+        usleep_range(1000, 2000);
+    }
+
+    if (readl(CTRL_ADDR(fw_version)) != PRUCAM_CTRL_VERSION) {
+        printk(KERN_ERR "prucam: PRU firmware control block version %u, "
+               "expected %u\n", readl(CTRL_ADDR(fw_version)),
+               PRUCAM_CTRL_VERSION);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int prucam_ctrl_send(u32 op, u32 arg0, u32 arg1, u32 arg2)
+{
+    struct prucam_cmd cmd = {
+        .op   = op,
+        .args = {arg0, arg1, arg2},
+    };
+    void __iomem *slot;
+
+    if (cmd_head - readl(CTRL_ADDR(cmd_tail)) >= PRUCAM_CMD_RING_SIZE)
+        return -EBUSY;
+
+    cmd.csum = prucam_cmd_csum(&cmd, cmd_head);
+
+    slot = CTRL_ADDR(cmds[cmd_head & (PRUCAM_CMD_RING_SIZE - 1)]);
+    writel(cmd.op, slot + offsetof(struct prucam_cmd, op));
+    for (int i = 0; i < ARRAY_SIZE(cmd.args); i++)
+        writel(cmd.args[i], slot + offsetof(struct prucam_cmd, args[i]));
+    writel(cmd.csum, slot + offsetof(struct prucam_cmd, csum));
+
+    // writel orders the command before the new head
+    writel(++cmd_head, CTRL_ADDR(cmd_head));
+
+    return 0;
+}
+
+int prucam_ctrl_sync(unsigned int timeout_ms)
+{
+    unsigned long timeout = jiffies + msecs_to_jiffies(timeout_ms);
+    u32 errors;
+
+    while (readl(CTRL_ADDR(cmd_tail)) != cmd_head) {
+        if (time_after(jiffies, timeout))
+            return -ETIMEDOUT;
+        usleep_range(1000, 2000);
+    }
+
+    errors = readl(CTRL_ADDR(cmd_errors));
+    if (errors != cmd_errors_seen) {
+        printk(KERN_ERR "prucam: PRU rejected %u command(s), last error %u\n",
+               errors - cmd_errors_seen, readl(CTRL_ADDR(last_error)));
+        cmd_errors_seen = errors;
+        return -EIO;
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file    prucam_ctrl.h
+ * @brief   Kernel side of the control block shared with the PRUs.
+ *
+ * Callers must serialise calls, the prucam mutex does so after probe.
+ */
+
+#ifndef PRUCAM_CTRL_H
+#define PRUCAM_CTRL_H
+
+#include <linux/io.h>
+#include <linux/stddef.h>
+#include <linux/types.h>
+
+#include "prucam_shared.h"
+
+/**
+ * @brief Initializes the control block, must be called before every PRU boot.
+ * @param base The base of the PRU shared RAM
+ */
+void prucam_ctrl_init(void __iomem *base);
+
+/**
+ * @brief Invalidates the control block, so the PRU firmware ignores it until
+ * it is initialized again.
+ */
+void prucam_ctrl_end(void);
+
+/**
+ * @brief Waits for PRU1 to accept the control block after it boots.
+ * @param timeout_ms How long to wait
+ * @return 0 on success and negative errno value on error
+ */
+int prucam_ctrl_wait_ready(unsigned int timeout_ms);
+
+/**
+ * @brief Sends a command to PRU1.
+ * @param op The PRUCAM_CMD_* command
+ * @param arg0 The first argument
+ * @param arg1 The second argument
+ * @param arg2 The third argument
+ * @return 0 on success, -EBUSY if the ring is full
+ */
+int prucam_ctrl_send(u32 op, u32 arg0, u32 arg1, u32 arg2);
+
+/**
+ * @brief Waits for PRU1 to run all the commands sent.
+ * @param timeout_ms How long to wait
+ * @return 0 on success, -ETIMEDOUT if PRU1 did not run them in time or -EIO if
+ * it rejected any
+ */
+int prucam_ctrl_sync(unsigned int timeout_ms);
+
+/**
+ * @brief Name of a PRUCAM_STATE_* capture state.
+ * @param state The state
+ * @return The name, "unknown" for an invalid state
+ */
+const char *prucam_ctrl_state_name(u32 state);
+
+/**
+ * @brief Name of a PRUCAM_PRU0_* or PRUCAM_PRU1_* PRU status state.
+ * @param pru 0 for PRU0 or 1 for PRU1
+ * @param state The state
+ * @return The name, "unknown" for an invalid state
+ */
+const char *prucam_pru_state_name(int pru, u32 state);
+
+/**
+ * @brief Reads a 32-bit word of the control block.
+ * @param offset Offset of the word in struct prucam_ctrl
+ * @return The value
+ */
+u32 prucam_ctrl_readl(size_t offset);
+
+/** Reads a 32-bit field of the control block by name */
+#define prucam_ctrl_read(field) \
+    prucam_ctrl_readl(offsetof(struct prucam_ctrl, field))
+
+#endif /* PRUCAM_CTRL_H */
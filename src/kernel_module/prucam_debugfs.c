@@ -0,0 +1,200 @@
+/**
+ * @file    prucam_debugfs.c
+ * @brief   prucam debugfs interface, /sys/kernel/debug/prucam/.
+ *
+ * status shows the capture state, the command ring and the progress each PRU
+ * publishes in the control block. On a capture timeout it tells whether PRU0
+ * is waiting for VSYNC, HSYNC or PRU1, and how far into the frame each PRU
+ * got. The cycle high-water marks show how close the PRUs get to their
+ * deadlines. A PRU cycle is 5ns.
+ *
+ * recovery shows how often captures timed out and how long getting the PRUs
+ * going again took.
+ *
+ * latency/ has a histogram for each of the prucam_latency durations. Writing
+ * anything to one of them empties it.
+ *
+ * i2c shows the register traffic to the sensor and how long the last
+ * bring-up of its registers took. Writing anything to it zeroes the traffic
+ * counters.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "cam_i2c.h"
+#include "prucam_ctrl.h"
+#include "prucam_debugfs.h"
+
+#define PRU_CYCLE_NS 5
+
+static struct dentry *debugfs_dir;
+
+static void status_show_pru(struct seq_file *s, int n, const char *max_name)
+{
+    u32 state      = prucam_ctrl_read(pru[n].state);
+    u32 cycles_max = prucam_ctrl_read(pru[n].cycles_max);
+
+    seq_printf(s, "pru%d state: %s\n", n, prucam_pru_state_name(n, state));
+    seq_printf(s, "pru%d frames: %u\n", n, prucam_ctrl_read(pru[n].frames));
+    seq_printf(s, "pru%d lines: %u\n", n, prucam_ctrl_read(pru[n].lines));
+    seq_printf(s, "pru%d chunks: %u\n", n, prucam_ctrl_read(pru[n].chunks));
+    seq_printf(s, "pru%d %s max: %u cycles (%u ns)\n", n, max_name,
+               cycles_max, cycles_max * PRU_CYCLE_NS);
+}
+
+static int status_show(struct seq_file *s, void *unused)
+{
+    // rows and columns are 16 bits each, rows first
+    u32 geometry = prucam_ctrl_read(rows);
+
+    seq_printf(s, "version: %u\n", prucam_ctrl_read(version));
+    seq_printf(s, "fw version: %u\n", prucam_ctrl_read(fw_version));
+    seq_printf(s, "state: %s\n",
+               prucam_ctrl_state_name(prucam_ctrl_read(state)));
+    seq_printf(s, "cmd head: %u\n", prucam_ctrl_read(cmd_head));
+    seq_printf(s, "cmd tail: %u\n", prucam_ctrl_read(cmd_tail));
+    seq_printf(s, "cmd errors: %u\n", prucam_ctrl_read(cmd_errors));
+    seq_printf(s, "last error: %u\n", prucam_ctrl_read(last_error));
+    seq_printf(s, "frames done: %u\n", prucam_ctrl_read(frames_done));
+    seq_printf(s, "frames left: %u\n", prucam_ctrl_read(frames_left));
+    seq_printf(s, "geometry: %ux%u\n", geometry & 0xFFFF, geometry >> 16);
+    seq_printf(s, "options: 0x%x\n", prucam_ctrl_read(options));
+    seq_printf(s, "dest: 0x%08x\n", prucam_ctrl_read(dest));
+    seq_printf(s, "stride: %u\n", prucam_ctrl_read(stride));
+    seq_printf(s, "buffers: %u\n", prucam_ctrl_read(nbufs));
+    seq_printf(s, "last buffer: %u\n", prucam_ctrl_read(last_buf));
+    seq_printf(s, "frame errors: 0x%x\n", prucam_ctrl_read(frame_errors));
+    seq_printf(s, "bad lines: 0x%08x\n", prucam_ctrl_read(bad_lines));
+    status_show_pru(s, 0, "line");
+    status_show_pru(s, 1, "chunk");
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(status);
+
+static int recovery_show(struct seq_file *s, void *unused)
+{
+    struct prucam_recovery_stats *r = &recovery_stats;
+    u32 ok = r->recoveries - r->failures;
+
+    seq_printf(s, "timeouts: %u\n", r->timeouts);
+    seq_printf(s, "recoveries: %u\n", r->recoveries);
+    seq_printf(s, "failures: %u\n", r->failures);
+    seq_printf(s, "last us: %llu\n", div_u64(r->last_ns, NSEC_PER_USEC));
+    seq_printf(s, "max us: %llu\n", div_u64(r->max_ns, NSEC_PER_USEC));
+    seq_printf(s, "mean us: %llu\n",
+               ok ? div_u64(div_u64(r->total_ns, ok), NSEC_PER_USEC) : 0);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(recovery);
+
+static const char *const latency_names[PRUCAM_LAT_COUNT] = {
+    [PRUCAM_LAT_TRIGGER_TO_IRQ]  = "trigger_to_irq",
+    [PRUCAM_LAT_IRQ_TO_WAKEUP]   = "irq_to_wakeup",
+    [PRUCAM_LAT_COPY]            = "copy",
+    [PRUCAM_LAT_FRAME_INTERVAL]  = "frame_interval",
+};
+
+static int latency_show(struct seq_file *s, void *unused)
+{
+    prucam_hist_show(s, s->private);
+    return 0;
+}
+
+static int latency_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, latency_show, inode->i_private);
+}
+
+static ssize_t latency_write(struct file *file, const char __user *buf,
+                             size_t count, loff_t *ppos)
+{
+    struct seq_file *s = file->private_data;
+
+    prucam_hist_reset(s->private);
+    return count;
+}
+
+static const struct file_operations latency_fops = {
+    .owner   = THIS_MODULE,
+    .open    = latency_open,
+    .read    = seq_read,
+    .write   = latency_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static int i2c_show(struct seq_file *s, void *unused)
+{
+    struct cam_i2c_stats st;
+    u32 n;
+
+    cam_i2c_get_stats(&st);
+    n = st.reads + st.writes;
+
+    seq_printf(s, "reads: %u\n", st.reads);
+    seq_printf(s, "writes: %u\n", st.writes);
+    seq_printf(s, "reg reads: %u\n", st.reg_reads);
+    seq_printf(s, "cached reads: %u\n", st.reg_reads > st.bus_reg_reads ?
+               st.reg_reads - st.bus_reg_reads : 0);
+    seq_printf(s, "errors: %u\n", st.errors);
+    seq_printf(s, "total us: %llu\n", div_u64(st.total_ns, NSEC_PER_USEC));
+    seq_printf(s, "mean us: %llu\n",
+               n ? div_u64(div_u64(st.total_ns, n), NSEC_PER_USEC) : 0);
+    seq_printf(s, "max us: %llu\n", div_u64(st.max_ns, NSEC_PER_USEC));
+    seq_printf(s, "init writes: %u\n", st.init_writes);
+    seq_printf(s, "init transfers: %u\n", st.init_transfers);
+    seq_printf(s, "init cache reads: %u\n", st.init_reads);
+    seq_printf(s, "init us: %llu\n", div_u64(st.init_ns, NSEC_PER_USEC));
+    seq_printf(s, "init delay us: %llu\n",
+               div_u64(st.init_delay_ns, NSEC_PER_USEC));
+
+    return 0;
+}
+
+static int i2c_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, i2c_show, NULL);
+}
+
+static ssize_t i2c_write(struct file *file, const char __user *buf,
+                         size_t count, loff_t *ppos)
+{
+    cam_i2c_reset_stats();
+    return count;
+}
+
+static const struct file_operations i2c_fops = {
+    .owner   = THIS_MODULE,
+    .open    = i2c_open,
+    .read    = seq_read,
+    .write   = i2c_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+void prucam_debugfs_init(void)
+{
+    struct dentry *latency_dir;
+
+    debugfs_dir = debugfs_create_dir("prucam", NULL);
+    debugfs_create_file("status", 0444, debugfs_dir, NULL, &status_fops);
+    debugfs_create_file("recovery", 0444, debugfs_dir, NULL, &recovery_fops);
+    debugfs_create_file("i2c", 0644, debugfs_dir, NULL, &i2c_fops);
+
+    latency_dir = debugfs_create_dir("latency", debugfs_dir);
+    for (int i = 0; i < PRUCAM_LAT_COUNT; i++)
+        debugfs_create_file(latency_names[i], 0644, latency_dir,
+                            &latency_hists[i], &latency_fops);
+}
+
+void prucam_debugfs_end(void)
+{
+    debugfs_remove_recursive(debugfs_dir);
+    debugfs_dir = NULL;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file    prucam_debugfs.h
+ * @brief   prucam debugfs interface, /sys/kernel/debug/prucam/.
+ *
+ * debugfs is for diagnosing live units, so failing to create any of it is
+ * not an error.
+ */
+
+#ifndef PRUCAM_DEBUGFS_H
+#define PRUCAM_DEBUGFS_H
+
+#include <linux/types.h>
+
+#include "prucam_hist.h"
+
+/** @brief Statistics of the recoveries from capture timeouts */
+struct prucam_recovery_stats {
+    /** number of captures that timed out */
+    u32 timeouts;
+    /** number of recoveries attempted */
+    u32 recoveries;
+    /** number of recoveries that failed to restart the PRUs */
+    u32 failures;
+    /** time the last successful recovery took */
+    u64 last_ns;
+    /** longest successful recovery */
+    u64 max_ns;
+    /** total time of the successful recoveries */
+    u64 total_ns;
+};
+
+/** @brief The capture latencies measured, see latency_hists */
+enum prucam_latency {
+    /** capture command sent to the PRU1 interrupt */
+    PRUCAM_LAT_TRIGGER_TO_IRQ,
+    /** PRU1 interrupt to the reader waking up */
+    PRUCAM_LAT_IRQ_TO_WAKEUP,
+    /** copying the frame to userspace */
+    PRUCAM_LAT_COPY,
+    /** between the interrupts of frames read one after the other */
+    PRUCAM_LAT_FRAME_INTERVAL,
+    PRUCAM_LAT_COUNT,
+};
+
+/** owned by prucam_main.c */
+extern struct prucam_recovery_stats recovery_stats;
+extern struct prucam_hist latency_hists[PRUCAM_LAT_COUNT];
+
+/**
+ * @brief Creates the prucam debugfs directory and files. Must be called after
+ * the control block is initialized.
+ */
+void prucam_debugfs_init(void);
+
+/**
+ * @brief Removes the prucam debugfs directory and files.
+ */
+void prucam_debugfs_end(void);
+
+#endif /* PRUCAM_DEBUGFS_H */
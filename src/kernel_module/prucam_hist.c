@@ -0,0 +1,83 @@
+/**
+ * @file    prucam_hist.c
+ * @brief   log2 histograms of capture latencies.
+ */
+
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+
+#include "prucam_hist.h"
+
+void prucam_hist_init(struct prucam_hist *h)
+{
+    spin_lock_init(&h->lock);
+    prucam_hist_reset(h);
+}
+
+void prucam_hist_add(struct prucam_hist *h, u64 ns)
+{
+    u64 us = div_u64(ns, NSEC_PER_USEC);
+    int bucket;
+
+    bucket = us < 2 ? 0 : ilog2(us);
+    if (bucket >= PRUCAM_HIST_BUCKETS)
+        bucket = PRUCAM_HIST_BUCKETS - 1;
+
+    spin_lock(&h->lock);
+    h->count++;
+    h->total_ns += ns;
+    if (ns < h->min_ns)
+        h->min_ns = ns;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+    h->buckets[bucket]++;
+    spin_unlock(&h->lock);
+}
+
+void prucam_hist_reset(struct prucam_hist *h)
+{
+    spin_lock(&h->lock);
+    h->count    = 0;
+    h->min_ns   = U64_MAX;
+    h->max_ns   = 0;
+    h->total_ns = 0;
+    memset(h->buckets, 0, sizeof(h->buckets));
+    spin_unlock(&h->lock);
+}
+
+void prucam_hist_show(struct seq_file *s, struct prucam_hist *h)
+{
+    u32 buckets[PRUCAM_HIST_BUCKETS];
+    u64 count, min_ns, max_ns, total_ns;
+
+    // print from a copy, seq_printf can't be called with the lock held
+    spin_lock(&h->lock);
+    count    = h->count;
+    min_ns   = h->min_ns;
+    max_ns   = h->max_ns;
+    total_ns = h->total_ns;
+    memcpy(buckets, h->buckets, sizeof(buckets));
+    spin_unlock(&h->lock);
+
+    seq_printf(s, "count: %llu\n", count);
+    if (count == 0)
+        return;
+
+    seq_printf(s, "min us: %llu\n", div_u64(min_ns, NSEC_PER_USEC));
+    seq_printf(s, "max us: %llu\n", div_u64(max_ns, NSEC_PER_USEC));
+    seq_printf(s, "mean us: %llu\n",
+               div64_u64(total_ns, count * NSEC_PER_USEC));
+
+    for (int i = 0; i < PRUCAM_HIST_BUCKETS; i++) {
+        if (buckets[i] == 0)
+            continue;
+        if (i == 0)
+            seq_printf(s, "[0, 2) us: %u\n", buckets[i]);
+        else if (i == PRUCAM_HIST_BUCKETS - 1)
+            seq_printf(s, "[%llu, inf) us: %u\n", 1ULL << i, buckets[i]);
+        else
+            seq_printf(s, "[%llu, %llu) us: %u\n", 1ULL << i, 1ULL << (i + 1),
+                       buckets[i]);
+    }
+}
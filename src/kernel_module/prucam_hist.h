@@ -0,0 +1,61 @@
+/**
+ * @file    prucam_hist.h
+ * @brief   log2 histograms of capture latencies.
+ *
+ * Each histogram keeps the count, min, max and total of the durations added
+ * to it, and counts them in power of 2 microsecond buckets. Bucket 0 is
+ * everything under 2us, bucket n is [2^n, 2^(n + 1)) us.
+ */
+
+#ifndef PRUCAM_HIST_H
+#define PRUCAM_HIST_H
+
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/** the last bucket holds everything over ~35 minutes */
+#define PRUCAM_HIST_BUCKETS 32
+
+/** @brief A latency histogram */
+struct prucam_hist {
+    spinlock_t lock;
+    /** number of durations added */
+    u64 count;
+    /** shortest duration in ns */
+    u64 min_ns;
+    /** longest duration in ns */
+    u64 max_ns;
+    /** sum of the durations in ns */
+    u64 total_ns;
+    /** counts of durations by log2 of microseconds */
+    u32 buckets[PRUCAM_HIST_BUCKETS];
+};
+
+/**
+ * @brief Initializes an empty histogram.
+ * @param h The histogram.
+ */
+void prucam_hist_init(struct prucam_hist *h);
+
+/**
+ * @brief Adds a duration to a histogram.
+ * @param h The histogram.
+ * @param ns The duration in nanoseconds.
+ */
+void prucam_hist_add(struct prucam_hist *h, u64 ns);
+
+/**
+ * @brief Empties a histogram.
+ * @param h The histogram.
+ */
+void prucam_hist_reset(struct prucam_hist *h);
+
+/**
+ * @brief Prints a histogram's summary and its non-empty buckets.
+ * @param s The seq_file to print to.
+ * @param h The histogram.
+ */
+void prucam_hist_show(struct seq_file *s, struct prucam_hist *h);
+
+#endif /* PRUCAM_HIST_H */
@@ -2,24 +2,37 @@
 #include <linux/dma-mapping.h>
 #include <linux/fs.h>
 #include <linux/init.h>
-#include <linux/interrupt.h>
-#include <linux/irq.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
-#include <linux/pruss.h>
-#include <linux/remoteproc.h>
+#include <linux/slab.h>
 #include <linux/sysfs.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
 #include <linux/completion.h>
 
 #include "ar0130_ctrl_regs.h"
 #include "ar0134_ctrl_regs.h"
+#include "ar013x_context.h"
+#include "ar013x_controls.h"
+#include "ar013x_embedded.h"
+#include "ar013x_hold.h"
 #include "ar013x_regs.h"
 #include "ar013x_sysfs.h"
+#include "ar013x_timing.h"
 #include "cam_gpio.h"
 #include "cam_i2c.h"
+#include "prucam_backend.h"
+#include "prucam_ctrl.h"
+#include "prucam_debugfs.h"
+#include "prucam_stats.h"
+#include "prucam_uapi.h"
+
+#define CREATE_TRACE_POINTS
+#include "prucam_trace.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Rew");
@@ -30,16 +43,78 @@ MODULE_VERSION("1.1.0");
 #define ROWS           960
 #define COLS           1280
 #define PIXELS         (ROWS * COLS)
-#define PRU0_FW_NAME   "prucam_pru0_fw.out"
-#define PRU1_FW_NAME   "prucam_pru1_fw.out"
+#define EMBEDDED_ROWS  PRUCAM_EMBEDDED_ROWS
+/**
+ * the image followed by the side buffer for the embedded rows and the
+ * histogram
+ */
+#define FRAME_BUFFER_SIZE PRUCAM_BUFFER_SIZE
+#define FRAME_HIST_OFFSET ((ROWS + EMBEDDED_ROWS) * COLS)
+#define NUM_BUFFERS       PRUCAM_NUM_BUFFERS
+#define FRAME_BUFFERS_SIZE (NUM_BUFFERS * FRAME_BUFFER_SIZE)
+
+/* capture option bits, see PRUCAM_CMD_CAPTURE */
+#define FRAME_OPT_EMBEDDED BIT(PRUCAM_FRAME_OPT_EMBEDDED_BIT)
+#define FRAME_OPT_HIST     BIT(PRUCAM_FRAME_OPT_HIST_BIT)
+
+/* how long to wait for PRU1 to accept the control block and run commands */
+#define PRU_CTRL_TIMEOUT_MS 100
+
+/* capture timeout when the frame period can't be read from the sensor */
+#define CAPTURE_TIMEOUT_DEFAULT_MS 500
+
+/* without PRU support only the simulated backend is built, e.g. for x86 */
+#ifdef PRUCAM_PRU
+static bool virt;
+#else
+static bool virt = true;
+#endif
+module_param(virt, bool, 0444);
+MODULE_PARM_DESC(virt,
+                 "Capture from simulated PRUs and sensor instead of the "
+                 "hardware, see the virt_* params (default: false, true "
+                 "when built without PRU support)");
+
+static bool drop_bad_frames = true;
+module_param(drop_bad_frames, bool, 0644);
+MODULE_PARM_DESC(drop_bad_frames,
+                 "Fail reads of torn frames with -EIO instead of returning "
+                 "them (default: true)");
+
+static bool embedded_data;
+module_param(embedded_data, bool, 0644);
+MODULE_PARM_DESC(embedded_data,
+                 "Capture the sensor's embedded register and statistics rows "
+                 "and decode them into the frame info (default: false)");
+
+static bool histogram = true;
+module_param(histogram, bool, 0644);
+MODULE_PARM_DESC(histogram,
+                 "Have PRU1 publish the histogram it counts while moving each "
+                 "frame, see PRUCAM_IOC_G_HISTOGRAM (default: true)");
+
+static unsigned int timeout_margin_ms = 50;
+module_param(timeout_margin_ms, uint, 0644);
+MODULE_PARM_DESC(timeout_margin_ms,
+                 "Time on top of two frame periods to wait for a frame before "
+                 "timing out (default: 50)");
+
+static bool recover_sensor;
+module_param(recover_sensor, bool, 0644);
+MODULE_PARM_DESC(recover_sensor,
+                 "Also re-initialize the sensor registers when recovering "
+                 "from a capture timeout (default: false)");
 
 // private data
 struct miscdevice miscdev;
 struct mutex mutex;
 
+/* the platform device, the frame buffers are allocated and mapped for it */
+static struct device *prucam_dev;
+
 /**
- * physical/virtual addresses of the frame buffer used to transfer image from
- * PRU to kernel
+ * physical/virtual addresses of the NUM_BUFFERS frame buffers used to transfer
+ * images from PRU to kernel, back to back
  */
 dma_addr_t frame_buffer_pa = (dma_addr_t)NULL;
 int *frame_buffer_va = NULL;
@@ -50,40 +125,178 @@ int *frame_buffer_va = NULL;
  */
 static DECLARE_COMPLETION(pru_to_arm_irq_trigger);
 
-struct rproc *pru0 = NULL;
-struct rproc *pru1 = NULL;
+/* the PRUs to capture with and their control block */
+static const struct prucam_backend *backend;
+static void __iomem *ctrl_base;
+
+/* the platform device for the simulated backend, there is no DT node */
+static struct platform_device *virt_pdev;
 
-/* underlying pruss object */
-struct pruss *pruss;
+/* true while the PRUs are booted, rproc_shutdown must not be called twice */
+static bool prus_running;
 
-/* PRU shared memory region */
-struct pruss_mem_region shared_mem;
+/* startup registers of the detected sensor model */
+static camera_regs_t *startup_regs;
 
-static irqreturn_t pru_irq_handler(int irq_num, void *);
+/* capture timeout recovery statistics, shown in debugfs */
+struct prucam_recovery_stats recovery_stats;
 
-typedef struct {
-    char *name;
-    int num;
-    irq_handler_t handler;
-} irq_info_t;
+/* capture latency histograms, shown in debugfs */
+struct prucam_hist latency_hists[PRUCAM_LAT_COUNT];
+
+/* when the last frame done interrupt came, and the one of the frame before */
+static ktime_t irq_time;
+static ktime_t last_irq_time;
+
+/* true while a reader waits for a frame, frames finished without one drop */
+static bool reader_waiting;
 
 /**
- * interrupts as defined in the device-tree overlay. The number is the value
- * returned by platform_get_irq_byname. The last 2 are inter-PRU interrupts and
- * don't interrupt the kernel. However, we still use the kernel driver to
- * configure them, but specifiy the 'no_action' handler
+ * The stream started by PRUCAM_IOC_STREAMON: the file that started it, its
+ * capture options and the PRU1 frames_done count of the last frame returned.
  */
-irq_info_t irqs[] = {
-    {.name = "pru1_to_arm", .num = -1, .handler = pru_irq_handler},
-    {.name = "arm_to_prus", .num = -1, .handler = no_action},
-    {.name = "pru0_to_pru1", .num = -1, .handler = no_action},
-};
+static bool streaming;
+static struct file *stream_owner;
+static u32 stream_options;
+static u32 stream_frames_taken;
+
+/* info, raw embedded rows and histogram of the last frame captured */
+static struct prucam_frame_info frame_info;
+static u8 embedded_rows[EMBEDDED_ROWS * COLS];
+static struct prucam_histogram frame_hist;
+static u32 frame_seq;
+
+static u8 *frame_buffer(u32 index)
+{
+    return (u8 *)frame_buffer_va + index * FRAME_BUFFER_SIZE;
+}
+
+/* PRUCAM_FRAME_OPT_* bits of a capture, from the module params */
+static u32 capture_options(void)
+{
+    return (embedded_data ? FRAME_OPT_EMBEDDED : 0) |
+           (histogram ? FRAME_OPT_HIST : 0);
+}
+
+/**
+ * Boots the PRUs with a fresh control block and configures the capture. PRU0
+ * waits for the start of a new frame, so this also resyncs it to VSYNC.
+ */
+static int start_prus(void)
+{
+    int ret;
+
+    /**
+     * Initialize the control block at the base of PRU shared mem before the
+     * PRUs boot. The PRU firmware places it there with its linker command
+     * file and waits for it to be valid.
+     */
+    prucam_ctrl_init(ctrl_base);
+
+    ret = backend->boot(frame_buffer_va, frame_buffer_pa, FRAME_BUFFERS_SIZE);
+    if (ret)
+        return ret;
+    prus_running = true;
+
+    /* Tell PRU1 the frame size and where to put the frames */
+    ret = prucam_ctrl_wait_ready(PRU_CTRL_TIMEOUT_MS);
+    if (ret)
+        return ret;
+    prucam_ctrl_send(PRUCAM_CMD_SET_GEOMETRY, ROWS, COLS, 0);
+    prucam_ctrl_send(PRUCAM_CMD_SET_DEST, (u32)frame_buffer_pa,
+                     FRAME_BUFFER_SIZE, NUM_BUFFERS);
+    /* pick a stream back up, e.g. after recovering from a timeout */
+    if (streaming)
+        prucam_ctrl_send(PRUCAM_CMD_CAPTURE, 0, stream_options, 0);
+    ret = prucam_ctrl_sync(PRU_CTRL_TIMEOUT_MS);
+    if (ret) {
+        printk(KERN_ERR "prucam: failed to configure PRUs: %d\n", ret);
+        return ret;
+    }
+
+    stream_frames_taken = 0;
+
+    return 0;
+}
+
+static void stop_prus(void)
+{
+    if (!prus_running)
+        return;
+
+    backend->shutdown();
+    prus_running = false;
+}
+
+/**
+ * Gets the capture going again after a timeout. The PRUs may be stuck
+ * anywhere in a frame, e.g. PRU0 waiting on a pixel clock that stopped, so
+ * they can't be trusted to run a command. Restart them instead, which costs
+ * about a frame.
+ */
+static void recover_capture(void)
+{
+    ktime_t start = ktime_get();
+    u64 ns;
+    int ret;
+
+    printk(KERN_WARNING "prucam: recovering from capture timeout\n");
+    recovery_stats.recoveries++;
+
+    stop_prus();
+
+    /* re-init the sensor before PRU0 syncs to its next frame */
+    if (recover_sensor) {
+        ret = init_camera_regs(startup_regs);
+        if (ret < 0)
+            printk(KERN_ERR "prucam: sensor re-init failed: %d\n", ret);
+    }
+
+    ret = start_prus();
+
+    /* drop an interrupt that raced with the timeout */
+    reinit_completion(&pru_to_arm_irq_trigger);
+
+    /* the gap to the next frame is not a frame interval */
+    last_irq_time = 0;
+
+    ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    trace_prucam_recovery(ns, ret);
+
+    if (ret) {
+        /* the next read times out and tries again */
+        recovery_stats.failures++;
+        printk(KERN_ERR "prucam: recovery failed: %d\n", ret);
+        return;
+    }
 
-static void free_irqs(void)
+    recovery_stats.last_ns   = ns;
+    recovery_stats.total_ns += ns;
+    if (ns > recovery_stats.max_ns)
+        recovery_stats.max_ns = ns;
+}
+
+/**
+ * How long to wait for a frame. PRU0 waits for the next VSYNC, so a capture
+ * can take up to two frame periods. The period is the longest the frames in
+ * flight can have, see ar013x_timing.h. The margin covers the interrupt and
+ * scheduling latency.
+ */
+static unsigned long capture_timeout(void)
 {
-    for (int i = 0; i < (sizeof(irqs) / sizeof(irqs[0])); i++)
-        if (irqs[i].num > -1)
-            free_irq(irqs[i].num, NULL);
+    u32 period_us;
+    int ret;
+
+    ret = ar013x_frame_period_us(&period_us);
+    if (ret) {
+        printk_ratelimited(KERN_WARNING "prucam: can't get the frame period: "
+                           "%d, using %dms timeout\n", ret,
+                           CAPTURE_TIMEOUT_DEFAULT_MS);
+        return msecs_to_jiffies(CAPTURE_TIMEOUT_DEFAULT_MS);
+    }
+
+    return 2 * usecs_to_jiffies(period_us) +
+           msecs_to_jiffies(timeout_margin_ms);
 }
 
 static int dev_open(struct inode *inodep, struct file *filep)
@@ -91,51 +304,582 @@ static int dev_open(struct inode *inodep, struct file *filep)
     return 0;
 }
 
+/**
+ * Gets the next frame into a frame buffer: captures one, or takes the next
+ * frame of the stream. Updates the frame info and embedded rows for it. Must
+ * be called with the mutex held.
+ *
+ * @param index Set to the frame buffer the frame is in
+ * @param skipped Set to the frames of the stream that were never taken
+ * @return 0 on success, -EIO for a torn frame when drop_bad_frames is set or
+ * another negative errno value on error
+ */
+static int capture_frame(u32 *index, u32 *skipped)
+{
+    u32 frame_errors, bad_lines, seq, options, done, batch;
+    unsigned long timeout;
+    bool frame_ready = false, have_count = false;
+    u16 frame_count = 0, context;
+    s32 value;
+    ktime_t start, wake;
+    int ret;
+
+    /* the sensor is read over i2c when its settings changed, do it first */
+    timeout = capture_timeout();
+    seq     = frame_seq + 1;
+    options = streaming ? stream_options : capture_options();
+    *skipped = 0;
+
+    /**
+     * Until a frame carries the last settings batch, each frame needs its
+     * sensor frame count. Without the embedded rows, the captured frame is
+     * at least the one after the frame being read out now.
+     */
+    batch = ar013x_hold_batch();
+    if (frame_info.settings != batch && !streaming &&
+        !(options & FRAME_OPT_EMBEDDED) &&
+        read_cam_reg(AR013X_AD_FRAME_COUNT, &frame_count) == 0) {
+        frame_count++;
+        have_count = true;
+    }
+
+    trace_prucam_trigger(seq, options, jiffies_to_msecs(timeout));
+    start = ktime_get();
+    WRITE_ONCE(reader_waiting, true);
+    if (streaming) {
+        /* a frame that finishes after the check still ends the wait */
+        reinit_completion(&pru_to_arm_irq_trigger);
+        frame_ready = prucam_ctrl_read(frames_done) != stream_frames_taken;
+    } else {
+        /**
+         * Ask PRU1 for one frame, with the embedded rows and histogram if
+         * enabled. It starts PRU0 itself.
+         */
+        ret = prucam_ctrl_send(PRUCAM_CMD_CAPTURE, 1, options, 0);
+        /* PRU1 runs it right away when idle, a rejected one never ends */
+        if (!ret)
+            ret = prucam_ctrl_sync(PRU_CTRL_TIMEOUT_MS);
+        if (ret) {
+            WRITE_ONCE(reader_waiting, false);
+            printk(KERN_ERR "prucam: capture command failed: %d\n", ret);
+            /* PRU1 isn't taking commands, restart it */
+            if (ret == -ETIMEDOUT)
+                recover_capture();
+            return ret;
+        }
+    }
+
+    /* Wait for intc to be triggered */
+    if (!frame_ready &&
+        !wait_for_completion_timeout(&pru_to_arm_irq_trigger, timeout)) {
+        WRITE_ONCE(reader_waiting, false);
+        trace_prucam_timeout(seq, ktime_to_ns(ktime_sub(ktime_get(), start)),
+                             prucam_ctrl_read(pru[0].state),
+                             prucam_ctrl_read(pru[0].lines),
+                             prucam_ctrl_read(pru[1].state),
+                             prucam_ctrl_read(pru[1].chunks));
+        printk(KERN_ERR "prucam: interrupt never triggered, pru0 %s at line "
+               "%u, pru1 %s at chunk %u\n",
+               prucam_pru_state_name(0, prucam_ctrl_read(pru[0].state)),
+               prucam_ctrl_read(pru[0].lines),
+               prucam_pru_state_name(1, prucam_ctrl_read(pru[1].state)),
+               prucam_ctrl_read(pru[1].chunks));
+        recovery_stats.timeouts++;
+        recover_capture();
+        return -ETIMEDOUT;
+    }
+    WRITE_ONCE(reader_waiting, false);
+
+    /**
+     * PRU0 writes the frame status before PRU1 raises the interrupt. Any error
+     * bit means at least one line is padding, so the frame is torn. PRU1
+     * counts the frame after it sets the buffer, so the buffer is never older
+     * than the count.
+     */
+    wake = ktime_get();
+    if (streaming) {
+        done = prucam_ctrl_read(frames_done);
+        *skipped = done - stream_frames_taken - 1;
+        stream_frames_taken = done;
+        capture_stats.frames_dropped += *skipped;
+    }
+    *index       = prucam_ctrl_read(last_buf);
+    frame_errors = prucam_ctrl_read(frame_errors);
+    bad_lines    = prucam_ctrl_read(bad_lines);
+
+    trace_prucam_frame(seq, ktime_to_ns(ktime_sub(wake, start)), frame_errors,
+                       bad_lines);
+
+    /* a stream isn't triggered, and its frame may have waited for us */
+    if (!streaming)
+        prucam_hist_add(&latency_hists[PRUCAM_LAT_TRIGGER_TO_IRQ],
+                        ktime_to_ns(ktime_sub(irq_time, start)));
+    if (!frame_ready)
+        prucam_hist_add(&latency_hists[PRUCAM_LAT_IRQ_TO_WAKEUP],
+                        ktime_to_ns(ktime_sub(wake, irq_time)));
+    if (last_irq_time && !*skipped)
+        prucam_hist_add(&latency_hists[PRUCAM_LAT_FRAME_INTERVAL],
+                        ktime_to_ns(ktime_sub(irq_time, last_irq_time)));
+    last_irq_time = irq_time;
+
+    frame_seq                 = seq;
+    frame_info.sequence       = seq;
+    frame_info.errors         = frame_errors;
+    frame_info.bad_lines      = bad_lines & 0xFFFF;
+    frame_info.first_bad_line = bad_lines >> 16;
+
+    /**
+     * The PRUs put the embedded rows in the side buffer after the image. Keep
+     * a copy so they survive the next capture and decode the register rows.
+     */
+    if (options & FRAME_OPT_EMBEDDED) {
+        memcpy(embedded_rows, frame_buffer(*index) + PIXELS,
+               sizeof(embedded_rows));
+        ar013x_decode_embedded(embedded_rows, EMBEDDED_ROWS / 2, COLS,
+                               &frame_info);
+    } else {
+        memset(embedded_rows, 0, sizeof(embedded_rows));
+        frame_info.embedded_valid = 0;
+    }
+
+    /* PRU1 writes the histogram in the layout of struct prucam_histogram */
+    BUILD_BUG_ON(sizeof(struct prucam_frame_hist) != sizeof(frame_hist));
+    if (options & FRAME_OPT_HIST)
+        memcpy(&frame_hist, frame_buffer(*index) + FRAME_HIST_OFFSET,
+               sizeof(frame_hist));
+    else
+        memset(&frame_hist, 0, sizeof(frame_hist));
+
+    /**
+     * In a stream, the count read after the frame is done is already the
+     * next frame's when that one started, so take the one before.
+     */
+    if (frame_info.embedded_valid & PRUCAM_EMB_FRAME_COUNT) {
+        frame_count = frame_info.frame_count;
+        have_count  = true;
+    } else if ((frame_info.settings != batch || ar013x_context_active()) &&
+               streaming &&
+               read_cam_reg(AR013X_AD_FRAME_COUNT, &frame_count) == 0) {
+        frame_count--;
+        have_count = true;
+    }
+    /* a frame without a count keeps the batch of the frame before */
+    if (have_count)
+        frame_info.settings = ar013x_hold_batch_of(frame_count);
+
+    /**
+     * Without the embedded rows, a stream frame has the context the pattern
+     * switched the sensor to for it, and any other frame the current one.
+     */
+    if (!(frame_info.embedded_valid & PRUCAM_EMB_CONTEXT)) {
+        if (!streaming || !have_count ||
+            ar013x_context_of(frame_count, &context) != 0)
+            context = ar013x_control_get(PRUCAM_CID_CONTEXT, &value) == 0 ?
+                      value : 0;
+        frame_info.context = context;
+    }
+
+    if (frame_errors) {
+        capture_stats.torn_frames++;
+        printk_ratelimited(KERN_WARNING "prucam: torn frame %lu, errors 0x%x, "
+                           "%u bad lines starting at line %u\n",
+                           capture_stats.torn_frames, frame_errors, bad_lines & 0xFFFF,
+                           bad_lines >> 16);
+        if (drop_bad_frames)
+            return -EIO;
+    }
+
+    return 0;
+}
+
 static ssize_t dev_read(struct file *filep, char *buffer, size_t len,
                         loff_t *offset)
 {
+    u32 index, skipped;
+    ktime_t start;
+    u64 copy_ns;
     int ret;
 
     mutex_lock(&mutex);
 
-    printk(KERN_INFO "prucam: signalling PRUs to capture image.");
-
-    /* Trigger ARM to PRUs interrupt to start image capture */
-    irq_set_irqchip_state(irqs[1].num, IRQCHIP_STATE_PENDING, true);
-
-    /* Wait for intc to be triggered for 500ms */
-    ret = wait_for_completion_timeout(&pru_to_arm_irq_trigger, msecs_to_jiffies(500));
-    if (ret == 0) {
-        printk(KERN_ERR "prucam: interrupt never triggered\n");
+    ret = capture_frame(&index, &skipped);
+    if (ret) {
         mutex_unlock(&mutex);
-        return -1;
+        return ret;
     }
 
-    printk(KERN_INFO "prucam: image captured\n");
-
     /* copy the image to the caller */
-    ret = copy_to_user(buffer, (char*)frame_buffer_va, PIXELS);
+    trace_prucam_copy_start(frame_seq, PIXELS);
+    start = ktime_get();
+    ret = copy_to_user(buffer, frame_buffer(index), PIXELS);
+    copy_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    trace_prucam_copy_end(frame_seq, copy_ns, ret);
+    prucam_hist_add(&latency_hists[PRUCAM_LAT_COPY], copy_ns);
     if (ret) {
+        capture_stats.copy_errors++;
         printk(KERN_ERR "prucam: copy to user failed\n");
         mutex_unlock(&mutex);
         return -EFAULT;
     }
 
+    prucam_stats_frame_read();
+
     mutex_unlock(&mutex);
 
     return PIXELS;
 }
 
-static irqreturn_t pru_irq_handler(int irq_num, void *dev_id)
+/* Starts a stream for a file. Must be called with the mutex held. */
+static int stream_on(struct file *filep)
 {
+    int ret;
+
+    if (streaming)
+        return stream_owner == filep ? 0 : -EBUSY;
+
+    /* PRU1 is idle between reads, so its frame count holds still */
+    stream_options      = capture_options();
+    stream_frames_taken = prucam_ctrl_read(frames_done);
+    stream_owner        = filep;
+    WRITE_ONCE(streaming, true);
+
+    ret = prucam_ctrl_send(PRUCAM_CMD_CAPTURE, 0, stream_options, 0);
+    if (!ret)
+        ret = prucam_ctrl_sync(PRU_CTRL_TIMEOUT_MS);
+    if (ret) {
+        printk(KERN_ERR "prucam: failed to start stream: %d\n", ret);
+        WRITE_ONCE(streaming, false);
+        stream_owner = NULL;
+    }
+
+    return ret;
+}
+
+/* Stops the stream of a file. Must be called with the mutex held. */
+static int stream_off(struct file *filep)
+{
+    int ret;
+
+    if (!streaming)
+        return 0;
+    if (stream_owner != filep)
+        return -EBUSY;
+
+    WRITE_ONCE(streaming, false);
+    stream_owner = NULL;
+
+    /* PRU1 runs the stop between frames, so this waits for the last one */
+    ret = prucam_ctrl_send(PRUCAM_CMD_STOP, 0, 0, 0);
+    if (!ret)
+        ret = prucam_ctrl_sync(jiffies_to_msecs(capture_timeout()));
+    if (ret) {
+        /* PRU1 is stuck in a frame, restart it idle */
+        printk(KERN_ERR "prucam: failed to stop stream: %d\n", ret);
+        recover_capture();
+        return 0;
+    }
+
+    /* nobody takes the last frame, it must not end the next wait */
+    reinit_completion(&pru_to_arm_irq_trigger);
+
+    return 0;
+}
+
+/* the controls a bracket step sets */
+#define BRACKET_CONTROLS 3
+/* frames a bracket may take on top of one per step */
+#define BRACKET_EXTRA_FRAMES 8
+
+static void bracket_controls(struct prucam_control *controls,
+                             const struct prucam_bracket_step *step)
+{
+    controls[0].id    = PRUCAM_CID_COARSE_TIME;
+    controls[0].value = step->coarse_time;
+    controls[1].id    = PRUCAM_CID_ANALOG_GAIN;
+    controls[1].value = step->analog_gain;
+    controls[2].id    = PRUCAM_CID_GLOBAL_GAIN;
+    controls[2].value = step->global_gain;
+}
+
+/**
+ * Captures the frames of a bracket in a stream of its own. Must be called
+ * with the mutex held.
+ *
+ * After each frame, the next step is set as a settings batch. The sensor
+ * latches it on the frame after the one it is reading out, so the steps go
+ * to consecutive frames as long as each frame is taken before the next one
+ * is done. Each frame's batch says which step it has, if any.
+ */
+static int bracket(struct file *filep, struct prucam_bracket *br)
+{
+    void __user *ptr = u64_to_user_ptr(br->ptr);
+    struct prucam_control controls[BRACKET_CONTROLS];
+    /* the context first, so the rest go back to the one they came from */
+    struct prucam_control saved[1 + BRACKET_CONTROLS];
+    u32 batches[PRUCAM_BRACKET_MAX];
+    u32 applied = 0, captured = 0, index, skipped, error_idx, i, j;
+    int ret, r;
+
+    if (br->count == 0 || br->count > PRUCAM_BRACKET_MAX)
+        return -EINVAL;
+
+    for (i = 0; i < br->count; i++) {
+        bracket_controls(controls, &br->steps[i]);
+        ret = ar013x_controls_check(controls, BRACKET_CONTROLS, &error_idx);
+        if (ret)
+            return ret;
+    }
+
+    if (streaming || ar013x_context_active())
+        return -EBUSY;
+
+    /* a set running now is done before the settings are saved, later ones
+     * fail until the bracket ends, and the sensor's auto exposure must be
+     * off as it owns the integration time and gains */
+    ret = ar013x_controls_claim();
+    if (ret)
+        return ret;
+
+    /* the settings go back when the bracket is done */
+    saved[0].id = PRUCAM_CID_CONTEXT;
+    bracket_controls(saved + 1, &br->steps[0]);
+    ret = ar013x_controls_get(saved, ARRAY_SIZE(saved), &error_idx);
+    if (ret)
+        goto out;
+
+    ret = stream_on(filep);
+    if (ret)
+        goto out;
+
+    for (i = 0; captured < br->count &&
+                i < br->count + BRACKET_EXTRA_FRAMES; i++) {
+        ret = capture_frame(&index, &skipped);
+        if (ret && ret != -EIO)
+            break;
+
+        if (applied < br->count) {
+            bracket_controls(controls, &br->steps[applied]);
+            r = ar013x_controls_set_claimed(controls, BRACKET_CONTROLS,
+                                            &error_idx, &batches[applied]);
+            if (r) {
+                ret = r;
+                break;
+            }
+            applied++;
+        }
+
+        /* a torn frame is left out, its step finds no frame */
+        if (ret == -EIO) {
+            ret = 0;
+            continue;
+        }
+
+        /* frames from before the next step, or still with the last one */
+        for (j = captured; j < applied; j++)
+            if (batches[j] == frame_info.settings)
+                break;
+        if (j == applied)
+            continue;
+
+        /* a later step overtook this one */
+        if (j != captured) {
+            ret = -EAGAIN;
+            break;
+        }
+
+        if (copy_to_user(ptr + (size_t)captured * PIXELS, frame_buffer(index),
+                         PIXELS)) {
+            capture_stats.copy_errors++;
+            ret = -EFAULT;
+            break;
+        }
+        prucam_stats_frame_read();
+        br->info[captured++] = frame_info;
+    }
+    if (!ret && captured < br->count)
+        ret = -EAGAIN;
+
+    stream_off(filep);
+
+    r = ar013x_controls_set_claimed(saved, ARRAY_SIZE(saved), &error_idx,
+                                    NULL);
+    if (r && !ret)
+        ret = r;
+
+out:
+    ar013x_controls_release();
+
+    return ret;
+}
+
+static long bracket_ioctl(struct file *filep, void __user *argp)
+{
+    struct prucam_bracket *br;
+    long ret;
+
+    br = memdup_user(argp, sizeof(*br));
+    if (IS_ERR(br))
+        return PTR_ERR(br);
+
+    /* the steps captured before a failure are still returned */
+    memset(br->info, 0, sizeof(br->info));
+    ret = bracket(filep, br);
+    if (copy_to_user(argp, br, sizeof(*br)) && !ret)
+        ret = -EFAULT;
+
+    kfree(br);
+
+    return ret;
+}
+
+/**
+ * Gets or sets the controls of PRUCAM_IOC_G_CONTROLS or PRUCAM_IOC_S_CONTROLS.
+ * They only touch the sensor registers, so a capture can run meanwhile. A set
+ * fails with -EBUSY during a bracket, see ar013x_controls_claim().
+ */
+static long controls_ioctl(unsigned int cmd, void __user *argp)
+{
+    struct prucam_controls arg;
+    struct prucam_control *controls;
+    void __user *ptr;
+    long ret;
+
+    if (copy_from_user(&arg, argp, sizeof(arg)))
+        return -EFAULT;
+
+    if (arg.count == 0 || arg.count > PRUCAM_CONTROLS_MAX)
+        return -EINVAL;
+
+    ptr = u64_to_user_ptr(arg.ptr);
+    controls = memdup_user(ptr, arg.count * sizeof(*controls));
+    if (IS_ERR(controls))
+        return PTR_ERR(controls);
+
+    arg.batch = 0;
+    if (cmd == PRUCAM_IOC_G_CONTROLS) {
+        ret = ar013x_controls_get(controls, arg.count, &arg.error_idx);
+        if (ret == 0 &&
+            copy_to_user(ptr, controls, arg.count * sizeof(*controls)))
+            ret = -EFAULT;
+    } else {
+        ret = ar013x_controls_set(controls, arg.count, &arg.error_idx,
+                                  &arg.batch);
+    }
+
+    kfree(controls);
+
+    if (copy_to_user(argp, &arg, sizeof(arg)))
+        return -EFAULT;
+
+    return ret;
+}
+
+static long dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+    void __user *argp = (void __user *)arg;
+    struct prucam_buffer buf;
+    long ret = 0;
+
+    if (cmd == PRUCAM_IOC_G_CONTROLS || cmd == PRUCAM_IOC_S_CONTROLS)
+        return controls_ioctl(cmd, argp);
+
+    mutex_lock(&mutex);
+
+    switch (cmd) {
+    case PRUCAM_IOC_G_FRAME_INFO:
+        if (copy_to_user(argp, &frame_info, sizeof(frame_info)))
+            ret = -EFAULT;
+        break;
+    case PRUCAM_IOC_G_EMBEDDED_ROWS:
+        if (copy_to_user(argp, embedded_rows, sizeof(embedded_rows)))
+            ret = -EFAULT;
+        break;
+    case PRUCAM_IOC_G_HISTOGRAM:
+        if (copy_to_user(argp, &frame_hist, sizeof(frame_hist)))
+            ret = -EFAULT;
+        break;
+    case PRUCAM_IOC_CAPTURE:
+        ret = capture_frame(&buf.index, &buf.skipped);
+        if (ret)
+            break;
+        prucam_stats_frame_read();
+        buf.info = frame_info;
+        if (copy_to_user(argp, &buf, sizeof(buf)))
+            ret = -EFAULT;
+        break;
+    case PRUCAM_IOC_STREAMON:
+        ret = stream_on(filep);
+        break;
+    case PRUCAM_IOC_STREAMOFF:
+        ret = stream_off(filep);
+        break;
+    case PRUCAM_IOC_BRACKET:
+        ret = bracket_ioctl(filep, argp);
+        break;
+    default:
+        ret = -ENOTTY;
+        break;
+    }
+
+    mutex_unlock(&mutex);
+
+    return ret;
+}
+
+/**
+ * Maps the frame buffers read-only, back to back. PRUCAM_IOC_CAPTURE says
+ * which one a frame is in.
+ */
+static int dev_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+    /* the PRUs write the buffers at any time, so they are only for reading */
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    return dma_mmap_coherent(prucam_dev, vma, frame_buffer_va,
+                             frame_buffer_pa, FRAME_BUFFERS_SIZE);
+}
+
+void prucam_frame_done(void)
+{
+    irq_time = ktime_get();
+
+    /**
+     * A frame nobody waits for is one that finished after its read timed out.
+     * One that finishes before the reader took the last one overwrote it. The
+     * reader counts the frames of a stream it never takes instead.
+     */
+    capture_stats.frames_captured++;
+    if (!READ_ONCE(streaming)) {
+        if (!READ_ONCE(reader_waiting))
+            capture_stats.frames_dropped++;
+        else if (completion_done(&pru_to_arm_irq_trigger))
+            capture_stats.overruns++;
+    }
+
+    if (trace_prucam_irq_enabled())
+        trace_prucam_irq(prucam_ctrl_read(frames_done));
+
+    ar013x_context_frame_done();
+    ar013x_timing_frame_done();
+
     /* Signal that interrupt has been triggered */
     complete(&pru_to_arm_irq_trigger);
-
-    return IRQ_HANDLED;
 }
 
 static int dev_release(struct inode *inodep, struct file *filep)
 {
+    /* a stream doesn't outlive the file that started it */
+    mutex_lock(&mutex);
+    if (streaming && stream_owner == filep)
+        stream_off(filep);
+    mutex_unlock(&mutex);
+
     return 0;
 }
 
@@ -144,103 +888,40 @@ static const struct file_operations prucam_fops = {
     .open    = dev_open,
     .read    = dev_read,
     .release = dev_release,
+    .unlocked_ioctl = dev_ioctl,
+    .mmap    = dev_mmap,
 };
 
 static int prucam_probe(struct platform_device *pdev)
 {
     struct device *dev;
-    struct device_node *node = pdev->dev.of_node;
-    camera_regs_t *startup_regs = NULL;
-    int ret, irq;
+    int ret;
     u16 cam_ver;
 
-    if (!node)
-        return -ENODEV; /* No support for non-DT platforms */
+    /**
+     * The simulated backend has its own device without a DT node. Don't take
+     * the real one with it, or the simulated one without it.
+     */
+    if (virt == !!pdev->dev.of_node)
+        return -ENODEV;
 
-    /* Get a handle to the PRUSS structures */
     dev = &pdev->dev;
+    prucam_dev = dev;
 
     dev_info(dev, "probing device: %s\n", pdev->name);
 
-    /* Get PRUs */
-    pru0 = pru_rproc_get(node, PRUSS_PRU0, NULL);
-    if (IS_ERR(pru0)) {
-        ret = PTR_ERR(pru0);
-        if (ret != -EPROBE_DEFER)
-            dev_err(dev, "Unable to get PRU0.\n");
-        goto error_get_pru0;
-    }
-    pru1 = pru_rproc_get(node, PRUSS_PRU1, NULL);
-    if (IS_ERR(pru1)) {
-        ret = PTR_ERR(pru1);
-        if (ret != -EPROBE_DEFER)
-            dev_err(dev, "Unable to get PRU1.\n");
-        goto error_get_pru1;
-    }
-
-    /* Get the underlying PRUSS object */
-    pruss = pruss_get(pru0);
-    if (IS_ERR(pruss)) {
-        dev_err(dev, "error requesting shared memory region: %d", ret);
-        ret = PTR_ERR(pruss);
-        goto err_pruss_get;
-    }
-
-    /* Request the shared memory region */
-    ret = pruss_request_mem_region(pruss, PRUSS_MEM_SHRD_RAM2, &shared_mem);
-    if (ret) {
-        dev_err(dev, "error requesting shared memory region: %d", ret);
-        goto err_shared_mem;
-    }
-
-    /* Get interrupts and install interrupt handlers */
-    for (int i = 0; i < (sizeof(irqs) / sizeof(irqs[0])); i++) {
-        /* Get the irq based on the name in the device tree node */
-        irq = platform_get_irq_byname(pdev, irqs[i].name);
-        if (irq < 0) {
-            ret = irq;
-            dev_err(dev, "Unable to get irq %s: %d\n", irqs[i].name, ret);
-            goto error_irq;
-        }
-
-        dev_info(dev, "irq: %s -> %d\n", irqs[i].name, irq);
-
-        /* Request that irq from the kernel */
-        ret = request_irq(irq, irqs[i].handler, IRQ_TYPE_LEVEL_HIGH,
-                          dev_name(dev), NULL);
-        if (ret < 0) {
-            dev_err(dev, "Unable to request irq %s: %d\n", irqs[i].name, ret);
-            goto error_irq;
-        }
-
-        /* Save irq numbers for freeing */
-        irqs[i].num = irq;
-    }
-
-    /* Set firmware for PRUs */
-    ret = rproc_set_firmware(pru0, PRU0_FW_NAME);
-    if (ret) {
-        dev_err(dev, "Failed to set PRU0 firmware %s: %d\n",
-            PRU0_FW_NAME, ret);
-        goto error_set_pru0_fw;
-    }
-    ret = rproc_set_firmware(pru1, PRU1_FW_NAME);
-    if (ret) {
-        dev_err(dev, "Failed to set PRU1 firmware %s: %d\n",
-            PRU1_FW_NAME, ret);
-        goto error_set_pru1_fw;
-    }
-
-    /* Boot PRUs (boot PRU1 1st) */
-    ret = rproc_boot(pru1);
-    if (ret) {
-        dev_err(dev, "Failed to boot PRU1: %d\n", ret);
-        goto error_boot_pru1;
-    }
-    ret = rproc_boot(pru0);
+    /* Get the PRUs, their interrupts and the control block */
+#ifdef PRUCAM_PRU
+    backend = virt ? &prucam_virt_backend : &prucam_pru_backend;
+#else
+    backend = &prucam_virt_backend;
+#endif
+    ret = backend->init(pdev, &ctrl_base);
     if (ret) {
-        dev_err(dev, "Failed to boot PRU0: %d\n", ret);
-        goto error_boot_pru0;
+        if (ret != -EPROBE_DEFER)
+            dev_err(dev, "Failed to init %s backend: %d\n", backend->name,
+                    ret);
+        goto error_backend;
     }
 
     /* Set DMA mask */
@@ -250,8 +931,8 @@ static int prucam_probe(struct platform_device *pdev)
         goto error_dma_set;
     }
 
-    /* Allocate a physically contiguous frame buffer */
-    frame_buffer_va = dma_alloc_coherent(dev, PIXELS, &frame_buffer_pa, GFP_KERNEL);
+    /* Allocate physically contiguous frame buffers */
+    frame_buffer_va = dma_alloc_coherent(dev, FRAME_BUFFERS_SIZE, &frame_buffer_pa, GFP_KERNEL);
     if (!frame_buffer_va) {
         dev_err(dev, "Failed to allocate DMA\n");
         ret = -1;
@@ -260,33 +941,30 @@ static int prucam_probe(struct platform_device *pdev)
 
     dev_info(dev, "prucam: frame buffer virt/phys: 0x%p/0x%p\n", frame_buffer_va, (void*)frame_buffer_pa);
 
-    /**
-     * Write the frame buffer physical address to the base of PRU shared mem.
-     * The PRUs will read the address from here and then write the image to
-     * this buffer. In the future, this will like be a struct with additional
-     * information to be transferred to the PRUs.
-     * TODO We are technically writing to this memory without the PRUs permission
-     * and it would be preferrable to somehow allocate this memory in the PRUs,
-     * perhaps with the linker script, so it could not be clobbered
-     * TODO write checksum to other location for PRU to verify
-     */
-    writel((int)frame_buffer_pa, shared_mem.va);
+    /* Boot and configure the PRUs */
+    ret = start_prus();
+    if (ret) {
+        dev_err(dev, "Failed to start PRUs: %d\n", ret);
+        goto error_start_prus;
+    }
 
-    ret = init_cam_i2c();
+    ret = init_cam_i2c(dev, virt);
     if (ret < 0) {
         dev_err(dev, "Init camera i2c failed: %d.\n", ret);
         goto error_i2c;
     }
 
-    /* Init the camera control GPIO */
-    ret = init_cam_gpio();
-    if (ret < 0) {
-        dev_err(dev, "Init camera gpio failed: %d.\n", ret);
-        goto error_gpio;
-    }
+    /* Init the camera control GPIO, the simulated sensor has none */
+    if (!virt) {
+        ret = init_cam_gpio();
+        if (ret < 0) {
+            dev_err(dev, "Init camera gpio failed: %d.\n", ret);
+            goto error_gpio;
+        }
 
-    /* enable the camera via gpio */
-    camera_enable();
+        /* enable the camera via gpio */
+        camera_enable();
+    }
 
     /* Detect image sensor model */
     ret = read_cam_reg(AR013X_AD_CHIP_VERSION_REG, &cam_ver);
@@ -320,6 +998,15 @@ static int prucam_probe(struct platform_device *pdev)
         goto error_sysfs;
     }
 
+    ret = sysfs_create_groups(&dev->kobj, prucam_groups);
+    if (ret) {
+        dev_err(dev, "Stats registration failed.\n");
+        goto error_stats;
+    }
+
+    for (int i = 0; i < PRUCAM_LAT_COUNT; i++)
+        prucam_hist_init(&latency_hists[i]);
+
     /* add misc device for file ops */
     miscdev.fops = &prucam_fops;
     miscdev.minor = MISC_DYNAMIC_MINOR;
@@ -331,36 +1018,30 @@ static int prucam_probe(struct platform_device *pdev)
 
     mutex_init(&mutex);
 
+    prucam_debugfs_init();
+
     printk("prucam probe complete");
     return 0;
 
 error_misc:
+    sysfs_remove_groups(&dev->kobj, prucam_groups);
+error_stats:
     sysfs_remove_groups(&dev->kobj, ar013x_groups);
 error_sysfs:
 error_i2c_rw:
-    free_cam_gpio();
+    if (!virt)
+        free_cam_gpio();
 error_gpio:
     end_cam_i2c();
 error_i2c:
-    dma_free_coherent(dev, PIXELS, frame_buffer_va, frame_buffer_pa);
+error_start_prus:
+    stop_prus();
+    prucam_ctrl_end();
+    dma_free_coherent(dev, FRAME_BUFFERS_SIZE, frame_buffer_va, frame_buffer_pa);
 error_dma_alloc:
 error_dma_set:
-    rproc_shutdown(pru0);
-error_boot_pru0:
-    rproc_shutdown(pru1);
-error_boot_pru1:
-error_set_pru1_fw:
-error_set_pru0_fw:
-error_irq:
-    free_irqs();
-    pruss_release_mem_region(pruss, &shared_mem);
-err_shared_mem:
-    pruss_put(pruss);
-err_pruss_get:
-    pru_rproc_put(pru1);
-error_get_pru1:
-    pru_rproc_put(pru0);
-error_get_pru0:
+    backend->end();
+error_backend:
     printk("prucam probe failed with: %d\n", ret);
     return ret;
 }
@@ -369,31 +1050,29 @@ static int prucam_remove(struct platform_device *pdev)
 {
     struct device *dev = &pdev->dev;
 
+    prucam_debugfs_end();
+
     misc_deregister(&miscdev);
 
     /* Remove the sysfs attr */
+    sysfs_remove_groups(&dev->kobj, prucam_groups);
     sysfs_remove_groups(&dev->kobj, ar013x_groups);
+    ar013x_context_stop();
 
     /* Put camera GPIO in good state and free the lines */
-    free_cam_gpio();
+    if (!virt)
+        free_cam_gpio();
 
     end_cam_i2c();
 
-    dma_free_coherent(dev, PIXELS, frame_buffer_va, frame_buffer_pa);
-
-    /* Free the shared mem region and pruss */
-    pruss_release_mem_region(pruss, &shared_mem);
-    pruss_put(pruss);
+    /* Stop PRUs before freeing the buffer they write to */
+    stop_prus();
 
-    /* Stop PRUs */
-    rproc_shutdown(pru0);
-    rproc_shutdown(pru1);
+    prucam_ctrl_end();
+    dma_free_coherent(dev, FRAME_BUFFERS_SIZE, frame_buffer_va, frame_buffer_pa);
 
-
-    free_irqs();
-
-    pru_rproc_put(pru1);
-    pru_rproc_put(pru0);
+    /* Free the PRUs, their interrupts and the control block */
+    backend->end();
 
     printk("prucam removed\n");
     return 0;
@@ -416,4 +1095,36 @@ static struct platform_driver prucam_driver = {
     .remove = prucam_remove,
 };
 
-module_platform_driver(prucam_driver);
+static const struct platform_device_info virt_pdev_info = {
+    .name     = "prucam",
+    .id       = PLATFORM_DEVID_NONE,
+    .dma_mask = DMA_BIT_MASK(32),
+};
+
+static int __init prucam_init(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&prucam_driver);
+    if (ret || !virt)
+        return ret;
+
+    /* there is no device tree node for the simulated hardware, add a device */
+    virt_pdev = platform_device_register_full(&virt_pdev_info);
+    if (IS_ERR(virt_pdev)) {
+        ret = PTR_ERR(virt_pdev);
+        virt_pdev = NULL;
+        platform_driver_unregister(&prucam_driver);
+    }
+
+    return ret;
+}
+
+static void __exit prucam_exit(void)
+{
+    platform_device_unregister(virt_pdev);
+    platform_driver_unregister(&prucam_driver);
+}
+
+module_init(prucam_init);
+module_exit(prucam_exit);
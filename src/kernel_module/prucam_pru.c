@@ -0,0 +1,205 @@
+/**
+ * @file    prucam_pru.c
+ * @brief   PRU-ICSS capture backend, the PRU firmware in ../pru_code on the
+ * AM335x PRUs.
+ */
+
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/kernel.h>
+#include <linux/platform_device.h>
+#include <linux/pruss.h>
+#include <linux/remoteproc.h>
+
+#include "prucam_backend.h"
+
+#define PRU0_FW_NAME "prucam_pru0_fw.out"
+#define PRU1_FW_NAME "prucam_pru1_fw.out"
+
+static struct rproc *pru0 = NULL;
+static struct rproc *pru1 = NULL;
+
+/* underlying pruss object */
+static struct pruss *pruss;
+
+/* PRU shared memory region */
+static struct pruss_mem_region shared_mem;
+
+static irqreturn_t pru_irq_handler(int irq_num, void *);
+
+typedef struct {
+    char *name;
+    int num;
+    irq_handler_t handler;
+} irq_info_t;
+
+/**
+ * interrupts as defined in the device-tree overlay. The number is the value
+ * returned by platform_get_irq_byname. The last 2 are inter-PRU interrupts and
+ * don't interrupt the kernel. However, we still use the kernel driver to
+ * configure them, but specifiy the 'no_action' handler. PRU1 raises
+ * 'arm_to_prus' to start PRU0 on each frame of a capture command.
+ */
+static irq_info_t irqs[] = {
+    {.name = "pru1_to_arm", .num = -1, .handler = pru_irq_handler},
+    {.name = "arm_to_prus", .num = -1, .handler = no_action},
+    {.name = "pru0_to_pru1", .num = -1, .handler = no_action},
+};
+
+static void free_irqs(void)
+{
+    for (int i = 0; i < (sizeof(irqs) / sizeof(irqs[0])); i++) {
+        if (irqs[i].num > -1)
+            free_irq(irqs[i].num, NULL);
+        irqs[i].num = -1;
+    }
+}
+
+static irqreturn_t pru_irq_handler(int irq_num, void *dev_id)
+{
+    prucam_frame_done();
+
+    return IRQ_HANDLED;
+}
+
+static int pru_init(struct platform_device *pdev, void __iomem **ctrl)
+{
+    struct device *dev = &pdev->dev;
+    struct device_node *node = pdev->dev.of_node;
+    int ret, irq;
+
+    if (!node)
+        return -ENODEV; /* No support for non-DT platforms */
+
+    /* Get PRUs */
+    pru0 = pru_rproc_get(node, PRUSS_PRU0, NULL);
+    if (IS_ERR(pru0)) {
+        ret = PTR_ERR(pru0);
+        if (ret != -EPROBE_DEFER)
+            dev_err(dev, "Unable to get PRU0.\n");
+        goto error_get_pru0;
+    }
+    pru1 = pru_rproc_get(node, PRUSS_PRU1, NULL);
+    if (IS_ERR(pru1)) {
+        ret = PTR_ERR(pru1);
+        if (ret != -EPROBE_DEFER)
+            dev_err(dev, "Unable to get PRU1.\n");
+        goto error_get_pru1;
+    }
+
+    /* Get the underlying PRUSS object */
+    pruss = pruss_get(pru0);
+    if (IS_ERR(pruss)) {
+        ret = PTR_ERR(pruss);
+        dev_err(dev, "error getting pruss: %d", ret);
+        goto err_pruss_get;
+    }
+
+    /* Request the shared memory region */
+    ret = pruss_request_mem_region(pruss, PRUSS_MEM_SHRD_RAM2, &shared_mem);
+    if (ret) {
+        dev_err(dev, "error requesting shared memory region: %d", ret);
+        goto err_shared_mem;
+    }
+
+    /* Get interrupts and install interrupt handlers */
+    for (int i = 0; i < (sizeof(irqs) / sizeof(irqs[0])); i++) {
+        /* Get the irq based on the name in the device tree node */
+        irq = platform_get_irq_byname(pdev, irqs[i].name);
+        if (irq < 0) {
+            ret = irq;
+            dev_err(dev, "Unable to get irq %s: %d\n", irqs[i].name, ret);
+            goto error_irq;
+        }
+
+        dev_info(dev, "irq: %s -> %d\n", irqs[i].name, irq);
+
+        /* Request that irq from the kernel */
+        ret = request_irq(irq, irqs[i].handler, IRQ_TYPE_LEVEL_HIGH,
+                          dev_name(dev), NULL);
+        if (ret < 0) {
+            dev_err(dev, "Unable to request irq %s: %d\n", irqs[i].name, ret);
+            goto error_irq;
+        }
+
+        /* Save irq numbers for freeing */
+        irqs[i].num = irq;
+    }
+
+    /* Set firmware for PRUs */
+    ret = rproc_set_firmware(pru0, PRU0_FW_NAME);
+    if (ret) {
+        dev_err(dev, "Failed to set PRU0 firmware %s: %d\n",
+            PRU0_FW_NAME, ret);
+        goto error_set_fw;
+    }
+    ret = rproc_set_firmware(pru1, PRU1_FW_NAME);
+    if (ret) {
+        dev_err(dev, "Failed to set PRU1 firmware %s: %d\n",
+            PRU1_FW_NAME, ret);
+        goto error_set_fw;
+    }
+
+    /* The control block is at the base of PRU shared mem */
+    *ctrl = shared_mem.va;
+    return 0;
+
+error_set_fw:
+error_irq:
+    free_irqs();
+    pruss_release_mem_region(pruss, &shared_mem);
+err_shared_mem:
+    pruss_put(pruss);
+err_pruss_get:
+    pru_rproc_put(pru1);
+error_get_pru1:
+    pru_rproc_put(pru0);
+error_get_pru0:
+    return ret;
+}
+
+static void pru_end(void)
+{
+    /* Free the shared mem region and pruss */
+    pruss_release_mem_region(pruss, &shared_mem);
+    pruss_put(pruss);
+
+    free_irqs();
+
+    pru_rproc_put(pru1);
+    pru_rproc_put(pru0);
+}
+
+static int pru_boot(void *buf_va, dma_addr_t buf_pa, size_t buf_size)
+{
+    int ret;
+
+    /* Boot PRUs (boot PRU1 1st) */
+    ret = rproc_boot(pru1);
+    if (ret) {
+        printk(KERN_ERR "prucam: failed to boot PRU1: %d\n", ret);
+        return ret;
+    }
+    ret = rproc_boot(pru0);
+    if (ret) {
+        printk(KERN_ERR "prucam: failed to boot PRU0: %d\n", ret);
+        rproc_shutdown(pru1);
+        return ret;
+    }
+
+    return 0;
+}
+
+static void pru_shutdown(void)
+{
+    rproc_shutdown(pru0);
+    rproc_shutdown(pru1);
+}
+
+const struct prucam_backend prucam_pru_backend = {
+    .name     = "pru",
+    .init     = pru_init,
+    .end      = pru_end,
+    .boot     = pru_boot,
+    .shutdown = pru_shutdown,
+};
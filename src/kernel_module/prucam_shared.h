@@ -0,0 +1,253 @@
+/**
+ * @file    prucam_shared.h
+ * @brief   Control block shared between the kernel module and PRU firmware.
+ *
+ * The control block sits at the base of the PRU shared RAM. The PRU firmware
+ * places it there with the linker command file and the kernel initialises it
+ * before every PRU boot. The kernel sends commands to PRU1 through a ring and
+ * the PRUs publish their status and the active capture config in the block.
+ *
+ * This file is included by the kernel module and the PRU firmware (C and
+ * assembly), so it must only use fixed size types. The PRU assembly cannot
+ * use the struct, so the offsets it needs are defined too and checked by the
+ * kernel at build time.
+ */
+
+#ifndef PRUCAM_SHARED_H
+#define PRUCAM_SHARED_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+/** "PCAM", written last by the kernel once the block is initialised */
+#define PRUCAM_CTRL_MAGIC   0x4D414350U
+/** bump on any change to the layout or meaning of the control block */
+#define PRUCAM_CTRL_VERSION 3U
+
+/** number of commands in the ring, must be a power of 2 */
+#define PRUCAM_CMD_RING_SIZE 8U
+
+/**
+ * @name Commands
+ * @{
+ */
+/** capture args[0] frames (0 = until PRUCAM_CMD_STOP) with the
+ * PRUCAM_FRAME_OPT_* bits in args[1] */
+#define PRUCAM_CMD_CAPTURE      1U
+/** set the frame size to args[0] rows by args[1] columns */
+#define PRUCAM_CMD_SET_GEOMETRY 2U
+/** capture to args[2] buffers args[1] bytes apart starting at the physical
+ * address args[0] */
+#define PRUCAM_CMD_SET_DEST     3U
+/** stop capturing after the current frame */
+#define PRUCAM_CMD_STOP         4U
+/** @} */
+
+/**
+ * @name Command errors
+ * Reported in prucam_ctrl.last_error when PRU1 rejects a command
+ * @{
+ */
+#define PRUCAM_ERR_CSUM    1U /**< checksum mismatch */
+#define PRUCAM_ERR_OP      2U /**< unknown command */
+#define PRUCAM_ERR_ARG     3U /**< argument out of range */
+#define PRUCAM_ERR_NO_DEST 4U /**< capture before a valid destination */
+/** @} */
+
+/**
+ * @name Capture states
+ * Reported by PRU1 in prucam_ctrl.state
+ * @{
+ */
+#define PRUCAM_STATE_WAIT_INIT 0U /**< waiting for a valid control block */
+#define PRUCAM_STATE_IDLE      1U /**< waiting for a capture command */
+#define PRUCAM_STATE_CAPTURING 2U /**< capturing frames_left frames */
+#define PRUCAM_STATE_STREAMING 3U /**< capturing until stopped */
+/** @} */
+
+/**
+ * @name PRU0 status states
+ * Where PRU0 is in the capture, see prucam_pru_status.state
+ * @{
+ */
+#define PRUCAM_PRU0_WAIT_TRIGGER 1U /**< waiting for PRU1 to start a frame */
+#define PRUCAM_PRU0_WAIT_VSYNC   2U /**< waiting for the frame to start */
+#define PRUCAM_PRU0_WAIT_HSYNC   3U /**< waiting for, or capturing, a line */
+#define PRUCAM_PRU0_FRAME_DONE   4U /**< handing the frame status to PRU1 */
+/** @} */
+
+/**
+ * @name PRU1 status states
+ * Where PRU1 is in the capture, see prucam_pru_status.state
+ * @{
+ */
+#define PRUCAM_PRU1_WAIT_CMD          1U /**< waiting for a capture command */
+#define PRUCAM_PRU1_WAIT_CHUNK        2U /**< waiting for PRU0 to send a chunk */
+#define PRUCAM_PRU1_WAIT_FRAME_STATUS 3U /**< waiting for PRU0 to end a frame */
+/** @} */
+
+/** @name Capture option bits, see PRUCAM_CMD_CAPTURE
+ * @{
+ */
+#define PRUCAM_FRAME_OPT_EMBEDDED_BIT 0 /**< also capture the embedded rows */
+#define PRUCAM_FRAME_OPT_HIST_BIT     1 /**< publish the frame histogram */
+/** @} */
+
+/** largest frame the PRUs capture */
+#define PRUCAM_MAX_ROWS 960
+#define PRUCAM_MAX_COLS 1280
+
+/** number of bins of the frame histogram, of 4 pixel levels each */
+#define PRUCAM_HIST_BINS 64
+/** PRU1 counts 1 in this many image pixels in the frame histogram */
+#define PRUCAM_HIST_SAMPLE 8
+
+/** @name Offsets of the fields used by the PRU assembly
+ * @{
+ */
+#define PRUCAM_CTRL_GEOMETRY_OFFSET     0xD0
+#define PRUCAM_CTRL_OPTIONS_OFFSET      0xD4
+#define PRUCAM_CTRL_FRAME_STATUS_OFFSET 0xE8
+#define PRUCAM_CTRL_PRU0_STATUS_OFFSET  0xF0
+#define PRUCAM_CTRL_PRU1_STATUS_OFFSET  0x104
+#define PRUCAM_STATUS_STATE_OFFSET      0x0
+#define PRUCAM_STATUS_FRAMES_OFFSET     0x4
+#define PRUCAM_STATUS_LINES_OFFSET      0x8
+#define PRUCAM_STATUS_CHUNKS_OFFSET     0xC
+#define PRUCAM_STATUS_CYCLES_MAX_OFFSET 0x10
+#define PRUCAM_HIST_SATURATED_OFFSET    0x0
+#define PRUCAM_HIST_BLACK_OFFSET        0x4
+#define PRUCAM_HIST_BINS_OFFSET         0x8
+/** @} */
+
+/** @brief A command in the ring */
+struct prucam_cmd {
+    /** PRUCAM_CMD_* */
+    uint32_t op;
+    /** command arguments, unused ones are 0 */
+    uint32_t args[3];
+    /** see prucam_cmd_csum() */
+    uint32_t csum;
+};
+
+/**
+ * @brief Progress of one PRU, written only by that PRU.
+ *
+ * PRU0 can't spare the cycles to write it in the middle of a line, so it
+ * updates it between lines. PRU1 updates it after every chunk.
+ */
+struct prucam_pru_status {
+    /** PRUCAM_PRU0_* or PRUCAM_PRU1_* */
+    uint32_t state;
+    /** number of frames finished */
+    uint32_t frames;
+    /** lines finished in the current frame */
+    uint32_t lines;
+    /** 32 byte chunks finished in the current frame */
+    uint32_t chunks;
+    /** high-water mark in PRU cycles of a line (PRU0) or the transfer of a
+     * chunk (PRU1) */
+    uint32_t cycles_max;
+};
+
+/**
+ * @brief Histogram of a frame, counted by PRU1 while it moves the frame.
+ *
+ * With PRUCAM_FRAME_OPT_HIST_BIT, PRU1 writes it to the frame's buffer after
+ * the image and the room for the embedded rows, whether those were captured
+ * or not. It counts the first 2 pixels of each half of a 32 byte chunk, so
+ * both colours of every Bayer row, and not the embedded rows.
+ */
+struct prucam_frame_hist {
+    /** pixels at 255 */
+    uint32_t saturated;
+    /** pixels at 0 */
+    uint32_t black;
+    /** pixels with each level / 4 */
+    uint32_t bins[PRUCAM_HIST_BINS];
+    /** pixels counted, 0 when the firmware is built for a 100MHz pixel clock,
+     * which leaves PRU1 no time to count */
+    uint32_t samples;
+    uint32_t reserved;
+};
+
+/** @brief The control block at the base of the PRU shared RAM */
+struct prucam_ctrl {
+    /* header, written by the kernel */
+    /** PRUCAM_CTRL_MAGIC */
+    uint32_t magic;
+    /** PRUCAM_CTRL_VERSION */
+    uint32_t version;
+    /** sizeof(struct prucam_ctrl) */
+    uint32_t size;
+
+    /* command ring */
+    /** number of commands sent, written by the kernel */
+    uint32_t cmd_head;
+    /** number of commands consumed, written by PRU1 */
+    uint32_t cmd_tail;
+    /** command n is in cmds[n % PRUCAM_CMD_RING_SIZE] */
+    struct prucam_cmd cmds[PRUCAM_CMD_RING_SIZE];
+
+    /* status, written by PRU1 */
+    /** PRUCAM_CTRL_VERSION of the firmware once it accepted the block */
+    uint32_t fw_version;
+    /** PRUCAM_STATE_* */
+    uint32_t state;
+    /** number of commands rejected */
+    uint32_t cmd_errors;
+    /** PRUCAM_ERR_* of the last command rejected */
+    uint32_t last_error;
+    /** number of frames captured */
+    uint32_t frames_done;
+    /** frames left in the current PRUCAM_CMD_CAPTURE */
+    uint32_t frames_left;
+    /** index of the buffer the last frame was captured to */
+    uint32_t last_buf;
+
+    /* active config, published by PRU1 and read by PRU0 at frame start */
+    uint16_t rows;
+    uint16_t cols;
+    /** PRUCAM_FRAME_OPT_* bits of the current capture */
+    uint32_t options;
+    /** physical address of the first buffer */
+    uint32_t dest;
+    /** bytes between buffers */
+    uint32_t stride;
+    /** number of buffers, 0 until PRUCAM_CMD_SET_DEST */
+    uint32_t nbufs;
+    /** index of the buffer the next frame goes to */
+    uint32_t cur_buf;
+
+    /* frame status, written by PRU0 */
+    /** FRAME_ERR_* bits of the last frame */
+    uint32_t frame_errors;
+    /** bad lines (low half) and first bad line (high half) of the last frame */
+    uint32_t bad_lines;
+
+    /* PRU progress, for diagnosing stalls */
+    /** status of PRU0 and PRU1 */
+    struct prucam_pru_status pru[2];
+};
+
+/**
+ * @brief Checksum of a command.
+ *
+ * Covers the position of the command in the ring so a stale entry left over
+ * from a previous lap is rejected too.
+ *
+ * @param cmd The command.
+ * @param seq The number of the command, the value of cmd_head it was sent at.
+ *
+ * @return The checksum.
+ */
+static inline uint32_t prucam_cmd_csum(const struct prucam_cmd *cmd,
+                                       uint32_t seq)
+{
+    return ~(seq ^ cmd->op ^ cmd->args[0] ^ cmd->args[1] ^ cmd->args[2]);
+}
+
+#endif /* PRUCAM_SHARED_H */
@@ -0,0 +1,126 @@
+/**
+ * @file    prucam_stats.c
+ * @brief   prucam capture statistics sysfs, the stats group of the device.
+ *
+ * The throughput is the number of frames read in a window of at least a
+ * second. A new window starts with the first frame read after one ends, and
+ * the window in progress is used once it is over a second old, so when the
+ * reads stop the estimate decays towards 0 instead of sticking at the last
+ * rate.
+ */
+
+#include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+
+#include "prucam_debugfs.h"
+#include "prucam_stats.h"
+
+struct prucam_stats capture_stats;
+
+/** frames read and start of the throughput window in progress */
+static unsigned long window_frames;
+static ktime_t window_start;
+/** frames read per 100 seconds in the last full window */
+static u32 last_fps_x100;
+static DEFINE_SPINLOCK(window_lock);
+
+static u32 window_fps_x100(ktime_t now)
+{
+    u64 ns = ktime_to_ns(ktime_sub(now, window_start));
+
+    return (u32)div64_u64((u64)(capture_stats.frames_read - window_frames) *
+                              100 * NSEC_PER_SEC, ns);
+}
+
+void prucam_stats_frame_read(void)
+{
+    ktime_t now = ktime_get();
+
+    spin_lock(&window_lock);
+    capture_stats.frames_read++;
+    if (window_start == 0) {
+        window_start  = now;
+        window_frames = capture_stats.frames_read;
+    } else if (ktime_to_ns(ktime_sub(now, window_start)) >= NSEC_PER_SEC) {
+        last_fps_x100 = window_fps_x100(now);
+        window_start  = now;
+        window_frames = capture_stats.frames_read;
+    }
+    spin_unlock(&window_lock);
+}
+
+static ssize_t prucam_stats_print(struct device *dev, char *buf,
+                                  unsigned long value)
+{
+    int len;
+
+    len = sprintf(buf, "%lu\n", value);
+    if (len <= 0)
+        dev_err(dev, "prucam: invalid sprintf len %d", len);
+
+    return len;
+}
+
+/** @brief Defines dev_attr_<name> and its show function, which prints value */
+#define STATS_ATTR(_name, _value)                                              \
+    static ssize_t _name##_show(struct device *dev,                            \
+                                struct device_attribute *attr, char *buf)      \
+    {                                                                          \
+        return prucam_stats_print(dev, buf, _value);                           \
+    }                                                                          \
+    static DEVICE_ATTR(_name, S_IRUGO, _name##_show, NULL)
+
+STATS_ATTR(frames_captured, capture_stats.frames_captured);
+STATS_ATTR(frames_read, capture_stats.frames_read);
+STATS_ATTR(frames_dropped, capture_stats.frames_dropped);
+STATS_ATTR(overruns, capture_stats.overruns);
+STATS_ATTR(torn_frames, capture_stats.torn_frames);
+STATS_ATTR(copy_errors, capture_stats.copy_errors);
+STATS_ATTR(timeouts, recovery_stats.timeouts);
+
+static ssize_t prucam_fps_show(struct device *dev,
+                               struct device_attribute *attr, char *buf)
+{
+    ktime_t now = ktime_get();
+    u32 fps_x100;
+    int len;
+
+    spin_lock(&window_lock);
+    if (window_start == 0)
+        fps_x100 = 0;
+    else if (ktime_to_ns(ktime_sub(now, window_start)) >= NSEC_PER_SEC)
+        fps_x100 = window_fps_x100(now);
+    else
+        fps_x100 = last_fps_x100;
+    spin_unlock(&window_lock);
+
+    len = sprintf(buf, "%u.%02u\n", fps_x100 / 100, fps_x100 % 100);
+    if (len <= 0)
+        dev_err(dev, "prucam: invalid sprintf len %d", len);
+
+    return len;
+}
+
+static DEVICE_ATTR(fps, S_IRUGO, prucam_fps_show, NULL);
+
+static struct attribute *prucam_stats_attrs[] = {
+    &dev_attr_frames_captured.attr,
+    &dev_attr_frames_read.attr,
+    &dev_attr_frames_dropped.attr,
+    &dev_attr_overruns.attr,
+    &dev_attr_torn_frames.attr,
+    &dev_attr_copy_errors.attr,
+    &dev_attr_timeouts.attr,
+    &dev_attr_fps.attr,
+    NULL,
+};
+
+static const struct attribute_group prucam_stats_group = {
+    .name  = "stats",
+    .attrs = prucam_stats_attrs,
+};
+
+const struct attribute_group *prucam_groups[] = {&prucam_stats_group, NULL};
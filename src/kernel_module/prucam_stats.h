@@ -0,0 +1,43 @@
+/**
+ * @file    prucam_stats.h
+ * @brief   prucam capture statistics sysfs, the stats group of the device.
+ *
+ * Monotonic counters for telemetry to poll. They are unsigned longs and wrap
+ * after 2^32 events on the BeagleBone.
+ */
+
+#ifndef PRUCAM_STATS_H
+#define PRUCAM_STATS_H
+
+#include <linux/sysfs.h>
+
+/** @brief Capture event counters */
+struct prucam_stats {
+    /** frame done interrupts from PRU1 */
+    unsigned long frames_captured;
+    /** frames handed to a reader, by read or PRUCAM_IOC_CAPTURE */
+    unsigned long frames_read;
+    /** frames that finished with no reader waiting, e.g. after a timeout, or
+     * frames of a stream that were never taken */
+    unsigned long frames_dropped;
+    /** frames that finished before the reader took the previous one */
+    unsigned long overruns;
+    /** frames PRU0 flagged with sync errors */
+    unsigned long torn_frames;
+    /** frames that could not be copied to the reader */
+    unsigned long copy_errors;
+};
+
+/** owned by prucam_stats.c, updated by prucam_main.c */
+extern struct prucam_stats capture_stats;
+
+/**
+ * @brief Counts a frame handed to a reader and updates the throughput
+ * estimate.
+ */
+void prucam_stats_frame_read(void);
+
+/** the stats attribute group, registered on the device with the sensor's */
+extern const struct attribute_group *prucam_groups[];
+
+#endif /* PRUCAM_STATS_H */
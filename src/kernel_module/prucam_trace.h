@@ -0,0 +1,158 @@
+/**
+ * @file    prucam_trace.h
+ * @brief   prucam tracepoints.
+ *
+ * Events for each step of a capture, in /sys/kernel/debug/tracing/events/
+ * prucam/. They cost a branch when disabled, so they are used instead of
+ * logging every frame. E.g.
+ *
+ *     echo 1 > /sys/kernel/debug/tracing/events/prucam/enable
+ *     cat /sys/kernel/debug/tracing/trace_pipe
+ *
+ * seq is the driver frame sequence the capture will get, see
+ * prucam_frame_info.sequence.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM prucam
+
+#if !defined(PRUCAM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define PRUCAM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** The capture command was sent to PRU1 */
+TRACE_EVENT(prucam_trigger,
+    TP_PROTO(u32 seq, u32 options, unsigned int timeout_ms),
+    TP_ARGS(seq, options, timeout_ms),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(u32, options)
+        __field(unsigned int, timeout_ms)
+    ),
+    TP_fast_assign(
+        __entry->seq        = seq;
+        __entry->options    = options;
+        __entry->timeout_ms = timeout_ms;
+    ),
+    TP_printk("seq=%u options=0x%x timeout_ms=%u", __entry->seq,
+              __entry->options, __entry->timeout_ms)
+);
+
+/** PRU1 raised the frame done interrupt */
+TRACE_EVENT(prucam_irq,
+    TP_PROTO(u32 frames_done),
+    TP_ARGS(frames_done),
+    TP_STRUCT__entry(
+        __field(u32, frames_done)
+    ),
+    TP_fast_assign(
+        __entry->frames_done = frames_done;
+    ),
+    TP_printk("frames_done=%u", __entry->frames_done)
+);
+
+/** The reader woke up with a frame, wait_ns after the trigger */
+TRACE_EVENT(prucam_frame,
+    TP_PROTO(u32 seq, u64 wait_ns, u32 errors, u32 bad_lines),
+    TP_ARGS(seq, wait_ns, errors, bad_lines),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(u64, wait_ns)
+        __field(u32, errors)
+        __field(u32, bad_lines)
+    ),
+    TP_fast_assign(
+        __entry->seq       = seq;
+        __entry->wait_ns   = wait_ns;
+        __entry->errors    = errors;
+        __entry->bad_lines = bad_lines;
+    ),
+    TP_printk("seq=%u wait_ns=%llu errors=0x%x bad_lines=0x%08x",
+              __entry->seq, __entry->wait_ns, __entry->errors,
+              __entry->bad_lines)
+);
+
+/** Copying the frame to userspace started */
+TRACE_EVENT(prucam_copy_start,
+    TP_PROTO(u32 seq, size_t len),
+    TP_ARGS(seq, len),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(size_t, len)
+    ),
+    TP_fast_assign(
+        __entry->seq = seq;
+        __entry->len = len;
+    ),
+    TP_printk("seq=%u len=%zu", __entry->seq, __entry->len)
+);
+
+/** Copying the frame to userspace finished, ret is what copy_to_user left */
+TRACE_EVENT(prucam_copy_end,
+    TP_PROTO(u32 seq, u64 copy_ns, unsigned long ret),
+    TP_ARGS(seq, copy_ns, ret),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(u64, copy_ns)
+        __field(unsigned long, ret)
+    ),
+    TP_fast_assign(
+        __entry->seq     = seq;
+        __entry->copy_ns = copy_ns;
+        __entry->ret     = ret;
+    ),
+    TP_printk("seq=%u copy_ns=%llu ret=%lu", __entry->seq, __entry->copy_ns,
+              __entry->ret)
+);
+
+/** No interrupt came within the timeout, with where each PRU got to */
+TRACE_EVENT(prucam_timeout,
+    TP_PROTO(u32 seq, u64 wait_ns, u32 pru0_state, u32 pru0_lines,
+             u32 pru1_state, u32 pru1_chunks),
+    TP_ARGS(seq, wait_ns, pru0_state, pru0_lines, pru1_state, pru1_chunks),
+    TP_STRUCT__entry(
+        __field(u32, seq)
+        __field(u64, wait_ns)
+        __field(u32, pru0_state)
+        __field(u32, pru0_lines)
+        __field(u32, pru1_state)
+        __field(u32, pru1_chunks)
+    ),
+    TP_fast_assign(
+        __entry->seq         = seq;
+        __entry->wait_ns     = wait_ns;
+        __entry->pru0_state  = pru0_state;
+        __entry->pru0_lines  = pru0_lines;
+        __entry->pru1_state  = pru1_state;
+        __entry->pru1_chunks = pru1_chunks;
+    ),
+    TP_printk("seq=%u wait_ns=%llu pru0_state=%u pru0_lines=%u "
+              "pru1_state=%u pru1_chunks=%u", __entry->seq, __entry->wait_ns,
+              __entry->pru0_state, __entry->pru0_lines, __entry->pru1_state,
+              __entry->pru1_chunks)
+);
+
+/** The PRUs were restarted after a timeout, ret is 0 on success */
+TRACE_EVENT(prucam_recovery,
+    TP_PROTO(u64 duration_ns, int ret),
+    TP_ARGS(duration_ns, ret),
+    TP_STRUCT__entry(
+        __field(u64, duration_ns)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->duration_ns = duration_ns;
+        __entry->ret         = ret;
+    ),
+    TP_printk("duration_ns=%llu ret=%d", __entry->duration_ns, __entry->ret)
+);
+
+#endif /* PRUCAM_TRACE_H */
+
+/* the kernel's trace headers include this file again from their directory */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE prucam_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,271 @@
+/**
+ * @file    prucam_uapi.h
+ * @brief   prucam character device interface shared with userspace.
+ *
+ * Userspace programs include this file directly, so it must only use types
+ * from linux/types.h.
+ */
+
+#ifndef PRUCAM_UAPI_H
+#define PRUCAM_UAPI_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define PRUCAM_ROWS 960
+#define PRUCAM_COLS 1280
+
+/** number of embedded data rows the sensor outputs around the image */
+#define PRUCAM_EMBEDDED_ROWS 4
+
+/** number of bins of the frame histogram, of 4 pixel levels each */
+#define PRUCAM_HIST_BINS 64
+
+/**
+ * @brief Histogram of a frame, counted by the PRUs while they move it. It
+ * counts 1 in 8 pixels of the image, both colours of every Bayer row.
+ */
+struct prucam_histogram {
+    /** pixels at 255 */
+    __u32 saturated;
+    /** pixels at 0 */
+    __u32 black;
+    /** pixels with each level / 4 */
+    __u32 bins[PRUCAM_HIST_BINS];
+    /** pixels counted, 0 when the histogram was not captured */
+    __u32 samples;
+    __u32 reserved;
+};
+
+/** number of frame buffers the PRUs capture to in turn, see mmap */
+#define PRUCAM_NUM_BUFFERS 4
+/** bytes between the frame buffers in the mapping, an image followed by its
+ * embedded rows and its histogram */
+#define PRUCAM_BUFFER_SIZE \
+    ((PRUCAM_ROWS + PRUCAM_EMBEDDED_ROWS) * PRUCAM_COLS + \
+     sizeof(struct prucam_histogram))
+
+/**
+ * @name Frame error bits
+ * Set by the PRU when a frame is torn, see prucam_frame_info.errors
+ * @{
+ */
+#define PRUCAM_FRAME_ERR_SHORT_LINE  (1U << 0) /**< HSYNC fell early */
+#define PRUCAM_FRAME_ERR_LONG_LINE   (1U << 1) /**< HSYNC fell late */
+#define PRUCAM_FRAME_ERR_EARLY_VSYNC (1U << 2) /**< VSYNC fell early */
+/** @} */
+
+/**
+ * @name Embedded data fields
+ * Set in prucam_frame_info.embedded_valid for each field that was decoded from
+ * the embedded register rows of the frame
+ * @{
+ */
+#define PRUCAM_EMB_FRAME_COUNT      (1U << 0)
+#define PRUCAM_EMB_COARSE_TIME      (1U << 1)
+#define PRUCAM_EMB_FINE_TIME        (1U << 2)
+#define PRUCAM_EMB_ANALOG_GAIN      (1U << 3)
+#define PRUCAM_EMB_GLOBAL_GAIN      (1U << 4)
+#define PRUCAM_EMB_AE_CURRENT_GAINS (1U << 5)
+#define PRUCAM_EMB_AE_MEAN          (1U << 6)
+#define PRUCAM_EMB_CONTEXT          (1U << 7)
+/** @} */
+
+/** @brief Information about the last frame captured. */
+struct prucam_frame_info {
+    /** driver frame counter, incremented for every frame captured */
+    __u32 sequence;
+    /** PRUCAM_FRAME_ERR_* bits, 0 for a good frame */
+    __u32 errors;
+    /** number of lines that were padded instead of captured */
+    __u16 bad_lines;
+    /** index of the first padded line */
+    __u16 first_bad_line;
+    /** PRUCAM_EMB_* bits of the fields below that are valid */
+    __u32 embedded_valid;
+    /** sensor frame count */
+    __u16 frame_count;
+    /** integration time of the frame in lines */
+    __u16 coarse_time;
+    /** integration time of the frame in pixel clocks, added to coarse_time */
+    __u16 fine_time;
+    /** analog gain field of the frame's context, 0-3 for 1x, 2x, 4x & 8x */
+    __u16 analog_gain;
+    /** global digital gain of the frame's context, 3.5 fixed point */
+    __u16 global_gain;
+    /** gains the sensor auto exposure picked for the frame */
+    __u16 ae_current_gains;
+    /** mean luma the sensor auto exposure measured */
+    __u16 ae_mean;
+    /** context (0 = A, 1 = B) the frame was captured with, from the embedded
+     * rows, or else from the context_pattern in a stream */
+    __u16 context;
+    /** last settings batch the frame was exposed with, 0 for none, see the
+     * settings and settings_batch attributes */
+    __u32 settings;
+};
+
+/** @brief Raw embedded rows of the last frame, see the embedded_data param */
+struct prucam_embedded_rows {
+    __u8 rows[PRUCAM_EMBEDDED_ROWS][PRUCAM_COLS];
+};
+
+/** @brief A frame left in one of the mmap'd frame buffers */
+struct prucam_buffer {
+    /** buffer the frame is in, at index * PRUCAM_BUFFER_SIZE in the mapping */
+    __u32 index;
+    /** frames of the stream that finished since the last one returned and
+     * were never returned, always 0 outside a stream */
+    __u32 skipped;
+    /** info of the frame, as PRUCAM_IOC_G_FRAME_INFO returns it after */
+    struct prucam_frame_info info;
+};
+
+/**
+ * @name Control ids
+ * The context_settings and auto_exposure_settings attributes, for
+ * PRUCAM_IOC_G_CONTROLS and PRUCAM_IOC_S_CONTROLS. The context ones are those
+ * of the current context, like the attributes. While the context_pattern
+ * alternates the contexts, PRUCAM_IOC_S_CONTROLS fails with -EBUSY for a
+ * context one that doesn't follow a PRUCAM_CID_CONTEXT, which then picks the
+ * context the ones after it go to instead of switching the sensor.
+ * @{
+ */
+#define PRUCAM_CID_CONTEXT               0
+#define PRUCAM_CID_X_SIZE                1
+#define PRUCAM_CID_Y_SIZE                2
+#define PRUCAM_CID_COARSE_TIME           3
+#define PRUCAM_CID_FINE_TIME             4
+#define PRUCAM_CID_Y_ODD_INC             5
+#define PRUCAM_CID_GREEN1_GAIN           6
+#define PRUCAM_CID_BLUE_GAIN             7
+#define PRUCAM_CID_RED_GAIN              8
+#define PRUCAM_CID_GREEN2_GAIN           9
+#define PRUCAM_CID_GLOBAL_GAIN           10
+#define PRUCAM_CID_ANALOG_GAIN           11
+#define PRUCAM_CID_FRAME_LEN_LINES       12
+#define PRUCAM_CID_DIGITAL_BINNING       13
+#define PRUCAM_CID_AE_ENABLE             14
+#define PRUCAM_CID_AE_AG_EN              15
+#define PRUCAM_CID_AE_DG_EN              16
+#define PRUCAM_CID_AE_MIN_ANA_GAIN       17
+#define PRUCAM_CID_AE_ROI_X_START_OFFSET 18
+#define PRUCAM_CID_AE_ROI_Y_START_OFFSET 19
+#define PRUCAM_CID_AE_ROI_X_SIZE         20
+#define PRUCAM_CID_AE_ROI_Y_SIZE         21
+#define PRUCAM_CID_AE_LUMA_TARGET        22
+#define PRUCAM_CID_AE_MIN_EV_STEP        23
+#define PRUCAM_CID_AE_MAX_EV_STEP        24
+#define PRUCAM_CID_AE_DAMP_OFFSET        25
+#define PRUCAM_CID_AE_DAMP_GAIN          26
+#define PRUCAM_CID_AE_DAMP_MAX           27
+#define PRUCAM_CID_AE_MIN_EXPOSURE       28
+#define PRUCAM_CID_AE_MAX_EXPOSURE       29
+#define PRUCAM_CID_AE_AG_EXPOSURE_HI     30
+#define PRUCAM_CID_AE_AG_EXPOSURE_LO     31
+#define PRUCAM_CID_AE_DARK_CUR_THRESH    32
+#define PRUCAM_CID_COUNT                 33
+/** @} */
+
+/** most controls in one PRUCAM_IOC_G_CONTROLS or PRUCAM_IOC_S_CONTROLS */
+#define PRUCAM_CONTROLS_MAX 64
+
+/** @brief The value of a control */
+struct prucam_control {
+    /** PRUCAM_CID_* */
+    __u32 id;
+    /** value, as the control's attribute reads or writes it */
+    __s32 value;
+};
+
+/** @brief Controls to get or set together */
+struct prucam_controls {
+    /** number of controls at ptr, at most PRUCAM_CONTROLS_MAX */
+    __u32 count;
+    /** set to the index of the control that failed, or to count when none
+     * did */
+    __u32 error_idx;
+    /** set to the settings batch of PRUCAM_IOC_S_CONTROLS, see
+     * prucam_frame_info.settings */
+    __u32 batch;
+    __u32 reserved;
+    /** userspace address of an array of count struct prucam_control */
+    __u64 ptr;
+};
+
+/** most steps in a PRUCAM_IOC_BRACKET */
+#define PRUCAM_BRACKET_MAX 8
+
+/** @brief The exposure of a bracket step, as the controls of the same name */
+struct prucam_bracket_step {
+    /** PRUCAM_CID_COARSE_TIME */
+    __u16 coarse_time;
+    /** PRUCAM_CID_ANALOG_GAIN */
+    __u16 analog_gain;
+    /** PRUCAM_CID_GLOBAL_GAIN */
+    __u16 global_gain;
+    __u16 reserved;
+};
+
+/** @brief Frames captured with consecutive exposures */
+struct prucam_bracket {
+    /** number of steps, at most PRUCAM_BRACKET_MAX */
+    __u32 count;
+    __u32 reserved;
+    /** userspace address of count images, the one of step i at
+     * i * PRUCAM_ROWS * PRUCAM_COLS */
+    __u64 ptr;
+    /** exposure of each step, in the current context */
+    struct prucam_bracket_step steps[PRUCAM_BRACKET_MAX];
+    /** set to the info of the frame of each step */
+    struct prucam_frame_info info[PRUCAM_BRACKET_MAX];
+};
+
+#define PRUCAM_IOC_MAGIC 'p'
+
+/** Get the prucam_frame_info of the last frame read */
+#define PRUCAM_IOC_G_FRAME_INFO \
+    _IOR(PRUCAM_IOC_MAGIC, 0, struct prucam_frame_info)
+/** Get the raw embedded rows of the last frame read */
+#define PRUCAM_IOC_G_EMBEDDED_ROWS \
+    _IOR(PRUCAM_IOC_MAGIC, 1, struct prucam_embedded_rows)
+/**
+ * Get a frame like read does, but leave it in its frame buffer instead of
+ * copying it. The buffer is rewritten by the next capture, or in a stream
+ * PRUCAM_NUM_BUFFERS - 1 frames later.
+ */
+#define PRUCAM_IOC_CAPTURE \
+    _IOR(PRUCAM_IOC_MAGIC, 2, struct prucam_buffer)
+/**
+ * Capture continuously to the frame buffers in turn. Reads and
+ * PRUCAM_IOC_CAPTURE then return the next frame of the stream instead of
+ * starting a capture. Stops when the file that started it is closed.
+ */
+#define PRUCAM_IOC_STREAMON  _IO(PRUCAM_IOC_MAGIC, 3)
+/** Stop the stream after the frame being captured */
+#define PRUCAM_IOC_STREAMOFF _IO(PRUCAM_IOC_MAGIC, 4)
+/** Get the values of the controls */
+#define PRUCAM_IOC_G_CONTROLS \
+    _IOWR(PRUCAM_IOC_MAGIC, 5, struct prucam_controls)
+/**
+ * Set the controls in order, as one settings batch. Nothing is written when
+ * any of them is unknown or out of range, error_idx says which. Fails with
+ * -EBUSY while a PRUCAM_IOC_BRACKET runs, as it puts its settings back after.
+ */
+#define PRUCAM_IOC_S_CONTROLS \
+    _IOWR(PRUCAM_IOC_MAGIC, 6, struct prucam_controls)
+/**
+ * Capture a frame with each exposure of a bracket, on consecutive frames
+ * when the copies keep up, and put the settings back after. Setting the
+ * controls, with PRUCAM_IOC_S_CONTROLS, the settings attribute or a control's
+ * attribute, fails with -EBUSY meanwhile. Fails with -EBUSY during a stream, a
+ * context pattern or the sensor's auto exposure, and with -EAGAIN when a step
+ * got no frame of its own.
+ */
+#define PRUCAM_IOC_BRACKET \
+    _IOWR(PRUCAM_IOC_MAGIC, 7, struct prucam_bracket)
+/** Get the histogram of the last frame read, see the histogram param */
+#define PRUCAM_IOC_G_HISTOGRAM \
+    _IOR(PRUCAM_IOC_MAGIC, 8, struct prucam_histogram)
+
+#endif /* PRUCAM_UAPI_H */
@@ -0,0 +1,396 @@
+/**
+ * @file    prucam_virt.c
+ * @brief   Simulated PRU capture backend, for running the driver without a
+ * BeagleBone or camera board.
+ *
+ * A kthread plays PRU1 and PRU0. It runs the commands from the control block
+ * ring the way pru1_fw.c does and writes frames to the buffers the kernel
+ * gave it, then calls prucam_frame_done() where PRU1 would raise its
+ * interrupt. The sensor free runs, so a frame starts on the next frame
+ * boundary after the capture command and is done one frame period later.
+ * The frame period comes from the simulated sensor registers, like the
+ * capture timeout, unless virt_fps is set.
+ *
+ * The frames are a diagonal ramp that moves one pixel per frame, with the
+ * frame count in the first 4 bytes (little endian), or raw frames replayed
+ * from a firmware file. The embedded rows are zeroes. The histogram counts
+ * the same pixels PRU1 does.
+ */
+
+#include <linux/delay.h>
+#include <linux/firmware.h>
+#include <linux/hrtimer.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "ar013x_timing.h"
+#include "ar013x_virt.h"
+#include "prucam_backend.h"
+#include "prucam_shared.h"
+#include "prucam_uapi.h"
+
+/** how often the idle PRU checks for commands */
+#define VIRT_POLL_US 500
+/** frame period when the sensor timing can't be read, 30 fps */
+#define VIRT_DEFAULT_PERIOD_NS (NSEC_PER_SEC / 30)
+/** bytes PRU0 hands PRU1 at a time, counted in the status */
+#define VIRT_CHUNK_SIZE 32
+
+static unsigned int virt_fps;
+module_param(virt_fps, uint, 0644);
+MODULE_PARM_DESC(virt_fps, "Frame rate of the simulated sensor, 0 to derive "
+                           "it from its registers (default: 0)");
+
+static char *virt_raw;
+module_param(virt_raw, charp, 0444);
+MODULE_PARM_DESC(virt_raw, "Firmware file with raw 8 bit frames for the "
+                           "simulated sensor to replay instead of a test "
+                           "pattern (default: none)");
+
+static unsigned int virt_torn_every;
+module_param(virt_torn_every, uint, 0644);
+MODULE_PARM_DESC(virt_torn_every, "Flag every nth simulated frame as torn, 0 "
+                                  "for never (default: 0)");
+
+static struct prucam_ctrl *ctrl;
+static struct task_struct *thread;
+static const struct firmware *raw;
+
+/** the kernel's frame buffers */
+static u8 *buf_va;
+static dma_addr_t buf_pa;
+static size_t buf_size;
+
+/** start of the next frame the sensor outputs */
+static ktime_t vsync;
+
+/** a ramp a row of the test pattern is copied from */
+static u8 ramp[PRUCAM_MAX_COLS + 256];
+
+static void reject_cmd(u32 err)
+{
+    ctrl->last_error = err;
+    ctrl->cmd_errors++;
+}
+
+static u32 frame_size(u32 options)
+{
+    u32 rows = ctrl->rows;
+
+    if (options & BIT(PRUCAM_FRAME_OPT_HIST_BIT))
+        return (rows + PRUCAM_EMBEDDED_ROWS) * ctrl->cols +
+               sizeof(struct prucam_frame_hist);
+    if (options & BIT(PRUCAM_FRAME_OPT_EMBEDDED_BIT))
+        rows += PRUCAM_EMBEDDED_ROWS;
+
+    return rows * ctrl->cols;
+}
+
+/* validate and run one command from the ring, see run_cmd() in pru1_fw.c */
+static void run_cmd(u32 seq)
+{
+    struct prucam_cmd cmd = ctrl->cmds[seq & (PRUCAM_CMD_RING_SIZE - 1)];
+    u64 end;
+
+    if (prucam_cmd_csum(&cmd, seq) != cmd.csum) {
+        reject_cmd(PRUCAM_ERR_CSUM);
+        return;
+    }
+
+    switch (cmd.op) {
+    case PRUCAM_CMD_CAPTURE:
+        if (ctrl->nbufs == 0) {
+            reject_cmd(PRUCAM_ERR_NO_DEST);
+            break;
+        }
+        if (frame_size(cmd.args[1]) > ctrl->stride) {
+            reject_cmd(PRUCAM_ERR_ARG);
+            break;
+        }
+        ctrl->options     = cmd.args[1];
+        ctrl->frames_left = cmd.args[0];
+        ctrl->state = cmd.args[0] ? PRUCAM_STATE_CAPTURING
+                                  : PRUCAM_STATE_STREAMING;
+        break;
+    case PRUCAM_CMD_SET_GEOMETRY:
+        if (cmd.args[0] == 0 || cmd.args[0] > PRUCAM_MAX_ROWS ||
+            cmd.args[1] == 0 || cmd.args[1] > PRUCAM_MAX_COLS ||
+            (cmd.args[1] & (VIRT_CHUNK_SIZE - 1)) != 0) {
+            reject_cmd(PRUCAM_ERR_ARG);
+            break;
+        }
+        ctrl->rows = cmd.args[0];
+        ctrl->cols = cmd.args[1];
+        break;
+    case PRUCAM_CMD_SET_DEST:
+        // the real PRU writes anywhere, keep the simulated one in the buffers
+        end = (u64)cmd.args[0] + (u64)cmd.args[1] * cmd.args[2];
+        if (cmd.args[0] == 0 || cmd.args[2] == 0 || cmd.args[0] < buf_pa ||
+            end > (u64)buf_pa + buf_size) {
+            reject_cmd(PRUCAM_ERR_ARG);
+            break;
+        }
+        ctrl->dest    = cmd.args[0];
+        ctrl->stride  = cmd.args[1];
+        ctrl->nbufs   = cmd.args[2];
+        ctrl->cur_buf = 0;
+        break;
+    case PRUCAM_CMD_STOP:
+        ctrl->frames_left = 0;
+        ctrl->state       = PRUCAM_STATE_IDLE;
+        break;
+    default:
+        reject_cmd(PRUCAM_ERR_OP);
+        break;
+    }
+}
+
+static u64 frame_period_ns(void)
+{
+    u32 period_us;
+
+    if (virt_fps)
+        return div_u64(NSEC_PER_SEC, virt_fps);
+    if (ar013x_frame_period_us(&period_us) == 0 && period_us)
+        return (u64)period_us * NSEC_PER_USEC;
+    return VIRT_DEFAULT_PERIOD_NS;
+}
+
+/* sleep until a time, returns false if the thread is being stopped */
+static bool sleep_until(ktime_t t)
+{
+    while (ktime_before(ktime_get(), t)) {
+        if (kthread_should_stop())
+            return false;
+        set_current_state(TASK_INTERRUPTIBLE);
+        schedule_hrtimeout(&t, HRTIMER_MODE_ABS);
+    }
+    return !kthread_should_stop();
+}
+
+static void fill_frame(u8 *image, u32 rows, u32 cols, u32 frame)
+{
+    size_t size = (size_t)rows * cols;
+    u32 nraw    = raw ? raw->size / size : 0;
+
+    if (nraw) {
+        memcpy(image, raw->data + (frame % nraw) * size, size);
+        return;
+    }
+
+    for (u32 r = 0; r < rows; r++)
+        memcpy(image + r * cols, ramp + ((r + frame) & 0xFF), cols);
+    memcpy(image, &frame, sizeof(frame));
+}
+
+/* count the pixels of an image PRU1 counts, see image_transfer in pru1_asm.s */
+static void count_hist(struct prucam_frame_hist *hist, const u8 *image,
+                       u32 rows, u32 cols)
+{
+    static const u8 offsets[] = { 0, 1, VIRT_CHUNK_SIZE / 2,
+                                  VIRT_CHUNK_SIZE / 2 + 1 };
+
+    memset(hist, 0, sizeof(*hist));
+    for (u32 i = 0; i < rows * cols; i += VIRT_CHUNK_SIZE) {
+        for (int j = 0; j < ARRAY_SIZE(offsets); j++) {
+            u8 pixel = image[i + offsets[j]];
+
+            hist->bins[pixel / 4]++;
+            if (pixel == 0xFF)
+                hist->saturated++;
+            else if (pixel == 0)
+                hist->black++;
+        }
+    }
+    hist->samples = rows * cols / PRUCAM_HIST_SAMPLE;
+}
+
+/* capture one frame to the current buffer, see capture_frame() in pru1_fw.c */
+static bool capture_frame(void)
+{
+    u32 rows = ctrl->rows, cols = ctrl->cols;
+    u32 frame = ctrl->frames_done;
+    ktime_t now = ktime_get();
+    u64 period = frame_period_ns();
+    u32 passed = 0;
+    u8 *image;
+
+    ctrl->pru[1].lines  = 0;
+    ctrl->pru[1].chunks = 0;
+    ctrl->pru[1].state  = PRUCAM_PRU1_WAIT_CHUNK;
+    ctrl->pru[0].lines  = 0;
+    ctrl->pru[0].state  = PRUCAM_PRU0_WAIT_VSYNC;
+
+    // wait for the next frame to start and then to be read out, the sensor
+    // counts the frames that went by since the last one and this one
+    if (ktime_before(vsync, now)) {
+        passed = div64_u64(ktime_to_ns(ktime_sub(now, vsync)), period) + 1;
+        vsync  = ktime_add_ns(vsync, passed * period);
+    }
+    if (!sleep_until(vsync))
+        return false;
+    ar013x_virt_frames(passed + 1);
+    ctrl->pru[0].state = PRUCAM_PRU0_WAIT_HSYNC;
+    vsync = ktime_add_ns(vsync, period);
+    if (!sleep_until(vsync))
+        return false;
+
+    image = buf_va + (ctrl->dest - buf_pa) + ctrl->cur_buf * ctrl->stride;
+    fill_frame(image, rows, cols, frame);
+    if (ctrl->options & BIT(PRUCAM_FRAME_OPT_EMBEDDED_BIT))
+        memset(image + rows * cols, 0, PRUCAM_EMBEDDED_ROWS * cols);
+    if (ctrl->options & BIT(PRUCAM_FRAME_OPT_HIST_BIT))
+        count_hist((struct prucam_frame_hist *)
+                   (image + (rows + PRUCAM_EMBEDDED_ROWS) * cols),
+                   image, rows, cols);
+
+    if (virt_torn_every && (frame + 1) % virt_torn_every == 0) {
+        ctrl->frame_errors = PRUCAM_FRAME_ERR_SHORT_LINE;
+        ctrl->bad_lines    = 1 | (rows / 2) << 16;
+    } else {
+        ctrl->frame_errors = 0;
+        ctrl->bad_lines    = 0;
+    }
+
+    ctrl->pru[0].lines  = rows;
+    ctrl->pru[0].frames++;
+    ctrl->pru[0].state  = PRUCAM_PRU0_WAIT_TRIGGER;
+    ctrl->pru[1].lines  = rows;
+    ctrl->pru[1].chunks = rows * cols / VIRT_CHUNK_SIZE;
+    ctrl->pru[1].frames++;
+    ctrl->pru[1].state  = PRUCAM_PRU1_WAIT_CMD;
+
+    ctrl->last_buf = ctrl->cur_buf;
+    ctrl->frames_done++;
+    if (++ctrl->cur_buf >= ctrl->nbufs)
+        ctrl->cur_buf = 0;
+    if (ctrl->state == PRUCAM_STATE_CAPTURING && --ctrl->frames_left == 0)
+        ctrl->state = PRUCAM_STATE_IDLE;
+
+    // the frame and its status before the "interrupt"
+    smp_wmb();
+    prucam_frame_done();
+
+    return true;
+}
+
+static int virt_pru_thread(void *unused)
+{
+    u32 head;
+
+    // wait for the kernel to set up the control block, see main() in
+    // pru1_fw.c
+    while (READ_ONCE(ctrl->magic) != PRUCAM_CTRL_MAGIC) {
+        if (kthread_should_stop())
+            return 0;
+        usleep_range(VIRT_POLL_US, 2 * VIRT_POLL_US);
+    }
+    smp_rmb();
+    if (ctrl->version != PRUCAM_CTRL_VERSION ||
+        ctrl->size != sizeof(struct prucam_ctrl)) {
+        // never leave PRUCAM_STATE_WAIT_INIT, the kernel times out
+        while (!kthread_should_stop())
+            msleep(100);
+        return 0;
+    }
+    ctrl->fw_version   = PRUCAM_CTRL_VERSION;
+    ctrl->pru[0].state = PRUCAM_PRU0_WAIT_TRIGGER;
+    ctrl->pru[1].state = PRUCAM_PRU1_WAIT_CMD;
+    smp_wmb();
+    WRITE_ONCE(ctrl->state, PRUCAM_STATE_IDLE);
+
+    vsync = ktime_get();
+
+    while (!kthread_should_stop()) {
+        head = READ_ONCE(ctrl->cmd_head);
+        smp_rmb();
+        while (ctrl->cmd_tail != head) {
+            run_cmd(ctrl->cmd_tail);
+            smp_wmb();
+            WRITE_ONCE(ctrl->cmd_tail, ctrl->cmd_tail + 1);
+        }
+
+        if (ctrl->state != PRUCAM_STATE_IDLE) {
+            if (!capture_frame())
+                break;
+        } else {
+            usleep_range(VIRT_POLL_US, 2 * VIRT_POLL_US);
+        }
+    }
+
+    return 0;
+}
+
+static int virt_init(struct platform_device *pdev, void __iomem **ctrl_base)
+{
+    int ret;
+
+    ctrl = kzalloc(sizeof(*ctrl), GFP_KERNEL);
+    if (!ctrl)
+        return -ENOMEM;
+
+    for (int i = 0; i < ARRAY_SIZE(ramp); i++)
+        ramp[i] = i;
+
+    if (virt_raw) {
+        ret = request_firmware(&raw, virt_raw, &pdev->dev);
+        if (ret) {
+            dev_err(&pdev->dev, "Failed to load raw frames %s: %d\n",
+                    virt_raw, ret);
+            kfree(ctrl);
+            ctrl = NULL;
+            return ret;
+        }
+    }
+
+    dev_info(&pdev->dev, "using simulated PRUs and sensor\n");
+
+    // the control block is ordinary memory, which readl/writel work on too
+    *ctrl_base = (void __iomem *)ctrl;
+    return 0;
+}
+
+static void virt_end(void)
+{
+    release_firmware(raw);
+    raw = NULL;
+    kfree(ctrl);
+    ctrl = NULL;
+}
+
+static int virt_boot(void *va, dma_addr_t pa, size_t size)
+{
+    buf_va   = va;
+    buf_pa   = pa;
+    buf_size = size;
+
+    thread = kthread_run(virt_pru_thread, NULL, "prucam-virt");
+    if (IS_ERR(thread)) {
+        int ret = PTR_ERR(thread);
+
+        thread = NULL;
+        return ret;
+    }
+
+    return 0;
+}
+
+static void virt_shutdown(void)
+{
+    if (thread)
+        kthread_stop(thread);
+    thread = NULL;
+}
+
+const struct prucam_backend prucam_virt_backend = {
+    .name     = "virt",
+    .init     = virt_init,
+    .end      = virt_end,
+    .boot     = virt_boot,
+    .shutdown = virt_shutdown,
+};
@@ -81,5 +81,10 @@ SECTIONS {
 	.rofardata	>  PRU_DMEM_0_1, PAGE 1
 	.farbss		>  PRU_DMEM_0_1, PAGE 1
 	.fardata	>  PRU_DMEM_0_1, PAGE 1
+
+	/* The prucam control block shared with the kernel, see prucam_shared.h.
+	   It must be at the base of shared RAM and the kernel initialises it, so
+	   it is not loaded */
+	.prucam_ctrl	>  0x10000, PAGE 2, type = NOLOAD
 }
 
@@ -59,25 +59,76 @@ __timing_routine .macro
   .endif
   .endm
 
+; __set_state writes one of the PRUCAM_PRU0_* states to the PRU0 status in
+; shared memory. Clobbers r19 and r20.
+__set_state .macro state
+  ldi32 r19, SHARED_RAM + PRU0_STATUS_OFFSET
+  ldi r20, state
+  sbbo &r20, r19, PRUCAM_STATUS_STATE_OFFSET, 4
+  .endm
+
 ;* C declaration:
 ;* void capture_frame_8b(void)
+;*
+;* Register usage:
+;* - r0: scratch for the status updates
+;* - r1.w0: rows, r1.w2: columns of the frame from the control block
+;* - r13.w0: lines started while padding a short line, r13.w2: HSYNC when
+;*   last sampled, see PAD_LINE
+;* - r14.w0: number of lines captured in the frame, r14.w2: chunks sent
+;* - r15: capture options (FRAME_OPT_*_BIT) until the capture starts, then the
+;*   cycle count at the end of the last line
+;* - r16.w0: lines left in the frame, r16.w2: pixels left in the line
+;* - r17: frame error bits (FRAME_ERR_*_BIT)
+;* - r18.w0: number of bad lines, r18.w2: index of the first bad line
+;* - r19-r21: scratch for the error, status and frame end paths
+;* - r22-r29: the 32 byte chunk being captured
 	.clink
 	.global capture_frame_8b
 capture_frame_8b:
-  ; wait for signal from kernel to start frame capture
+  __set_state PRUCAM_PRU0_WAIT_TRIGGER
+
+  ; wait for signal from the other PRU to start frame capture. It raises the
+  ; same event the kernel used to, once per frame of a capture command
   wbs r31, KERNEL_TO_PRUS_R31_BIT
 
   ; clear the system event interrupt in INTC SICR register. Here we use the
   ; constants tables to address the register for efficiency
   ldi r16, KERNEL_TO_PRUS_EVENT
   sbco &r16, INTC_CO_TABLE_ENTRY, SICR_REG_OFFSET, 4
+
+  ; restart the cycle counter for the line times. It saturates after ~21s, so
+  ; it is restarted for every frame rather than left running between frames
+  ldi32 r19, PRU0_CTRL_BASE
+  lbbo &r20, r19, PRU_CTRL_CONTROL_OFFSET, 4
+  clr r20, r20, PRU_CTRL_CTR_EN_BIT
+  sbbo &r20, r19, PRU_CTRL_CONTROL_OFFSET, 4
+  zero &r0, 4
+  sbbo &r0, r19, PRU_CTRL_CYCLE_OFFSET, 4
+  set r20, r20, PRU_CTRL_CTR_EN_BIT
+  sbbo &r20, r19, PRU_CTRL_CONTROL_OFFSET, 4
+
+  ; clear the line and chunk counters of the last frame
+  ldi32 r19, SHARED_RAM + PRU0_STATUS_OFFSET
+  sbbo &r0, r19, PRUCAM_STATUS_LINES_OFFSET, 4
+  sbbo &r0, r19, PRUCAM_STATUS_CHUNKS_OFFSET, 4
+  __set_state PRUCAM_PRU0_WAIT_VSYNC
   
+  ; read the frame size and capture options the other PRU published in the
+  ; control block before triggering us
+  ldi32 r19, SHARED_RAM
+  lbbo &r1, r19, FRAME_GEOMETRY_OFFSET, 4
+  lbbo &r15, r19, FRAME_OPTIONS_OFFSET, 4
+
   ; r16.w0 holds the number of lines left in the image(rows) and r16.w2 holds
   ; the number of pixels left in the image line(columns). Here we preload them 
   ; so they can be decremented later. Each use 2 bytes from R16 because rows 
   ; and columns are both <65536. A larger capture in the future might need
   ; standalone counters.
-  ldi r16.w0, ROWS
+  mov r16.w0, r1.w0
+
+  ; clear the frame error bits and bad line counters
+  zero &r17, 8
 
   ; wait for VSYNC to go high
   wbc r31, VSYNC_BIT
@@ -85,21 +136,47 @@ capture_frame_8b:
 
   ; there are 964 valid lines, but we only need 960. Likewise, when 
   ; auto-exposure is enabled, the first 2 and last 2 lines have image
-  ; statistics and register data. Thus, skip the first 2 lines by waiting
-  ; 2 HSYNC cycles
+  ; statistics and register data. Unless the kernel asked for those, skip the
+  ; first 2 lines by waiting 2 HSYNC cycles and stop after the image.
+  qbbs CAPTURE_EMBEDDED, r15, FRAME_OPT_EMBEDDED_BIT
   wbc r31, HSYNC_BIT
   wbs r31, HSYNC_BIT
   wbc r31, HSYNC_BIT
   wbs r31, HSYNC_BIT
+  jmp CAPTURE_START
+
+CAPTURE_EMBEDDED:
+  ; capture the embedded lines too, the other PRU sorts out where they go
+  add r16.w0, r1.w0, EMBEDDED_ROWS
+
+CAPTURE_START:
+  ; save the number of lines in the frame to index bad lines
+  mov r14.w0, r16.w0
+  ldi r14.w2, 0
+
+  ; the first line has no line before it to time from
+  ldi r15, 0
+  __set_state PRUCAM_PRU0_WAIT_HSYNC
 
 ; LINE_RESTART is where we branch back to on every subsequent line capture. It
 ; comes after VSYNC is asserted but before HSYNC is asserted
 LINE_RESTART:
-  ldi r16.w2, COLS ; reload number of pixels in row
+  mov r16.w2, r1.w2 ; reload number of pixels in row
 
   ; wait for HSYNC to go high
   wbc r31, HSYNC_BIT
+  .if SPEED = 1
+  ; VSYNC stays high between the lines of a frame, so if it falls while we are
+  ; waiting for HSYNC the sensor ended the frame early. Polling both bits
+  ; adds at most one instruction(5ns) of HSYNC latency over WBS, which still
+  ; lands before the pixel clock falls at <=50MHz. The faster capture loops
+  ; keep WBS as they have no such slack.
+WAIT_HSYNC:
+  qbbc EARLY_VSYNC, r31, VSYNC_BIT
+  qbbc WAIT_HSYNC, r31, HSYNC_BIT
+  .else
   wbs r31, HSYNC_BIT
+  .endif
 
   ; TODO should we wait for horizontal blanking here 
 
@@ -135,11 +212,14 @@ CHUNK_RESTART:
   ; save to reg 23
   __timing_routine
   mov r23.b0, r31.b0
-  nop
+  ; HSYNC stays high for exactly r1.w2 pixels, if it is low here the line was
+  ; cut short
+  qbbc SHORT_LINE, r31, HSYNC_BIT
 
   __timing_routine
   mov r23.b1, r31.b0
-  nop
+  ; count the chunk for the status
+  add r14.w2, r14.w2, 1
 
   __timing_routine
   mov r23.b2, r31.b0
@@ -274,13 +354,148 @@ CHUNK_RESTART:
   ; if we still have pixels left to read, branch back to CHUNK_RESTART
   qblt CHUNK_RESTART, r16.w2, 0
 
+  ; we are now 2 pixel clocks past the end of the line, so HSYNC should have
+  ; fallen. If not, the sensor line is longer than r1.w2 and we truncated it
+  qbbc LINE_DONE, r31, HSYNC_BIT
+  set r17, r17, FRAME_ERR_LONG_LINE_BIT
+  jal r21.w0, COUNT_BAD_LINE
+
+; LINE_DONE is where the normal and error paths meet once all the chunks of a
+; line have been handed to the other PRU
+LINE_DONE:
   ; decrement the row counter and restart the line capture if there are lines
   ; left in the image. Since we finished the line, we no longer need to
   ; precisely time and interleave instructions because there is slack time
   ; between lines
   sub r16.w0, r16.w0, 1
+  jal r21.w0, LINE_STATUS
   qblt LINE_RESTART, r16.w0, 0
 
+FRAME_DONE:
+  ; count the frame for the status
+  __set_state PRUCAM_PRU0_FRAME_DONE
+  lbbo &r0, r19, PRUCAM_STATUS_FRAMES_OFFSET, 4
+  add r0, r0, 1
+  sbbo &r0, r19, PRUCAM_STATUS_FRAMES_OFFSET, 4
+
+  ; publish the frame error bits and bad line counters to shared memory for
+  ; the kernel
+  ldi32 r19, SHARED_RAM + FRAME_STATUS_OFFSET
+  sbbo &r17, r19, 0, 8
+
+  ; tell the other PRU the frame status is written. It only raises the kernel
+  ; interrupt after this, so the kernel never reads a stale status. Wait a
+  ; chunk worth of pixel clocks first so the other PRU has cleared the event
+  ; for the last chunk, the same spacing it gets between two chunks.
+  ldi r16.w2, CHUNK_SIZE
+FRAME_DONE_WAIT:
+  __timing_routine
+  sub r16.w2, r16.w2, 1
+  qblt FRAME_DONE_WAIT, r16.w2, 0
+  ldi r31, SYS_EVT_17_TRIGGER
+
   ; once we have read all the lines in the image, return to the caller
   jmp     r3.w2 ; jump to link register to return 
 
+; SHORT_LINE is branched to from the capture loop when HSYNC fell before all
+; the pixels of the line were read. The line is marked bad and its remaining
+; chunks are padded out so the other PRU still receives a full line. Padding
+; most of a line takes longer than the horizontal blanking, so the next lines
+; can start while it runs. Those lines are lost: each one is padded out as the
+; next row and marked bad too, until the padding ends before a line starts, so
+; the rest of the frame keeps its rows.
+SHORT_LINE:
+  set r17, r17, FRAME_ERR_SHORT_LINE_BIT
+  ; HSYNC is low, no line has started yet
+  zero &r13, 4
+SHORT_LINE_PAD:
+  jal r21.w0, COUNT_BAD_LINE
+  jal r21.w0, PAD_LINE
+  sub r16.w0, r16.w0, 1
+  ; the padding isn't a line time, don't time the next line from it
+  ldi r15, 0
+  jal r21.w0, LINE_STATUS
+  qbeq FRAME_DONE, r16.w0, 0
+  mov r16.w2, r1.w2
+  qbne SHORT_LINE_LOST, r13.w0, 0
+  qbbc LINE_RESTART, r31, HSYNC_BIT
+  ; high since the last chunk, the line that was just padded is still going
+  qbne LINE_RESTART, r13.w2, 0
+  ; a line started during the status update
+  jmp SHORT_LINE_PAD
+SHORT_LINE_LOST:
+  sub r13.w0, r13.w0, 1
+  jmp SHORT_LINE_PAD
+
+; EARLY_VSYNC is branched to when VSYNC fell before all the lines were read.
+; All the missing lines are marked bad and padded out so the other PRU
+; completes the frame and the kernel gets its interrupt instead of a timeout.
+EARLY_VSYNC:
+  set r17, r17, FRAME_ERR_EARLY_VSYNC_BIT
+EARLY_VSYNC_LINE:
+  jal r21.w0, COUNT_BAD_LINE
+  jal r21.w0, PAD_LINE
+  sub r16.w0, r16.w0, 1
+  mov r16.w2, r1.w2
+  qblt EARLY_VSYNC_LINE, r16.w0, 0
+  jmp FRAME_DONE
+
+; LINE_STATUS publishes the line and chunk counters to the PRU0 status and
+; raises its high-water mark of the line time, the cycles from the end of the
+; last line to the end of this one. It runs in the horizontal blanking, so it
+; only costs blanking margin. Called with JAL, returns through r21.w0.
+LINE_STATUS:
+  ldi32 r19, PRU0_CTRL_BASE
+  lbbo &r20, r19, PRU_CTRL_CYCLE_OFFSET, 4
+  ldi32 r19, SHARED_RAM + PRU0_STATUS_OFFSET
+  qbeq LINE_STATUS_SAVE, r15, 0
+  sub r0, r20, r15
+  lbbo &r15, r19, PRUCAM_STATUS_CYCLES_MAX_OFFSET, 4
+  qbge LINE_STATUS_SAVE, r0, r15
+  sbbo &r0, r19, PRUCAM_STATUS_CYCLES_MAX_OFFSET, 4
+LINE_STATUS_SAVE:
+  ; the end of this line is the start of the next one
+  mov r15, r20
+  sub r0, r14.w0, r16.w0
+  sbbo &r0, r19, PRUCAM_STATUS_LINES_OFFSET, 4
+  mov r0, r14.w2
+  sbbo &r0, r19, PRUCAM_STATUS_CHUNKS_OFFSET, 4
+  jmp r21.w0
+
+; COUNT_BAD_LINE increments the bad line counter and saves the index of the
+; first bad line of the frame. Called with JAL, returns through r21.w0.
+COUNT_BAD_LINE:
+  qbne COUNT_BAD_LINE_INC, r18.w0, 0
+  sub r18.w2, r14.w0, r16.w0
+COUNT_BAD_LINE_INC:
+  add r18.w0, r18.w0, 1
+  jmp r21.w0
+
+; PAD_LINE hands the r16.w2 pixels left in the current line to the other PRU
+; as zeros. Each chunk is paced by CHUNK_SIZE pixel clocks, the same rate as a
+; real line, so the other PRU can keep up. HSYNC is sampled after each chunk,
+; far more often than a line or the blanking, and every time it is high after
+; being low a line has started, which is counted in r13.w0. r13.w2 is HSYNC at
+; the last sample. Called with JAL, returns through r21.w0.
+PAD_LINE:
+  zero &r22, CHUNK_SIZE
+PAD_LINE_CHUNK:
+  ldi r20, CHUNK_SIZE
+PAD_LINE_WAIT:
+  __timing_routine
+  sub r20, r20, 1
+  qblt PAD_LINE_WAIT, r20, 0
+  xout SCRATCHPAD_BANK_0, &r22, CHUNK_SIZE
+  ldi r31, SYS_EVT_17_TRIGGER
+  add r14.w2, r14.w2, 1
+  qbbc PAD_LINE_LOW, r31, HSYNC_BIT
+  qbne PAD_LINE_NEXT, r13.w2, 0
+  add r13.w0, r13.w0, 1
+  ldi r13.w2, 1
+  jmp PAD_LINE_NEXT
+PAD_LINE_LOW:
+  ldi r13.w2, 0
+PAD_LINE_NEXT:
+  sub r16.w2, r16.w2, CHUNK_SIZE
+  qblt PAD_LINE_CHUNK, r16.w2, 0
+  jmp r21.w0
@@ -1,27 +1,70 @@
 ;* Import all symbols from the C file
 	.cdecls "pru1_fw.c"
 
+; __hist_pixel counts a pixel of the chunk in the histogram at HIST_ADDR, see
+; struct prucam_frame_hist. r24 holds the address of its bins and r25 its own
+; address. Clobbers r16 and r23.
+__hist_pixel .macro pixel
+  ; the bins are 4 levels and 4 bytes wide, so the offset of a pixel's bin is
+  ; the pixel with its low 2 bits cleared
+  and r16, pixel, 0xFC
+  lbbo &r23, r24, r16, 4
+  add r23, r23, 1
+  sbbo &r23, r24, r16, 4
+  qbne NOT_SATURATED?, pixel, 0xFF
+  lbbo &r23, r25, PRUCAM_HIST_SATURATED_OFFSET, 4
+  add r23, r23, 1
+  sbbo &r23, r25, PRUCAM_HIST_SATURATED_OFFSET, 4
+NOT_SATURATED?:
+  qbne NOT_BLACK?, pixel, 0
+  lbbo &r23, r25, PRUCAM_HIST_BLACK_OFFSET, 4
+  add r23, r23, 1
+  sbbo &r23, r25, PRUCAM_HIST_BLACK_OFFSET, 4
+NOT_BLACK?:
+  .endm
+
 ; C declaration:
-; void image_transfer(uint8_t* addr);
-; Argument 'addr' contains the base address of the image buffer
-; and is passed in R14
+; void image_transfer(uint8_t *image, uint32_t rows, uint32_t cols,
+;                     uint8_t *embedded_top, uint8_t *embedded_bottom);
+; The arguments are passed in R14-R18. 'image' is the base address of the image
+; buffer. 'embedded_top' and 'embedded_bottom' are where the embedded rows go,
+; or 0 when they are not captured. The other PRU must already be triggered.
 	.clink
 	.global image_transfer
 image_transfer:
-  ; wait for signal from the kernel to start
-  wbs r31, KERNEL_TO_PRUS_R31_BIT
+  ; keep the arguments, R14-R18 are reused below. r19 keeps the base address
+  ; of the image buffer, r20 the number of rows, r21 the number of 32 byte
+  ; chunks per line and r0/r1 the embedded row addresses. r15 times each chunk
+  ; and r22-r25 are scratch for the histogram and the status once a chunk is
+  ; in memory.
+  mov r19, r14
+  mov r20, r15
+  lsr r21, r16, CHUNK_SHIFT
+  mov r0, r17
+  mov r1, r18
 
   ; r18 contains the number of lines left in the image. 
-  ldi r18, ROWS
+  mov r18, r20
+  qbeq LINE_RESTART, r0, 0
+
+  ; with the embedded rows, the other PRU sends the top rows, the image and
+  ; then the bottom rows. The embedded rows go in a side buffer after the
+  ; image, so the image stays at the start of the buffer.
+  add r18, r20, EMBEDDED_ROWS
+  mov r14, r0
 
 LINE_RESTART:
   ; r17 contains the number of 32 byte chunks left in in the image line. 
-  ldi r17, LINE_CHUNKS
+  mov r17, r21
 
 CHUNK_RESTART:
   ; wait for signal from other PRU to transfer current chunk
   wbs r31, PRU0_TO_PRU1_R31_BIT
 
+  ; r15 times the chunk transfer from here for the status
+  ldi32 r16, PRU1_CTRL_BASE
+  lbbo &r15, r16, PRU_CTRL_CYCLE_OFFSET, 4
+
   ; clear the system event interrupt in INTC SICR register. Here we use the
   ; constants tables to address the register for efficiency
   ldi r16, PRU0_TO_PRU1_EVENT
@@ -33,24 +76,76 @@ CHUNK_RESTART:
   ; store image data to buffer address in R14
   sbbo &r22, r14, 0, CHUNK_SIZE
 
+  ; count 1 in 8 pixels of the image in the histogram: the first 2 pixels of
+  ; each half of the chunk, so both colours of the Bayer row. There is no time
+  ; for more between two chunks at 50MHz, and none at all at 100MHz. The
+  ; embedded rows go to the side buffer at r0 and after, they are not counted.
+  .if SPEED < 3
+  qbeq HIST_COUNT, r0, 0
+  qbge HIST_DONE, r0, r14
+HIST_COUNT:
+  ldi r25, HIST_ADDR
+  ldi r24, HIST_ADDR + PRUCAM_HIST_BINS_OFFSET
+  __hist_pixel r22.b0
+  __hist_pixel r22.b1
+  __hist_pixel r26.b0
+  __hist_pixel r26.b1
+
+HIST_DONE:
+  .endif
+
   ; increment the image buffer pointer
   add r14, r14, CHUNK_SIZE
 
   ; decrement the chunk counter
   sub r17, r17, 1
 
+  ; count the chunk in the status and raise the high-water mark of the chunk
+  ; transfer time. The chunk is in memory, so r22-r24 are free for this.
+  ldi32 r22, SHARED_RAM + PRU1_STATUS_OFFSET
+  lbbo &r23, r22, PRUCAM_STATUS_CHUNKS_OFFSET, 4
+  add r23, r23, 1
+  sbbo &r23, r22, PRUCAM_STATUS_CHUNKS_OFFSET, 4
+  ldi32 r24, PRU1_CTRL_BASE
+  lbbo &r23, r24, PRU_CTRL_CYCLE_OFFSET, 4
+  sub r23, r23, r15
+  lbbo &r24, r22, PRUCAM_STATUS_CYCLES_MAX_OFFSET, 4
+  qbge CHUNK_NEXT, r23, r24
+  sbbo &r23, r22, PRUCAM_STATUS_CYCLES_MAX_OFFSET, 4
+
+CHUNK_NEXT:
   ; if we still have chunks left in the line, restart another chunk transfer
   qblt CHUNK_RESTART, r17, 0
 
-  ; decrement the line counter
+  ; decrement the line counter and count the line in the status, r22 still
+  ; holds the status address
   sub r18, r18, 1
+  lbbo &r23, r22, PRUCAM_STATUS_LINES_OFFSET, 4
+  add r23, r23, 1
+  sbbo &r23, r22, PRUCAM_STATUS_LINES_OFFSET, 4
+
+  ; with the embedded rows, move the buffer pointer to the image after the
+  ; top rows and back to the side buffer for the bottom rows
+  qbeq LINE_NEXT, r0, 0
+  add r16, r20, EMBEDDED_BOTTOM_ROWS
+  qbne LINE_BOTTOM_ROWS, r18, r16
+  mov r14, r19
+LINE_BOTTOM_ROWS:
+  qbne LINE_NEXT, r18, EMBEDDED_BOTTOM_ROWS
+  mov r14, r1
 
+LINE_NEXT:
   ; if we still have lines left in the image, restart another line transfer
   qblt LINE_RESTART, r18, 0
 
-  ; trigger interrupt 20 to tell kernel the transfer is complete
-  ldi r31, SYS_EVT_18_TRIGGER
-  ; TODO do I need to clear this interrupt? I haven't in the past...
+  ; wait for the other PRU to signal that it wrote the frame status to shared
+  ; memory, so the kernel reads the status of this frame and not the last one.
+  ; The caller tells the kernel the frame is done.
+  ldi r23, PRUCAM_PRU1_WAIT_FRAME_STATUS
+  sbbo &r23, r22, PRUCAM_STATUS_STATE_OFFSET, 4
+  wbs r31, PRU0_TO_PRU1_R31_BIT
+  ldi r16, PRU0_TO_PRU1_EVENT
+  sbco &r16, INTC_CO_TABLE_ENTRY, SICR_REG_OFFSET, 4
 
   jmp     r3.w2 ; jump to link register to return 
 
@@ -1,27 +1,199 @@
 #include "pru_fw.h"
 
 // image_transfer is a function defined in assembly
-extern void image_transfer(uint8_t* addr);
+extern void image_transfer(uint8_t* image, uint32_t rows, uint32_t cols,
+                           uint8_t* embedded_top, uint8_t* embedded_bottom);
+
+// The control block shared with the kernel, see prucam_shared.h. The linker
+// command file places it at the base of shared RAM without loading it, the
+// kernel initialises it before booting us.
+#pragma DATA_SECTION(ctrl, ".prucam_ctrl")
+volatile far struct prucam_ctrl ctrl;
+
+// the PRU1 part of the status, the assembly updates it during a frame
+#define PRU1_STATUS (ctrl.pru[1])
+
+// the histogram of the frame being moved, the assembly counts it
+#pragma LOCATION(hist, HIST_ADDR)
+struct prucam_frame_hist hist;
+
+// reject the current command with one of the PRUCAM_ERR_* codes
+void reject_cmd(uint32_t err)
+{
+  ctrl.last_error = err;
+  ctrl.cmd_errors++;
+}
+
+// number of bytes a frame takes in a buffer with the capture options. The
+// histogram goes after the room for the embedded rows, captured or not.
+uint32_t frame_size(uint32_t options)
+{
+  uint32_t rows = ctrl.rows;
+
+  if (options & (1U << FRAME_OPT_HIST_BIT))
+    return (rows + EMBEDDED_ROWS) * ctrl.cols + sizeof(hist);
+  if (options & (1U << FRAME_OPT_EMBEDDED_BIT))
+    rows += EMBEDDED_ROWS;
+
+  return rows * ctrl.cols;
+}
+
+// validate and run one command from the ring
+void run_cmd(uint32_t seq)
+{
+  volatile far struct prucam_cmd* slot;
+  struct prucam_cmd cmd;
+
+  // copy the command out of shared RAM so it can't change under us
+  slot = &ctrl.cmds[seq & (PRUCAM_CMD_RING_SIZE - 1)];
+  cmd.op = slot->op;
+  cmd.args[0] = slot->args[0];
+  cmd.args[1] = slot->args[1];
+  cmd.args[2] = slot->args[2];
+  cmd.csum = slot->csum;
+
+  if (prucam_cmd_csum(&cmd, seq) != cmd.csum) {
+    reject_cmd(PRUCAM_ERR_CSUM);
+    return;
+  }
+
+  switch (cmd.op) {
+  case PRUCAM_CMD_CAPTURE:
+    if (ctrl.nbufs == 0) {
+      reject_cmd(PRUCAM_ERR_NO_DEST);
+      break;
+    }
+    // the frame must fit in a buffer with the requested options
+    if (frame_size(cmd.args[1]) > ctrl.stride) {
+      reject_cmd(PRUCAM_ERR_ARG);
+      break;
+    }
+    ctrl.options = cmd.args[1];
+    ctrl.frames_left = cmd.args[0];
+    ctrl.state = cmd.args[0] ? PRUCAM_STATE_CAPTURING : PRUCAM_STATE_STREAMING;
+    break;
+  case PRUCAM_CMD_SET_GEOMETRY:
+    // the capture loop moves whole chunks and counts lines in 16 bits
+    if (cmd.args[0] == 0 || cmd.args[0] > PRUCAM_MAX_ROWS ||
+        cmd.args[1] == 0 || cmd.args[1] > PRUCAM_MAX_COLS ||
+        (cmd.args[1] & (CHUNK_SIZE - 1)) != 0) {
+      reject_cmd(PRUCAM_ERR_ARG);
+      break;
+    }
+    ctrl.rows = cmd.args[0];
+    ctrl.cols = cmd.args[1];
+    break;
+  case PRUCAM_CMD_SET_DEST:
+    if (cmd.args[0] == 0 || cmd.args[2] == 0) {
+      reject_cmd(PRUCAM_ERR_ARG);
+      break;
+    }
+    ctrl.dest = cmd.args[0];
+    ctrl.stride = cmd.args[1];
+    ctrl.nbufs = cmd.args[2];
+    ctrl.cur_buf = 0;
+    break;
+  case PRUCAM_CMD_STOP:
+    ctrl.frames_left = 0;
+    ctrl.state = PRUCAM_STATE_IDLE;
+    break;
+  default:
+    reject_cmd(PRUCAM_ERR_OP);
+    break;
+  }
+}
+
+// capture one frame to the current buffer and tell the kernel it is done
+void capture_frame(void)
+{
+  uint8_t* image;
+  uint8_t* embedded_top = 0;
+  uint8_t* embedded_bottom = 0;
+  uint32_t i;
+
+  image = (uint8_t*)(ctrl.dest + ctrl.cur_buf * ctrl.stride);
+  if (ctrl.options & (1U << FRAME_OPT_EMBEDDED_BIT)) {
+    embedded_top = image + ctrl.rows * ctrl.cols;
+    embedded_bottom = embedded_top + EMBEDDED_TOP_ROWS * ctrl.cols;
+  }
+
+  // restart the cycle counter the chunk transfers are timed with. It saturates
+  // after ~21s, so it is restarted for every frame rather than left running.
+  PRU1_CTRL.CTRL_bit.CTR_EN = 0;
+  PRU1_CTRL.CYCLE = 0;
+  PRU1_CTRL.CTRL_bit.CTR_EN = 1;
+
+  PRU1_STATUS.lines = 0;
+  PRU1_STATUS.chunks = 0;
+  PRU1_STATUS.state = PRUCAM_PRU1_WAIT_CHUNK;
+
+  // the assembly counts every frame, it is only published when asked for
+  memset(&hist, 0, sizeof(hist));
+
+  // start the other PRU on the frame, the config it reads is published
+  __R31 = SYS_EVT_16_TRIGGER;
+
+  // This waits for triggers from the other PRU, reads the data transfered
+  // from it(in the scratchpad registers), and transfers that data to the
+  // buffer
+  image_transfer(image, ctrl.rows, ctrl.cols, embedded_top, embedded_bottom);
+
+  // publish the histogram with the frame, the kernel reads it after the
+  // interrupt. The assembly counts nothing when built for 100MHz.
+  if (ctrl.options & (1U << FRAME_OPT_HIST_BIT)) {
+    hist.samples = 0;
+    for (i = 0; i < PRUCAM_HIST_BINS; i++)
+      hist.samples += hist.bins[i];
+    memcpy(image + (ctrl.rows + EMBEDDED_ROWS) * ctrl.cols, &hist,
+           sizeof(hist));
+  }
+
+  PRU1_STATUS.frames++;
+  PRU1_STATUS.state = PRUCAM_PRU1_WAIT_CMD;
+  ctrl.last_buf = ctrl.cur_buf;
+  ctrl.frames_done++;
+  if (++ctrl.cur_buf >= ctrl.nbufs)
+    ctrl.cur_buf = 0;
+  if (ctrl.state == PRUCAM_STATE_CAPTURING && --ctrl.frames_left == 0)
+    ctrl.state = PRUCAM_STATE_IDLE;
+
+  // trigger interrupt 18 to tell kernel the transfer is complete
+  __R31 = SYS_EVT_18_TRIGGER;
+}
 
 void main(void)
 {
-  uint8_t* image_buf;
+  uint32_t head;
 
   // init PRU registers
   init_pru();
 
-  // read the image buffer address from where kernel saved it in shared memory
-  image_buf = *(uint8_t**)SHARED_RAM; 
-
-  // transfer images forever
-  while(1)
-  {  
-    // Perform the image transfer. This will wait for the trigger from the
-    // kernel to start the transfer process. Then it will wait for triggers 
-    // from the other PRU, read the data transfered from it(in the scratchpad 
-    // registers), and transfer that data to the image buffer specified by the 
-    // kernel driver
-    image_transfer(image_buf);
+  // wait for the kernel to set up the control block. It writes the magic
+  // last, so the rest of the header is valid once the magic is.
+  while (ctrl.magic != PRUCAM_CTRL_MAGIC)
+    ;
+  if (ctrl.version != PRUCAM_CTRL_VERSION ||
+      ctrl.size != sizeof(struct prucam_ctrl)) {
+    // never leave PRUCAM_STATE_WAIT_INIT, the kernel times out and reports it
+    while (1)
+      ;
+  }
+  ctrl.fw_version = PRUCAM_CTRL_VERSION;
+  ctrl.state = PRUCAM_STATE_IDLE;
+  PRU1_STATUS.state = PRUCAM_PRU1_WAIT_CMD;
+
+  // run commands and capture frames forever. Commands are only run between
+  // frames, so a new config never applies to part of a frame.
+  while (1)
+  {
+    head = ctrl.cmd_head;
+    while (ctrl.cmd_tail != head) {
+      run_cmd(ctrl.cmd_tail);
+      ctrl.cmd_tail++;
+    }
+
+    if (ctrl.state != PRUCAM_STATE_IDLE)
+      capture_frame();
   }
 }
 
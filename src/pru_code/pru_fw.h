@@ -1,13 +1,47 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pru_cfg.h>
 #include <pru_intc.h>
 #include <pru_ctrl.h>
 
+// control block shared with the kernel, from the kernel module directory
+#include "prucam_shared.h"
+
 #define SHARED_RAM 0x00010000 //offset of PRU shared mem
-#define ROWS 960  //rows per image
-#define COLS 1280 //pixels per row
+//offset of the frame status in shared mem
+#define FRAME_STATUS_OFFSET PRUCAM_CTRL_FRAME_STATUS_OFFSET
+//offset of the capture options in shared mem
+#define FRAME_OPTIONS_OFFSET PRUCAM_CTRL_OPTIONS_OFFSET
+//offset of the active rows(low half) and columns(high half) in shared mem
+#define FRAME_GEOMETRY_OFFSET PRUCAM_CTRL_GEOMETRY_OFFSET
+
+// The sensor outputs 2 rows of embedded register data before the image and 2
+// rows of statistics after it
+#define EMBEDDED_TOP_ROWS 2
+#define EMBEDDED_BOTTOM_ROWS 2
+#define EMBEDDED_ROWS (EMBEDDED_TOP_ROWS + EMBEDDED_BOTTOM_ROWS)
+
+// Capture option bits sent by the kernel with the capture command
+#define FRAME_OPT_EMBEDDED_BIT PRUCAM_FRAME_OPT_EMBEDDED_BIT
+#define FRAME_OPT_HIST_BIT PRUCAM_FRAME_OPT_HIST_BIT
+
+// PRU1 data RAM address of the histogram it counts, a struct
+// prucam_frame_hist. It is fixed so the assembly can load it with ldi.
+#define HIST_ADDR 0x1E00
+
+// offsets of the PRU0 and PRU1 status in shared mem
+#define PRU0_STATUS_OFFSET PRUCAM_CTRL_PRU0_STATUS_OFFSET
+#define PRU1_STATUS_OFFSET PRUCAM_CTRL_PRU1_STATUS_OFFSET
+
+// PRU control registers, see TRM section 4.5.1. The cycle counter only counts
+// while enabled and can only be written while disabled.
+#define PRU0_CTRL_BASE 0x00022000
+#define PRU1_CTRL_BASE 0x00024000
+#define PRU_CTRL_CONTROL_OFFSET 0x0
+#define PRU_CTRL_CYCLE_OFFSET 0xC
+#define PRU_CTRL_CTR_EN_BIT 3
 
 // R31 image sync signal bit definitions
 #define CLK_BIT 16
@@ -45,10 +79,13 @@
 
 // number of bytes per transfer chunk
 #define CHUNK_SIZE 32
+#define CHUNK_SHIFT 5 // log2(CHUNK_SIZE)
 
-// TODO assert that COLS/CHUNK_SIZE is evenly divisible
-// the number of chunks(transfers) per image line 
-#define LINE_CHUNKS (COLS / CHUNK_SIZE)
+// Frame error bits set by PRU0 in the frame status. A frame with any of these
+// bits set is torn: some of its lines are padding instead of pixel data
+#define FRAME_ERR_SHORT_LINE_BIT 0 // HSYNC fell before all columns were read
+#define FRAME_ERR_LONG_LINE_BIT 1 // HSYNC still high after all columns
+#define FRAME_ERR_EARLY_VSYNC_BIT 2 // VSYNC fell before all rows were read
 
 volatile register uint32_t __R30;
 volatile register uint32_t __R31;
@@ -58,6 +95,6 @@ void init_pru();
 // pru_shared_vars_t is a struct that defines variables shared between the PRU
 // cores. It must be declared and mapped to a known address in both PRU FWs
 struct pru_shared_vars_t {
-  uint8_t buf0[COLS]; // shared line buffer
+  uint8_t buf0[PRUCAM_MAX_COLS]; // shared line buffer
 };
 
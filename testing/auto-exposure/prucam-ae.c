@@ -0,0 +1,384 @@
+/*
+ * prucam-ae: auto exposure and white balance loop for /dev/prucam.
+ *
+ * Streams frames and meters the histogram of each with prucam_ae, then sets
+ * the exposure it picks as one settings batch with PRUCAM_IOC_S_CONTROLS. The
+ * sensor latches the batch on a frame boundary, and the frames still exposed
+ * with an older batch, by their prucam_frame_info.settings, are not metered.
+ * So each correction is measured once, on the first frame that has it, and a
+ * scene the sensor doesn't clip converges in about as many frames as the
+ * batch takes to reach a frame.
+ *
+ * The histogram is the one the PRUs counted for the frame, see the histogram
+ * param, or is counted from the mapped frame when they didn't. The sensor's
+ * own auto exposure is turned off, the loop drives the current context.
+ *
+ * With -w, the Bayer channel means of the same frames are balanced with
+ * prucam_awb, and the colour gains go in the exposure's batch. The sensor
+ * sets all four colour gains to the global gain when it is written, so they
+ * are always written after it, with the balance read at the start when there
+ * is no white balance.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "prucam_ae.h"
+#include "prucam_awb.h"
+#include "prucam_uapi.h"
+
+// largest gain register, 3.5 fixed point
+#define MAX_GAIN 0xFE
+
+static const char *metering_names[] = {
+  [PRUCAM_AE_MEAN] = "mean",
+  [PRUCAM_AE_PERCENTILE] = "percentile",
+  [PRUCAM_AE_PEAK] = "peak",
+};
+
+static const char *pattern_names[] = {
+  [PRUCAM_AWB_RGGB] = "rggb",
+  [PRUCAM_AWB_GRBG] = "grbg",
+  [PRUCAM_AWB_GBRG] = "gbrg",
+  [PRUCAM_AWB_BGGR] = "bggr",
+};
+
+// the colour gain control of each channel
+static const uint32_t gain_cids[PRUCAM_AWB_CHANNELS] = {
+  [PRUCAM_AWB_RED] = PRUCAM_CID_RED_GAIN,
+  [PRUCAM_AWB_GREEN1] = PRUCAM_CID_GREEN1_GAIN,
+  [PRUCAM_AWB_GREEN2] = PRUCAM_CID_GREEN2_GAIN,
+  [PRUCAM_AWB_BLUE] = PRUCAM_CID_BLUE_GAIN,
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+
+// gets the exposure, and the balance of the colour gains
+static int get_exposure(int fd, struct prucam_ae_exposure *e,
+                        double balance[PRUCAM_AWB_CHANNELS],
+                        unsigned *frame_len_lines)
+{
+  struct prucam_control controls[4 + PRUCAM_AWB_CHANNELS] = {
+    { PRUCAM_CID_COARSE_TIME, 0 },
+    { PRUCAM_CID_ANALOG_GAIN, 0 },
+    { PRUCAM_CID_GLOBAL_GAIN, 0 },
+    { PRUCAM_CID_FRAME_LEN_LINES, 0 },
+  };
+  struct prucam_controls arg = {
+    .count = 4 + PRUCAM_AWB_CHANNELS,
+    .ptr = (uintptr_t)controls,
+  };
+  double min = MAX_GAIN;
+
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++)
+    controls[4 + i].id = gain_cids[i];
+  if (ioctl(fd, PRUCAM_IOC_G_CONTROLS, &arg) < 0)
+    return -errno;
+  e->coarse_time = controls[0].value;
+  e->analog_gain = controls[1].value;
+  e->global_gain = controls[2].value;
+  *frame_len_lines = controls[3].value;
+
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++)
+    if (controls[4 + i].value > 0 && controls[4 + i].value < min)
+      min = controls[4 + i].value;
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++)
+    balance[i] = controls[4 + i].value > 0 ? controls[4 + i].value / min : 1;
+  return 0;
+}
+
+// sets an exposure and a balance as one batch, and turns the sensor's auto
+// exposure off with them
+static int set_exposure(int fd, const struct prucam_ae_exposure *e,
+                        const double balance[PRUCAM_AWB_CHANNELS],
+                        uint32_t *batch)
+{
+  struct prucam_control controls[4 + PRUCAM_AWB_CHANNELS] = {
+    { PRUCAM_CID_AE_ENABLE, 0 },
+    { PRUCAM_CID_COARSE_TIME, e->coarse_time },
+    { PRUCAM_CID_ANALOG_GAIN, e->analog_gain },
+    { PRUCAM_CID_GLOBAL_GAIN, e->global_gain },
+  };
+  struct prucam_controls arg = {
+    .count = 4 + PRUCAM_AWB_CHANNELS,
+    .ptr = (uintptr_t)controls,
+  };
+  unsigned gains[PRUCAM_AWB_CHANNELS];
+
+  // after the global gain, which sets them all
+  prucam_awb_gains(balance, e->global_gain, gains);
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++) {
+    controls[4 + i].id = gain_cids[i];
+    controls[4 + i].value = gains[i];
+  }
+
+  if (ioctl(fd, PRUCAM_IOC_S_CONTROLS, &arg) < 0)
+    return -errno;
+  *batch = arg.batch;
+  return 0;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-d device] [-m mean|percentile|peak] [-t target] "
+          "[-p percentile] [-k pixels] [-b black] [-T stops] [-c lines] "
+          "[-g analog] [-w pattern] [-n frames] [-x] [-q]\n"
+          "  -d  device (default: /dev/prucam)\n"
+          "  -m  metering (default: mean)\n"
+          "  -t  level to bring the metered level to (default: 64 for mean, "
+          "230 for percentile, 200 for peak)\n"
+          "  -p  fraction of the pixels at or under the level, for percentile "
+          "(default: 0.99)\n"
+          "  -k  counted pixels that may be over the level, for peak "
+          "(default: 4)\n"
+          "  -b  black level (default: 12)\n"
+          "  -T  stops off the target that are left alone (default: 0.1)\n"
+          "  -c  longest integration time in lines (default: frame length "
+          "less one)\n"
+          "  -g  highest analog gain, 0 to 3 for 1x to 8x (default: 3)\n"
+          "  -w  white balance too, for the colour of the top left pixel, "
+          "rggb, grbg, gbrg or bggr (rggb is the image server's BG2BGR)\n"
+          "  -n  frames to run for, 0 for until interrupted (default: 0)\n"
+          "  -x  exit once the exposure is on target or at its limit\n"
+          "  -q  only print the exposure changes\n",
+          prog);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *dev = "/dev/prucam";
+  size_t map_len = (size_t)PRUCAM_NUM_BUFFERS * PRUCAM_BUFFER_SIZE;
+  enum prucam_ae_metering metering = PRUCAM_AE_MEAN;
+  double target = -1, percentile = -1, black = -1, tolerance = -1;
+  long peak_pixels = -1, max_coarse = -1, max_analog = -1;
+  unsigned nframes = 0, metered = 0, changes = 0;
+  int once = 0, quiet = 0, awb = 0, opt, fd, ret = 1;
+  enum prucam_awb_pattern pattern = PRUCAM_AWB_RGGB;
+  struct prucam_ae_config config;
+  struct prucam_awb_config awb_config;
+  struct prucam_ae_exposure cur, next;
+  double balance[PRUCAM_AWB_CHANNELS], next_balance[PRUCAM_AWB_CHANNELS];
+  struct prucam_histogram hist;
+  struct prucam_buffer buf;
+  unsigned frame_len_lines = 0;
+  uint32_t wait_batch = 0;
+  uint8_t *map;
+
+  while ((opt = getopt(argc, argv, "d:m:t:p:k:b:T:c:g:w:n:xqh")) != -1) {
+    switch (opt) {
+    case 'd':
+      dev = optarg;
+      break;
+    case 'm':
+      for (metering = 0; metering <= PRUCAM_AE_PEAK; metering++)
+        if (!strcmp(optarg, metering_names[metering]))
+          break;
+      if (metering > PRUCAM_AE_PEAK) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 't':
+      target = strtod(optarg, NULL);
+      break;
+    case 'p':
+      percentile = strtod(optarg, NULL);
+      break;
+    case 'k':
+      peak_pixels = strtol(optarg, NULL, 0);
+      break;
+    case 'b':
+      black = strtod(optarg, NULL);
+      break;
+    case 'T':
+      tolerance = strtod(optarg, NULL);
+      break;
+    case 'c':
+      max_coarse = strtol(optarg, NULL, 0);
+      break;
+    case 'g':
+      max_analog = strtol(optarg, NULL, 0);
+      break;
+    case 'w':
+      for (pattern = 0; pattern <= PRUCAM_AWB_BGGR; pattern++)
+        if (!strcmp(optarg, pattern_names[pattern]))
+          break;
+      if (pattern > PRUCAM_AWB_BGGR) {
+        usage(argv[0]);
+        return 1;
+      }
+      awb = 1;
+      break;
+    case 'n':
+      nframes = strtoul(optarg, NULL, 0);
+      break;
+    case 'x':
+      once = 1;
+      break;
+    case 'q':
+      quiet = 1;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if ((fd = open(dev, O_RDWR | O_CLOEXEC)) < 0) {
+    perror(dev);
+    return 1;
+  }
+  if ((ret = get_exposure(fd, &cur, balance, &frame_len_lines)) < 0) {
+    fprintf(stderr, "PRUCAM_IOC_G_CONTROLS: %s\n", strerror(-ret));
+    close(fd);
+    return 1;
+  }
+  ret = 1;
+
+  prucam_ae_defaults(&config, metering,
+                     frame_len_lines > 1 ? frame_len_lines - 1 : 1);
+  if (target >= 0)
+    config.target = target;
+  if (percentile >= 0)
+    config.percentile = percentile;
+  if (peak_pixels >= 0)
+    config.peak_pixels = peak_pixels;
+  prucam_awb_defaults(&awb_config, pattern);
+  if (black >= 0)
+    config.black_level = awb_config.black_level = black;
+  if (tolerance >= 0)
+    config.tolerance = tolerance;
+  if (max_coarse > 0)
+    config.max_coarse_time = max_coarse > 0xFFFF ? 0xFFFF : max_coarse;
+  if (max_analog >= 0)
+    config.max_analog_gain = max_analog > 3 ? 3 : max_analog;
+  if (!(config.target > config.black_level && config.target < 255) ||
+      !(config.percentile >= 0 && config.percentile <= 1)) {
+    usage(argv[0]);
+    close(fd);
+    return 1;
+  }
+
+  map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    close(fd);
+    return 1;
+  }
+  // the sensor's auto exposure would fight the loop
+  if ((ret = set_exposure(fd, &cur, balance, &wait_batch)) < 0) {
+    fprintf(stderr, "PRUCAM_IOC_S_CONTROLS: %s\n", strerror(-ret));
+    ret = 1;
+    goto out;
+  }
+  ret = 1;
+  if (ioctl(fd, PRUCAM_IOC_STREAMON) < 0) {
+    perror("PRUCAM_IOC_STREAMON");
+    goto out;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  fprintf(stderr, "%s metering to %.0f, coarse_time %u analog_gain %u "
+          "global_gain %u\n", metering_names[metering], config.target,
+          cur.coarse_time, cur.analog_gain, cur.global_gain);
+  if (awb)
+    fprintf(stderr, "white balance of %s, red %.2f green1 %.2f green2 %.2f "
+            "blue %.2f\n", pattern_names[pattern], balance[PRUCAM_AWB_RED],
+            balance[PRUCAM_AWB_GREEN1], balance[PRUCAM_AWB_GREEN2],
+            balance[PRUCAM_AWB_BLUE]);
+
+  for (unsigned i = 0; !stop && (!nframes || i < nframes); i++) {
+    const uint8_t *frame;
+    double level, stops, means[PRUCAM_AWB_CHANNELS], top = 1;
+    int changed, balanced = 0;
+
+    if (ioctl(fd, PRUCAM_IOC_CAPTURE, &buf) < 0) {
+      if (errno == EIO || errno == ETIMEDOUT || errno == EINTR)
+        continue;
+      perror("PRUCAM_IOC_CAPTURE");
+      goto out;
+    }
+
+    // a frame before the last batch, or a torn one, says nothing about it
+    if (buf.info.errors || (int32_t)(buf.info.settings - wait_batch) < 0)
+      continue;
+
+    frame = map + (size_t)buf.index * PRUCAM_BUFFER_SIZE;
+    if (ioctl(fd, PRUCAM_IOC_G_HISTOGRAM, &hist) < 0 || !hist.samples)
+      prucam_ae_histogram(frame, &hist);
+    metered++;
+
+    // the colour gains are the digital gain times the balance, and the
+    // largest must fit its register
+    for (unsigned c = 0; c < PRUCAM_AWB_CHANNELS; c++)
+      if (balance[c] > top)
+        top = balance[c];
+    config.max_global_gain = MAX_GAIN / top;
+
+    level = prucam_ae_meter(&config, &hist);
+    changed = prucam_ae_update(&config, &hist, &cur, &next, &stops);
+    if (awb && prucam_awb_means(&awb_config, frame, means) == 0)
+      balanced = prucam_awb_update(&awb_config, means, balance,
+                                   next_balance);
+
+    if (changed > 0 || balanced || !quiet) {
+      printf("frame %u: level %.1f, coarse_time %u analog_gain %u "
+             "global_gain %u", buf.info.sequence, level, cur.coarse_time,
+             cur.analog_gain, cur.global_gain);
+      if (changed > 0)
+        printf(", %+.2f stops to coarse_time %u analog_gain %u "
+               "global_gain %u", stops, next.coarse_time, next.analog_gain,
+               next.global_gain);
+      if (balanced)
+        printf(", balance to red %.2f green1 %.2f green2 %.2f blue %.2f",
+               next_balance[PRUCAM_AWB_RED], next_balance[PRUCAM_AWB_GREEN1],
+               next_balance[PRUCAM_AWB_GREEN2],
+               next_balance[PRUCAM_AWB_BLUE]);
+      printf("\n");
+      fflush(stdout);
+    }
+
+    if (changed <= 0 && !balanced) {
+      if (once && changed == 0) {
+        fprintf(stderr, "settled after %u metered frames, %u changes\n",
+                metered, changes);
+        break;
+      }
+      continue;
+    }
+
+    if (balanced)
+      memcpy(balance, next_balance, sizeof(balance));
+    if ((ret = set_exposure(fd, &next, balance, &wait_batch)) < 0) {
+      fprintf(stderr, "PRUCAM_IOC_S_CONTROLS: %s\n", strerror(-ret));
+      ret = 1;
+      goto out;
+    }
+    cur = next;
+    changes++;
+  }
+  ret = 0;
+
+out:
+  munmap(map, map_len);
+  close(fd);
+  return ret;
+}
@@ -0,0 +1,194 @@
+/*
+ * prucam_ae: auto exposure from the histogram of each frame, see prucam_ae.h.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "prucam_ae.h"
+
+// levels of a histogram bin
+#define BIN_LEVELS (256 / PRUCAM_HIST_BINS)
+
+// the pixels PRU1 counts of each 32 byte chunk, both Bayer colours of a row
+static const unsigned hist_offsets[] = { 0, 1, 16, 17 };
+#define HIST_CHUNK 32
+
+// the data pedestal the driver sets, 0xC8 of 12 bits, in the top 8 bits
+#define DEFAULT_BLACK_LEVEL 12
+
+// 1x digital gain, in 3.5 fixed point
+#define GLOBAL_GAIN_1X 32
+
+void prucam_ae_defaults(struct prucam_ae_config *c,
+                        enum prucam_ae_metering metering,
+                        unsigned max_coarse_time)
+{
+  memset(c, 0, sizeof(*c));
+  c->metering = metering;
+  c->black_level = DEFAULT_BLACK_LEVEL;
+  c->tolerance = 0.1;
+  c->max_stops = 3;
+  c->max_coarse_time = max_coarse_time;
+  c->max_analog_gain = 3;
+  c->max_global_gain = 0xFE;
+
+  switch (metering) {
+  case PRUCAM_AE_MEAN:
+    // a quarter of full scale leaves room for the highlights
+    c->target = 64;
+    break;
+  case PRUCAM_AE_PERCENTILE:
+    c->percentile = 0.99;
+    c->target = 230;
+    break;
+  case PRUCAM_AE_PEAK:
+    // a few hot pixels are always over, and the stars are kept under full
+    // scale so their centroids aren't clipped
+    c->peak_pixels = 4;
+    c->target = 200;
+    break;
+  }
+}
+
+void prucam_ae_histogram(const uint8_t *image, struct prucam_histogram *h)
+{
+  memset(h, 0, sizeof(*h));
+  for (size_t i = 0; i < (size_t)PRUCAM_ROWS * PRUCAM_COLS; i += HIST_CHUNK) {
+    for (unsigned j = 0; j < sizeof(hist_offsets) / sizeof(*hist_offsets);
+         j++) {
+      uint8_t v = image[i + hist_offsets[j]];
+
+      h->bins[v / BIN_LEVELS]++;
+      h->saturated += v == 255;
+      h->black += v == 0;
+      h->samples++;
+    }
+  }
+}
+
+// the level rank of the counted pixels are under, by interpolating in its bin
+static double level_at(const struct prucam_histogram *h, double rank)
+{
+  double below = 0;
+
+  if (rank < h->black)
+    return 0;
+  if (rank >= h->samples - h->saturated)
+    return 255;
+
+  for (unsigned i = 0; i < PRUCAM_HIST_BINS; i++) {
+    double n = h->bins[i];
+
+    // the black and saturated pixels are at the ends of their bins
+    if (i == 0)
+      n -= h->black;
+    if (i == PRUCAM_HIST_BINS - 1)
+      n -= h->saturated;
+    if (i == 0)
+      below += h->black;
+
+    if (n > 0 && rank < below + n)
+      return i * BIN_LEVELS + BIN_LEVELS * (rank - below) / n;
+    below += n;
+  }
+  return 255;
+}
+
+double prucam_ae_meter(const struct prucam_ae_config *c,
+                       const struct prucam_histogram *h)
+{
+  double sum = 0;
+
+  if (!h->samples)
+    return -1;
+
+  switch (c->metering) {
+  case PRUCAM_AE_MEAN:
+    for (unsigned i = 0; i < PRUCAM_HIST_BINS; i++)
+      sum += h->bins[i] * (i * BIN_LEVELS + (BIN_LEVELS - 1) / 2.0);
+    // the black and saturated pixels are at 0 and 255, not the bin middle
+    sum -= h->black * (BIN_LEVELS - 1) / 2.0;
+    sum += h->saturated * (BIN_LEVELS - 1) / 2.0;
+    return sum / h->samples;
+  case PRUCAM_AE_PERCENTILE:
+    return level_at(h, c->percentile * h->samples);
+  case PRUCAM_AE_PEAK:
+    return level_at(h, c->peak_pixels < h->samples ?
+                       h->samples - c->peak_pixels : 0);
+  }
+  return -1;
+}
+
+double prucam_ae_total(const struct prucam_ae_exposure *e)
+{
+  return (double)e->coarse_time * (1 << e->analog_gain) * e->global_gain /
+         GLOBAL_GAIN_1X;
+}
+
+// splits an exposure into integration time first, then analog and then
+// digital gain
+static void split(const struct prucam_ae_config *c, double total,
+                  struct prucam_ae_exposure *e)
+{
+  double gain;
+
+  e->analog_gain = 0;
+  e->global_gain = GLOBAL_GAIN_1X;
+  if (total <= c->max_coarse_time) {
+    e->coarse_time = total < 1 ? 1 : lround(total);
+    return;
+  }
+
+  e->coarse_time = c->max_coarse_time;
+  gain = total / c->max_coarse_time;
+  while (e->analog_gain < c->max_analog_gain &&
+         (2 << e->analog_gain) <= gain)
+    e->analog_gain++;
+
+  long global = lround(GLOBAL_GAIN_1X * gain / (1 << e->analog_gain));
+
+  e->global_gain = global > (long)c->max_global_gain ? c->max_global_gain
+                                                     : global;
+}
+
+int prucam_ae_update(const struct prucam_ae_config *c,
+                     const struct prucam_histogram *h,
+                     const struct prucam_ae_exposure *cur,
+                     struct prucam_ae_exposure *next, double *stops)
+{
+  double level = prucam_ae_meter(c, h);
+  double signal = level - c->black_level;
+  double step;
+
+  *next = *cur;
+  if (stops)
+    *stops = 0;
+  if (level < 0)
+    return -1;
+
+  // a clipped or black level says which way to go but not how far
+  if (level >= 255)
+    step = -c->max_stops;
+  else if (signal < 1)
+    step = c->max_stops;
+  else
+    step = log2((c->target - c->black_level) / signal);
+
+  if (fabs(step) <= c->tolerance)
+    return 0;
+  if (step > c->max_stops)
+    step = c->max_stops;
+  if (step < -c->max_stops)
+    step = -c->max_stops;
+
+  // an exposure of 0, e.g. no digital gain, is taken as the shortest
+  double total = prucam_ae_total(cur) > 0 ? prucam_ae_total(cur) : 1;
+
+  split(c, total * exp2(step), next);
+  if (!memcmp(next, cur, sizeof(*next)))
+    return 0;
+  if (stops)
+    *stops = log2(prucam_ae_total(next) / total);
+  return 1;
+}
@@ -0,0 +1,91 @@
+/*
+ * prucam_ae: auto exposure from the histogram of each frame, for a loop that
+ * sets the exposure it picks with PRUCAM_IOC_S_CONTROLS.
+ *
+ * The histogram is metered to one pixel level, and the exposure is scaled by
+ * how far that level is from the target. The sensor is linear above its black
+ * level, so a frame that is neither black nor clipped is corrected in one
+ * step. A clipped or black one gets a step of max_stops and is measured again.
+ *
+ * The exposure is the integration time times the analog and the digital gain.
+ * Integration time goes up first, to its longest, then the analog gain and
+ * then the digital gain, so the gains only add noise when the light is too
+ * low for the integration time alone.
+ *
+ * Metering:
+ * - mean: the mean level, for a scene that fills the frame
+ * - percentile: the level a fraction of the pixels is at or under
+ * - peak: the level only peak_pixels pixels are over, for a star field, where
+ *   the few bright pixels matter and the black sky doesn't
+ */
+
+#ifndef PRUCAM_AE_H
+#define PRUCAM_AE_H
+
+#include <stdint.h>
+
+#include "prucam_uapi.h"
+
+enum prucam_ae_metering {
+  PRUCAM_AE_MEAN,
+  PRUCAM_AE_PERCENTILE,
+  PRUCAM_AE_PEAK,
+};
+
+struct prucam_ae_config {
+  enum prucam_ae_metering metering;
+  double target;        // level the metered level is brought to, 1 to 254
+  double percentile;    // fraction of the pixels, for PRUCAM_AE_PERCENTILE
+  unsigned peak_pixels; // counted pixels over the level, for PRUCAM_AE_PEAK
+  double black_level;   // level of no light, the sensor's pedestal
+  double tolerance;     // stops off the target that are left alone
+  double max_stops;     // largest change of a frame, in stops
+  unsigned max_coarse_time; // longest integration time, in lines
+  unsigned max_analog_gain; // 0 to 3, for 1x to 8x
+  unsigned max_global_gain; // 3.5 fixed point, 32 is 1x, up to 0xFE
+};
+
+// an exposure, as the controls of the same name
+struct prucam_ae_exposure {
+  unsigned coarse_time;
+  unsigned analog_gain;
+  unsigned global_gain;
+};
+
+/**
+ * Fills a config with the defaults of a metering mode.
+ * @param max_coarse_time longest integration time, e.g. the frame length in
+ * lines less one to keep the frame rate
+ */
+void prucam_ae_defaults(struct prucam_ae_config *c,
+                        enum prucam_ae_metering metering,
+                        unsigned max_coarse_time);
+
+/**
+ * Counts a histogram of a frame as the PRUs do, for when the driver didn't.
+ * @param image PRUCAM_ROWS by PRUCAM_COLS 8-bit pixels
+ */
+void prucam_ae_histogram(const uint8_t *image, struct prucam_histogram *h);
+
+/**
+ * Meters a histogram.
+ * @return the metered level, 0 to 255, or -1 for an empty histogram
+ */
+double prucam_ae_meter(const struct prucam_ae_config *c,
+                       const struct prucam_histogram *h);
+
+/**
+ * Picks the exposure of the next frame from a frame and the exposure it had.
+ * @param stops set to the change, in stops, when not NULL
+ * @return 1 when next differs from cur, 0 when the frame is on target or the
+ * exposure is at its limit, or -1 for an empty histogram
+ */
+int prucam_ae_update(const struct prucam_ae_config *c,
+                     const struct prucam_histogram *h,
+                     const struct prucam_ae_exposure *cur,
+                     struct prucam_ae_exposure *next, double *stops);
+
+/** Gets an exposure in lines at 1x gain */
+double prucam_ae_total(const struct prucam_ae_exposure *e);
+
+#endif /* PRUCAM_AE_H */
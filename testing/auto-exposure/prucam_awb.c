@@ -0,0 +1,158 @@
+/*
+ * prucam_awb: auto white balance from the Bayer channel means of each frame,
+ * see prucam_awb.h.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#include "prucam_awb.h"
+
+// the data pedestal the driver sets, 0xC8 of 12 bits, in the top 8 bits
+#define DEFAULT_BLACK_LEVEL 12
+
+// largest colour gain register, 3.5 fixed point
+#define MAX_GAIN 0xFE
+
+// channel of each pixel of a 2x2 block, top left, top right, bottom left and
+// bottom right, by pattern
+static const enum prucam_awb_channel channels[][4] = {
+  [PRUCAM_AWB_RGGB] = { PRUCAM_AWB_RED, PRUCAM_AWB_GREEN1,
+                        PRUCAM_AWB_GREEN2, PRUCAM_AWB_BLUE },
+  [PRUCAM_AWB_GRBG] = { PRUCAM_AWB_GREEN1, PRUCAM_AWB_RED,
+                        PRUCAM_AWB_BLUE, PRUCAM_AWB_GREEN2 },
+  [PRUCAM_AWB_GBRG] = { PRUCAM_AWB_GREEN2, PRUCAM_AWB_BLUE,
+                        PRUCAM_AWB_RED, PRUCAM_AWB_GREEN1 },
+  [PRUCAM_AWB_BGGR] = { PRUCAM_AWB_BLUE, PRUCAM_AWB_GREEN2,
+                        PRUCAM_AWB_GREEN1, PRUCAM_AWB_RED },
+};
+
+void prucam_awb_defaults(struct prucam_awb_config *c,
+                         enum prucam_awb_pattern pattern)
+{
+  memset(c, 0, sizeof(*c));
+  c->pattern = pattern;
+  c->black_level = DEFAULT_BLACK_LEVEL;
+  c->saturation = 250;
+  c->row_step = 8;
+  c->tolerance = 0.02;
+  c->max_ratio = 4;
+}
+
+#ifdef __ARM_NEON
+// a row is 40 steps of 32 pixels, its 16-bit sums can't overflow
+_Static_assert(PRUCAM_COLS / 32 * 2 * 255 <= 0xFFFF, "row sums overflow");
+
+static inline uint32_t add_u16(uint16x8_t v)
+{
+  uint64x2_t s = vpaddlq_u32(vpaddlq_u16(v));
+
+  return vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1);
+}
+
+// sums the even and the odd pixels of a row under sat, 32 at a time
+static void sum_row(const uint8_t *row, uint8_t sat, uint64_t sum[2],
+                    uint32_t count[2])
+{
+  const uint8x16_t satv = vdupq_n_u8(sat);
+  uint16x8_t s0 = vdupq_n_u16(0), s1 = vdupq_n_u16(0);
+  uint8x16_t n0 = vdupq_n_u8(0), n1 = vdupq_n_u8(0);
+
+  for (unsigned x = 0; x < PRUCAM_COLS; x += 32) {
+    uint8x16x2_t p = vld2q_u8(row + x);
+    uint8x16_t m0 = vcltq_u8(p.val[0], satv);
+    uint8x16_t m1 = vcltq_u8(p.val[1], satv);
+
+    s0 = vpadalq_u8(s0, vandq_u8(p.val[0], m0));
+    s1 = vpadalq_u8(s1, vandq_u8(p.val[1], m1));
+    // the masks are all ones, -1, for a pixel under sat
+    n0 = vsubq_u8(n0, m0);
+    n1 = vsubq_u8(n1, m1);
+  }
+
+  sum[0] += add_u16(s0);
+  sum[1] += add_u16(s1);
+  count[0] += add_u16(vpaddlq_u8(n0));
+  count[1] += add_u16(vpaddlq_u8(n1));
+}
+#else
+static void sum_row(const uint8_t *row, uint8_t sat, uint64_t sum[2],
+                    uint32_t count[2])
+{
+  for (unsigned x = 0; x < PRUCAM_COLS; x++) {
+    if (row[x] < sat) {
+      sum[x & 1] += row[x];
+      count[x & 1]++;
+    }
+  }
+}
+#endif
+
+int prucam_awb_means(const struct prucam_awb_config *c, const uint8_t *image,
+                     double means[PRUCAM_AWB_CHANNELS])
+{
+  uint64_t sum[4] = { 0 };
+  uint32_t count[4] = { 0 };
+  unsigned step = c->row_step ? c->row_step : 1;
+
+  for (unsigned r = 0; r + 1 < PRUCAM_ROWS; r += 2 * step) {
+    sum_row(image + (size_t)r * PRUCAM_COLS, c->saturation, sum, count);
+    sum_row(image + (size_t)(r + 1) * PRUCAM_COLS, c->saturation, sum + 2,
+            count + 2);
+  }
+
+  for (unsigned i = 0; i < 4; i++) {
+    enum prucam_awb_channel ch = channels[c->pattern][i];
+
+    if (!count[i])
+      return -1;
+    means[ch] = (double)sum[i] / count[i] - c->black_level;
+    // too dark for the ratios to mean anything
+    if (means[ch] < 1)
+      return -1;
+  }
+  return 0;
+}
+
+int prucam_awb_update(const struct prucam_awb_config *c,
+                      const double means[PRUCAM_AWB_CHANNELS],
+                      const double cur[PRUCAM_AWB_CHANNELS],
+                      double next[PRUCAM_AWB_CHANNELS])
+{
+  double green = (means[PRUCAM_AWB_GREEN1] + means[PRUCAM_AWB_GREEN2]) / 2;
+  double min = 0;
+  int changed = 0;
+
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++) {
+    next[i] = cur[i] * green / means[i];
+    if (!i || next[i] < min)
+      min = next[i];
+  }
+
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++) {
+    next[i] /= min;
+    if (next[i] > c->max_ratio)
+      next[i] = c->max_ratio;
+    if (fabs(next[i] / cur[i] - 1) > c->tolerance)
+      changed = 1;
+  }
+
+  if (!changed)
+    memcpy(next, cur, sizeof(*next) * PRUCAM_AWB_CHANNELS);
+  return changed;
+}
+
+void prucam_awb_gains(const double balance[PRUCAM_AWB_CHANNELS],
+                      unsigned global_gain,
+                      unsigned gains[PRUCAM_AWB_CHANNELS])
+{
+  for (unsigned i = 0; i < PRUCAM_AWB_CHANNELS; i++) {
+    long gain = lround(global_gain * balance[i]);
+
+    gains[i] = gain < 1 ? 1 : gain > MAX_GAIN ? MAX_GAIN : gain;
+  }
+}
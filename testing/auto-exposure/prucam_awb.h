@@ -0,0 +1,80 @@
+/*
+ * prucam_awb: auto white balance from the Bayer channel means of each frame,
+ * for a loop that sets the colour gains it picks with PRUCAM_IOC_S_CONTROLS.
+ *
+ * It is grey world: the scene is taken to average to grey, so each channel is
+ * balanced to the mean of the greens. The means are of the level over black,
+ * without the pixels at or over saturation, as clipped pixels have lost their
+ * colour. The balance is a ratio of each colour gain to the digital gain,
+ * with the smallest at 1, so no channel clips before the others.
+ *
+ * The sensor is linear, so the balance of a frame is corrected in one step.
+ * The means are counted from a row pair in every row_step, with NEON when
+ * built for it, as the frame buffers are uncached and slow to read.
+ */
+
+#ifndef PRUCAM_AWB_H
+#define PRUCAM_AWB_H
+
+#include <stdint.h>
+
+#include "prucam_uapi.h"
+
+// colour of the pixel at the top left of the image
+enum prucam_awb_pattern {
+  PRUCAM_AWB_RGGB,
+  PRUCAM_AWB_GRBG,
+  PRUCAM_AWB_GBRG,
+  PRUCAM_AWB_BGGR,
+};
+
+// channels, as the colour gain controls
+enum prucam_awb_channel {
+  PRUCAM_AWB_RED,
+  PRUCAM_AWB_GREEN1, // green of the red rows
+  PRUCAM_AWB_GREEN2, // green of the blue rows
+  PRUCAM_AWB_BLUE,
+  PRUCAM_AWB_CHANNELS,
+};
+
+struct prucam_awb_config {
+  enum prucam_awb_pattern pattern;
+  double black_level;  // level of no light, the sensor's pedestal
+  unsigned saturation; // pixels at or over it are left out, 1 to 255
+  unsigned row_step;   // row pairs from one counted to the next
+  double tolerance;    // change of a ratio that is left alone, e.g. 0.02
+  double max_ratio;    // largest ratio of a colour gain to the digital gain
+};
+
+/** Fills a config with the defaults for a pattern */
+void prucam_awb_defaults(struct prucam_awb_config *c,
+                         enum prucam_awb_pattern pattern);
+
+/**
+ * Gets the mean level over black of each channel of a frame.
+ * @param image PRUCAM_ROWS by PRUCAM_COLS 8-bit pixels
+ * @return 0, or -1 when a channel is too dark or clipped to measure
+ */
+int prucam_awb_means(const struct prucam_awb_config *c, const uint8_t *image,
+                     double means[PRUCAM_AWB_CHANNELS]);
+
+/**
+ * Picks the balance of the next frame from the means of a frame and the
+ * balance it had.
+ * @return 1 when next differs from cur, 0 when the frame is balanced
+ */
+int prucam_awb_update(const struct prucam_awb_config *c,
+                      const double means[PRUCAM_AWB_CHANNELS],
+                      const double cur[PRUCAM_AWB_CHANNELS],
+                      double next[PRUCAM_AWB_CHANNELS]);
+
+/**
+ * Gets the colour gain registers of a balance at a digital gain.
+ * @param global_gain digital gain, 3.5 fixed point, as PRUCAM_CID_GLOBAL_GAIN
+ * @param gains set to the colour gains, in the order of the channels
+ */
+void prucam_awb_gains(const double balance[PRUCAM_AWB_CHANNELS],
+                      unsigned global_gain,
+                      unsigned gains[PRUCAM_AWB_CHANNELS]);
+
+#endif /* PRUCAM_AWB_H */
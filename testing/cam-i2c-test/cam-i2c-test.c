@@ -0,0 +1,941 @@
+/*
+ * cam-i2c-test: tests the driver's sensor register code off-target and counts
+ * the I2C traffic it makes.
+ *
+ * cam_i2c.c, ar013x_sysfs.c, ar013x_controls.c and ar013x_timing.c are built as they are in the
+ * kernel module, on top of kshim.h, and talk to the emulated AR013x in
+ * i2c_emu.c. For each sensor model it:
+ * - finds the sensor from the device tree properties, like probe does
+ * - brings the sensor up with its startup table, one register per transfer
+ *   and then in bursts, and checks every register and the sequencer RAM
+ * - reads every sysfs attribute, writes it with another value and reads it
+ *   back, then restores it
+ * - checks the settings attribute against the attributes one by one
+ * - checks the register cache only reads the volatile registers again,
+ *   forgets everything on a soft reset, and has every control after a
+ *   bring-up
+ * - writes a batch of settings under the grouped parameter hold, and checks
+ *   which frame counts get the batch
+ * - gets every control and checks it against its attribute, sets a few at
+ *   once, checks the colour gains follow the global gain, and that nothing
+ *   else sets them while they are claimed
+ * - alternates the contexts with a pattern, checks each frame switches
+ *   the sensor to the context of a later one, and that the contexts are only
+ *   set by picking one
+ * - reads the frame period, without and with the cached value, and checks it
+ *   keeps a longer one while its frames are in flight, and is the longer of
+ *   the contexts while they alternate
+ * - checks the failure paths: no adapter, nobody at the address, a register
+ *   the sensor doesn't have
+ * and reports the transfers, bytes and bus time of each operation, and of the
+ * whole bring-up.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kshim.h"
+
+#include "ar0130_ctrl_regs.h"
+#include "ar0134_ctrl_regs.h"
+#include "ar013x_context.h"
+#include "ar013x_controls.h"
+#include "ar013x_hold.h"
+#include "ar013x_regs.h"
+#include "ar013x_sysfs.h"
+#include "ar013x_timing.h"
+#include "ar013x_virt.h"
+#include "cam_i2c.h"
+#include "i2c_emu.h"
+
+static const struct chip {
+  const char *name;
+  uint16_t version;
+  camera_regs_t *startup_regs;
+} chips[] = {
+  { "AR0130", 0x2402, ar0130_startup_regs },
+  { "AR0134", 0x2406, ar0134_startup_regs },
+};
+
+static int json;
+static unsigned failures;
+
+// cam_i2c.c's i2c_burst module param
+extern void *kshim_param_i2c_burst;
+
+#define FAIL(fmt, ...)                                                  \
+  do {                                                                  \
+    fprintf(stderr, "FAIL: " fmt "\n", ##__VA_ARGS__);                  \
+    failures++;                                                         \
+  } while (0)
+
+// traffic of one operation, from before() to after()
+struct op {
+  struct i2c_emu_counts start;
+  struct i2c_emu_counts used;
+};
+
+static void before(struct op *op)
+{
+  i2c_emu_get(&op->start);
+}
+
+static void after(struct op *op)
+{
+  struct i2c_emu_counts now;
+
+  i2c_emu_get(&now);
+  op->used.transfers = now.transfers - op->start.transfers;
+  op->used.msgs = now.msgs - op->start.msgs;
+  op->used.bytes = now.bytes - op->start.bytes;
+  op->used.naks = now.naks - op->start.naks;
+  op->used.bus_ns = now.bus_ns - op->start.bus_ns;
+  op->used.delay_ns = now.delay_ns - op->start.delay_ns;
+}
+
+static void report(const struct chip *chip, const char *name,
+                   const struct op *op)
+{
+  const struct i2c_emu_counts *c = &op->used;
+
+  if (json) {
+    printf("{\"chip\":\"%s\",\"op\":\"%s\",\"scl_hz\":%u,"
+           "\"overhead_ns\":%llu,\"transfers\":%llu,\"msgs\":%llu,"
+           "\"bytes\":%llu,\"bus_us\":%.1f,\"delay_us\":%.1f}\n",
+           chip->name, name, i2c_emu_scl_hz,
+           (unsigned long long)i2c_emu_overhead_ns,
+           (unsigned long long)c->transfers, (unsigned long long)c->msgs,
+           (unsigned long long)c->bytes, c->bus_ns / 1e3, c->delay_ns / 1e3);
+    return;
+  }
+
+  printf("  %-50s %9llu %6llu %10.1f\n", name,
+         (unsigned long long)c->transfers, (unsigned long long)c->bytes,
+         c->bus_ns / 1e3);
+}
+
+static void report_header(void)
+{
+  if (!json)
+    printf("  %-50s %9s %6s %10s\n", "operation", "transfers", "bytes",
+           "bus us");
+}
+
+static void test_probe(void)
+{
+  struct device_node node = { .i2c_bus = i2c_emu_bus, .i2c_addr = -1 };
+  struct device dev = { .of_node = &node };
+  struct cam_i2c_stats st;
+  uint16_t val;
+  int r;
+
+  // no adapter at the bus the device tree gives
+  node.i2c_bus = i2c_emu_bus + 1;
+  if ((r = init_cam_i2c(&dev, false)) != -ENODEV) {
+    FAIL("init on a missing adapter returned %d, not -ENODEV", r);
+    if (r == 0)
+      end_cam_i2c();
+  }
+
+  // nobody at the address the device tree gives
+  node.i2c_bus = i2c_emu_bus;
+  node.i2c_addr = i2c_emu_addr + 1;
+  if ((r = init_cam_i2c(&dev, false)) != 0) {
+    FAIL("init at a wrong address returned %d", r);
+  } else {
+    cam_i2c_reset_stats();
+    if ((r = read_cam_reg(AR013X_AD_CHIP_VERSION_REG, &val)) >= 0)
+      FAIL("read with nobody at the address returned %d", r);
+    if ((r = write_cam_reg(AR013X_AD_DIGITAL_TEST, 0)) >= 0)
+      FAIL("write with nobody at the address returned %d", r);
+    cam_i2c_get_stats(&st);
+    if (st.reads != 1 || st.writes != 1 || st.errors != 2)
+      FAIL("stats after 2 failed transfers: %u reads %u writes %u errors",
+           st.reads, st.writes, st.errors);
+    end_cam_i2c();
+  }
+
+  // an invalid address is refused before the adapter is touched
+  node.i2c_addr = 0x80;
+  if ((r = init_cam_i2c(&dev, false)) != -EINVAL) {
+    FAIL("init at address 0x80 returned %d, not -EINVAL", r);
+    if (r == 0)
+      end_cam_i2c();
+  }
+}
+
+// replays the startup table and checks the sensor ended up with the values
+static void check_startup_regs(const struct chip *chip)
+{
+  camera_regs_t *regs = chip->startup_regs;
+
+  for (int i = 0; regs[i].reg != 0 || regs[i].val != 0; i++) {
+    uint16_t want, got;
+
+    if (regs[i].reg == 0)
+      continue;
+    // the last write to a register wins
+    want = regs[i].val;
+    for (int j = i + 1; regs[j].reg != 0 || regs[j].val != 0; j++)
+      if (regs[j].reg == regs[i].reg)
+        want = regs[j].val;
+
+    if (ar013x_virt_read(regs[i].reg, &got) < 0)
+      FAIL("%s: startup register 0x%04x does not exist", chip->name,
+           regs[i].reg);
+    else if (got != want)
+      FAIL("%s: register 0x%04x is 0x%04x after bring-up, not 0x%04x",
+           chip->name, regs[i].reg, got, want);
+  }
+}
+
+// checks the words written to the sequencer data port went in, in order
+static void check_seq_ram(const struct chip *chip)
+{
+  camera_regs_t *regs = chip->startup_regs;
+  uint16_t ram[512];
+  unsigned n, want = 0;
+
+  n = i2c_emu_seq_ram(ram, ARRAY_SIZE(ram));
+  for (int i = 0; regs[i].reg != 0 || regs[i].val != 0; i++) {
+    if (regs[i].reg == AR013X_AD_SEQ_CTRL_PORT && regs[i].val == 0x8000)
+      want = 0;
+    if (regs[i].reg != AR013X_AD_SEQ_DATA_PORT)
+      continue;
+    if (want >= n || ram[want] != regs[i].val) {
+      FAIL("%s: sequencer word %u is not 0x%04x", chip->name, want,
+           regs[i].val);
+      return;
+    }
+    want++;
+  }
+  if (want != n)
+    FAIL("%s: sequencer got %u words, not %u", chip->name, n, want);
+}
+
+static void test_bring_up(const struct chip *chip, struct device *dev,
+                          unsigned burst)
+{
+  struct op op;
+  struct cam_i2c_stats st;
+  uint16_t version = 0;
+  uint64_t delay_ns;
+  char label[32];
+  int r;
+
+  *(unsigned *)kshim_param_i2c_burst = burst;
+  i2c_emu_power_on(chip->version);
+
+  before(&op);
+  if ((r = init_cam_i2c(dev, false)) != 0) {
+    FAIL("%s: init_cam_i2c returned %d", chip->name, r);
+    return;
+  }
+  cam_i2c_reset_stats();
+
+  if ((r = read_cam_reg(AR013X_AD_CHIP_VERSION_REG, &version)) != 0)
+    FAIL("%s: reading the chip version returned %d", chip->name, r);
+  else if (version != chip->version)
+    FAIL("%s: chip version is 0x%04x", chip->name, version);
+
+  if ((r = init_camera_regs(chip->startup_regs)) != 0)
+    FAIL("%s: init_camera_regs returned %d", chip->name, r);
+  after(&op);
+
+  check_startup_regs(chip);
+  check_seq_ram(chip);
+
+  // the driver's own counters must agree with the bus
+  cam_i2c_get_stats(&st);
+  if (st.reads + st.writes != op.used.transfers)
+    FAIL("%s: driver counted %u transfers, the bus saw %llu", chip->name,
+         st.reads + st.writes, (unsigned long long)op.used.transfers);
+  if (st.errors != op.used.naks)
+    FAIL("%s: driver counted %u errors, the bus saw %llu", chip->name,
+         st.errors, (unsigned long long)op.used.naks);
+  delay_ns = op.used.delay_ns;
+  if (st.init_delay_ns != delay_ns)
+    FAIL("%s: driver timed %llu ns of delays, there were %llu", chip->name,
+         (unsigned long long)st.init_delay_ns, (unsigned long long)delay_ns);
+
+  if (st.init_transfers + st.init_reads + 1 != op.used.transfers)
+    FAIL("%s: driver counted %u bring-up transfers, the bus saw %llu",
+         chip->name, st.init_transfers + st.init_reads,
+         (unsigned long long)op.used.transfers - 1);
+  // the controls are read into the cache a range per transfer
+  if (st.init_reads != 5)
+    FAIL("%s: bring-up read the controls in %u transfers, not 5", chip->name,
+         st.init_reads);
+
+  snprintf(label, sizeof(label), "bring-up burst=%u", burst);
+  if (json) {
+    report(chip, label, &op);
+  } else {
+    printf("%s %s: %u register writes, %llu transfers, %llu bytes\n",
+           chip->name, label, st.init_writes,
+           (unsigned long long)op.used.transfers,
+           (unsigned long long)op.used.bytes);
+    printf("  bus %.1f ms + delays %.1f ms = %.1f ms"
+           " (driver measured init_camera_regs %.1f ms)\n",
+           op.used.bus_ns / 1e6, delay_ns / 1e6,
+           (op.used.bus_ns + delay_ns) / 1e6, st.init_ns / 1e6);
+  }
+}
+
+static ssize_t show(struct device *dev, struct device_attribute *da,
+                    char *buf, struct op *op)
+{
+  ssize_t r;
+
+  before(op);
+  r = da->show(dev, da, buf);
+  after(op);
+  if (r >= 0)
+    buf[r] = '\0';
+  return r;
+}
+
+static ssize_t store(struct device *dev, struct device_attribute *da,
+                     const char *buf, struct op *op)
+{
+  ssize_t r;
+
+  before(op);
+  r = da->store(dev, da, buf, strlen(buf));
+  after(op);
+  return r;
+}
+
+// show, store another value, show it back and restore the attribute
+static void test_attr(const struct chip *chip, struct device *dev,
+                      const struct attribute_group *grp,
+                      struct device_attribute *da)
+{
+  char name[96], label[128], buf[PAGE_SIZE], other[32];
+  struct op op;
+  ssize_t r;
+  long v;
+
+  if (grp->name)
+    snprintf(name, sizeof(name), "%s/%s", grp->name, da->attr.name);
+  else
+    snprintf(name, sizeof(name), "%s", da->attr.name);
+
+  if ((r = show(dev, da, buf, &op)) <= 0) {
+    FAIL("%s: show %s returned %zd", chip->name, name, r);
+    return;
+  }
+  snprintf(label, sizeof(label), "show %s", name);
+  report(chip, label, &op);
+
+  // read only
+  if (!da->store)
+    return;
+
+  v = strtol(buf, NULL, 10);
+  snprintf(other, sizeof(other), "%d\n", v == 1 ? 0 : 1);
+
+  r = store(dev, da, other, &op);
+  snprintf(label, sizeof(label), "store %s", name);
+  report(chip, label, &op);
+  if (r < 0) {
+    FAIL("%s: store %d to %s returned %zd", chip->name, v == 1 ? 0 : 1, name,
+         r);
+    return;
+  }
+
+  if ((r = show(dev, da, buf, &op)) <= 0 || strcmp(buf, other) != 0)
+    FAIL("%s: %s reads back %s after storing %s", chip->name, name,
+         r > 0 ? buf : "nothing", other);
+
+  snprintf(other, sizeof(other), "%ld\n", v);
+  if ((r = store(dev, da, other, &op)) < 0)
+    FAIL("%s: restoring %s returned %zd", chip->name, name, r);
+}
+
+// the name=value lines of the settings attribute must be what the attributes
+// show one by one
+static void test_settings(const struct chip *chip, struct device *dev)
+{
+  char settings[PAGE_SIZE + 1], buf[64], want[128];
+  struct op op;
+  unsigned n = 0;
+  ssize_t r;
+
+  // a newline in front of every line, so each name matches only itself
+  settings[0] = '\n';
+  r = show(dev, &dev_attr_settings, settings + 1, &op);
+  if (r <= 0) {
+    FAIL("%s: show settings returned %zd", chip->name, r);
+    return;
+  }
+
+  for (int g = 0; ar013x_groups[g]; g++) {
+    const struct attribute_group *grp = ar013x_groups[g];
+
+    for (int a = 0; grp->attrs[a]; a++) {
+      struct device_attribute *da =
+          (struct device_attribute *)grp->attrs[a];
+
+      if (da == &dev_attr_settings || da == &dev_attr_settings_batch ||
+          da == &dev_attr_context_pattern)
+        continue;
+      if (da->show(dev, da, buf) <= 0)
+        continue;
+      snprintf(want, sizeof(want), "\n%s=%s", da->attr.name, buf);
+      if (!strstr(settings, want))
+        FAIL("%s: settings does not have %.*s", chip->name,
+             (int)strlen(want) - 2, want + 1);
+      n++;
+    }
+  }
+
+  // every line is an attribute
+  for (char *p = settings + 1; (p = strchr(p, '\n')); p++)
+    n--;
+  if (n != 0)
+    FAIL("%s: settings has %d lines more than attributes", chip->name,
+         -(int)n);
+}
+
+static void test_sysfs(const struct chip *chip, struct device *dev)
+{
+  for (int g = 0; ar013x_groups[g]; g++) {
+    const struct attribute_group *grp = ar013x_groups[g];
+
+    for (int a = 0; grp->attrs[a]; a++) {
+      struct device_attribute *da =
+          (struct device_attribute *)grp->attrs[a];
+
+      // test_batch() writes settings, test_context() the context pattern
+      if (da == &dev_attr_settings || da == &dev_attr_context_pattern)
+        continue;
+      test_attr(chip, dev, grp, da);
+    }
+  }
+}
+
+// the frames a write can still be in flight for
+static void frames_done(void)
+{
+  for (unsigned i = 0; i < ar013x_hold_latency() + 2; i++)
+    ar013x_timing_frame_done();
+}
+
+static void test_frame_period(const struct chip *chip)
+{
+  struct op op;
+  uint32_t uncached, cached, longer, in_flight, later, alternating;
+  uint16_t frame_len, coarse;
+  int r;
+
+  // any write drops the cached period
+  write_cam_reg(AR013X_AD_DIGITAL_TEST, 0);
+  frames_done();
+
+  before(&op);
+  r = ar013x_frame_period_us(&uncached);
+  after(&op);
+  report(chip, "frame period", &op);
+  if (r != 0 || uncached == 0)
+    FAIL("%s: frame period returned %d, %u us", chip->name, r, uncached);
+
+  before(&op);
+  r = ar013x_frame_period_us(&cached);
+  after(&op);
+  report(chip, "frame period (cached)", &op);
+  if (r != 0 || cached != uncached)
+    FAIL("%s: cached frame period returned %d, %u us", chip->name, r,
+         cached);
+  if (op.used.transfers != 0)
+    FAIL("%s: cached frame period made %llu transfers", chip->name,
+         (unsigned long long)op.used.transfers);
+  // a shorter exposure only shortens the period once the frames with the
+  // longer one are done
+  read_cam_reg(AR013X_AD_FRAME_LEN_LINES, &frame_len);
+  read_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME, &coarse);
+  write_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME, 2 * frame_len);
+  frames_done();
+  ar013x_frame_period_us(&longer);
+  write_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME, coarse);
+  ar013x_frame_period_us(&in_flight);
+  frames_done();
+  ar013x_frame_period_us(&later);
+  if (longer <= uncached || in_flight != longer || later != uncached)
+    FAIL("%s: frame period %u us with a long exposure, %u us right after "
+         "and %u us later, not %u, %u and %u", chip->name, longer, in_flight,
+         later, longer, longer, uncached);
+
+  // while alternating, it is the longer of the two contexts
+  read_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME_CB, &coarse);
+  write_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME_CB, 2 * frame_len);
+  frames_done();
+  ar013x_context_set_pattern("AB", 2);
+  ar013x_frame_period_us(&alternating);
+  ar013x_context_set_pattern("", 0);
+  write_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME_CB, coarse);
+  frames_done();
+  if (alternating < longer)
+    FAIL("%s: frame period %u us while alternating, not the %u us of B",
+         chip->name, alternating, longer);
+}
+
+// after the first read, only the registers the sensor changes itself go over
+// the bus, until a soft reset
+static void test_cache(const struct chip *chip, struct device *dev)
+{
+  char buf[PAGE_SIZE];
+  struct op op;
+  uint16_t val;
+  ssize_t r;
+
+  if ((r = show(dev, &dev_attr_settings, buf, &op)) <= 0)
+    FAIL("%s: show settings returned %zd", chip->name, r);
+  report(chip, "show settings (cached)", &op);
+  if (op.used.transfers != 0)
+    FAIL("%s: cached settings made %llu transfers", chip->name,
+         (unsigned long long)op.used.transfers);
+
+  // unchanged bits aren't written
+  before(&op);
+  update_cam_reg(AR013X_AD_AE_CTRL_REG, 0x0001, 0);
+  after(&op);
+  report(chip, "update AE_CTRL_REG unchanged", &op);
+  if (op.used.transfers != 0)
+    FAIL("%s: an unchanged update made %llu transfers", chip->name,
+         (unsigned long long)op.used.transfers);
+
+  before(&op);
+  read_cam_reg(AR013X_AD_FRAME_COUNT, &val);
+  read_cam_reg(AR013X_AD_FRAME_COUNT, &val);
+  after(&op);
+  if (op.used.transfers != 2)
+    FAIL("%s: 2 frame count reads made %llu transfers", chip->name,
+         (unsigned long long)op.used.transfers);
+
+  // auto exposure owns the integration time while it is on
+  update_cam_reg(AR013X_AD_AE_CTRL_REG, 0x0001, 1);
+  before(&op);
+  read_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME, &val);
+  after(&op);
+  if (op.used.transfers != 1)
+    FAIL("%s: integration time read with AE on made %llu transfers",
+         chip->name, (unsigned long long)op.used.transfers);
+  update_cam_reg(AR013X_AD_AE_CTRL_REG, 0x0001, 0);
+
+  // a soft reset puts the registers back to their defaults
+  write_cam_reg(AR013X_AD_RESET_REGISTER, 0x0001);
+  before(&op);
+  show(dev, &dev_attr_settings, buf, &op);
+  after(&op);
+  if (op.used.transfers == 0)
+    FAIL("%s: settings after a soft reset made no transfers", chip->name);
+
+  // the bring-up reads the registers its table doesn't set into the cache
+  init_camera_regs(chip->startup_regs);
+  show(dev, &dev_attr_settings, buf, &op);
+  report(chip, "show settings (after bring-up)", &op);
+  if (op.used.transfers != 0)
+    FAIL("%s: settings after a bring-up made %llu transfers", chip->name,
+         (unsigned long long)op.used.transfers);
+}
+
+static ssize_t show_attr(struct device *dev, const char *name, char *buf)
+{
+  for (int g = 0; ar013x_groups[g]; g++)
+    for (int a = 0; ar013x_groups[g]->attrs[a]; a++) {
+      struct device_attribute *da =
+          (struct device_attribute *)ar013x_groups[g]->attrs[a];
+
+      if (strcmp(da->attr.name, name) == 0)
+        return da->show(dev, da, buf);
+    }
+  return -ENOENT;
+}
+
+// a batch of settings is written under the grouped parameter hold, and a
+// bad line or value keeps the whole batch off the sensor
+static void test_batch(const struct chip *chip, struct device *dev)
+{
+  const char *batch = "coarse_time=300\nglobal_gain=40\nae_luma_target=1200\n";
+  char buf[PAGE_SIZE];
+  struct op op;
+  uint16_t hold, fc;
+  ssize_t r;
+  uint32_t n;
+
+  // each batch gets frames of its own
+  n = ar013x_hold_batch();
+  fc = 100 + 10 * n;
+  ar013x_virt_write(AR013X_AD_FRAME_COUNT, fc);
+
+  r = store(dev, &dev_attr_settings, batch, &op);
+  report(chip, "store settings (3 values)", &op);
+  if (r != (ssize_t)strlen(batch))
+    FAIL("%s: store settings returned %zd", chip->name, r);
+  // hold, 3 writes, release, frame count
+  if (op.used.transfers != 6)
+    FAIL("%s: store settings made %llu transfers, not 6", chip->name,
+         (unsigned long long)op.used.transfers);
+  if (ar013x_virt_read(AR013X_AD_GROUPED_PARAMETER_HOLD, &hold) < 0 || hold)
+    FAIL("%s: the hold is still on after the batch", chip->name);
+  if (ar013x_hold_batch() != n + 1)
+    FAIL("%s: batch is %u after a store, not %u", chip->name,
+         ar013x_hold_batch(), n + 1);
+
+  if (show_attr(dev, "coarse_time", buf) <= 0 || strcmp(buf, "300\n"))
+    FAIL("%s: coarse_time is not 300 after the batch", chip->name);
+  if (show_attr(dev, "ae_luma_target", buf) <= 0 || strcmp(buf, "1200\n"))
+    FAIL("%s: ae_luma_target is not 1200 after the batch", chip->name);
+
+  // latched on the next frame, exposed from the one after
+  if (ar013x_hold_batch_of(fc + 1) != n || ar013x_hold_batch_of(fc + 2) != n + 1)
+    FAIL("%s: frames %u and %u have batches %u and %u, not %u and %u",
+         chip->name, fc + 1, fc + 2, ar013x_hold_batch_of(fc + 1),
+         ar013x_hold_batch_of(fc + 2), n, n + 1);
+
+  r = store(dev, &dev_attr_settings, "coarse_time=400\nnot_a_setting=1\n",
+            &op);
+  if (r != -EINVAL || op.used.transfers != 0)
+    FAIL("%s: a bad batch returned %zd after %llu transfers", chip->name, r,
+         (unsigned long long)op.used.transfers);
+  if (ar013x_hold_batch() != n + 1)
+    FAIL("%s: a bad batch was counted", chip->name);
+
+  // a value out of range after a good line keeps the good one off too
+  r = store(dev, &dev_attr_settings, "coarse_time=400\nglobal_gain=300\n",
+            &op);
+  if (r != -EINVAL || op.used.transfers != 0)
+    FAIL("%s: an out of range batch returned %zd after %llu transfers",
+         chip->name, r, (unsigned long long)op.used.transfers);
+  if (ar013x_hold_batch() != n + 1)
+    FAIL("%s: an out of range batch was counted", chip->name);
+  if (show_attr(dev, "coarse_time", buf) <= 0 || strcmp(buf, "300\n"))
+    FAIL("%s: an out of range batch set coarse_time", chip->name);
+}
+
+// the attribute of each control
+static const char *const control_names[PRUCAM_CID_COUNT] = {
+  [PRUCAM_CID_CONTEXT] = "context",
+  [PRUCAM_CID_X_SIZE] = "x_size",
+  [PRUCAM_CID_Y_SIZE] = "y_size",
+  [PRUCAM_CID_COARSE_TIME] = "coarse_time",
+  [PRUCAM_CID_FINE_TIME] = "fine_time",
+  [PRUCAM_CID_Y_ODD_INC] = "y_odd_inc",
+  [PRUCAM_CID_GREEN1_GAIN] = "green1_gain",
+  [PRUCAM_CID_BLUE_GAIN] = "blue_gain",
+  [PRUCAM_CID_RED_GAIN] = "red_gain",
+  [PRUCAM_CID_GREEN2_GAIN] = "green2_gain",
+  [PRUCAM_CID_GLOBAL_GAIN] = "global_gain",
+  [PRUCAM_CID_ANALOG_GAIN] = "analog_gain",
+  [PRUCAM_CID_FRAME_LEN_LINES] = "frame_len_lines",
+  [PRUCAM_CID_DIGITAL_BINNING] = "digital_binning",
+  [PRUCAM_CID_AE_ENABLE] = "ae_enable",
+  [PRUCAM_CID_AE_AG_EN] = "ae_ag_en",
+  [PRUCAM_CID_AE_DG_EN] = "ae_dg_en",
+  [PRUCAM_CID_AE_MIN_ANA_GAIN] = "ae_min_ana_gain",
+  [PRUCAM_CID_AE_ROI_X_START_OFFSET] = "ae_roi_x_start_offset",
+  [PRUCAM_CID_AE_ROI_Y_START_OFFSET] = "ae_roi_y_start_offset",
+  [PRUCAM_CID_AE_ROI_X_SIZE] = "ae_roi_x_size",
+  [PRUCAM_CID_AE_ROI_Y_SIZE] = "ae_roi_y_size",
+  [PRUCAM_CID_AE_LUMA_TARGET] = "ae_luma_target",
+  [PRUCAM_CID_AE_MIN_EV_STEP] = "ae_min_ev_step",
+  [PRUCAM_CID_AE_MAX_EV_STEP] = "ae_max_ev_step",
+  [PRUCAM_CID_AE_DAMP_OFFSET] = "ae_damp_offset",
+  [PRUCAM_CID_AE_DAMP_GAIN] = "ae_damp_gain",
+  [PRUCAM_CID_AE_DAMP_MAX] = "ae_damp_max",
+  [PRUCAM_CID_AE_MIN_EXPOSURE] = "ae_min_exposure",
+  [PRUCAM_CID_AE_MAX_EXPOSURE] = "ae_max_exposure",
+  [PRUCAM_CID_AE_AG_EXPOSURE_HI] = "ae_ag_exposure_hi",
+  [PRUCAM_CID_AE_AG_EXPOSURE_LO] = "ae_ag_exposure_lo",
+  [PRUCAM_CID_AE_DARK_CUR_THRESH] = "ae_dark_cur_thresh",
+};
+
+// the controls read what the attributes show, and a set is one batch that is
+// checked before anything is written
+static void test_controls(const struct chip *chip, struct device *dev)
+{
+  struct prucam_control all[PRUCAM_CID_COUNT];
+  struct prucam_control set[] = {
+    { PRUCAM_CID_COARSE_TIME, 350 },
+    { PRUCAM_CID_GLOBAL_GAIN, 48 },
+    { PRUCAM_CID_AE_LUMA_TARGET, 1100 },
+  };
+  struct prucam_control bad[] = {
+    { PRUCAM_CID_COARSE_TIME, 400 },
+    { PRUCAM_CID_GREEN1_GAIN, 0x100 },
+  };
+  struct prucam_control balance[] = {
+    { PRUCAM_CID_GLOBAL_GAIN, 40 },
+    { PRUCAM_CID_RED_GAIN, 60 },
+  };
+  struct prucam_control context_b[] = {
+    { PRUCAM_CID_CONTEXT, 1 },
+    { PRUCAM_CID_COARSE_TIME, 500 },
+    { PRUCAM_CID_CONTEXT, 0 },
+  };
+  char buf[PAGE_SIZE];
+  uint32_t error_idx, batch;
+  struct op op;
+  uint16_t val;
+  int r;
+
+  for (unsigned i = 0; i < PRUCAM_CID_COUNT; i++)
+    all[i].id = i;
+  before(&op);
+  r = ar013x_controls_get(all, PRUCAM_CID_COUNT, &error_idx);
+  after(&op);
+  report(chip, "get controls (all)", &op);
+  if (r != 0 || error_idx != PRUCAM_CID_COUNT)
+    FAIL("%s: get controls returned %d at %u", chip->name, r, error_idx);
+  for (unsigned i = 0; r == 0 && i < PRUCAM_CID_COUNT; i++)
+    if (show_attr(dev, control_names[i], buf) <= 0 ||
+        strtol(buf, NULL, 10) != all[i].value)
+      FAIL("%s: control %s is %d, the attribute shows %s", chip->name,
+           control_names[i], all[i].value, buf);
+
+  before(&op);
+  r = ar013x_controls_set(set, ARRAY_SIZE(set), &error_idx, &batch);
+  after(&op);
+  report(chip, "set controls (3 values)", &op);
+  if (r != 0 || batch != ar013x_hold_batch())
+    FAIL("%s: set controls returned %d, batch %u", chip->name, r, batch);
+  // hold, 3 writes, release, frame count
+  if (op.used.transfers != 6)
+    FAIL("%s: set controls made %llu transfers, not 6", chip->name,
+         (unsigned long long)op.used.transfers);
+  if (show_attr(dev, "global_gain", buf) <= 0 || strcmp(buf, "48\n"))
+    FAIL("%s: global_gain is not 48 after set controls", chip->name);
+
+  // the global gain sets the colour gains, a colour gain after it keeps its
+  // own, and the cache doesn't hold on to the old ones
+  r = ar013x_controls_set(balance, ARRAY_SIZE(balance), &error_idx, &batch);
+  if (r != 0 || show_attr(dev, "blue_gain", buf) <= 0 || strcmp(buf, "40\n") ||
+      show_attr(dev, "red_gain", buf) <= 0 || strcmp(buf, "60\n"))
+    FAIL("%s: the colour gains don't follow the global gain", chip->name);
+
+  // the second one is out of range
+  before(&op);
+  r = ar013x_controls_set(bad, ARRAY_SIZE(bad), &error_idx, &batch);
+  after(&op);
+  if (r != -EINVAL || error_idx != 1 || op.used.transfers != 0)
+    FAIL("%s: a bad control returned %d at %u after %llu transfers",
+         chip->name, r, error_idx, (unsigned long long)op.used.transfers);
+
+  // the controls after a context switch are those of the new context
+  r = ar013x_controls_set(context_b, ARRAY_SIZE(context_b), &error_idx,
+                          &batch);
+  if (r != 0 ||
+      read_cam_reg(AR013X_AD_COARSE_INTEGRATION_TIME_CB, &val) != 0 ||
+      val != 500)
+    FAIL("%s: coarse_time in context B did not go to its register",
+         chip->name);
+
+  // while claimed, e.g. by a bracket, only the claimer sets them
+  if (ar013x_controls_claim() != 0)
+    FAIL("%s: the controls can't be claimed", chip->name);
+  if (ar013x_controls_claim() != -EBUSY ||
+      ar013x_controls_set(set, ARRAY_SIZE(set), &error_idx, &batch) !=
+          -EBUSY ||
+      store(dev, &dev_attr_coarse_time.attr, "200\n", &op) != -EBUSY ||
+      store(dev, &dev_attr_settings, "coarse_time=200\n", &op) != -EBUSY ||
+      store(dev, &dev_attr_ae_enable.attr, "1\n", &op) != -EBUSY)
+    FAIL("%s: the controls were set while claimed", chip->name);
+  if (ar013x_controls_set_claimed(set, ARRAY_SIZE(set), &error_idx,
+                                  &batch) != 0)
+    FAIL("%s: the claimer can't set the controls", chip->name);
+  ar013x_controls_release();
+
+  // nor while the sensor's auto exposure is on
+  ar013x_control_set(PRUCAM_CID_AE_ENABLE, 1);
+  if (ar013x_controls_claim() != -EBUSY)
+    FAIL("%s: the controls were claimed with auto exposure on", chip->name);
+  ar013x_control_set(PRUCAM_CID_AE_ENABLE, 0);
+  // the digital test register is cached again, like the other tests expect
+  read_cam_reg(AR013X_AD_DIGITAL_TEST, &val);
+}
+
+// with a pattern, every frame switches the sensor to the context of the frame
+// the switch is first exposed on, with one write when the context changes
+static void test_context(const struct chip *chip, struct device *dev)
+{
+  struct prucam_control one[] = {
+    { PRUCAM_CID_COARSE_TIME, 200 },
+  };
+  struct prucam_control both[] = {
+    { PRUCAM_CID_CONTEXT, 0 },
+    { PRUCAM_CID_COARSE_TIME, 100 },
+    { PRUCAM_CID_CONTEXT, 1 },
+    { PRUCAM_CID_COARSE_TIME, 800 },
+  };
+  char buf[PAGE_SIZE];
+  struct op op;
+  uint16_t fc, digital_test, context, val, a, b;
+  uint32_t error_idx, batch;
+  ssize_t r;
+
+  r = store(dev, &dev_attr_context_pattern, "AAB\n", &op);
+  if (r != 4 || show(dev, &dev_attr_context_pattern, buf, &op) != 4 ||
+      strcmp(buf, "AAB\n"))
+    FAIL("%s: context_pattern AAB returned %zd and reads back %s", chip->name,
+         r, buf);
+
+  for (fc = 300; fc < 306; fc++) {
+    uint16_t next = fc + 1 + ar013x_hold_latency();
+
+    ar013x_virt_write(AR013X_AD_FRAME_COUNT, fc);
+    before(&op);
+    ar013x_context_frame_done();
+    after(&op);
+    if (fc == 300)
+      report(chip, "context switch", &op);
+
+    ar013x_virt_read(AR013X_AD_DIGITAL_TEST, &digital_test);
+    if (ar013x_context_of(next, &context) != 0 ||
+        !!(digital_test & 0x2000) != context || context != (next % 3 == 2))
+      FAIL("%s: frame %u is in context %d, not %d", chip->name, next,
+           !!(digital_test & 0x2000), next % 3 == 2);
+    // a frame count read, and a write when the context changes
+    if (op.used.transfers > 2)
+      FAIL("%s: a context switch made %llu transfers", chip->name,
+           (unsigned long long)op.used.transfers);
+  }
+
+  if (store(dev, &dev_attr_context_pattern, "ABC\n", &op) != -EINVAL)
+    FAIL("%s: context_pattern took ABC", chip->name);
+
+  // while alternating, a context control only goes to the context picked for
+  // it, and never switches the sensor
+  // each batch gets frames of its own, as in test_batch()
+  ar013x_virt_write(AR013X_AD_FRAME_COUNT, 100 + 10 * ar013x_hold_batch());
+  ar013x_virt_read(AR013X_AD_DIGITAL_TEST, &digital_test);
+  if (store(dev, &dev_attr_coarse_time.attr, "200\n", &op) != -EBUSY ||
+      store(dev, &dev_attr_context.attr, "0\n", &op) != -EBUSY ||
+      ar013x_controls_set(one, ARRAY_SIZE(one), &error_idx, &batch) !=
+          -EBUSY || error_idx != 0)
+    FAIL("%s: a context control was set with no context while alternating",
+         chip->name);
+  r = ar013x_controls_set(both, ARRAY_SIZE(both), &error_idx, &batch);
+  if (r != 0 ||
+      ar013x_virt_read(AR013X_AD_COARSE_INTEGRATION_TIME, &a) < 0 ||
+      ar013x_virt_read(AR013X_AD_COARSE_INTEGRATION_TIME_CB, &b) < 0 ||
+      a != 100 || b != 800)
+    FAIL("%s: setting both contexts while alternating returned %zd, A %u and "
+         "B %u", chip->name, r, a, b);
+  r = store(dev, &dev_attr_settings, "context=1\ncoarse_time=700\n", &op);
+  if (r < 0 ||
+      ar013x_virt_read(AR013X_AD_COARSE_INTEGRATION_TIME_CB, &b) < 0 ||
+      b != 700)
+    FAIL("%s: settings of context B while alternating returned %zd, B %u",
+         chip->name, r, b);
+  ar013x_virt_read(AR013X_AD_DIGITAL_TEST, &val);
+  if ((val ^ digital_test) & 0x2000)
+    FAIL("%s: setting the contexts while alternating switched the sensor",
+         chip->name);
+
+  // stopping leaves the sensor where it is
+  store(dev, &dev_attr_context_pattern, "\n", &op);
+  before(&op);
+  ar013x_context_frame_done();
+  after(&op);
+  if (op.used.transfers != 0 || ar013x_context_of(0, &context) != -ENODATA)
+    FAIL("%s: a stopped pattern still switches", chip->name);
+  update_cam_reg(AR013X_AD_DIGITAL_TEST, 0x2000, 0);
+}
+
+static void test_nak(const struct chip *chip)
+{
+  uint16_t val;
+  int r;
+
+  // the sensor has no registers below 0x3000
+  if ((r = read_cam_reg(0x2000, &val)) != -EREMOTEIO)
+    FAIL("%s: reading a missing register returned %d", chip->name, r);
+  if ((r = write_cam_reg(0x2000, 0)) != -EREMOTEIO)
+    FAIL("%s: writing a missing register returned %d", chip->name, r);
+  if ((r = init_camera_regs(NULL)) != 0)
+    FAIL("%s: init_camera_regs(NULL) returned %d", chip->name, r);
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-k khz] [-o us] [-c chip] [-j] [-v]\n"
+          "  -k khz   I2C clock (default: 100)\n"
+          "  -o us    adapter overhead per transfer (default: 0)\n"
+          "  -c chip  only test ar0130 or ar0134\n"
+          "  -j       print the operations as JSON lines\n"
+          "  -v       print the driver's log\n",
+          prog);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *only = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "k:o:c:jvh")) != -1) {
+    switch (opt) {
+    case 'k':
+      i2c_emu_scl_hz = strtoul(optarg, NULL, 10) * 1000;
+      break;
+    case 'o':
+      i2c_emu_overhead_ns = strtoull(optarg, NULL, 10) * 1000;
+      break;
+    case 'c':
+      only = optarg;
+      break;
+    case 'j':
+      json = 1;
+      break;
+    case 'v':
+      kshim_verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (i2c_emu_scl_hz == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  test_probe();
+
+  for (unsigned i = 0; i < ARRAY_SIZE(chips); i++) {
+    const struct chip *chip = &chips[i];
+    struct device_node node = { .i2c_bus = i2c_emu_bus,
+                                .i2c_addr = i2c_emu_addr };
+    struct device dev = { .of_node = &node };
+
+    if (only && strcasecmp(only, chip->name) != 0)
+      continue;
+
+    // before and after bursts
+    test_bring_up(chip, &dev, 1);
+    end_cam_i2c();
+    test_bring_up(chip, &dev, CAM_I2C_BURST_MAX);
+    report_header();
+    test_sysfs(chip, &dev);
+    test_settings(chip, &dev);
+    test_frame_period(chip);
+    test_cache(chip, &dev);
+    test_batch(chip, &dev);
+    test_controls(chip, &dev);
+    test_context(chip, &dev);
+    test_nak(chip);
+    end_cam_i2c();
+    if (!json)
+      printf("\n");
+  }
+
+  if (failures) {
+    fprintf(stderr, "%u failures\n", failures);
+    return 1;
+  }
+  if (!json)
+    printf("PASS\n");
+  return 0;
+}
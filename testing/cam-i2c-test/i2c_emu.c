@@ -0,0 +1,228 @@
+/*
+ * i2c_emu: an emulated I2C adapter with an AR013x on it, for cam_i2c.c.
+ */
+
+#include "kshim.h"
+
+#include "ar013x_regs.h"
+#include "ar013x_virt.h"
+#include "i2c_emu.h"
+
+bool kshim_verbose;
+
+int i2c_emu_bus = 2;
+int i2c_emu_addr = 0x10;
+unsigned i2c_emu_scl_hz = 100000;
+uint64_t i2c_emu_overhead_ns;
+
+static struct i2c_emu_counts counts;
+static uint64_t clock_ns;
+
+static struct i2c_adapter adapter;
+static struct i2c_client clients[4];
+static int adapter_refs;
+
+// the sensor's register address pointer
+static u16 reg_ptr;
+// read only, ar013x_virt.c has it as a module param
+static u16 chip_version;
+// the sequencer RAM, written through the data port
+static u16 seq_ram[512];
+static unsigned seq_len;
+
+void i2c_emu_power_on(uint16_t version)
+{
+  ar013x_virt_init();
+  chip_version = version;
+  reg_ptr = 0;
+  seq_len = 0;
+}
+
+unsigned i2c_emu_seq_ram(uint16_t *words, unsigned max)
+{
+  unsigned n = seq_len < max ? seq_len : max;
+
+  memcpy(words, seq_ram, n * sizeof(*words));
+  return n;
+}
+
+// the data port keeps its address for the next word of a burst
+static u16 next_reg(u16 reg)
+{
+  return reg == AR013X_AD_SEQ_DATA_PORT ? reg : reg + 2;
+}
+
+static int sensor_write(u16 reg, u16 val)
+{
+  if (reg == AR013X_AD_SEQ_CTRL_PORT && val == 0x8000)
+    seq_len = 0;
+  if (reg == AR013X_AD_SEQ_DATA_PORT) {
+    if (seq_len == ARRAY_SIZE(seq_ram))
+      return -EREMOTEIO;
+    seq_ram[seq_len++] = val;
+  }
+  return ar013x_virt_write(reg, val);
+}
+
+void i2c_emu_get(struct i2c_emu_counts *c)
+{
+  *c = counts;
+}
+
+void i2c_emu_reset(void)
+{
+  memset(&counts, 0, sizeof(counts));
+}
+
+u64 ktime_get_ns(void)
+{
+  return clock_ns;
+}
+
+void mdelay(unsigned long ms)
+{
+  counts.delay_ns += ms * 1000000ULL;
+  clock_ns += ms * 1000000ULL;
+}
+
+int of_property_read_u32(const struct device_node *np, const char *name,
+                         u32 *out)
+{
+  int v = -1;
+
+  if (!np)
+    return -EINVAL;
+  if (strcmp(name, "psas,i2c-bus") == 0)
+    v = np->i2c_bus;
+  else if (strcmp(name, "psas,i2c-addr") == 0)
+    v = np->i2c_addr;
+  if (v < 0)
+    return -EINVAL;
+
+  *out = v;
+  return 0;
+}
+
+struct i2c_adapter *i2c_get_adapter(int nr)
+{
+  if (nr != i2c_emu_bus)
+    return NULL;
+
+  adapter.nr = nr;
+  adapter_refs++;
+  return &adapter;
+}
+
+void i2c_put_adapter(struct i2c_adapter *adap)
+{
+  if (adap) {
+    if (adapter_refs == 0)
+      fprintf(stderr, "i2c_emu: adapter put more than it was got\n");
+    else
+      adapter_refs--;
+  }
+}
+
+struct i2c_client *i2c_new_client_device(struct i2c_adapter *adap,
+                                         const struct i2c_board_info *info)
+{
+  for (unsigned i = 0; i < ARRAY_SIZE(clients); i++) {
+    if (!clients[i].adapter) {
+      clients[i].adapter = adap;
+      clients[i].addr = info->addr;
+      return &clients[i];
+    }
+  }
+  return (struct i2c_client *)(long)-EBUSY;
+}
+
+void i2c_unregister_device(struct i2c_client *client)
+{
+  if (!IS_ERR_OR_NULL(client))
+    client->adapter = NULL;
+}
+
+// bits on the bus for a message: (repeated) START, the address byte and the
+// data bytes, each with its ACK bit
+static uint64_t msg_bits(unsigned len)
+{
+  return 1 + 9 * (1 + (uint64_t)len);
+}
+
+// the sensor's side of one message, 0 or -EREMOTEIO for a NAK
+static int sensor_msg(struct i2c_msg *msg)
+{
+  unsigned i = 0;
+  u16 val;
+
+  if (msg->flags & I2C_M_RD) {
+    for (; i + 1 < msg->len; i += 2, reg_ptr = next_reg(reg_ptr)) {
+      if (reg_ptr == AR013X_AD_CHIP_VERSION_REG)
+        val = chip_version;
+      else if (ar013x_virt_read(reg_ptr, &val) < 0)
+        return -EREMOTEIO;
+      msg->buf[i] = val >> 8;
+      msg->buf[i + 1] = val;
+    }
+    return 0;
+  }
+
+  if (msg->len < 2)
+    return -EREMOTEIO;
+  reg_ptr = msg->buf[0] << 8 | msg->buf[1];
+
+  for (i = 2; i + 1 < msg->len; i += 2, reg_ptr = next_reg(reg_ptr)) {
+    val = msg->buf[i] << 8 | msg->buf[i + 1];
+    if (sensor_write(reg_ptr, val) < 0)
+      return -EREMOTEIO;
+  }
+  return 0;
+}
+
+int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+  uint64_t bits = 1;  // STOP
+  int ret = num;
+
+  if (adap != &adapter || adapter_refs == 0)
+    return -ENODEV;
+
+  counts.transfers++;
+  for (int i = 0; i < num; i++) {
+    counts.msgs++;
+    if (msgs[i].addr != i2c_emu_addr) {
+      // nobody acknowledges the address, the adapter stops there
+      bits += msg_bits(0);
+      ret = -ENXIO;
+      break;
+    }
+    bits += msg_bits(msgs[i].len);
+    counts.bytes += msgs[i].len;
+    if (sensor_msg(&msgs[i]) < 0) {
+      ret = -EREMOTEIO;
+      break;
+    }
+  }
+  if (ret < 0)
+    counts.naks++;
+
+  uint64_t ns = bits * 1000000000ULL / i2c_emu_scl_hz + i2c_emu_overhead_ns;
+  counts.bus_ns += ns;
+  clock_ns += ns;
+
+  return ret;
+}
+
+int i2c_master_send(const struct i2c_client *client, const char *buf,
+                    int count)
+{
+  struct i2c_msg msg = {
+    .addr = client->addr,
+    .flags = 0,
+    .len = count,
+    .buf = (u8 *)buf,
+  };
+  int ret = i2c_transfer(client->adapter, &msg, 1);
+
+  return ret < 0 ? ret : count;
+}
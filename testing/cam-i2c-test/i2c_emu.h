@@ -0,0 +1,58 @@
+/*
+ * i2c_emu: an emulated I2C adapter with an AR013x on it, for cam_i2c.c.
+ *
+ * The sensor decodes the bytes on the wire like the AR013x does: the first
+ * two bytes written after its address are the register address, and each
+ * two bytes written or read after that are a register, the address going up
+ * by 2 after each one. The sequencer data port keeps its address, and what is
+ * written to it is kept as the sequencer RAM. The other registers are the
+ * ones of ar013x_virt.c.
+ *
+ * Every transfer is counted, and the time it would take on the bus is added
+ * to the clock ktime_get_ns() returns, so the driver's own I2C timings come
+ * out in bus time.
+ */
+
+#ifndef I2C_EMU_H
+#define I2C_EMU_H
+
+#include <stdint.h>
+
+/** the traffic on the emulated bus */
+struct i2c_emu_counts {
+  uint64_t transfers;  // i2c_transfer() and i2c_master_send() calls
+  uint64_t msgs;       // messages, a read is a write and a read message
+  uint64_t bytes;      // bytes after the address bytes
+  uint64_t naks;       // transfers the sensor or nobody acknowledged
+  uint64_t bus_ns;     // time on the bus, with the per transfer overhead
+  uint64_t delay_ns;   // time in mdelay()
+};
+
+/** the adapter number and address the sensor is at */
+extern int i2c_emu_bus;
+extern int i2c_emu_addr;
+/** SCL frequency in Hz */
+extern unsigned i2c_emu_scl_hz;
+/** time the adapter driver takes to set up and finish each transfer */
+extern uint64_t i2c_emu_overhead_ns;
+
+/**
+ * Powers the sensor up: its registers are reset and it reports the chip
+ * version, 0x2402 for an AR0130 or 0x2406 for an AR0134.
+ */
+void i2c_emu_power_on(uint16_t chip_version);
+
+/**
+ * Gets what was written to the sequencer data port since the last 0x8000
+ * written to the sequencer control port.
+ * @return the number of words, up to max
+ */
+unsigned i2c_emu_seq_ram(uint16_t *words, unsigned max);
+
+/** Gets the traffic since the last reset */
+void i2c_emu_get(struct i2c_emu_counts *counts);
+
+/** Zeroes the traffic counters, the clock keeps going */
+void i2c_emu_reset(void);
+
+#endif /* I2C_EMU_H */
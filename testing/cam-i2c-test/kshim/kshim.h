@@ -0,0 +1,270 @@
+/*
+ * kshim.h: just enough of the kernel API to build the driver's register code
+ * (cam_i2c.c, ar013x_sysfs.c, ar013x_timing.c, ar013x_virt.c, ar013x_hold.c,
+ * ar013x_controls.c, ar013x_context.c) as a userspace program. Every <linux/...> header the driver includes is a
+ * copy of this one.
+ *
+ * The I2C adapter, ktime_get_ns() and mdelay() are implemented by the
+ * emulator in i2c_emu.c, and regmap by regmap.c.
+ */
+
+#ifndef KSHIM_H
+#define KSHIM_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef int16_t s16;
+typedef int32_t s32;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint16_t __be16;
+typedef unsigned short umode_t;
+
+/* uapi types, for prucam_uapi.h */
+typedef uint8_t __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef int32_t __s32;
+typedef uint64_t __u64;
+#define _IO(type, nr)         (((type) << 8) | (nr))
+#define _IOR(type, nr, size)  _IO(type, nr)
+#define _IOWR(type, nr, size) _IO(type, nr)
+
+#define U32_MAX       UINT32_MAX
+#define USEC_PER_SEC  1000000UL
+#define NSEC_PER_USEC 1000UL
+#define PAGE_SIZE     4096
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member)                                        \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp_t(t, v, lo, hi) min_t(t, max_t(t, v, lo), hi)
+
+#define __ffs(x) ((unsigned long)__builtin_ctzl(x))
+
+static inline u64 div_u64(u64 a, u32 b) { return a / b; }
+static inline u64 div64_u64(u64 a, u64 b) { return a / b; }
+
+#define cpu_to_be16(x) htons(x)
+#define be16_to_cpu(x) ntohs(x)
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE      KERNEL_VERSION(6, 1, 0)
+
+#define KERN_ERR  ""
+#define KERN_INFO ""
+
+/* the driver's log, printed with -v */
+extern bool kshim_verbose;
+#define printk(fmt, ...)                                                       \
+    do {                                                                       \
+        if (kshim_verbose)                                                     \
+            fprintf(stderr, "  [kernel] " fmt "\n", ##__VA_ARGS__);            \
+    } while (0)
+#define dev_err(dev, fmt, ...) printk(fmt, ##__VA_ARGS__)
+#define printk_ratelimited printk
+
+/* the tests set a param through kshim_param_<name> */
+#define module_param(name, type, perm) void *kshim_param_##name = &name
+#define MODULE_PARM_DESC(name, desc)
+
+/* single threaded, the locks only have to compile */
+typedef int spinlock_t;
+#define DEFINE_SPINLOCK(x) spinlock_t x
+#define spin_lock(l)       ((void)(l))
+#define spin_unlock(l)     ((void)(l))
+struct mutex {
+    int unused;
+};
+#define DEFINE_MUTEX(x) struct mutex x
+#define mutex_lock(m)   ((void)(m))
+#define mutex_unlock(m) ((void)(m))
+typedef struct {
+    int counter;
+} atomic_t;
+#define ATOMIC_INIT(i)   {(i)}
+#define atomic_inc(a)    ((a)->counter++)
+#define atomic_read(a)   ((a)->counter)
+#define atomic_set(a, i) ((a)->counter = (i))
+
+#define READ_ONCE(x)     (x)
+#define WRITE_ONCE(x, v) ((x) = (v))
+
+/* work runs as soon as it is scheduled */
+struct work_struct {
+    void (*func)(struct work_struct *work);
+};
+#define DECLARE_WORK(n, f) struct work_struct n = {f}
+static inline bool schedule_work(struct work_struct *work)
+{
+    work->func(work);
+    return true;
+}
+static inline bool cancel_work_sync(struct work_struct *work)
+{
+    return false;
+}
+
+#define IS_ERR(p)         ((unsigned long)(p) >= (unsigned long)-4095)
+#define IS_ERR_OR_NULL(p) (!(p) || IS_ERR(p))
+#define ERR_PTR(e)        ((void *)(long)(e))
+#define PTR_ERR(p)        ((long)(p))
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (size == 0)
+        return 0;
+    va_start(ap, fmt);
+    n = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n < (int)size ? n : (int)size - 1;
+}
+
+static inline int kstrtoint(const char *s, unsigned int base, int *res)
+{
+    char *end;
+    long v;
+
+    errno = 0;
+    v     = strtol(s, &end, base);
+    if (end == s || errno || v < INT32_MIN || v > INT32_MAX)
+        return -EINVAL;
+    if (*end == '\n')
+        end++;
+    if (*end)
+        return -EINVAL;
+    *res = (int)v;
+    return 0;
+}
+
+/* of */
+struct device_node {
+    /** psas,i2c-bus and psas,i2c-addr, <0 when not set */
+    int i2c_bus;
+    int i2c_addr;
+};
+int of_property_read_u32(const struct device_node *np, const char *name,
+                         u32 *out);
+
+/* sysfs */
+struct device {
+    struct device_node *of_node;
+};
+struct attribute {
+    const char *name;
+    umode_t mode;
+};
+struct device_attribute {
+    struct attribute attr;
+    ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+                    char *buf);
+    ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+                     const char *buf, size_t count);
+};
+struct attribute_group {
+    const char *name;
+    struct attribute **attrs;
+};
+#define S_IRUGO 0444
+#define S_IWUSR 0200
+#define __ATTR(_name, _mode, _show, _store)                                    \
+    {{#_name, _mode}, _show, _store}
+#define DEVICE_ATTR(_name, _mode, _show, _store)                               \
+    struct device_attribute dev_attr_##_name =                                 \
+        __ATTR(_name, _mode, _show, _store)
+
+/* i2c */
+#define I2C_M_RD           0x0001
+#define I2C_M_REV_DIR_ADDR 0x2000
+struct i2c_adapter {
+    int nr;
+};
+struct i2c_client {
+    unsigned short addr;
+    struct i2c_adapter *adapter;
+};
+struct i2c_board_info {
+    char type[20];
+    unsigned short addr;
+};
+#define I2C_BOARD_INFO(dev_type, dev_addr) .type = dev_type, .addr = (dev_addr)
+struct i2c_msg {
+    u16 addr;
+    u16 flags;
+    u16 len;
+    u8 *buf;
+};
+struct i2c_adapter *i2c_get_adapter(int nr);
+void i2c_put_adapter(struct i2c_adapter *adap);
+struct i2c_client *i2c_new_client_device(struct i2c_adapter *adap,
+                                         const struct i2c_board_info *info);
+void i2c_unregister_device(struct i2c_client *client);
+int i2c_master_send(const struct i2c_client *client, const char *buf,
+                    int count);
+int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num);
+
+/* regmap, only what a big endian bus with 16 bit registers and values needs */
+enum regcache_type { REGCACHE_NONE, REGCACHE_RBTREE, REGCACHE_FLAT };
+enum regmap_endian { REGMAP_ENDIAN_DEFAULT, REGMAP_ENDIAN_BIG };
+struct regmap;
+struct regmap_bus {
+    int (*write)(void *context, const void *data, size_t count);
+    int (*read)(void *context, const void *reg_buf, size_t reg_size,
+                void *val_buf, size_t val_size);
+    enum regmap_endian reg_format_endian_default;
+    enum regmap_endian val_format_endian_default;
+    size_t max_raw_read;
+    size_t max_raw_write;
+};
+struct regmap_config {
+    const char *name;
+    int reg_bits;
+    int reg_stride;
+    int val_bits;
+    unsigned int max_register;
+    bool (*volatile_reg)(struct device *dev, unsigned int reg);
+    bool (*writeable_noinc_reg)(struct device *dev, unsigned int reg);
+    enum regcache_type cache_type;
+};
+struct regmap *regmap_init(struct device *dev, const struct regmap_bus *bus,
+                           void *bus_context,
+                           const struct regmap_config *config);
+void regmap_exit(struct regmap *map);
+int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val);
+int regmap_write(struct regmap *map, unsigned int reg, unsigned int val);
+int regmap_bulk_read(struct regmap *map, unsigned int reg, void *val,
+                     size_t val_count);
+int regmap_raw_read(struct regmap *map, unsigned int reg, void *val,
+                    size_t val_len);
+int regmap_bulk_write(struct regmap *map, unsigned int reg, const void *val,
+                      size_t val_count);
+int regmap_noinc_write(struct regmap *map, unsigned int reg, const void *val,
+                       size_t val_len);
+int regmap_update_bits(struct regmap *map, unsigned int reg,
+                       unsigned int mask, unsigned int val);
+int regcache_drop_region(struct regmap *map, unsigned int min,
+                         unsigned int max);
+void regcache_cache_bypass(struct regmap *map, bool enable);
+void regcache_cache_only(struct regmap *map, bool enable);
+
+/* time */
+u64 ktime_get_ns(void);
+void mdelay(unsigned long ms);
+
+#endif /* KSHIM_H */
@@ -0,0 +1,3 @@
+/* libc's <errno.h> includes this one, pass it on to the real one */
+#include_next <linux/errno.h>
+#include "../kshim.h"
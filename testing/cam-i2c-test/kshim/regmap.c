@@ -0,0 +1,302 @@
+/*
+ * regmap.c: a model of the kernel's regmap, for the bus and config cam_i2c.c
+ * uses: 16 bit big endian registers and values, raw bus reads and writes,
+ * and a register cache.
+ *
+ * It follows drivers/base/regmap: writes go to the cache before the bus,
+ * even when the bus write fails, volatile registers are never cached,
+ * regmap_bulk_read() and regmap_raw_read() read raw only when every register
+ * in the range is volatile or the cache is bypassed, and go register by
+ * register otherwise, regmap_bulk_write() and regmap_noinc_write() split the
+ * values at max_raw_write bytes, regmap_update_bits() only writes when the
+ * value changes, and writes only go to the cache while it is cache only.
+ *
+ * It is a hand-written model of those rules, not the kernel's code, so a test
+ * passing here doesn't prove regmap behaves the same.
+ */
+
+#include "kshim.h"
+
+struct regmap {
+    struct device *dev;
+    const struct regmap_bus *bus;
+    void *context;
+    struct regmap_config config;
+    /* indexed by reg / reg_stride */
+    u16 *cache;
+    bool *cached;
+    bool cache_bypass;
+    bool cache_only;
+};
+
+static bool is_volatile(struct regmap *map, unsigned int reg)
+{
+    if (map->config.cache_type == REGCACHE_NONE)
+        return true;
+    return map->config.volatile_reg && map->config.volatile_reg(map->dev, reg);
+}
+
+static int check_reg(struct regmap *map, unsigned int reg)
+{
+    if (reg % map->config.reg_stride)
+        return -EINVAL;
+    if (reg > map->config.max_register)
+        return -EIO;
+    return 0;
+}
+
+static void cache_write(struct regmap *map, unsigned int reg, u16 val)
+{
+    if (map->cache_bypass || is_volatile(map, reg))
+        return;
+    map->cache[reg / map->config.reg_stride] = val;
+    map->cached[reg / map->config.reg_stride] = true;
+}
+
+struct regmap *regmap_init(struct device *dev, const struct regmap_bus *bus,
+                           void *bus_context,
+                           const struct regmap_config *config)
+{
+    struct regmap *map;
+    size_t n;
+
+    if (config->reg_bits != 16 || config->val_bits != 16
+        || config->reg_stride < 1)
+        return ERR_PTR(-EINVAL);
+
+    map = calloc(1, sizeof(*map));
+    if (!map)
+        return ERR_PTR(-ENOMEM);
+    n = config->max_register / config->reg_stride + 1;
+    map->dev = dev;
+    map->bus = bus;
+    map->context = bus_context;
+    map->config = *config;
+    map->cache = calloc(n, sizeof(*map->cache));
+    map->cached = calloc(n, sizeof(*map->cached));
+    if (!map->cache || !map->cached) {
+        regmap_exit(map);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    return map;
+}
+
+void regmap_exit(struct regmap *map)
+{
+    if (IS_ERR_OR_NULL(map))
+        return;
+    free(map->cache);
+    free(map->cached);
+    free(map);
+}
+
+/* one bus write of the register and count values, already big endian */
+static int raw_write(struct regmap *map, unsigned int reg, const u8 *vals,
+                     size_t len)
+{
+    u8 buf[2 + len];
+
+    buf[0] = reg >> 8;
+    buf[1] = reg;
+    memcpy(buf + 2, vals, len);
+    return map->bus->write(map->context, buf, sizeof(buf));
+}
+
+static int raw_read(struct regmap *map, unsigned int reg, u8 *vals,
+                    size_t len)
+{
+    u8 reg_buf[2] = { reg >> 8, reg };
+
+    return map->bus->read(map->context, reg_buf, 2, vals, len);
+}
+
+int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val)
+{
+    u8 buf[2];
+    int r;
+
+    if ((r = check_reg(map, reg)) < 0)
+        return r;
+
+    if (!map->cache_bypass && !is_volatile(map, reg)
+        && map->cached[reg / map->config.reg_stride]) {
+        *val = map->cache[reg / map->config.reg_stride];
+        return 0;
+    }
+
+    if ((r = raw_read(map, reg, buf, 2)) < 0)
+        return r;
+    *val = (buf[0] << 8) | buf[1];
+    cache_write(map, reg, *val);
+    return 0;
+}
+
+int regmap_write(struct regmap *map, unsigned int reg, unsigned int val)
+{
+    u8 buf[2] = { val >> 8, val };
+    int r;
+
+    if ((r = check_reg(map, reg)) < 0)
+        return r;
+
+    cache_write(map, reg, val);
+    if (map->cache_only && !map->cache_bypass)
+        return 0;
+    return raw_write(map, reg, buf, 2);
+}
+
+int regmap_bulk_read(struct regmap *map, unsigned int reg, void *val,
+                     size_t val_count)
+{
+    unsigned int stride = map->config.reg_stride;
+    size_t max = map->bus->max_raw_read / 2;
+    u16 *vals = val;
+    bool vol = true;
+    unsigned int v;
+    int r;
+
+    if ((r = check_reg(map, reg)) < 0
+        || (r = check_reg(map, reg + (val_count - 1) * stride)) < 0)
+        return r;
+
+    for (size_t i = 0; i < val_count; i++)
+        vol = vol && is_volatile(map, reg + i * stride);
+
+    if (!vol && !map->cache_bypass) {
+        for (size_t i = 0; i < val_count; i++) {
+            if ((r = regmap_read(map, reg + i * stride, &v)) < 0)
+                return r;
+            vals[i] = v;
+        }
+        return 0;
+    }
+
+    for (size_t i = 0; i < val_count; i += max) {
+        size_t n = val_count - i < max ? val_count - i : max;
+        u8 buf[2 * n];
+
+        if ((r = raw_read(map, reg + i * stride, buf, 2 * n)) < 0)
+            return r;
+        for (size_t j = 0; j < n; j++)
+            vals[i + j] = (buf[2 * j] << 8) | buf[2 * j + 1];
+    }
+
+    return 0;
+}
+
+int regmap_raw_read(struct regmap *map, unsigned int reg, void *val,
+                    size_t val_len)
+{
+    u16 vals[val_len / 2];
+    u8 *buf = val;
+    int r;
+
+    if (val_len == 0 || val_len % 2)
+        return -EINVAL;
+
+    // the same reads as a bulk read, but the values stay big endian
+    if ((r = regmap_bulk_read(map, reg, vals, val_len / 2)) < 0)
+        return r;
+    for (size_t i = 0; i < val_len / 2; i++) {
+        buf[2 * i] = vals[i] >> 8;
+        buf[2 * i + 1] = vals[i];
+    }
+
+    return 0;
+}
+
+int regmap_bulk_write(struct regmap *map, unsigned int reg, const void *val,
+                      size_t val_count)
+{
+    unsigned int stride = map->config.reg_stride;
+    size_t max = map->bus->max_raw_write / 2;
+    const u16 *vals = val;
+    int r;
+
+    if ((r = check_reg(map, reg)) < 0
+        || (r = check_reg(map, reg + (val_count - 1) * stride)) < 0)
+        return r;
+
+    for (size_t i = 0; i < val_count; i++)
+        cache_write(map, reg + i * stride, vals[i]);
+    if (map->cache_only && !map->cache_bypass)
+        return 0;
+
+    for (size_t i = 0; i < val_count; i += max) {
+        size_t n = val_count - i < max ? val_count - i : max;
+        u8 buf[2 * n];
+
+        for (size_t j = 0; j < n; j++) {
+            buf[2 * j] = vals[i + j] >> 8;
+            buf[2 * j + 1] = vals[i + j];
+        }
+        if ((r = raw_write(map, reg + i * stride, buf, 2 * n)) < 0)
+            return r;
+    }
+
+    return 0;
+}
+
+int regmap_noinc_write(struct regmap *map, unsigned int reg, const void *val,
+                       size_t val_len)
+{
+    size_t max = map->bus->max_raw_write;
+    const u8 *buf = val;
+    int r;
+
+    if ((r = check_reg(map, reg)) < 0)
+        return r;
+    if (!map->config.writeable_noinc_reg
+        || !map->config.writeable_noinc_reg(map->dev, reg))
+        return -EINVAL;
+    if (val_len == 0 || val_len % 2)
+        return -EINVAL;
+
+    for (size_t i = 0; i < val_len; i += max) {
+        size_t n = val_len - i < max ? val_len - i : max;
+
+        if ((r = raw_write(map, reg, buf + i, n)) < 0)
+            return r;
+    }
+
+    return 0;
+}
+
+int regmap_update_bits(struct regmap *map, unsigned int reg,
+                       unsigned int mask, unsigned int val)
+{
+    unsigned int orig, tmp;
+    int r;
+
+    if ((r = regmap_read(map, reg, &orig)) < 0)
+        return r;
+
+    tmp = (orig & ~mask) | (val & mask);
+    if (tmp == orig)
+        return 0;
+
+    return regmap_write(map, reg, tmp);
+}
+
+int regcache_drop_region(struct regmap *map, unsigned int min,
+                         unsigned int max)
+{
+    unsigned int stride = map->config.reg_stride;
+
+    for (unsigned int reg = min; reg <= max && reg <= map->config.max_register;
+         reg += stride)
+        map->cached[reg / stride] = false;
+
+    return 0;
+}
+
+void regcache_cache_bypass(struct regmap *map, bool enable)
+{
+    map->cache_bypass = enable;
+}
+
+void regcache_cache_only(struct regmap *map, bool enable)
+{
+    map->cache_only = enable;
+}
@@ -5,7 +5,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <time.h>
 #include "qdbmp.h"
 
 #define ROWS 960
@@ -15,7 +15,7 @@
 int main(){
   int ret, fd;
 
-  struct timeval before, after;
+  struct timespec before, after;
 
   printf("Starting device test code example...\n");
   fd = open("/dev/prucam", O_RDONLY|O_LARGEFILE|O_CLOEXEC);             // Open the device with read/write access
@@ -27,7 +27,7 @@ int main(){
 
   char buf[PIXELS];
 
-  gettimeofday(&before , NULL);
+  clock_gettime(CLOCK_MONOTONIC, &before);
 
   printf("Reading from the device...\n");
   ret = read(fd, buf, PIXELS);        // Read the response from the LKM
@@ -36,12 +36,11 @@ int main(){
     return errno;
   }
 
-  gettimeofday(&after , NULL);
+  clock_gettime(CLOCK_MONOTONIC, &after);
 
-  long uSecs = after.tv_usec - before.tv_usec;
-
-  if(uSecs < 0) //occaisionally this number is 1000000 off??
-    uSecs += 1000000;
+  // the whole seconds too, a capture that times out takes longer than one
+  long uSecs = (after.tv_sec - before.tv_sec) * 1000000 +
+               (after.tv_nsec - before.tv_nsec) / 1000;
 
   printf("Elapsed time: %ld uSec\n", uSecs);
 
@@ -0,0 +1,287 @@
+/*
+ * hdr-merge: captures an exposure bracket from /dev/prucam, or reads raw
+ * frames from files, and merges them into one PGM with hdr_merge.
+ *
+ * The bracket is taken around the current integration time, a step of -s
+ * stops apart, with the gains left as they are. Raw files are 8-bit frames of
+ * PRUCAM_ROWS by PRUCAM_COLS, given as FILE:EXPOSURE, and are read a row at a
+ * time as they are merged.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdr_merge.h"
+#include "prucam_uapi.h"
+
+#define PIXELS (PRUCAM_ROWS * PRUCAM_COLS)
+
+static uint8_t *frames[HDR_MERGE_MAX_FRAMES];
+static FILE *files[HDR_MERGE_MAX_FRAMES];
+static double exposures[HDR_MERGE_MAX_FRAMES];
+static unsigned nframes;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// captures steps frames, stops apart around the current integration time
+static int capture(const char *dev, unsigned steps, double stops)
+{
+  struct prucam_control controls[] = {
+    { PRUCAM_CID_COARSE_TIME, 0 },
+    { PRUCAM_CID_ANALOG_GAIN, 0 },
+    { PRUCAM_CID_GLOBAL_GAIN, 0 },
+  };
+  struct prucam_controls arg = {
+    .count = 3,
+    .ptr = (uintptr_t)controls,
+  };
+  struct prucam_bracket bracket;
+  uint8_t *img = NULL;
+  int fd, ret = -1;
+
+  if ((fd = open(dev, O_RDWR)) < 0) {
+    perror(dev);
+    return -1;
+  }
+
+  if (ioctl(fd, PRUCAM_IOC_G_CONTROLS, &arg) < 0) {
+    perror("PRUCAM_IOC_G_CONTROLS");
+    goto out;
+  }
+
+  memset(&bracket, 0, sizeof(bracket));
+  bracket.count = steps;
+  for (unsigned i = 0; i < steps; i++) {
+    double coarse = controls[0].value * exp2(stops * (i - (steps - 1) / 2.0));
+
+    coarse = coarse < 1 ? 1 : coarse > 0xFFFF ? 0xFFFF : round(coarse);
+    bracket.steps[i].coarse_time = coarse;
+    bracket.steps[i].analog_gain = controls[1].value;
+    bracket.steps[i].global_gain = controls[2].value;
+    exposures[i] = coarse;
+  }
+
+  if (!(img = malloc((size_t)steps * PIXELS))) {
+    perror("malloc");
+    goto out;
+  }
+  bracket.ptr = (uintptr_t)img;
+  if (ioctl(fd, PRUCAM_IOC_BRACKET, &bracket) < 0) {
+    perror("PRUCAM_IOC_BRACKET");
+    goto out;
+  }
+
+  for (unsigned i = 0; i < steps; i++) {
+    frames[i] = img + (size_t)i * PIXELS;
+    fprintf(stderr, "frame %u: sequence %u coarse_time %u\n", i,
+            bracket.info[i].sequence, bracket.steps[i].coarse_time);
+  }
+  nframes = steps;
+  img = NULL;  // frames[0]
+  ret = 0;
+
+out:
+  free(img);
+  close(fd);
+  return ret;
+}
+
+// opens a FILE:EXPOSURE raw frame
+static int open_raw(const char *arg)
+{
+  const char *colon = strrchr(arg, ':');
+  char *end, path[256];
+
+  if (nframes == HDR_MERGE_MAX_FRAMES) {
+    fprintf(stderr, "at most %d frames\n", HDR_MERGE_MAX_FRAMES);
+    return -1;
+  }
+  if (!colon || colon - arg >= (int)sizeof(path)) {
+    fprintf(stderr, "%s: not FILE:EXPOSURE\n", arg);
+    return -1;
+  }
+  exposures[nframes] = strtod(colon + 1, &end);
+  if (*end || !(exposures[nframes] > 0)) {
+    fprintf(stderr, "%s: bad exposure\n", arg);
+    return -1;
+  }
+
+  memcpy(path, arg, colon - arg);
+  path[colon - arg] = '\0';
+  if (!(frames[nframes] = malloc(PRUCAM_COLS))) {
+    perror("malloc");
+    return -1;
+  }
+  if (!(files[nframes] = fopen(path, "rb"))) {
+    perror(path);
+    free(frames[nframes]);
+    return -1;
+  }
+  nframes++;
+  return 0;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-d device] [-n steps] [-s stops] [-l level] [-w] [-S] "
+          "[-o file] [FILE:EXPOSURE ...]\n"
+          "  -d  device to capture a bracket from (default: /dev/prucam)\n"
+          "  -n  frames in the bracket, 1 to %d (default: 3)\n"
+          "  -s  stops between the frames of the bracket (default: 1)\n"
+          "  -l  saturation level, pixels at or over it are left out "
+          "(default: %d)\n"
+          "  -w  write 16-bit linear instead of 8-bit tone mapped\n"
+          "  -S  merge with plain C instead of NEON\n"
+          "  -o  PGM file to write (default: hdr.pgm)\n"
+          "  FILE:EXPOSURE  merge %dx%d 8-bit raw frames instead\n",
+          prog, PRUCAM_BRACKET_MAX, HDR_MERGE_SATURATION, PRUCAM_COLS,
+          PRUCAM_ROWS);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *dev = "/dev/prucam", *path = "hdr.pgm";
+  unsigned steps = 3, level = 0;
+  double stops = 1;
+  int wide = 0, plain = 0, opt, ret = 1;
+  struct hdr_merge *m = NULL;
+  uint16_t *row16 = NULL;
+  uint8_t *row8 = NULL;
+  uint64_t merge_ns = 0;
+  FILE *out = NULL;
+
+  while ((opt = getopt(argc, argv, "d:n:s:l:wSo:h")) != -1) {
+    switch (opt) {
+    case 'd':
+      dev = optarg;
+      break;
+    case 'n':
+      steps = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      stops = strtod(optarg, NULL);
+      break;
+    case 'l':
+      level = strtoul(optarg, NULL, 0);
+      break;
+    case 'w':
+      wide = 1;
+      break;
+    case 'S':
+      plain = 1;
+      break;
+    case 'o':
+      path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (steps < 1 || steps > PRUCAM_BRACKET_MAX || level > 255) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (optind < argc) {
+    for (; optind < argc; optind++)
+      if (open_raw(argv[optind]) < 0)
+        goto out;
+  } else if (capture(dev, steps, stops) < 0) {
+    goto out;
+  }
+
+  if (!(m = hdr_merge_create(nframes, exposures, PRUCAM_COLS, level))) {
+    perror("hdr_merge_create");
+    goto out;
+  }
+  if (plain)
+    hdr_merge_use_neon(m, 0);
+
+  row16 = malloc(PRUCAM_COLS * sizeof(*row16));
+  row8 = malloc(PRUCAM_COLS * 2);
+  if (!row16 || !row8) {
+    perror("malloc");
+    goto out;
+  }
+  if (!(out = fopen(path, "wb"))) {
+    perror(path);
+    goto out;
+  }
+  fprintf(out, "P5\n%d %d\n%d\n", PRUCAM_COLS, PRUCAM_ROWS,
+          wide ? 65535 : 255);
+
+  for (unsigned r = 0; r < PRUCAM_ROWS; r++) {
+    const uint8_t *rows[HDR_MERGE_MAX_FRAMES];
+
+    for (unsigned i = 0; i < nframes; i++) {
+      if (files[i]) {
+        if (fread(frames[i], PRUCAM_COLS, 1, files[i]) != 1) {
+          fprintf(stderr, "frame %u: short file\n", i);
+          goto out;
+        }
+        rows[i] = frames[i];
+      } else {
+        rows[i] = frames[i] + (size_t)r * PRUCAM_COLS;
+      }
+    }
+
+    uint64_t start = now_ns();
+
+    if (wide)
+      hdr_merge_rows(m, rows, PRUCAM_COLS, 1, row16);
+    else
+      hdr_merge_rows8(m, rows, PRUCAM_COLS, 1, row8);
+    merge_ns += now_ns() - start;
+
+    // PGM samples over 8 bits are big endian
+    if (wide)
+      for (unsigned x = 0; x < PRUCAM_COLS; x++) {
+        row8[2 * x] = row16[x] >> 8;
+        row8[2 * x + 1] = row16[x];
+      }
+    if (fwrite(row8, wide ? 2 : 1, PRUCAM_COLS, out) != PRUCAM_COLS) {
+      perror(path);
+      goto out;
+    }
+  }
+
+  fprintf(stderr, "merged %u frames in %.1f ms (%.1f Mpixel/s, %s)\n",
+          nframes, merge_ns / 1e6, (double)PIXELS * 1e3 / merge_ns,
+          hdr_merge_use_neon(m, !plain) ? "neon" : "c");
+  ret = 0;
+
+out:
+  if (out && fclose(out) && !ret) {
+    perror(path);
+    ret = 1;
+  }
+  free(row8);
+  free(row16);
+  hdr_merge_destroy(m);
+  for (unsigned i = 0; i < nframes; i++) {
+    if (files[i]) {
+      fclose(files[i]);
+      free(frames[i]);
+    }
+  }
+  if (nframes && !files[0])
+    free(frames[0]);
+  return ret;
+}
@@ -0,0 +1,216 @@
+/*
+ * hdr_merge: fuses frames of the same scene taken with different exposures,
+ * see hdr_merge.h.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#include "hdr_merge.h"
+
+// entries of the tone curve, indexed by the top 12 bits of a merged pixel
+#define LUT_BITS 12
+#define LUT_SIZE (1 << LUT_BITS)
+
+struct hdr_merge {
+  unsigned frames;
+  unsigned cols;
+  // saturation level of each frame, 0 for the one that keeps every pixel
+  uint8_t sat[HDR_MERGE_MAX_FRAMES];
+  // radiance of a pixel level of each frame, 65535 / 255 for the shortest
+  float scale[HDR_MERGE_MAX_FRAMES];
+  int neon;
+  uint16_t *row;  // a merged row, for hdr_merge_rows8()
+  uint8_t lut[LUT_SIZE];
+};
+
+// how much a pixel level is trusted: most in the middle, least at black and
+// at full scale
+static inline unsigned weight(unsigned v, unsigned sat)
+{
+  if (sat && v >= sat)
+    return 0;
+  return v < 128 ? v + 1 : 256 - v;
+}
+
+// merges the pixels of a row from x on
+static void merge_row_c(const struct hdr_merge *m, const uint8_t *const *rows,
+                        size_t offset, unsigned x, uint16_t *out)
+{
+  for (; x < m->cols; x++) {
+    float num = 0, den = 0;
+
+    for (unsigned i = 0; i < m->frames; i++) {
+      unsigned v = rows[i][offset + x];
+      unsigned w = weight(v, m->sat[i]);
+
+      num += (float)(w * v) * m->scale[i];
+      den += w;
+    }
+
+    float q = num / den + 0.5f;
+    out[x] = q > 65535 ? 65535 : q;
+  }
+}
+
+#ifdef __ARM_NEON
+static inline float32x4_t div_f32(float32x4_t num, float32x4_t den)
+{
+#ifdef __aarch64__
+  return vdivq_f32(num, den);
+#else
+  // ARMv7 NEON has no divide, refine the reciprocal estimate twice
+  float32x4_t r = vrecpeq_f32(den);
+
+  r = vmulq_f32(vrecpsq_f32(den, r), r);
+  r = vmulq_f32(vrecpsq_f32(den, r), r);
+  return vmulq_f32(num, r);
+#endif
+}
+
+// merges a row 8 pixels at a time as merge_row_c() does, and the pixels left
+// over with merge_row_c()
+static void merge_row_neon(const struct hdr_merge *m,
+                           const uint8_t *const *rows, size_t offset,
+                           uint16_t *out)
+{
+  const uint16x8_t one = vdupq_n_u16(1);
+  const uint16x8_t full = vdupq_n_u16(256);
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  unsigned x;
+
+  for (x = 0; x + 8 <= m->cols; x += 8) {
+    float32x4_t num_lo = vdupq_n_f32(0), num_hi = vdupq_n_f32(0);
+    float32x4_t den_lo = vdupq_n_f32(0), den_hi = vdupq_n_f32(0);
+
+    for (unsigned i = 0; i < m->frames; i++) {
+      uint8x8_t v8 = vld1_u8(rows[i] + offset + x);
+      uint16x8_t v = vmovl_u8(v8);
+      uint16x8_t w = vminq_u16(vaddq_u16(v, one), vsubq_u16(full, v));
+
+      if (m->sat[i])
+        w = vandq_u16(w, vmovl_u8(vclt_u8(v8, vdup_n_u8(m->sat[i]))));
+
+      // at most 128 * 255, it fits
+      uint16x8_t wv = vmulq_u16(w, v);
+
+      num_lo = vmlaq_n_f32(num_lo, vcvtq_f32_u32(vmovl_u16(vget_low_u16(wv))),
+                           m->scale[i]);
+      num_hi = vmlaq_n_f32(num_hi, vcvtq_f32_u32(vmovl_u16(vget_high_u16(wv))),
+                           m->scale[i]);
+      den_lo = vaddq_f32(den_lo, vcvtq_f32_u32(vmovl_u16(vget_low_u16(w))));
+      den_hi = vaddq_f32(den_hi, vcvtq_f32_u32(vmovl_u16(vget_high_u16(w))));
+    }
+
+    uint32x4_t q_lo = vcvtq_u32_f32(vaddq_f32(div_f32(num_lo, den_lo), half));
+    uint32x4_t q_hi = vcvtq_u32_f32(vaddq_f32(div_f32(num_hi, den_hi), half));
+
+    vst1q_u16(out + x, vcombine_u16(vqmovn_u32(q_lo), vqmovn_u32(q_hi)));
+  }
+
+  merge_row_c(m, rows, offset, x, out);
+}
+#endif
+
+static void merge_row(const struct hdr_merge *m, const uint8_t *const *rows,
+                      size_t offset, uint16_t *out)
+{
+#ifdef __ARM_NEON
+  if (m->neon) {
+    merge_row_neon(m, rows, offset, out);
+    return;
+  }
+#endif
+  merge_row_c(m, rows, offset, 0, out);
+}
+
+struct hdr_merge *hdr_merge_create(unsigned frames, const double *exposures,
+                                   unsigned cols, unsigned saturation)
+{
+  struct hdr_merge *m;
+  unsigned shortest = 0, longest = 0;
+
+  if (frames < 1 || frames > HDR_MERGE_MAX_FRAMES || !cols ||
+      saturation > 255) {
+    errno = EINVAL;
+    return NULL;
+  }
+  for (unsigned i = 0; i < frames; i++) {
+    if (!(exposures[i] > 0) || isinf(exposures[i])) {
+      errno = EINVAL;
+      return NULL;
+    }
+    if (exposures[i] < exposures[shortest])
+      shortest = i;
+    if (exposures[i] > exposures[longest])
+      longest = i;
+  }
+
+  if (!(m = calloc(1, sizeof(*m))))
+    return NULL;
+  if (!(m->row = malloc(cols * sizeof(*m->row)))) {
+    free(m);
+    return NULL;
+  }
+
+  m->frames = frames;
+  m->cols = cols;
+  for (unsigned i = 0; i < frames; i++) {
+    m->sat[i] = i == shortest ? 0 : saturation ? saturation
+                                               : HDR_MERGE_SATURATION;
+    m->scale[i] = 65535.0 / 255 * exposures[shortest] / exposures[i];
+  }
+#ifdef __ARM_NEON
+  m->neon = 1;
+#endif
+
+  // a log curve that puts full scale of the longest exposure at log(2) of
+  // the way up, so the shadows it brings out keep most of the levels
+  double k = LUT_SIZE * exposures[shortest] / exposures[longest];
+  double top = log1p((LUT_SIZE - 1) / k);
+
+  for (unsigned i = 0; i < LUT_SIZE; i++)
+    m->lut[i] = lround(255 * log1p(i / k) / top);
+
+  return m;
+}
+
+void hdr_merge_destroy(struct hdr_merge *m)
+{
+  if (!m)
+    return;
+  free(m->row);
+  free(m);
+}
+
+int hdr_merge_use_neon(struct hdr_merge *m, int enable)
+{
+#ifdef __ARM_NEON
+  m->neon = !!enable;
+#endif
+  return m->neon;
+}
+
+void hdr_merge_rows(struct hdr_merge *m, const uint8_t *const *rows,
+                    size_t stride, unsigned count, uint16_t *out)
+{
+  for (unsigned r = 0; r < count; r++)
+    merge_row(m, rows, r * stride, out + (size_t)r * m->cols);
+}
+
+void hdr_merge_rows8(struct hdr_merge *m, const uint8_t *const *rows,
+                     size_t stride, unsigned count, uint8_t *out)
+{
+  for (unsigned r = 0; r < count; r++) {
+    uint8_t *o = out + (size_t)r * m->cols;
+
+    merge_row(m, rows, r * stride, m->row);
+    for (unsigned x = 0; x < m->cols; x++)
+      o[x] = m->lut[m->row[x] >> (16 - LUT_BITS)];
+  }
+}
@@ -0,0 +1,77 @@
+/*
+ * hdr_merge: fuses frames of the same scene taken with different exposures,
+ * like the ones of a PRUCAM_IOC_BRACKET, into one high dynamic range frame.
+ *
+ * The frames are 8-bit raw Bayer. Each pixel is merged on its own, so the
+ * Bayer pattern is kept and the result can be demosaiced as any other frame.
+ * A pixel of each frame is scaled by the frame's exposure to the radiance
+ * the shortest exposure would have seen, and the radiances are averaged,
+ * weighted by how far the pixel is from black and from saturation. Pixels at
+ * or over the saturation level are left out, except in the shortest exposure,
+ * so every pixel has at least one frame.
+ *
+ * The result is either 16-bit linear, where 65535 is the saturation of the
+ * shortest exposure, or 8-bit through a log tone curve fitted to the range
+ * of the exposures.
+ *
+ * Frames are merged a row at a time, so they can be fed as they come and only
+ * a row of each needs to be at hand. The merge uses NEON when built for it.
+ * ARMv7 NEON has no divide, so there a pixel can be 1 of 65535 off the plain
+ * C merge.
+ */
+
+#ifndef HDR_MERGE_H
+#define HDR_MERGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** most frames in a merge, as PRUCAM_BRACKET_MAX */
+#define HDR_MERGE_MAX_FRAMES 8
+
+/** default saturation level, a pixel at or over it is left out */
+#define HDR_MERGE_SATURATION 250
+
+struct hdr_merge;
+
+/**
+ * Sets up a merge.
+ * @param frames number of frames, 1 to HDR_MERGE_MAX_FRAMES
+ * @param exposures exposure of each frame, in any unit, only the ratios count
+ * @param cols pixels in a row
+ * @param saturation pixel level to leave out, 1 to 255, or 0 for the default
+ * @return the merge, or NULL with errno set
+ */
+struct hdr_merge *hdr_merge_create(unsigned frames, const double *exposures,
+                                   unsigned cols, unsigned saturation);
+
+/** Frees a merge */
+void hdr_merge_destroy(struct hdr_merge *m);
+
+/**
+ * Picks the NEON or the plain C merge, to compare them.
+ * @return 1 if the NEON merge is used, it is only when built with NEON
+ */
+int hdr_merge_use_neon(struct hdr_merge *m, int enable);
+
+/**
+ * Merges rows into 16-bit linear rows.
+ * @param rows first row of each frame, in the order of the exposures
+ * @param stride bytes from a row of a frame to the next
+ * @param count number of rows
+ * @param out count rows of cols pixels
+ */
+void hdr_merge_rows(struct hdr_merge *m, const uint8_t *const *rows,
+                    size_t stride, unsigned count, uint16_t *out);
+
+/**
+ * Merges rows into 8-bit tone mapped rows.
+ * @param rows first row of each frame, in the order of the exposures
+ * @param stride bytes from a row of a frame to the next
+ * @param count number of rows
+ * @param out count rows of cols pixels
+ */
+void hdr_merge_rows8(struct hdr_merge *m, const uint8_t *const *rows,
+                     size_t stride, unsigned count, uint8_t *out);
+
+#endif /* HDR_MERGE_H */
@@ -0,0 +1,546 @@
+#!/usr/bin/python3
+"""
+Runs the PRU0 capture loop and the PRU1 transfer loop of the prucam firmware
+on the instruction level simulator in prusim.py against a scripted sensor
+waveform, then reports the cycle budget of every pixel sample and any pixel
+that was missed or read twice.
+
+Usage: see README.md or ./capture_harness.py --help
+"""
+
+import argparse
+import json
+import os
+import random
+import sys
+from bisect import bisect_right
+
+import prusim
+from prusim import CYCLE_PS, DDR_BASE, SHARED_RAM
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PRU_DIR = os.path.join(HERE, '..', '..', 'src', 'pru_code')
+KMOD_DIR = os.path.join(HERE, '..', '..', 'src', 'kernel_module')
+
+CHUNK_SIZE = 32
+EMBEDDED_TOP_ROWS = 2
+EMBEDDED_BOTTOM_ROWS = 2
+
+# where PRU1 counts the frame histogram and its layout, see pru_fw.h and
+# struct prucam_frame_hist
+_syms = prusim.Symbols(prusim.load_c_defines(
+    os.path.join(PRU_DIR, 'pru_fw.h'), [KMOD_DIR]))
+HIST_ADDR = _syms.eval('HIST_ADDR')
+HIST_BINS = _syms.eval('PRUCAM_HIST_BINS')
+HIST_BINS_OFFSET = _syms.eval('PRUCAM_HIST_BINS_OFFSET')
+# the pixels of a chunk PRU1 counts
+HIST_PIXELS = (0, 1, 16, 17)
+
+# R31 bits of the sensor signals, see pru_fw.h
+HSYNC_BIT = 14
+VSYNC_BIT = 15
+CLK_BIT = 16
+
+
+def pixel(line, col):
+    """Test pattern, a pixel shifted by one column or line never matches."""
+    return (line * 31 + col * 7 + 1) & 0xFF
+
+
+class Sensor:
+    """
+    Sensor parallel port waveform. Time is in picoseconds. The frame starts
+    with vblank lines of VSYNC low, then every line is hblank pixel clocks of
+    HSYNC low followed by cols clocks of HSYNC high. The data and sync signals
+    change on the falling edge of PCLK and are latched into R31 on the rising
+    edge, as the parallel capture mode does. HSYNC rises with the first pixel
+    unless lv_lead moves it that many clocks earlier. A short line is
+    short_width pixels, half a line by default, and the next line starts the
+    usual blanking after it.
+    """
+
+    def __init__(self, pclk_hz, rows, cols, hblank, vblank, phase_ps=0,
+                 jitter_ps=0, duty=0.5, seed=1, faults=None, lv_lead=0,
+                 short_width=None):
+        self.period = 1e12 / pclk_hz
+        self.rows = rows
+        self.cols = cols
+        self.lines = EMBEDDED_TOP_ROWS + rows + EMBEDDED_BOTTOM_ROWS
+        self.hblank = hblank
+        self.vblank = vblank
+        self.line_len = hblank + cols
+        self.high = self.period * duty
+        self.faults = faults or {}
+        self.lv_lead = lv_lead
+        self.short_width = short_width or cols // 2
+        # pixel clocks the lines after a short line start early by
+        self.cut = cols - self.short_width if 'short_line' in self.faults \
+            else 0
+
+        # a couple of blank lines after the frame for the end of frame path
+        self.nedges = (vblank + self.lines + 2) * self.line_len
+        rnd = random.Random(seed)
+        self.edges = [int(phase_ps + k * self.period +
+                          (rnd.uniform(-jitter_ps, jitter_ps)
+                           if jitter_ps else 0))
+                      for k in range(self.nedges)]
+        self.end_ps = self.edges[-1]
+
+    def first_edge(self, line):
+        """Edge of the first pixel of a sensor line."""
+        k = (self.vblank + line) * self.line_len + self.hblank
+        return k - self.cut if line > self.faults.get('short_line', line) \
+            else k
+
+    def state(self, k):
+        """(vsync, hsync, data, (line, col) or None) latched at edge k."""
+        pos = k - self.vblank * self.line_len
+        if pos < 0:
+            return 0, 0, 0, None
+        short = self.faults.get('short_line')
+        if short is not None and \
+                pos >= (short + 1) * self.line_len - self.cut:
+            pos += self.cut
+        line, x = divmod(pos, self.line_len)
+        early = self.faults.get('early_vsync')
+        if line >= self.lines or (early is not None and line >= early):
+            # VSYNC stays high for the blanking after the last line
+            vs = 1 if line == self.lines and x < self.hblank and \
+                early is None else 0
+            return vs, 0, 0, None
+        col = x - self.hblank
+        width = self.cols
+        if self.faults.get('short_line') == line:
+            width = self.short_width
+        if self.faults.get('long_line') == line:
+            width = self.cols + CHUNK_SIZE // 2
+        if col < 0:
+            if col >= -self.lv_lead:
+                return 1, 1, 0, None
+            # the tail of a long previous line runs into the blanking
+            prev = line - 1
+            if prev >= 0 and self.faults.get('long_line') == prev and \
+                    col + self.line_len < self.cols + CHUNK_SIZE // 2:
+                return 1, 1, 0, None
+            return 1, 0, 0, None
+        if col >= width:
+            return 1, 0, 0, None
+        return 1, 1, pixel(line, col), (line, col)
+
+    def r31(self, ps):
+        """R31 bits 0-16 of PRU0 at time ps."""
+        k = bisect_right(self.edges, ps) - 1
+        if k < 0:
+            return 0
+        vs, hs, data, _ = self.state(k)
+        clk = 1 if ps < self.edges[k] + self.high else 0
+        return data | hs << HSYNC_BIT | vs << VSYNC_BIT | clk << CLK_BIT
+
+    def hsync_rise(self, line):
+        """Edge HSYNC of a sensor line rises on."""
+        return self.first_edge(line) - self.lv_lead
+
+    def edge_at(self, ps):
+        return bisect_right(self.edges, ps) - 1
+
+
+def build(speed):
+    msgs = []
+    pru0 = prusim.assemble(os.path.join(PRU_DIR, 'pru0_asm.s'),
+                           {'SPEED': str(speed)}, [KMOD_DIR], msgs)
+    pru1 = prusim.assemble(os.path.join(PRU_DIR, 'pru1_asm.s'),
+                           {'SPEED': str(speed)}, [KMOD_DIR], msgs)
+    return pru0, pru1
+
+
+def run(args, pclk_hz, progs=None):
+    pru0_prog, pru1_prog = progs or build(args.speed)
+    faults = {k: getattr(args, k) for k in ('short_line', 'long_line',
+                                            'early_vsync')
+              if getattr(args, k) is not None}
+    sensor = Sensor(pclk_hz, args.rows, args.cols, args.hblank, args.vblank,
+                    args.phase, args.jitter, args.duty, args.seed, faults,
+                    args.lv_lead, args.short_width)
+    delay = args.input_delay
+
+    image_size = args.rows * args.cols
+    mem = prusim.Memory(ddr_size=image_size + 4 * args.cols)
+    pruss = prusim.Pruss(mem)
+    pruss.r31_input = lambda ps: sensor.r31(ps - delay)
+
+    # what the kernel and pru1_fw.c set up before image_transfer()
+    mem.write32(SHARED_RAM + 0xD0, args.rows | args.cols << 16)
+    mem.write32(SHARED_RAM + 0xD4, 1 if args.embedded else 0)
+    pruss.raise_event(1, 16)
+
+    samples = []  # (cycle, line index in capture order)
+    line_starts = []  # cycle PRU0 got to LINE_RESTART
+    xouts, xins = [], []
+    restart0 = pru0_prog.labels['LINE_RESTART']
+
+    def trace0(core, ins, cycle):
+        if ins.addr == restart0:
+            line_starts.append(cycle)
+        elif ins.op == 'mov' and isinstance(ins.args[1], prusim.Reg) and \
+                ins.args[1].num == 31:
+            samples.append((cycle, len(line_starts) - 1))
+        elif ins.op == 'xout':
+            xouts.append(cycle)
+
+    def trace1(core, ins, cycle):
+        if ins.op == 'xin':
+            xins.append(cycle)
+
+    pru0 = prusim.Core(0, pruss, pru0_prog, trace0)
+    pru1 = prusim.Core(1, pruss, pru1_prog, trace1)
+    pruss.cores = [pru0, pru1]
+
+    image = DDR_BASE
+    top = bottom = 0
+    if args.embedded:
+        top = image + image_size
+        bottom = top + EMBEDDED_TOP_ROWS * args.cols
+    # pru1_fw.c starts the PRU1 cycle counter, PRU0 starts its own
+    pru1.ctr_en = True
+    pru0.call('capture_frame_8b')
+    pru1.call('image_transfer', (image, args.rows, args.cols, top, bottom))
+
+    max_cycles = sensor.end_ps // CYCLE_PS + 100000
+    done = pruss.run(max_cycles)
+
+    return analyse(args, sensor, pruss, pru0, pru1, samples, line_starts,
+                   xouts, xins, done, pclk_hz)
+
+
+def analyse(args, sensor, pruss, pru0, pru1, samples, line_starts, xouts,
+            xins, done, pclk_hz):
+    mem = pruss.mem
+    delay = args.input_delay
+    first = 0 if args.embedded else EMBEDDED_TOP_ROWS
+    nlines = sensor.lines if args.embedded else args.rows
+    faults = sensor.faults
+
+    # sensor lines the frame errors are expected to cover
+    faulty = set()
+    for key in ('short_line', 'long_line'):
+        if key in faults:
+            faulty.add(faults[key])
+    if 'early_vsync' in faults:
+        faulty.update(range(faults['early_vsync'], sensor.lines))
+
+    # padding out a short line can outlast the blanking, the lines that start
+    # before PRU0 is back at LINE_RESTART are lost and padded out as the next
+    # rows. The rest of the frame has to keep its rows.
+    lost = []
+    short = faults.get('short_line')
+    if short is not None and first <= short < first + nlines:
+        si = short - first
+        end = line_starts[si + 1] * CYCLE_PS if si + 1 < len(line_starts) \
+            else None
+        for line in range(short + 1, first + nlines):
+            if end is not None and \
+                    sensor.edges[sensor.hsync_rise(line)] + delay >= end:
+                break
+            lost.append(line)
+        faulty.update(lost)
+    # sensor line of each line PRU0 captured, in order
+    captured = [line for line in range(first, first + nlines)
+                if line not in lost]
+
+    res = {
+        'speed': args.speed,
+        'pclk_hz': pclk_hz,
+        'rows': args.rows,
+        'cols': args.cols,
+        'embedded': bool(args.embedded),
+        'done': done,
+        'errors': [],
+        'samples': len(samples),
+        'missed': 0,
+        'duplicated': 0,
+    }
+
+    if not done:
+        for core in (pru0, pru1):
+            if not core.halted:
+                res['errors'].append(
+                    'PRU{} stuck at {} ({})'.format(
+                        core.num, core.prog.label_at(core.pc),
+                        core.prog.instrs[core.pc].line))
+    for cycle, msg in pruss.errors:
+        res['errors'].append('cycle {}: {}'.format(cycle, msg))
+
+    # per sample budget: a sample of pixel k must come after its rising edge
+    # latched (early margin) and before the next one replaced it (late slack)
+    per_line = {}
+    for cycle, li in samples:
+        per_line.setdefault(li, []).append(cycle)
+    slots = [[None, None] for _ in range(CHUNK_SIZE)]
+    line_slack = None
+    bad_samples = []
+    for li, line in enumerate(captured[:len(line_starts)]):
+        if line in faulty:
+            continue
+        k0 = sensor.first_edge(line)
+        t0 = sensor.edges[k0] + delay
+        start = line_starts[li] * CYCLE_PS
+        slack = (t0 - start) / CYCLE_PS
+        line_slack = slack if line_slack is None else min(line_slack, slack)
+        # the capture loop reads the first 2 pixels of the next chunk before
+        # it checks for the end of the line, those 2 are thrown away
+        for i, cycle in enumerate(per_line.get(li, [])[:sensor.cols]):
+            ps = cycle * CYCLE_PS
+            k = k0 + i
+            got = sensor.edge_at(ps - delay)
+            early = (ps - (sensor.edges[k] + delay)) / CYCLE_PS
+            late = (sensor.edges[k + 1] + delay - ps) / CYCLE_PS
+            slot = slots[i % CHUNK_SIZE]
+            slot[0] = late if slot[0] is None else min(slot[0], late)
+            slot[1] = early if slot[1] is None else min(slot[1], early)
+            if got > k:
+                res['missed'] += got - k
+                bad_samples.append((line, i, 'late', got - k))
+            elif got < k:
+                res['duplicated'] += 1
+                bad_samples.append((line, i, 'early', k - got))
+        n = len(per_line.get(li, []))
+        if n != sensor.cols + 2:
+            res['errors'].append('line {} has {} samples instead of {}'
+                                 .format(line, n, sensor.cols + 2))
+
+    res['slots'] = [{'slot': i, 'late_slack': s[0], 'early_margin': s[1]}
+                    for i, s in enumerate(slots)]
+    res['line_start_slack'] = line_slack
+    res['bad_samples'] = bad_samples[:20]
+
+    # the other PRU has to take every chunk before the next xout replaces it
+    handoff = [(xouts[n + 1] - xins[n]) for n in range(min(len(xins),
+                                                           len(xouts) - 1))]
+    latency = [(xins[n] - xouts[n]) for n in range(min(len(xins),
+                                                       len(xouts)))]
+    res['chunks'] = len(xouts)
+    res['chunk_handoff_slack'] = min(handoff) if handoff else None
+    res['chunk_latency_max'] = max(latency) if latency else None
+    res['pru1_cycles_max'] = mem.read32(SHARED_RAM + 0x104 + 0x10)
+    res['pru0_line_cycles_max'] = mem.read32(SHARED_RAM + 0xF0 + 0x10)
+
+    # end to end: the image the other PRU wrote to DDR
+    frame_errors = mem.read32(SHARED_RAM + 0xE8)
+    bad_lines = mem.read32(SHARED_RAM + 0xEC)
+    res['frame_errors'] = frame_errors
+    res['bad_lines'] = bad_lines & 0xFFFF
+    res['first_bad_line'] = bad_lines >> 16
+    res['lost_lines'] = len(lost)
+    if short is not None and (res['bad_lines'] != len(lost) + 1 or
+                              res['first_bad_line'] != short - first):
+        res['errors'].append('bad lines {} from {}, expected {} from {}'
+                             .format(res['bad_lines'], res['first_bad_line'],
+                                     len(lost) + 1, short - first))
+    wrong = 0
+    cols = args.cols
+    for line in range(first, first + nlines):
+        if line in faulty and line not in lost:
+            continue
+        if not args.embedded or \
+                EMBEDDED_TOP_ROWS <= line < EMBEDDED_TOP_ROWS + args.rows:
+            off = (line - EMBEDDED_TOP_ROWS) * cols
+        elif line < EMBEDDED_TOP_ROWS:
+            off = args.rows * cols + line * cols
+        else:
+            off = args.rows * cols + \
+                (line - args.rows) * cols
+        got = mem.ddr[off:off + cols]
+        # lost lines are padded with zeros
+        want = bytes(0 if line in lost else pixel(line, c)
+                     for c in range(cols))
+        wrong += sum(1 for a, b in zip(got, want) if a != b)
+    res['image_bytes_wrong'] = wrong
+
+    # the histogram PRU1 counted of the image, padded lines have no known
+    # pixels. There is none at SPEED=3.
+    if not faulty:
+        want = [0] * HIST_BINS
+        saturated = black = 0
+        lines = range(EMBEDDED_TOP_ROWS, EMBEDDED_TOP_ROWS + args.rows) \
+            if args.speed < 3 else ()
+        for line in lines:
+            for c in range(0, cols, CHUNK_SIZE):
+                for i in HIST_PIXELS:
+                    v = pixel(line, c + i)
+                    want[v >> 2] += 1
+                    saturated += v == 0xFF
+                    black += v == 0
+        words = [int.from_bytes(pru1.dram[a:a + 4], 'little') for a in
+                 range(HIST_ADDR, HIST_ADDR + HIST_BINS_OFFSET +
+                       4 * HIST_BINS, 4)]
+        if words != [saturated, black] + want:
+            res['errors'].append('histogram does not match the image')
+
+    want_errors = 0
+    if 'short_line' in faults:
+        want_errors |= 1 << 0
+    if 'long_line' in faults:
+        want_errors |= 1 << 1
+    if 'early_vsync' in faults:
+        want_errors |= 1 << 2
+    if frame_errors != want_errors:
+        res['errors'].append('frame errors 0x{:x}, expected 0x{:x}'
+                             .format(frame_errors, want_errors))
+
+    res['pass'] = (done and not res['errors'] and not res['missed'] and
+                   not res['duplicated'] and not wrong)
+    # known: SPEED=1 sees HSYNC on the edge that latches the first pixel and
+    # then waits for the next one, so every sample is a pixel late and the
+    # image and histogram are off by one, see README.md. Anything else is a
+    # real failure.
+    res['xfail'] = (not res['pass'] and args.speed == 1 and
+                    args.lv_lead == 0 and done and bool(bad_samples) and
+                    all(kind == 'late' and n == 1
+                        for _, _, kind, n in bad_samples) and
+                    all(e == 'histogram does not match the image'
+                        for e in res['errors']))
+    return res
+
+
+def verdict(res):
+    return 'PASS' if res['pass'] else 'XFAIL' if res.get('xfail') else 'FAIL'
+
+
+def fmt(val, spec='{:6.2f}'):
+    return '     -' if val is None else spec.format(val)
+
+
+def report(res, verbose):
+    print('SPEED={} PCLK {:.3f}MHz ({:.2f} PRU cycles), {}x{}{}'.format(
+        res['speed'], res['pclk_hz'] / 1e6, 2e8 / res['pclk_hz'],
+        res['rows'], res['cols'], ', embedded rows' if res['embedded'] else
+        ''))
+    print('  samples {}, missed {}, duplicated {}, image bytes wrong {}'
+          .format(res['samples'], res['missed'], res['duplicated'],
+                  res['image_bytes_wrong']))
+    print('  frame errors 0x{:x}, bad lines {} (first {}), lost lines {}'
+          .format(res['frame_errors'], res['bad_lines'],
+                  res['first_bad_line'], res['lost_lines']))
+    print('  line start slack {} cycles, chunk handoff slack {} cycles, '
+          'event latency max {} cycles'.format(
+              fmt(res['line_start_slack']).strip(),
+              res['chunk_handoff_slack'], res['chunk_latency_max']))
+    print('  status high-water marks: PRU0 line {} cycles, PRU1 chunk {} '
+          'cycles'.format(res['pru0_line_cycles_max'],
+                          res['pru1_cycles_max']))
+    if verbose:
+        print('  per sample budget by chunk slot, min over the frame in '
+              'PRU cycles:')
+        print('    slot  late slack  early margin')
+        for s in res['slots']:
+            print('    {:4d}      {}        {}'.format(
+                s['slot'], fmt(s['late_slack']), fmt(s['early_margin'])))
+    for line, i, kind, n in res['bad_samples']:
+        print('  line {} pixel {}: read {} by {} pixel(s)'.format(
+            line, i, kind, n))
+    for e in res['errors']:
+        print('  error: ' + e)
+    if res['xfail']:
+        print('  SPEED=1 misses the first pixel of each line with --lv-lead '
+              '0, a known failure')
+    print('  ' + verdict(res))
+
+
+def parse_sweep(s):
+    lo, hi, step = (float(x) * 1e6 for x in s.split(':'))
+    out = []
+    f = lo
+    while f <= hi + 1e-3:
+        out.append(f)
+        f += step
+    return out
+
+
+def main():
+    p = argparse.ArgumentParser(
+        description='Run the prucam PRU capture code against a simulated '
+                    'sensor and check every pixel sample.')
+    p.add_argument('--speed', type=int, default=1, choices=(1, 2, 3),
+                   help='SPEED the firmware is built with (default 1)')
+    p.add_argument('--pclk', type=float, default=48.0,
+                   help='pixel clock in MHz (default 48)')
+    p.add_argument('--sweep', metavar='LO:HI:STEP',
+                   help='run at every pixel clock from LO to HI MHz')
+    p.add_argument('--rows', type=int, default=8)
+    p.add_argument('--cols', type=int, default=128)
+    p.add_argument('--hblank', type=int, default=208,
+                   help='horizontal blanking in pixel clocks (default 208)')
+    p.add_argument('--vblank', type=int, default=1,
+                   help='vertical blanking in lines (default 1)')
+    p.add_argument('--embedded', action='store_true',
+                   help='capture the embedded rows too')
+    p.add_argument('--phase', type=float, default=0,
+                   help='time of the first PCLK rising edge in ps')
+    p.add_argument('--jitter', type=float, default=0,
+                   help='max PCLK edge jitter in ps, uniform')
+    p.add_argument('--duty', type=float, default=0.5,
+                   help='PCLK high time as a fraction of the period')
+    p.add_argument('--input-delay', type=float, default=0,
+                   help='delay from a PCLK edge to R31 in ps')
+    p.add_argument('--lv-lead', type=int, default=0,
+                   help='pixel clocks HSYNC rises before the first pixel '
+                        '(default 0, the AR013x aligns them)')
+    p.add_argument('--seed', type=int, default=1)
+    p.add_argument('--short-line', type=int, metavar='LINE',
+                   help='cut sensor line LINE short')
+    p.add_argument('--short-width', type=int, metavar='PIXELS',
+                   help='pixels of the short line (default half a line)')
+    p.add_argument('--long-line', type=int, metavar='LINE',
+                   help='make sensor line LINE too long')
+    p.add_argument('--early-vsync', type=int, metavar='LINE',
+                   help='end the frame before sensor line LINE')
+    p.add_argument('--mem-cost', action='append', default=[],
+                   metavar='REGION=READ,WRITE',
+                   help='override a memory cost, e.g. ddr=60,4')
+    p.add_argument('--json', action='store_true', help='print JSON results')
+    p.add_argument('-v', '--verbose', action='store_true',
+                   help='print the per sample budget of every chunk slot')
+    args = p.parse_args()
+
+    if args.cols % CHUNK_SIZE:
+        p.error('--cols must be a multiple of {}'.format(CHUNK_SIZE))
+    for mc in args.mem_cost:
+        region, costs = mc.split('=')
+        prusim.MEM_COST[region] = tuple(int(c) for c in costs.split(','))
+
+    progs = build(args.speed)
+    freqs = parse_sweep(args.sweep) if args.sweep else [args.pclk * 1e6]
+    results = []
+    for f in freqs:
+        try:
+            res = run(args, f, progs)
+        except prusim.SimError as e:
+            res = {'pclk_hz': f, 'pass': False, 'errors': [str(e)]}
+        results.append(res)
+        if args.json:
+            continue
+        if args.sweep:
+            if 'samples' not in res:
+                print('{:8.3f}MHz  FAIL  {}'.format(f / 1e6, res['errors'][0]))
+                continue
+            late = min((s['late_slack'] for s in res['slots']
+                        if s['late_slack'] is not None), default=None)
+            early = min((s['early_margin'] for s in res['slots']
+                         if s['early_margin'] is not None), default=None)
+            print('{:8.3f}MHz  {}  missed {:4d} dup {:4d}  late slack {} '
+                  'early margin {}'.format(
+                      f / 1e6, verdict(res),
+                      res['missed'], res['duplicated'], fmt(late),
+                      fmt(early)))
+        else:
+            report(res, args.verbose)
+
+    if args.json:
+        json.dump(results if args.sweep else results[0], sys.stdout,
+                  indent=2)
+        print()
+    return 0 if all(r['pass'] or r.get('xfail') for r in results) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
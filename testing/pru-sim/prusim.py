@@ -0,0 +1,698 @@
+#!/usr/bin/python3
+"""
+Instruction level simulator for the subset of the PRU instruction set and the
+clpru assembler used by the prucam firmware.
+
+The assembler front end handles the directives the firmware uses (.cdecls for
+the #defines of the C file, .if/.elseif/.else/.endif, .macro/.endm with
+label? labels, .mmsg and .emsg) and the simulator runs the two PRUs of a PRUSS in lock step, one
+instruction per 5ns cycle. Memory accesses take extra cycles from MEM_COST,
+which holds estimates rather than datasheet numbers, see README.md.
+
+Only what the capture code needs is modelled: the register file with byte and
+word fields, the scratchpad banks, the INTC events routed to R31 bits 30 and
+31, the control register cycle counter and flat memories for the data RAMs
+and DDR. Each PRU sees its own data RAM at 0. Anything else raises SimError so a firmware change that needs more
+of the PRU shows up here instead of silently running wrong.
+"""
+
+import os
+import re
+
+# length of a PRU cycle at 200MHz
+CYCLE_PS = 5000
+
+# the PRU's own data RAM, at 0 for both
+DATA_RAM_SIZE = 0x2000
+SHARED_RAM = 0x00010000
+SHARED_RAM_SIZE = 0x3000
+INTC_BASE = 0x00020000
+PRU_CTRL_BASE = (0x00022000, 0x00024000)
+DDR_BASE = 0x80000000
+
+# constant table entries used with sbco/lbco
+CONST_TABLE = {
+    'C0': INTC_BASE,
+    'C4': 0x00026000,
+    'C28': SHARED_RAM,
+}
+
+# INTC system event -> R31 bit of both PRUs (host interrupts 0 and 1)
+EVENT_R31_BIT = {16: 30, 17: 31}
+
+# (read, write) cycles of an lbbo/sbbo of up to 4 bytes for each region, every
+# further 4 bytes adds a cycle. DDR writes are posted, DDR reads are not.
+MEM_COST = {
+    'dram': (3, 2),
+    'shared': (3, 2),
+    'ctrl': (3, 2),
+    'intc': (3, 2),
+    'ddr': (40, 2),
+}
+
+
+class AsmError(Exception):
+    pass
+
+
+class SimError(Exception):
+    pass
+
+
+# --------------------------------------------------------------------------
+# assembler front end
+# --------------------------------------------------------------------------
+
+def c_to_py(expr):
+    """Convert a C or clpru constant expression to python."""
+    expr = re.sub(r'/\*.*?\*/', '', expr)
+    expr = re.sub(r'//.*', '', expr)
+    expr = re.sub(r'\b(0[xX][0-9a-fA-F]+|\d+)[uUlL]+\b', r'\1', expr)
+    return expr.strip()
+
+
+def load_c_defines(path, include_dirs, defines=None, seen=None):
+    """
+    Collect the object-like #defines of a C file and the local headers it
+    includes. System headers (<...>) are skipped, as are function-like macros.
+    """
+    if defines is None:
+        defines = {}
+    if seen is None:
+        seen = set()
+    path = os.path.realpath(path)
+    if path in seen:
+        return defines
+    seen.add(path)
+
+    with open(path) as f:
+        text = f.read()
+    # join continued lines
+    text = text.replace('\\\n', ' ')
+
+    for line in text.splitlines():
+        m = re.match(r'\s*#\s*include\s+"([^"]+)"', line)
+        if m:
+            for d in [os.path.dirname(path)] + include_dirs:
+                inc = os.path.join(d, m.group(1))
+                if os.path.exists(inc):
+                    load_c_defines(inc, include_dirs, defines, seen)
+                    break
+            else:
+                raise AsmError('{}: cannot find include "{}"'
+                               .format(path, m.group(1)))
+            continue
+        m = re.match(r'\s*#\s*define\s+(\w+)(\s+(.*))?$', line)
+        if m and not line.split(m.group(1), 1)[1].startswith('('):
+            defines[m.group(1)] = c_to_py(m.group(3) or '')
+    return defines
+
+
+class Symbols:
+    """#defines and assembler symbols, evaluated on use."""
+
+    def __init__(self, defines):
+        self.defines = dict(defines)
+
+    def defined(self, name):
+        return name in self.defines
+
+    def eval(self, expr, depth=0):
+        if depth > 32:
+            raise AsmError('recursive symbol in "{}"'.format(expr))
+        expr = c_to_py(expr)
+
+        def sub(m):
+            name = m.group(0)
+            if name in self.defines:
+                val = self.defines[name]
+                if re.match(r'^C\d+$', val):
+                    return repr(val)
+                return '(' + str(self.eval(val, depth + 1)) + ')'
+            raise AsmError('undefined symbol "{}"'.format(name))
+
+        py = re.sub(r'\b[A-Za-z_]\w*\b', sub, expr)
+        try:
+            return eval(py, {'__builtins__': {}})
+        except Exception as e:
+            raise AsmError('bad expression "{}": {}'.format(expr, e))
+
+
+class Reg:
+    """A register operand: rN, rN.wK or rN.bK, optionally as &rN (a byte
+    address in the register file for the block transfer instructions)."""
+
+    __slots__ = ('num', 'shift', 'mask', 'addr', 'byte')
+
+    def __init__(self, num, kind, idx, addr):
+        self.num = num
+        self.addr = addr
+        if kind == 'b':
+            self.shift, self.mask = idx * 8, 0xFF
+        elif kind == 'w':
+            self.shift, self.mask = idx * 8, 0xFFFF
+        else:
+            self.shift, self.mask = 0, 0xFFFFFFFF
+        self.byte = num * 4 + self.shift // 8
+
+    def __repr__(self):
+        return '{}r{}<<{}'.format('&' if self.addr else '', self.num,
+                                  self.shift)
+
+
+class Instr:
+    __slots__ = ('op', 'args', 'line', 'text', 'addr')
+
+    def __init__(self, op, args, line, text):
+        self.op = op
+        self.args = args
+        self.line = line
+        self.text = text
+        self.addr = 0
+
+
+class Program:
+    def __init__(self):
+        self.instrs = []
+        self.labels = {}
+
+    def label_at(self, addr):
+        """The last label at or before addr, for reports."""
+        best = None
+        for name, a in self.labels.items():
+            if a <= addr and (best is None or a > self.labels[best]):
+                best = name
+        return best
+
+
+REG_RE = re.compile(r'^(&)?r(\d+)(?:\.(w|b)([0-3]))?$')
+
+
+def split_args(s):
+    args, depth, cur = [], 0, ''
+    for ch in s:
+        if ch == ',' and depth == 0:
+            args.append(cur.strip())
+            cur = ''
+            continue
+        depth += ch == '('
+        depth -= ch == ')'
+        cur += ch
+    if cur.strip():
+        args.append(cur.strip())
+    return args
+
+
+def strip_comment(line):
+    out, quoted = '', False
+    for ch in line:
+        if ch == '"':
+            quoted = not quoted
+        if ch == ';' and not quoted:
+            break
+        out += ch
+    if out.startswith('*'):
+        return ''
+    return out.rstrip()
+
+
+def if_expr(expr, syms):
+    """Evaluate a .if condition, clpru uses = for equality."""
+    expr = re.sub(r'\$defined\((\w+)\)',
+                  lambda m: '1' if syms.defined(m.group(1)) else '0', expr)
+    expr = re.sub(r'(?<![=<>!])=(?!=)', '==', expr)
+    return bool(syms.eval(expr))
+
+
+def assemble(path, defines=None, include_dirs=(), messages=None):
+    """
+    Assemble a PRU assembly file into a Program. defines are extra symbols,
+    as given to clpru with --define, e.g. {'SPEED': '1'}.
+    """
+    syms = Symbols(defines or {})
+    prog = Program()
+    macros = {}
+    # number of macro expansions, for the label? labels of each
+    expansions = [0]
+    src_dir = os.path.dirname(os.path.abspath(path))
+    include_dirs = list(include_dirs)
+    if messages is None:
+        messages = []
+
+    with open(path) as f:
+        src = [(n + 1, strip_comment(l)) for n, l in enumerate(f)]
+
+    def process(lines):
+        # stack of [this branch active, a branch was taken, parent active]
+        conds = []
+        active = True
+        i = 0
+        while i < len(lines):
+            n, line = lines[i]
+            i += 1
+            words = line.split(None, 1)
+            if not words:
+                continue
+            first = words[0]
+            rest = words[1] if len(words) > 1 else ''
+            where = '{}:{}'.format(os.path.basename(path), n)
+
+            if first == '.if':
+                take = active and if_expr(rest, syms)
+                conds.append([take, take, active])
+                active = take
+                continue
+            if first == '.elseif':
+                c = conds[-1]
+                take = c[2] and not c[1] and if_expr(rest, syms)
+                c[0] = take
+                c[1] = c[1] or take
+                active = take
+                continue
+            if first == '.else':
+                c = conds[-1]
+                c[0] = c[2] and not c[1]
+                c[1] = True
+                active = c[0]
+                continue
+            if first == '.endif':
+                c = conds.pop()
+                active = c[2]
+                continue
+            if not active:
+                continue
+
+            # macro definitions, NAME .macro [params]
+            if len(words) > 1 and rest.split(None, 1)[0] == '.macro':
+                params = [p.strip() for p in
+                          rest.split(None, 1)[1].split(',')] \
+                    if len(rest.split(None, 1)) > 1 else []
+                body = []
+                while lines[i][1].split()[:1] != ['.endm']:
+                    body.append(lines[i])
+                    i += 1
+                i += 1
+                macros[first] = (params, body)
+                continue
+
+            if first == '.cdecls':
+                cfile = os.path.join(src_dir, rest.strip().strip('"'))
+                for k, v in load_c_defines(cfile, include_dirs).items():
+                    syms.defines.setdefault(k, v)
+                continue
+            if first == '.mmsg':
+                messages.append(rest.strip().strip('"'))
+                continue
+            if first == '.emsg':
+                raise AsmError('{}: {}'.format(where, rest.strip().strip('"')))
+            if first.startswith('.'):
+                # .clink, .global, .sect and friends don't change the code
+                continue
+
+            # labels, optionally followed by an instruction
+            m = re.match(r'^\s*(\w+):\s*(.*)$', line)
+            if m:
+                if m.group(1) in prog.labels:
+                    raise AsmError('{}: duplicate label {}'
+                                   .format(where, m.group(1)))
+                prog.labels[m.group(1)] = len(prog.instrs)
+                if m.group(2):
+                    lines.insert(i, (n, m.group(2)))
+                continue
+
+            if first in macros:
+                params, body = macros[first]
+                vals = split_args(rest)
+                expanded = []
+                expansions[0] += 1
+                for bn, bl in body:
+                    for p, v in zip(params, vals):
+                        bl = re.sub(r'\b{}\b'.format(re.escape(p)), v, bl)
+                    # clpru makes a label ending in ? unique to the expansion
+                    bl = re.sub(r'\b(\w+)\?', r'\1__{}'.format(expansions[0]),
+                                bl)
+                    expanded.append((bn, bl))
+                process(expanded)
+                continue
+
+            prog.instrs.append(Instr(first.lower(), split_args(rest), where,
+                                     line.strip()))
+
+        if conds:
+            raise AsmError('{}: unterminated .if'.format(path))
+
+    process(src)
+
+    for addr, ins in enumerate(prog.instrs):
+        ins.addr = addr
+        ins.args = [decode_arg(ins, a, prog, syms) for a in ins.args]
+    return prog
+
+
+def decode_arg(ins, arg, prog, syms):
+    m = REG_RE.match(arg)
+    if m:
+        return Reg(int(m.group(2)), m.group(3), int(m.group(4) or 0),
+                   bool(m.group(1)))
+    if arg in prog.labels:
+        return ('label', prog.labels[arg])
+    if re.match(r'^C\d+$', arg):
+        return ('const', arg)
+    try:
+        val = syms.eval(arg)
+    except AsmError as e:
+        raise AsmError('{}: {}'.format(ins.line, e))
+    if isinstance(val, str):
+        return ('const', val)
+    return val
+
+
+# --------------------------------------------------------------------------
+# simulator
+# --------------------------------------------------------------------------
+
+class Memory:
+    """The PRUSS local address space seen by both PRUs plus DDR."""
+
+    def __init__(self, ddr_size=0x100000):
+        self.shared = bytearray(SHARED_RAM_SIZE)
+        self.ddr = bytearray(ddr_size)
+        self.writes = []  # (cycle, pru, addr, length) of DDR writes
+
+    def region(self, addr, length):
+        if SHARED_RAM <= addr and addr + length <= SHARED_RAM + SHARED_RAM_SIZE:
+            return 'shared'
+        if DDR_BASE <= addr and addr + length <= DDR_BASE + len(self.ddr):
+            return 'ddr'
+        for base in PRU_CTRL_BASE:
+            if base <= addr < base + 0x100:
+                return 'ctrl'
+        if INTC_BASE <= addr < INTC_BASE + 0x2000:
+            return 'intc'
+        raise SimError('access to unmodelled address 0x{:08x}'.format(addr))
+
+    def read32(self, addr):
+        return int.from_bytes(self.read(addr, 4), 'little')
+
+    def write32(self, addr, val):
+        self.write(addr, (val & 0xFFFFFFFF).to_bytes(4, 'little'))
+
+    def read(self, addr, length):
+        if self.region(addr, length) == 'shared':
+            off = addr - SHARED_RAM
+            return bytes(self.shared[off:off + length])
+        off = addr - DDR_BASE
+        return bytes(self.ddr[off:off + length])
+
+    def write(self, addr, data):
+        if self.region(addr, len(data)) == 'shared':
+            off = addr - SHARED_RAM
+            self.shared[off:off + len(data)] = data
+        else:
+            off = addr - DDR_BASE
+            self.ddr[off:off + len(data)] = data
+
+
+class Pruss:
+    """State shared by the two PRUs: memory, INTC and scratchpad."""
+
+    def __init__(self, memory):
+        self.mem = memory
+        self.cycle = 0
+        self.pending = set()
+        self.event_log = []  # (cycle, pru, event)
+        self.errors = []  # (cycle, message)
+        # bank -> [data, cycle written, consumed]
+        self.scratch = {}
+        self.cores = []
+        self.r31_input = None  # callable(ps) -> bits 0-29 of PRU0 R31
+
+    def raise_event(self, pru, event):
+        if event in self.pending and event in EVENT_R31_BIT:
+            self.errors.append((self.cycle,
+                                'PRU{} raised event {} while it was still '
+                                'pending, the receiver missed one'
+                                .format(pru, event)))
+        self.pending.add(event)
+        self.event_log.append((self.cycle, pru, event))
+
+    def clear_event(self, event):
+        self.pending.discard(event)
+
+    def run(self, max_cycles):
+        cores = self.cores
+        while self.cycle < max_cycles:
+            running = False
+            for core in cores:
+                if core.halted:
+                    continue
+                running = True
+                if core.busy_until <= self.cycle:
+                    core.step(self.cycle)
+            if not running:
+                return True
+            self.cycle += 1
+        return False
+
+
+class Core:
+    RETURN_ADDR = 0xFFFF
+
+    def __init__(self, num, pruss, prog, trace=None):
+        self.num = num
+        self.pruss = pruss
+        self.prog = prog
+        self.regs = [0] * 32
+        self.pc = 0
+        self.halted = True
+        self.busy_until = 0
+        self.trace = trace
+        self.ctr_en = False
+        self.ctr_val = 0
+        self.ctr_since = 0
+        self.counts = [0] * len(prog.instrs)
+        self.dram = bytearray(DATA_RAM_SIZE)
+
+    def call(self, label, args=(), cycle=0):
+        """Start the core at label as if called from C with args in r14.."""
+        for i, a in enumerate(args):
+            self.regs[14 + i] = a & 0xFFFFFFFF
+        self.write(Reg(3, 'w', 2, False), self.RETURN_ADDR)
+        self.pc = self.prog.labels[label]
+        self.halted = False
+        self.busy_until = cycle
+
+    # register file -------------------------------------------------------
+
+    def r31(self, cycle):
+        val = 0
+        if self.num == 0 and self.pruss.r31_input:
+            val = self.pruss.r31_input(cycle * CYCLE_PS) & 0x3FFFFFFF
+        for ev, bit in EVENT_R31_BIT.items():
+            if ev in self.pruss.pending:
+                val |= 1 << bit
+        return val
+
+    def read(self, op, cycle):
+        if isinstance(op, int):
+            return op
+        if not isinstance(op, Reg):
+            raise SimError('expected a register or immediate, got {}'
+                           .format(op))
+        val = self.r31(cycle) if op.num == 31 else self.regs[op.num]
+        return (val >> op.shift) & op.mask
+
+    def write(self, op, val):
+        if op.num == 31:
+            # writes to R31 generate system events 16-31
+            if op.shift == 0 and val & (1 << 5):
+                self.pruss.raise_event(self.num, 16 + (val & 0xF))
+            return
+        r = self.regs[op.num]
+        r &= ~(op.mask << op.shift)
+        r |= (val & op.mask) << op.shift
+        self.regs[op.num] = r & 0xFFFFFFFF
+
+    def get_bytes(self, start, length):
+        if start + length > 128:
+            raise SimError('register block past r31')
+        return b''.join(r.to_bytes(4, 'little') for r in self.regs)[
+            start:start + length]
+
+    def set_bytes(self, start, data):
+        if start + len(data) > 128:
+            raise SimError('register block past r31')
+        raw = bytearray(b''.join(r.to_bytes(4, 'little') for r in self.regs))
+        raw[start:start + len(data)] = data
+        for i in range(32):
+            self.regs[i] = int.from_bytes(raw[i * 4:i * 4 + 4], 'little')
+
+    # memory --------------------------------------------------------------
+
+    def cycle_count(self, cycle):
+        if not self.ctr_en:
+            return self.ctr_val
+        return min(self.ctr_val + cycle - self.ctr_since, 0xFFFFFFFF)
+
+    def mem_cost(self, region, length, write):
+        base = MEM_COST[region][1 if write else 0]
+        return base + (length - 1) // 4
+
+    def load(self, addr, length, cycle):
+        if addr + length <= DATA_RAM_SIZE:
+            return (bytes(self.dram[addr:addr + length]),
+                    self.mem_cost('dram', length, False))
+        region = self.pruss.mem.region(addr, length)
+        if region == 'ctrl':
+            if addr != PRU_CTRL_BASE[self.num] + 0xC and \
+                    addr != PRU_CTRL_BASE[self.num]:
+                raise SimError('read of unmodelled control register 0x{:x}'
+                               .format(addr))
+            if addr == PRU_CTRL_BASE[self.num]:
+                val = (1 << 3) if self.ctr_en else 0
+            else:
+                val = self.cycle_count(cycle)
+            data = val.to_bytes(4, 'little')[:length]
+        elif region == 'intc':
+            raise SimError('INTC reads are not modelled')
+        else:
+            data = self.pruss.mem.read(addr, length)
+        return data, self.mem_cost(region, length, False)
+
+    def store(self, addr, data, cycle):
+        if addr + len(data) <= DATA_RAM_SIZE:
+            self.dram[addr:addr + len(data)] = data
+            return self.mem_cost('dram', len(data), True)
+        region = self.pruss.mem.region(addr, len(data))
+        if region == 'ctrl':
+            val = int.from_bytes(data, 'little')
+            if addr == PRU_CTRL_BASE[self.num]:
+                en = bool(val & (1 << 3))
+                if en != self.ctr_en:
+                    self.ctr_val = self.cycle_count(cycle)
+                    self.ctr_since = cycle
+                    self.ctr_en = en
+            elif addr == PRU_CTRL_BASE[self.num] + 0xC:
+                if self.ctr_en:
+                    raise SimError('cycle counter written while enabled')
+                self.ctr_val = val
+            else:
+                raise SimError('write of unmodelled control register 0x{:x}'
+                               .format(addr))
+        elif region == 'intc':
+            if addr - INTC_BASE != 0x24:
+                raise SimError('write of unmodelled INTC register 0x{:x}'
+                               .format(addr))
+            self.pruss.clear_event(int.from_bytes(data, 'little'))
+        else:
+            self.pruss.mem.write(addr, data)
+            if region == 'ddr':
+                self.pruss.mem.writes.append((cycle, self.num, addr,
+                                              len(data)))
+        return self.mem_cost(region, len(data), True)
+
+    # execution -----------------------------------------------------------
+
+    def step(self, cycle):
+        if self.pc == self.RETURN_ADDR:
+            self.halted = True
+            return
+        if not 0 <= self.pc < len(self.prog.instrs):
+            raise SimError('PRU{} ran off the program at {}'
+                           .format(self.num, self.pc))
+        ins = self.prog.instrs[self.pc]
+        a = ins.args
+        op = ins.op
+        nxt = self.pc + 1
+        cost = 1
+
+        if self.trace:
+            self.trace(self, ins, cycle)
+
+        if op == 'nop':
+            pass
+        elif op == 'ldi':
+            self.write(a[0], self.read(a[1], cycle))
+        elif op == 'ldi32':
+            self.write(a[0], self.read(a[1], cycle))
+            cost = 2
+        elif op == 'mov':
+            self.write(a[0], self.read(a[1], cycle))
+        elif op in ('add', 'sub', 'lsr', 'lsl', 'and', 'or', 'xor'):
+            x = self.read(a[1], cycle)
+            y = self.read(a[2], cycle)
+            val = {'add': lambda: x + y, 'sub': lambda: x - y,
+                   'lsr': lambda: x >> (y & 31), 'lsl': lambda: x << (y & 31),
+                   'and': lambda: x & y, 'or': lambda: x | y,
+                   'xor': lambda: x ^ y}[op]()
+            self.write(a[0], val & 0xFFFFFFFF)
+        elif op in ('set', 'clr'):
+            x = self.read(a[1], cycle)
+            bit = self.read(a[2], cycle) & 31
+            self.write(a[0], x | (1 << bit) if op == 'set' else
+                       x & ~(1 << bit))
+        elif op == 'zero':
+            self.set_bytes(a[0].byte, bytes(self.read(a[1], cycle)))
+        elif op in ('wbs', 'wbc'):
+            bit = (self.read(a[0], cycle) >> (self.read(a[1], cycle) & 31)) & 1
+            if bit != (op == 'wbs'):
+                nxt = self.pc
+        elif op in ('qbbs', 'qbbc'):
+            bit = (self.read(a[1], cycle) >> (self.read(a[2], cycle) & 31)) & 1
+            if bit == (op == 'qbbs'):
+                nxt = a[0][1]
+        elif op in ('qbeq', 'qbne', 'qblt', 'qble', 'qbgt', 'qbge'):
+            # qbXX label, a, b branches if b XX a
+            x = self.read(a[1], cycle)
+            y = self.read(a[2], cycle)
+            take = {'qbeq': y == x, 'qbne': y != x, 'qblt': y < x,
+                    'qble': y <= x, 'qbgt': y > x, 'qbge': y >= x}[op]
+            if take:
+                nxt = a[0][1]
+        elif op == 'qba':
+            nxt = a[0][1]
+        elif op == 'jmp':
+            nxt = a[0][1] if isinstance(a[0], tuple) else self.read(a[0], cycle)
+        elif op == 'jal':
+            self.write(a[0], self.pc + 1)
+            nxt = a[1][1] if isinstance(a[1], tuple) else self.read(a[1], cycle)
+        elif op in ('lbbo', 'sbbo', 'lbco', 'sbco'):
+            if op.endswith('co'):
+                base = CONST_TABLE[a[1][1]]
+            else:
+                base = self.read(a[1], cycle)
+            addr = (base + self.read(a[2], cycle)) & 0xFFFFFFFF
+            length = self.read(a[3], cycle)
+            if op[0] == 'l':
+                data, cost = self.load(addr, length, cycle)
+                self.set_bytes(a[0].byte, data)
+            else:
+                cost = self.store(addr, self.get_bytes(a[0].byte, length),
+                                  cycle)
+        elif op in ('xout', 'xin'):
+            bank = self.read(a[0], cycle)
+            length = self.read(a[2], cycle)
+            if op == 'xout':
+                old = self.pruss.scratch.get(bank)
+                if old is not None and not old[2]:
+                    self.pruss.errors.append(
+                        (cycle, 'PRU{} overwrote scratchpad bank {} before it '
+                         'was read'.format(self.num, bank)))
+                self.pruss.scratch[bank] = [
+                    self.get_bytes(a[1].byte, length), cycle, False]
+            else:
+                ent = self.pruss.scratch.get(bank)
+                if ent is None:
+                    raise SimError('xin of empty scratchpad bank {}'
+                                   .format(bank))
+                self.set_bytes(a[1].byte, ent[0][:length])
+                ent[2] = True
+        elif op == 'halt':
+            self.halted = True
+        else:
+            raise SimError('{}: instruction "{}" is not modelled'
+                           .format(ins.line, op))
+
+        self.counts[ins.addr] += 1
+        self.pc = nxt
+        self.busy_until = cycle + cost
@@ -0,0 +1,476 @@
+/*
+ * prucam-bench: capture throughput and latency benchmark for /dev/prucam.
+ *
+ * Captures N frames in each of the driver's capture modes and reports the
+ * frame rate, the latency percentiles of a capture, the CPU time per frame and
+ * the bandwidth of getting a frame out of the driver. The results are printed
+ * as text, or as one JSON object per mode so runs on different kernels,
+ * firmware and driver versions can be collected and compared.
+ *
+ * Modes:
+ * - read: read() a frame, the driver copies it out of its frame buffer
+ * - mmap: PRUCAM_IOC_CAPTURE a frame and copy it out of the mapped buffer
+ * - stream: PRUCAM_IOC_STREAMON, then PRUCAM_IOC_CAPTURE the next frame of the
+ *   stream and copy it out of the mapped buffer
+ * - bracket: PRUCAM_IOC_BRACKET a bracket of half, the current and twice the
+ *   current integration time, the driver copies the frames out
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "prucam_uapi.h"
+
+#define BENCH_VERSION "1"
+
+#define PIXELS (PRUCAM_ROWS * PRUCAM_COLS)
+
+#define DEBUGFS_DIR "/sys/kernel/debug/prucam"
+
+enum mode { MODE_READ, MODE_MMAP, MODE_STREAM, MODE_BRACKET, MODE_COUNT };
+
+static const char *mode_names[MODE_COUNT] = { "read", "mmap", "stream",
+                                              "bracket" };
+
+#define BRACKET_STEPS 3
+
+struct result {
+  enum mode mode;
+  unsigned frames;    // frames captured
+  unsigned torn;      // frames dropped by the driver as torn (EIO)
+  unsigned timeouts;  // captures that timed out (ETIMEDOUT)
+  unsigned errors;    // any other failed capture
+  unsigned skipped;   // frames of the stream never taken
+  double wall_s;      // time for all the captures
+  uint64_t *lat_ns;   // latency of every capture
+  double user_s;      // CPU time of the process
+  double sys_s;
+  double copy_ns;     // time copying the frames out of the driver, <0 unknown
+  unsigned bracket_frames; // sensor frames from the first to the last step
+};
+
+static const char *device = "/dev/prucam";
+static unsigned nframes = 100;
+static unsigned warmup = 5;
+static int json;
+static const char *tag = "";
+static struct prucam_bracket bracket;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double tv_s(struct timeval tv)
+{
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+// nearest rank percentile of a sorted array
+static uint64_t percentile(const uint64_t *v, unsigned n, double p)
+{
+  unsigned rank;
+
+  if (n == 0)
+    return 0;
+  rank = (unsigned)(p / 100.0 * n + 0.999999);
+  if (rank < 1)
+    rank = 1;
+  if (rank > n)
+    rank = n;
+  return v[rank - 1];
+}
+
+// read the first line of a file into buf, stripped of its newline
+static int read_line(const char *path, char *buf, size_t len)
+{
+  FILE *f = fopen(path, "r");
+
+  if (!f)
+    return -1;
+  if (!fgets(buf, len, f)) {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  buf[strcspn(buf, "\n")] = '\0';
+  return 0;
+}
+
+// value of a "key: value" line of a debugfs file, -1 when unavailable
+static long debugfs_value(const char *file, const char *key)
+{
+  char path[128], line[128];
+  size_t klen = strlen(key);
+  long val = -1;
+  FILE *f;
+
+  snprintf(path, sizeof(path), DEBUGFS_DIR "/%s", file);
+  f = fopen(path, "r");
+  if (!f)
+    return -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, key, klen) == 0 && line[klen] == ':') {
+      val = strtol(line + klen + 1, NULL, 0);
+      break;
+    }
+  }
+  fclose(f);
+  return val;
+}
+
+// writing a latency histogram resets it
+static void debugfs_reset(const char *file)
+{
+  char path[128];
+  FILE *f;
+
+  snprintf(path, sizeof(path), DEBUGFS_DIR "/%s", file);
+  f = fopen(path, "w");
+  if (!f)
+    return;
+  fputs("0\n", f);
+  fclose(f);
+}
+
+// sets up a bracket around the current integration time
+static int bracket_init(int fd)
+{
+  struct prucam_control controls[] = {
+    { PRUCAM_CID_COARSE_TIME, 0 },
+    { PRUCAM_CID_ANALOG_GAIN, 0 },
+    { PRUCAM_CID_GLOBAL_GAIN, 0 },
+  };
+  struct prucam_controls arg = {
+    .count = 3,
+    .ptr = (uintptr_t)controls,
+  };
+
+  if (ioctl(fd, PRUCAM_IOC_G_CONTROLS, &arg) < 0)
+    return -errno;
+
+  memset(&bracket, 0, sizeof(bracket));
+  bracket.count = BRACKET_STEPS;
+  for (int i = 0; i < BRACKET_STEPS; i++) {
+    int32_t coarse = controls[0].value * (1 << i) / 2;
+
+    bracket.steps[i].coarse_time = coarse < 1 ? 1 : coarse > 0xFFFF ? 0xFFFF
+                                                                     : coarse;
+    bracket.steps[i].analog_gain = controls[1].value;
+    bracket.steps[i].global_gain = controls[2].value;
+  }
+  return 0;
+}
+
+// one capture in a mode, returns 0 or a negative errno value
+static int capture(int fd, enum mode mode, uint8_t *img, const uint8_t *map,
+                   struct result *r)
+{
+  struct prucam_buffer buf;
+  uint64_t start;
+
+  if (mode == MODE_READ) {
+    if (read(fd, img, PIXELS) < 0)
+      return -errno;
+    return 0;
+  }
+
+  if (mode == MODE_BRACKET) {
+    bracket.ptr = (uintptr_t)img;
+    if (ioctl(fd, PRUCAM_IOC_BRACKET, &bracket) < 0)
+      return -errno;
+    r->bracket_frames += bracket.info[BRACKET_STEPS - 1].sequence -
+                         bracket.info[0].sequence + 1;
+    return 0;
+  }
+
+  if (ioctl(fd, PRUCAM_IOC_CAPTURE, &buf) < 0)
+    return -errno;
+  if (buf.index >= PRUCAM_NUM_BUFFERS)
+    return -ERANGE;
+  r->skipped += buf.skipped;
+
+  // the frame buffers are uncached, copy the frame out like a user would
+  start = now_ns();
+  memcpy(img, map + (size_t)buf.index * PRUCAM_BUFFER_SIZE, PIXELS);
+  r->copy_ns += now_ns() - start;
+  return 0;
+}
+
+static int run(enum mode mode, struct result *r)
+{
+  size_t map_len = (size_t)PRUCAM_NUM_BUFFERS * PRUCAM_BUFFER_SIZE;
+  struct rusage ru0, ru1;
+  uint8_t *map = NULL;
+  uint64_t t0, start;
+  uint8_t *img;
+  int fd, ret = 0;
+
+  memset(r, 0, sizeof(*r));
+  r->mode = mode;
+  r->lat_ns = calloc(nframes, sizeof(*r->lat_ns));
+  img = malloc((mode == MODE_BRACKET ? BRACKET_STEPS : 1) * PIXELS);
+  if (!r->lat_ns || !img) {
+    fprintf(stderr, "out of memory\n");
+    return -ENOMEM;
+  }
+
+  fd = open(device, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ret = -errno;
+    fprintf(stderr, "%s: %s\n", device, strerror(errno));
+    goto out;
+  }
+
+  if (mode == MODE_BRACKET && (ret = bracket_init(fd)) < 0) {
+    fprintf(stderr, "PRUCAM_IOC_G_CONTROLS: %s\n", strerror(-ret));
+    goto out;
+  }
+
+  if (mode == MODE_MMAP || mode == MODE_STREAM) {
+    map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      ret = -errno;
+      map = NULL;
+      fprintf(stderr, "mmap: %s\n", strerror(errno));
+      goto out;
+    }
+  }
+
+  if (mode == MODE_STREAM && ioctl(fd, PRUCAM_IOC_STREAMON) < 0) {
+    ret = -errno;
+    fprintf(stderr, "PRUCAM_IOC_STREAMON: %s\n", strerror(errno));
+    goto out;
+  }
+
+  // the first frames include the sensor and stream start up
+  for (unsigned i = 0; i < warmup; i++)
+    capture(fd, mode, img, map, r);
+
+  r->skipped = 0;
+  r->copy_ns = 0;
+  r->bracket_frames = 0;
+  debugfs_reset("latency/copy");
+
+  getrusage(RUSAGE_SELF, &ru0);
+  t0 = now_ns();
+  for (unsigned i = 0; i < nframes; i++) {
+    start = now_ns();
+    ret = capture(fd, mode, img, map, r);
+    r->lat_ns[r->frames] = now_ns() - start;
+    if (ret == 0)
+      r->frames++;
+    else if (ret == -EIO)
+      r->torn++;
+    else if (ret == -ETIMEDOUT)
+      r->timeouts++;
+    else
+      r->errors++;
+  }
+  r->wall_s = (now_ns() - t0) / 1e9;
+  getrusage(RUSAGE_SELF, &ru1);
+  ret = 0;
+
+  r->user_s = tv_s(ru1.ru_utime) - tv_s(ru0.ru_utime);
+  r->sys_s = tv_s(ru1.ru_stime) - tv_s(ru0.ru_stime);
+
+  // the driver copies for read, its copy histogram has the time it took. It
+  // doesn't time the copies of a bracket.
+  if (mode == MODE_BRACKET) {
+    r->copy_ns = -1;
+  } else if (mode == MODE_READ) {
+    long count = debugfs_value("latency/copy", "count");
+    long mean_us = debugfs_value("latency/copy", "mean us");
+
+    r->copy_ns = count > 0 && mean_us >= 0 ? (double)mean_us * 1000 * count
+                                           : -1;
+  }
+
+  if (mode == MODE_STREAM)
+    ioctl(fd, PRUCAM_IOC_STREAMOFF);
+
+out:
+  if (map)
+    munmap(map, map_len);
+  if (fd >= 0)
+    close(fd);
+  free(img);
+  return ret;
+}
+
+static void print_text(struct result *r)
+{
+  uint64_t *v = r->lat_ns;
+  unsigned n = r->frames;
+  double mb = (double)n * PIXELS / 1e6;
+
+  printf("%s: %u frames, %u torn, %u timeouts, %u errors, %u skipped\n",
+         mode_names[r->mode], n, r->torn, r->timeouts, r->errors, r->skipped);
+  if (n == 0)
+    return;
+  printf("  fps: %.2f (%.2f MB/s)\n", n / r->wall_s, mb / r->wall_s);
+  printf("  latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+         percentile(v, n, 50) / 1e6, percentile(v, n, 90) / 1e6,
+         percentile(v, n, 99) / 1e6, v[n - 1] / 1e6);
+  printf("  cpu per frame us: user %.1f, sys %.1f\n", r->user_s / n * 1e6,
+         r->sys_s / n * 1e6);
+  if (r->copy_ns > 0)
+    printf("  copy: %.1f us per frame, %.1f MB/s\n", r->copy_ns / n / 1e3,
+           mb / (r->copy_ns / 1e9));
+  else if (r->mode == MODE_READ)
+    printf("  copy: unknown, mount debugfs and run as root for read\n");
+  if (r->mode == MODE_BRACKET)
+    printf("  sensor frames per %d step bracket: %.2f\n", BRACKET_STEPS,
+           (double)r->bracket_frames / n);
+}
+
+static void print_json(struct result *r)
+{
+  long fw = debugfs_value("status", "fw version");
+  struct utsname uts = { { 0 } };
+  uint64_t *v = r->lat_ns;
+  unsigned n = r->frames;
+  char driver[64] = "";
+
+  uname(&uts);
+  read_line("/sys/module/prucam/version", driver, sizeof(driver));
+
+  printf("{\"bench_version\": \"%s\", \"tag\": \"%s\", \"time\": %ld, "
+         "\"host\": \"%s\", \"kernel\": \"%s\", \"driver\": \"%s\", ",
+         BENCH_VERSION, tag, (long)time(NULL), uts.nodename, uts.release,
+         driver);
+  if (fw >= 0)
+    printf("\"fw_version\": %ld, ", fw);
+  else
+    printf("\"fw_version\": null, ");
+  printf("\"mode\": \"%s\", \"frames\": %u, \"torn\": %u, \"timeouts\": %u, "
+         "\"errors\": %u, \"skipped\": %u, \"wall_s\": %.6f, ",
+         mode_names[r->mode], n, r->torn, r->timeouts, r->errors, r->skipped,
+         r->wall_s);
+  if (n) {
+    printf("\"fps\": %.3f, \"lat_p50_us\": %.1f, \"lat_p90_us\": %.1f, "
+           "\"lat_p99_us\": %.1f, \"lat_max_us\": %.1f, "
+           "\"cpu_user_us\": %.1f, \"cpu_sys_us\": %.1f, ",
+           n / r->wall_s, percentile(v, n, 50) / 1e3,
+           percentile(v, n, 90) / 1e3, percentile(v, n, 99) / 1e3,
+           v[n - 1] / 1e3, r->user_s / n * 1e6, r->sys_s / n * 1e6);
+  }
+  if (n && r->mode == MODE_BRACKET)
+    printf("\"bracket_frames\": %.3f, ", (double)r->bracket_frames / n);
+  if (n && r->copy_ns > 0)
+    printf("\"copy_us\": %.1f, \"copy_mbps\": %.1f}\n", r->copy_ns / n / 1e3,
+           (double)n * PIXELS / 1e6 / (r->copy_ns / 1e9));
+  else
+    printf("\"copy_us\": null, \"copy_mbps\": null}\n");
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-d device] [-m read|mmap|stream|bracket|all] [-n frames] "
+          "[-w warmup] [-j] [-t tag]\n"
+          "  -d  capture device (default /dev/prucam)\n"
+          "  -m  capture mode, may be repeated (default all)\n"
+          "  -n  frames to capture per mode (default 100)\n"
+          "  -w  frames to capture and ignore first (default 5)\n"
+          "  -j  print one JSON object per mode\n"
+          "  -t  tag to put in the JSON output, e.g. a git describe\n",
+          prog);
+}
+
+int main(int argc, char **argv)
+{
+  int modes[MODE_COUNT] = { 0 };
+  int any_mode = 0, failed = 0;
+  struct result r;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:m:n:w:jt:h")) != -1) {
+    switch (opt) {
+    case 'd':
+      device = optarg;
+      break;
+    case 'm':
+      any_mode = 1;
+      if (strcmp(optarg, "all") == 0) {
+        for (int i = 0; i < MODE_COUNT; i++)
+          modes[i] = 1;
+        break;
+      }
+      for (int i = 0; i < MODE_COUNT; i++) {
+        if (strcmp(optarg, mode_names[i]) == 0) {
+          modes[i] = 1;
+          break;
+        }
+        if (i == MODE_COUNT - 1) {
+          usage(argv[0]);
+          return 2;
+        }
+      }
+      break;
+    case 'n':
+      nframes = strtoul(optarg, NULL, 0);
+      break;
+    case 'w':
+      warmup = strtoul(optarg, NULL, 0);
+      break;
+    case 'j':
+      json = 1;
+      break;
+    case 't':
+      tag = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (nframes == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (!any_mode)
+    for (int i = 0; i < MODE_COUNT; i++)
+      modes[i] = 1;
+
+  for (int i = 0; i < MODE_COUNT; i++) {
+    if (!modes[i])
+      continue;
+    if (run(i, &r) < 0) {
+      failed = 1;
+      free(r.lat_ns);
+      continue;
+    }
+    qsort(r.lat_ns, r.frames, sizeof(*r.lat_ns), cmp_u64);
+    if (json)
+      print_json(&r);
+    else
+      print_text(&r);
+    if (r.frames != nframes)
+      failed = 1;
+    free(r.lat_ns);
+  }
+
+  return failed;
+}
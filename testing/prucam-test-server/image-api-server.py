@@ -2,8 +2,10 @@
 
 import os
 import io
+import fcntl
+import struct
+import ctypes
 from flask import Flask, request, Response
-from time import sleep
 from datetime import datetime
 import numpy as np
 import cv2
@@ -18,6 +20,34 @@ path="/dev/prucam"
 
 prucam_sysfs_ctx_settings = "/sys/devices/platform/prudev/context_settings/"
 prucam_sysfs_ae_settings = "/sys/devices/platform/prudev/auto_exposure_settings/"
+# all the settings above as name=value lines, read from the sensor at once,
+# and written as a batch that takes effect on one frame
+prucam_sysfs_settings = "/sys/devices/platform/prudev/settings"
+# number of the last batch written to settings
+prucam_sysfs_settings_batch = "/sys/devices/platform/prudev/settings_batch"
+
+# struct prucam_frame_info in prucam_uapi.h, and PRUCAM_IOC_G_FRAME_INFO
+frame_info_format = "=IIHHI8HI"
+frame_info_size = struct.calcsize(frame_info_format)
+PRUCAM_IOC_G_FRAME_INFO = (2 << 30) | (frame_info_size << 16) | (ord('p') << 8) | 0
+
+# frames to read at most, waiting for one with a new settings batch
+max_settings_frames = 10
+
+# struct prucam_bracket in prucam_uapi.h, and PRUCAM_IOC_BRACKET
+bracket_max = 8
+# count, reserved, ptr and the steps, the frame infos follow
+bracket_format = "=IIQ" + "4H" * bracket_max
+bracket_size = struct.calcsize(bracket_format) + frame_info_size * bracket_max
+PRUCAM_IOC_BRACKET = (3 << 30) | (bracket_size << 16) | (ord('p') << 8) | 7
+
+# frames merged for the hdr param, a step of hdr stops apart
+hdr_steps = 3
+
+# the merge of testing/hdr-merge, built with make there
+hdr_lib_path = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+        "../hdr-merge/libhdrmerge.so")
+hdr_lib = None
 
 # possible camera context settings
 ctx_settings = [
@@ -73,25 +103,86 @@ bayer_mappings = {
         }
 
 def settings_from_path_params(request, settings, path):
-    # loop through all the possible camera settings and set them if
-    # they are specified as query params
-    param_changed = False
+    # loop through all the possible camera settings and return the name=value
+    # lines of the ones specified as query params that change
+    lines = []
     for param in settings:
         # if this seting is in the query params, set it
         if param in request.args:
-            # create the sysfs path and write it
             param_path = os.path.join(path, param)
-            with open(param_path, 'r+') as f:
+            with open(param_path, 'r') as f:
                 val = f.read()
-                if not(request.args.get(param) in val):
-                    print("Changing {} from {} to {}".format(param, val.rstrip(), request.args.get(param)))
-                    f.write(request.args.get(param))
-                    param_changed = True
+            if not(request.args.get(param) in val):
+                print("Changing {} from {} to {}".format(param, val.rstrip(), request.args.get(param)))
+                lines.append("{}={}\n".format(param, request.args.get(param)))
+
+    return lines
+
+
+def apply_settings(lines):
+    # write the changed settings as one batch, and return its number for
+    # frame_settings() to wait for, or 0 when nothing changed
+    if not lines:
+        return 0
+
+    with open(prucam_sysfs_settings, 'w') as f:
+        f.write("".join(lines))
+    with open(prucam_sysfs_settings_batch, 'r') as f:
+        return int(f.read())
+
 
-    # If a param changed, sleep a moment. This seems required for the settings to
-    # take but we should come back to this because they should be more immediate
-    if param_changed:
-        sleep(0.2)
+def frame_settings(fd):
+    # the settings batch the last frame read was exposed with
+    info = fcntl.ioctl(fd, PRUCAM_IOC_G_FRAME_INFO, bytes(frame_info_size))
+    return struct.unpack(frame_info_format, info)[-1]
+
+
+def load_hdr_lib():
+    global hdr_lib
+    if hdr_lib is None:
+        hdr_lib = ctypes.CDLL(hdr_lib_path, use_errno=True)
+        hdr_lib.hdr_merge_create.restype = ctypes.c_void_p
+        hdr_lib.hdr_merge_create.argtypes = [ctypes.c_uint,
+                ctypes.POINTER(ctypes.c_double), ctypes.c_uint, ctypes.c_uint]
+        hdr_lib.hdr_merge_destroy.argtypes = [ctypes.c_void_p]
+        hdr_lib.hdr_merge_rows8.argtypes = [ctypes.c_void_p,
+                ctypes.POINTER(ctypes.c_void_p), ctypes.c_size_t,
+                ctypes.c_uint, ctypes.c_void_p]
+    return hdr_lib
+
+
+def capture_hdr(fd, stops):
+    # capture a bracket around the current integration time and merge it
+    # into one tone mapped frame
+    lib = load_hdr_lib()
+
+    with open(prucam_sysfs_settings, 'r') as f:
+        settings = dict(line.split('=', 1) for line in f.read().splitlines())
+    coarse = int(settings["coarse_time"])
+    steps = []
+    for i in range(hdr_steps):
+        time = round(coarse * 2 ** (stops * (i - (hdr_steps - 1) / 2)))
+        steps.append((min(max(time, 1), 0xFFFF), int(settings["analog_gain"]),
+                int(settings["global_gain"]), 0))
+    steps += [(0, 0, 0, 0)] * (bracket_max - hdr_steps)
+
+    frames = ctypes.create_string_buffer(hdr_steps * pixels)
+    arg = bytearray(struct.pack(bracket_format, hdr_steps, 0,
+            ctypes.addressof(frames), *[v for step in steps for v in step]))
+    arg += bytes(frame_info_size * bracket_max)
+    fcntl.ioctl(fd, PRUCAM_IOC_BRACKET, arg, True)
+
+    exposures = (ctypes.c_double * hdr_steps)(*[step[0] for step in steps[:hdr_steps]])
+    rows_ptrs = (ctypes.c_void_p * hdr_steps)(
+            *[ctypes.addressof(frames) + i * pixels for i in range(hdr_steps)])
+    img = np.empty((rows, cols), dtype=np.uint8)
+
+    merge = lib.hdr_merge_create(hdr_steps, exposures, cols, 0)
+    if not merge:
+        raise OSError(ctypes.get_errno(), "hdr_merge_create")
+    lib.hdr_merge_rows8(merge, rows_ptrs, cols, rows, img.ctypes.data)
+    lib.hdr_merge_destroy(merge)
+    return img
 
 
 def inject_stats(img,
@@ -109,18 +200,15 @@ def inject_stats(img,
         pos = (pos[0], pos[1] + text_seperation)
         return img, pos
 
-    def read_properties_from_directory(property_names, sysfs_directory):
-        retval=[]
-        for name in property_names:
-            param_path = os.path.join(sysfs_directory, name)
-            with open(param_path, 'r+') as f:
-                val = f.read().strip()
-            retval.append((name,val))
-        return retval
+    with open(prucam_sysfs_settings, 'r') as f:
+        settings = dict(line.split('=', 1) for line in f.read().splitlines())
+
+    def read_properties(property_names):
+        return [(name, settings.get(name, '?')) for name in property_names]
 
     constant_properties = [('time', time), ('img_shape', img.shape)]
-    context_properties = read_properties_from_directory(ctx_settings, prucam_sysfs_ctx_settings)
-    auto_exposure_properteis = read_properties_from_directory(ae_settings, prucam_sysfs_ae_settings)
+    context_properties = read_properties(ctx_settings)
+    auto_exposure_properteis = read_properties(ae_settings)
 
     all_properties = constant_properties +context_properties  +  auto_exposure_properteis
     previous_position = start_position
@@ -136,22 +224,32 @@ def get_image(filename):
     if "favicon" in filename:
         return Response()
 
-    # set sysfs settings from request params
-    settings_from_path_params(request, ctx_settings, prucam_sysfs_ctx_settings)
-    settings_from_path_params(request, ae_settings, prucam_sysfs_ae_settings)
+    # set sysfs settings from request params, all on the same frame
+    lines = settings_from_path_params(request, ctx_settings, prucam_sysfs_ctx_settings)
+    lines += settings_from_path_params(request, ae_settings, prucam_sysfs_ae_settings)
+    batch = apply_settings(lines)
 
     # open up the prucam char device
     fd = os.open(path, os.O_RDWR)
     fio = io.FileIO(fd, closefd = False)
 
-    # make buffer to read into
-    imgbuf = bytearray(pixels)
+    if "hdr" in request.args:
+        # a bracket of hdr stops apart, merged into one frame
+        img = capture_hdr(fd, float(request.args.get("hdr")))
+        os.close(fd)
+    else:
+        # make buffer to read into
+        imgbuf = bytearray(pixels)
 
-    # read from prucam into buffer
-    fio.readinto(imgbuf)
+        # read from prucam into buffer, until a frame has the new settings
+        for _ in range(max_settings_frames):
+            fio.readinto(imgbuf)
+            if frame_settings(fd) >= batch:
+                break
+        os.close(fd)
 
-    # convert to ndarray and reshape to cols/rows
-    img = np.frombuffer(imgbuf, dtype=np.uint8).reshape(rows, cols)
+        # convert to ndarray and reshape to cols/rows
+        img = np.frombuffer(imgbuf, dtype=np.uint8).reshape(rows, cols)
 
     # do bayer color conversion if bayer param given
     if "bayer" in request.args: